@@ -0,0 +1,197 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zephyr.h>
+#include <sys/printk.h>
+#include <sys/util.h>
+#include <sys/atomic.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/addr.h>
+#include <bluetooth/gap.h>
+
+// Scanner of the fleet benchmark. Scans continuously and syncs to every periodic advertiser it
+// sees, one sync creation at a time, as long as it has sync slots left. Events are printed as
+// the CSV read by scripts/adv_capture.py:
+//   ext   extended advertisement of a tag that has periodic advertising but no sync yet
+//   sync  sync established, with the periodic advertising interval
+//   per   periodic advertising report
+//   lost  sync lost
+// The tag column is the address and SID like adv_capture.py names tags of a btsnoop capture.
+
+#define SCANNER_CSV_HEADER              "timestamp,tag,event,interval_ms,counter,status\n"
+
+// Give up a sync creation after this many periodic intervals
+#define SCANNER_SYNC_CREATE_INTERVALS   6
+// Sync timeout in periodic intervals, in the range allowed by the spec
+#define SCANNER_SYNC_TIMEOUT_INTERVALS  10
+#define SCANNER_CREATE_RETRY_MS         1000
+
+// Periodic advertising interval unit is 1.25 ms
+#define PER_INTERVAL_TO_US(interval)    ((uint32_t)(interval) * 1250)
+
+static bool synced[CONFIG_BT_PER_ADV_SYNC_MAX];
+static atomic_t syncCreatePending;
+static bt_addr_le_t createAddr;
+static uint8_t createSid;
+static uint16_t createInterval;
+static struct bt_le_per_adv_sync *pCreateSync;
+
+static K_SEM_DEFINE(syncCreateSem, 0, 1);
+static K_SEM_DEFINE(syncDoneSem, 0, 1);
+
+static void printEvent(const bt_addr_le_t *pAddr, uint8_t sid, const char *pEvent,
+                       uint16_t interval)
+{
+    char addrStr[BT_ADDR_STR_LEN];
+    uint64_t us = k_ticks_to_us_floor64(k_uptime_ticks());
+
+    bt_addr_to_str(&pAddr->a, addrStr, sizeof(addrStr));
+    if (interval > 0) {
+        uint32_t intervalUs = PER_INTERVAL_TO_US(interval);
+
+        printk("%u.%06u,%s/%u,%s,%u.%03u,,\n", (uint32_t)(us / 1000000), (uint32_t)(us % 1000000),
+               addrStr, sid, pEvent, intervalUs / 1000, intervalUs % 1000);
+    } else {
+        printk("%u.%06u,%s/%u,%s,,,\n", (uint32_t)(us / 1000000), (uint32_t)(us % 1000000),
+               addrStr, sid, pEvent);
+    }
+}
+
+static bool isSynced(const bt_addr_le_t *pAddr, uint8_t sid)
+{
+    struct bt_le_per_adv_sync *pSync = bt_le_per_adv_sync_lookup_addr(pAddr, sid);
+
+    return pSync != NULL && synced[bt_le_per_adv_sync_get_index(pSync)];
+}
+
+static void scanRecvCb(const struct bt_le_scan_recv_info *pInfo, struct net_buf_simple *pBuf)
+{
+    if (pInfo->interval == 0 || isSynced(pInfo->addr, pInfo->sid)) {
+        return;
+    }
+
+    printEvent(pInfo->addr, pInfo->sid, "ext", 0);
+
+    // A tag with a sync being created is found by the lookup, so it is not picked again
+    if (bt_le_per_adv_sync_lookup_addr(pInfo->addr, pInfo->sid) == NULL &&
+        atomic_cas(&syncCreatePending, 0, 1)) {
+        bt_addr_le_copy(&createAddr, pInfo->addr);
+        createSid = pInfo->sid;
+        createInterval = pInfo->interval;
+        k_sem_give(&syncCreateSem);
+    }
+}
+
+static void syncedCb(struct bt_le_per_adv_sync *pSync,
+                     struct bt_le_per_adv_sync_synced_info *pInfo)
+{
+    synced[bt_le_per_adv_sync_get_index(pSync)] = true;
+    printEvent(pInfo->addr, pInfo->sid, "sync", pInfo->interval);
+    if (pSync == pCreateSync) {
+        k_sem_give(&syncDoneSem);
+    }
+}
+
+static void termCb(struct bt_le_per_adv_sync *pSync,
+                   const struct bt_le_per_adv_sync_term_info *pInfo)
+{
+    uint8_t index = bt_le_per_adv_sync_get_index(pSync);
+
+    // A cancelled sync creation also ends up here, it was never synced
+    if (synced[index]) {
+        synced[index] = false;
+        printEvent(pInfo->addr, pInfo->sid, "lost", 0);
+    }
+}
+
+static void recvCb(struct bt_le_per_adv_sync *pSync,
+                   const struct bt_le_per_adv_sync_recv_info *pInfo, struct net_buf_simple *pBuf)
+{
+    printEvent(pInfo->addr, pInfo->sid, "per", 0);
+}
+
+static struct bt_le_scan_cb scanCallbacks = {
+    .recv = scanRecvCb,
+};
+
+static struct bt_le_per_adv_sync_cb syncCallbacks = {
+    .synced = syncedCb,
+    .term = termCb,
+    .recv = recvCb,
+};
+
+static void createSync(void)
+{
+    struct bt_le_per_adv_sync_param param = {
+        .sid = createSid,
+        .options = BT_LE_PER_ADV_SYNC_OPT_NONE,
+        .skip = 0,
+    };
+    uint32_t intervalUs = PER_INTERVAL_TO_US(createInterval);
+    int err;
+
+    bt_addr_le_copy(&param.addr, &createAddr);
+    // Timeout is in 10 ms units
+    param.timeout = CLAMP(SCANNER_SYNC_TIMEOUT_INTERVALS * intervalUs / 10000,
+                          BT_GAP_PER_ADV_MIN_TIMEOUT, BT_GAP_PER_ADV_MAX_TIMEOUT);
+
+    err = bt_le_per_adv_sync_create(&param, &pCreateSync);
+    if (err) {
+        // Out of sync slots, wait a while before the next try
+        pCreateSync = NULL;
+        k_sleep(K_MSEC(SCANNER_CREATE_RETRY_MS));
+        return;
+    }
+
+    if (k_sem_take(&syncDoneSem, K_USEC(SCANNER_SYNC_CREATE_INTERVALS * intervalUs)) != 0) {
+        bt_le_per_adv_sync_delete(pCreateSync);
+    }
+    pCreateSync = NULL;
+}
+
+void main(void)
+{
+    struct bt_le_scan_param scanParam = {
+        .type = BT_LE_SCAN_TYPE_PASSIVE,
+        // Every report is needed, duplicates are not filtered
+        .options = BT_LE_SCAN_OPT_NONE,
+        .interval = BT_GAP_SCAN_FAST_INTERVAL,
+        .window = BT_GAP_SCAN_FAST_INTERVAL,
+    };
+    int err;
+
+    err = bt_enable(NULL);
+    if (err) {
+        printk("Bluetooth init failed (err %d)\n", err);
+        return;
+    }
+
+    bt_le_scan_cb_register(&scanCallbacks);
+    bt_le_per_adv_sync_cb_register(&syncCallbacks);
+
+    printk(SCANNER_CSV_HEADER);
+    err = bt_le_scan_start(&scanParam, NULL);
+    if (err) {
+        printk("Scan start failed (err %d)\n", err);
+        return;
+    }
+
+    while (true) {
+        k_sem_take(&syncCreateSem, K_FOREVER);
+        createSync();
+        atomic_set(&syncCreatePending, 0);
+    }
+}
@@ -0,0 +1,608 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Advertising performance per tag from an anchor/scanner capture.
+#
+# Input is either a btsnoop file (H4, raw HCI or btmon -w monitor format) with the HCI traffic
+# of the scanner, or a CSV file with a header and the columns
+#   timestamp   time in seconds
+#   tag         MAC address, instance ID or anything else identifying the tag
+#   event       ext, sync, per, iq or lost (see EVENTS below)
+#   interval_ms optional, periodic advertising interval for sync events
+#   counter     optional, periodic event counter for iq events
+#   status      optional, packet status for iq events, 0 means CRC ok
+#
+# Files are loaded in bulk and the CSV columns and HCI fields decoded with numpy on all rows at
+# once, only finding the btsnoop record boundaries and rare multi report events go record by
+# record. CSV fields can not be quoted.
+
+import argparse, csv, json, struct, sys
+import numpy as np
+
+# Event types
+EXT, SYNC, PER, IQ, LOST = range(5)
+EVENTS = {"ext": EXT, "sync": SYNC, "per": PER, "iq": IQ, "lost": LOST}
+
+BTSNOOP_MAGIC = b"btsnoop\x00"
+BTSNOOP_HDR_LEN = 16
+BTSNOOP_REC_HDR_LEN = 24
+DATALINK_HCI_UNENCAP = 1001
+DATALINK_HCI_UART = 1002
+DATALINK_MONITOR = 2001
+H4_EVENT = 0x04
+MONITOR_EVENT_PKT = 3
+HCI_EVT_LE_META = 0x3E
+
+LE_EXT_ADV_REPORT = 0x0D
+LE_PER_ADV_SYNC_ESTABLISHED = 0x0E
+LE_PER_ADV_REPORT = 0x0F
+LE_PER_ADV_SYNC_LOST = 0x10
+LE_CONNECTIONLESS_IQ_REPORT = 0x15
+
+EXT_ADV_REPORT_HDR_LEN = 24
+PER_ADV_DATA_INCOMPLETE = 1
+EDDYSTONE_UID_PREFIX = b"\xaa\xfe\x00"
+EDDYSTONE_INSTANCE_OFFSET = 14
+EDDYSTONE_INSTANCE_LEN = 6
+# Extended reports of a tag searched for its Eddystone-UID
+INSTANCE_SEARCH_REPORTS = 8
+
+
+class Capture:
+    def __init__(self):
+        self.tags = {}
+        self.instance = {}
+        self.time = []
+        self.tag = []
+        self.event = []
+        self.interval = []
+        self.counter = []
+        self.status = []
+        # Arrays added by add_many
+        self.chunks = []
+
+    def add(self, t, tag, event, interval=np.nan, counter=-1, status=0):
+        idx = self.tags.setdefault(tag, len(self.tags))
+        self.time.append(t)
+        self.tag.append(idx)
+        self.event.append(event)
+        self.interval.append(interval)
+        self.counter.append(counter)
+        self.status.append(status)
+
+    def add_many(self, t, names, tag, event, interval=None, counter=None, status=None):
+        """Adds events in bulk, tag indexes into names"""
+        n = len(t)
+        idx = np.array([self.tags.setdefault(name, len(self.tags)) for name in names], dtype=np.int32)
+        self.chunks.append(
+            (
+                np.asarray(t, dtype=np.float64),
+                idx[tag] if n else np.zeros(0, dtype=np.int32),
+                np.asarray(event, dtype=np.int8),
+                np.full(n, np.nan) if interval is None else np.asarray(interval, dtype=np.float64),
+                np.full(n, -1, dtype=np.int32) if counter is None else np.asarray(counter, dtype=np.int32),
+                np.zeros(n, dtype=np.int8) if status is None else np.asarray(status, dtype=np.int8),
+            )
+        )
+
+    def arrays(self):
+        columns = [
+            (self.time, np.float64),
+            (self.tag, np.int32),
+            (self.event, np.int8),
+            (self.interval, np.float64),
+            (self.counter, np.int32),
+            (self.status, np.int8),
+        ]
+        merged = [
+            np.concatenate([np.asarray(values, dtype=dtype)] + [c[i] for c in self.chunks])
+            for i, (values, dtype) in enumerate(columns)
+        ]
+        order = np.lexsort((merged[0], merged[1]))
+        return tuple(a[order] for a in merged)
+
+    def tag_name(self, tag):
+        return self.instance.get(tag, tag)
+
+
+def format_addr(raw, sid):
+    return ":".join("%02X" % b for b in reversed(raw)) + "/" + str(sid)
+
+
+def find_instance_id(data):
+    i = 0
+    while i + 1 < len(data):
+        length = data[i]
+        if length == 0 or i + 1 + length > len(data):
+            return None
+        value = data[i + 2 : i + 1 + length]
+        if data[i + 1] == 0x16 and value[0:3] == EDDYSTONE_UID_PREFIX and len(value) >= EDDYSTONE_INSTANCE_OFFSET + EDDYSTONE_INSTANCE_LEN:
+            return value[EDDYSTONE_INSTANCE_OFFSET : EDDYSTONE_INSTANCE_OFFSET + EDDYSTONE_INSTANCE_LEN].hex().upper()
+        i += 1 + length
+    return None
+
+
+def parse_le_meta(cap, t, evt, handles):
+    sub = evt[2]
+    p = evt[3:]
+    if sub == LE_EXT_ADV_REPORT:
+        off = 1
+        for _ in range(p[0]):
+            if off + EXT_ADV_REPORT_HDR_LEN > len(p):
+                return
+            addr, sid = p[off + 3 : off + 9], p[off + 11]
+            per_int = struct.unpack_from("<H", p, off + 14)[0]
+            dlen = p[off + 23]
+            data = p[off + EXT_ADV_REPORT_HDR_LEN : off + EXT_ADV_REPORT_HDR_LEN + dlen]
+            off += EXT_ADV_REPORT_HDR_LEN + dlen
+            # Only advertisers with periodic advertising are of interest
+            if per_int == 0:
+                continue
+            tag = format_addr(addr, sid)
+            if tag not in cap.instance:
+                instance = find_instance_id(data)
+                if instance:
+                    cap.instance[tag] = instance
+            cap.add(t, tag, EXT)
+    elif sub == LE_PER_ADV_SYNC_ESTABLISHED:
+        status, handle, sid = struct.unpack_from("<BHB", p, 0)
+        if status != 0:
+            return
+        tag = format_addr(p[5:11], sid)
+        handles[handle] = tag
+        cap.add(t, tag, SYNC, interval=struct.unpack_from("<H", p, 12)[0] * 1.25)
+    elif sub == LE_PER_ADV_REPORT:
+        handle = struct.unpack_from("<H", p, 0)[0]
+        if handle in handles and p[5] != PER_ADV_DATA_INCOMPLETE:
+            cap.add(t, handles[handle], PER)
+    elif sub == LE_PER_ADV_SYNC_LOST:
+        handle = struct.unpack_from("<H", p, 0)[0]
+        if handle in handles:
+            cap.add(t, handles.pop(handle), LOST)
+    elif sub == LE_CONNECTIONLESS_IQ_REPORT:
+        handle = struct.unpack_from("<H", p, 0)[0]
+        if handle in handles:
+            status = p[8]
+            counter = struct.unpack_from("<H", p, 9)[0]
+            cap.add(t, handles[handle], IQ, counter=counter, status=status)
+
+
+def u16le(b, at):
+    return b[at].astype(np.int64) | (b[at + 1].astype(np.int64) << 8)
+
+
+def u32be(b, at):
+    v = np.zeros(len(at), dtype=np.uint64)
+    for i in range(4):
+        v = (v << np.uint64(8)) | b[at + i].astype(np.uint64)
+    return v.astype(np.int64)
+
+
+def i64be(b, at):
+    v = np.zeros(len(at), dtype=np.uint64)
+    for i in range(8):
+        v = (v << np.uint64(8)) | b[at + i].astype(np.uint64)
+    return v.view(np.int64)
+
+
+def addr_keys(b, at, sid):
+    """Address and SID packed in one integer per advertiser"""
+    key = np.zeros(len(at), dtype=np.uint64)
+    for i in range(6):
+        key |= b[at + i].astype(np.uint64) << np.uint64(8 * i)
+    return key | (sid.astype(np.uint64) << np.uint64(48))
+
+
+def key_name(key):
+    key = int(key)
+    return format_addr(key.to_bytes(7, "little")[:6], key >> 48)
+
+
+def record_offsets(buf):
+    """Start of each complete btsnoop record, the only part that has to walk the records in order"""
+    offs = []
+    off = BTSNOOP_HDR_LEN
+    unpack = struct.Struct(">I").unpack_from
+    end = len(buf) - BTSNOOP_REC_HDR_LEN
+    while off <= end:
+        incl = unpack(buf, off + 4)[0]
+        if off + BTSNOOP_REC_HDR_LEN + incl > len(buf):
+            break
+        offs.append(off)
+        off += BTSNOOP_REC_HDR_LEN + incl
+    return np.array(offs, dtype=np.int64)
+
+
+def last_before(keys, sorted_keys):
+    """Index of the last of sorted_keys before each key, -1 if none"""
+    return np.searchsorted(sorted_keys, keys) - 1
+
+
+def read_btsnoop(path, cap):
+    with open(path, "rb") as f:
+        buf = f.read()
+    datalink = struct.unpack_from(">I", buf, 12)[0]
+    if datalink not in (DATALINK_HCI_UNENCAP, DATALINK_HCI_UART, DATALINK_MONITOR):
+        sys.exit("Unsupported btsnoop datalink type %d" % datalink)
+    b = np.frombuffer(buf, dtype=np.uint8)
+    rec = record_offsets(buf)
+    incl = u32be(b, rec + 4)
+    flags = u32be(b, rec + 8)
+    evt = rec + BTSNOOP_REC_HDR_LEN
+    evt_len = incl.copy()
+
+    # Keep the received LE meta events
+    if datalink == DATALINK_HCI_UART:
+        keep = (incl > 0) & (b[np.minimum(evt, len(b) - 1)] == H4_EVENT)
+        evt, evt_len = evt + 1, evt_len - 1
+    elif datalink == DATALINK_HCI_UNENCAP:
+        # Bit 0 is received, bit 1 is command/event
+        keep = flags & 3 == 3
+    else:
+        keep = flags & 0xFFFF == MONITOR_EVENT_PKT
+    keep &= evt_len >= 3
+    keep[keep] = b[evt[keep]] == HCI_EVT_LE_META
+    rec, evt, evt_len = rec[keep], evt[keep], evt_len[keep]
+    if not len(rec):
+        return
+    ts = i64be(b, rec + 16)
+    t = (ts - ts[0]) / 1e6
+    sub = b[evt + 2]
+    p = evt + 3
+    plen = evt_len - 3
+    seq = np.arange(len(rec))
+
+    # Extended advertising reports of advertisers with periodic advertising. Controllers put one
+    # report in each event, the others are decoded record by record.
+    ext = sub == LE_EXT_ADV_REPORT
+    ext &= plen >= 1 + EXT_ADV_REPORT_HDR_LEN
+    single = ext.copy()
+    single[ext] = b[p[ext]] == 1
+    for i in np.flatnonzero(ext & ~single):
+        e = evt[i]
+        parse_le_meta(cap, t[i], buf[e : e + evt_len[i]], {})
+    r = p[single] + 1
+    dlen = b[r + 23].astype(np.int64)
+    ok = (1 + EXT_ADV_REPORT_HDR_LEN + dlen <= plen[single]) & (u16le(b, r + 14) != 0)
+    ext_i = np.flatnonzero(single)[ok]
+    r, dlen = r[ok], dlen[ok]
+    ext_key = addr_keys(b, r + 3, b[r + 11])
+
+    # Sync established, lost, periodic and IQ reports, the last three name the sync by handle
+    sync = (sub == LE_PER_ADV_SYNC_ESTABLISHED) & (plen >= 14)
+    sync[sync] = b[p[sync]] == 0
+    sync_i = np.flatnonzero(sync)
+    sync_handle = u16le(b, p[sync_i] + 1)
+    sync_key = addr_keys(b, p[sync_i] + 5, b[p[sync_i] + 3])
+    sync_interval = u16le(b, p[sync_i] + 12) * 1.25
+
+    per = (sub == LE_PER_ADV_REPORT) & (plen >= 6)
+    per[per] = b[p[per] + 5] != PER_ADV_DATA_INCOMPLETE
+    lost = (sub == LE_PER_ADV_SYNC_LOST) & (plen >= 2)
+    iq = (sub == LE_CONNECTIONLESS_IQ_REPORT) & (plen >= 11)
+
+    names, tag_idx = np.unique(np.concatenate((ext_key, sync_key)), return_inverse=True)
+    names = [key_name(k) for k in names]
+    ext_tag, sync_tag = tag_idx[: len(ext_i)], tag_idx[len(ext_i) :]
+
+    # The sync a handle refers to is the last one established with it, unless it was lost since
+    order = np.lexsort((sync_i, sync_handle))
+    sync_hk = sync_handle[order] * len(rec) + sync_i[order]
+    lost_i = np.flatnonzero(lost)
+    lost_handle = u16le(b, p[lost_i])
+    lost_hk = np.sort(lost_handle * len(rec) + lost_i)
+
+    def synced(i):
+        if not len(sync_i):
+            return i[:0], np.zeros(0, dtype=np.int64)
+        handle = u16le(b, p[i])
+        hk = handle * len(rec) + i
+        s = last_before(hk, sync_hk)
+        valid = s >= 0
+        valid[valid] = sync_handle[order][s[valid]] == handle[valid]
+        # A loss between the sync and this event ends it, the loss itself still counts
+        lo = last_before(hk, lost_hk)
+        after = np.zeros(len(i), dtype=bool)
+        after[lo >= 0] = (lost_hk[lo[lo >= 0]] // len(rec) == handle[lo >= 0]) & (
+            lost_hk[lo[lo >= 0]] % len(rec) > sync_i[order][np.maximum(s[lo >= 0], 0)]
+        )
+        valid &= ~after
+        tag = np.zeros(len(i), dtype=np.int64)
+        tag[valid] = sync_tag[order][s[valid]]
+        return i[valid], tag[valid]
+
+    per_i, per_tag = synced(np.flatnonzero(per))
+    lost_i, lost_tag = synced(lost_i)
+    iq_i, iq_tag = synced(np.flatnonzero(iq))
+    iq_status = b[p[iq_i] + 8].astype(np.int8)
+    iq_counter = u16le(b, p[iq_i] + 9)
+
+    parts = [
+        (ext_i, ext_tag, EXT, None, None, None),
+        (sync_i, sync_tag, SYNC, sync_interval, None, None),
+        (per_i, per_tag, PER, None, None, None),
+        (lost_i, lost_tag, LOST, None, None, None),
+        (iq_i, iq_tag, IQ, None, iq_counter, iq_status),
+    ]
+    for i, tag, event, interval, counter, status in parts:
+        cap.add_many(t[i], names, tag, np.full(len(i), event), interval, counter, status)
+
+    # Instance IDs from the first report of each advertiser that carries one
+    by_tag = np.argsort(ext_tag, kind="stable")
+    tags, first = np.unique(ext_tag[by_tag], return_index=True)
+    for k, start in zip(tags, first):
+        if names[k] in cap.instance:
+            continue
+        for n in by_tag[start : start + INSTANCE_SEARCH_REPORTS]:
+            if ext_tag[n] != k:
+                break
+            data_at = r[n] + EXT_ADV_REPORT_HDR_LEN
+            instance = find_instance_id(buf[data_at : data_at + dlen[n]])
+            if instance:
+                cap.instance[names[k]] = instance
+                break
+
+
+def csv_fields(body, starts, ends):
+    """Fields of one column as a fixed width bytes array"""
+    width = max(int(np.max(ends - starts)), 1) if len(starts) else 1
+    pos = starts[:, None] + np.arange(width)
+    chars = np.where(pos < ends[:, None], body[np.minimum(pos, len(body) - 1)], 0).astype(np.uint8)
+    return chars.view("S%d" % width).ravel()
+
+
+def read_csv(path, cap):
+    with open(path, "rb") as f:
+        raw = f.read().replace(b"\r", b"")
+    header, _, body = raw.partition(b"\n")
+    cols = {name.strip(): i for i, name in enumerate(header.decode().split(","))}
+    body = np.frombuffer(body.rstrip(b"\n") + b"\n", dtype=np.uint8)
+    if len(body) < 2:
+        return
+    # One separator after each field, the rows are found by counting them
+    ends = np.flatnonzero((body == ord(",")) | (body == ord("\n")))
+    if len(ends) % len(cols) or np.any(body[ends[len(cols) - 1 :: len(cols)]] != ord("\n")):
+        sys.exit("Every row of %s must have the %d columns of the header" % (path, len(cols)))
+    starts = np.concatenate(([0], ends[:-1] + 1))
+
+    def column(name):
+        return csv_fields(body, starts[cols[name] :: len(cols)], ends[cols[name] :: len(cols)])
+
+    def numbers(name, default):
+        if name not in cols:
+            return np.full(len(ends) // len(cols), default, dtype=np.float64)
+        values = column(name)
+        return np.where(np.char.strip(values) == b"", str(default).encode(), values).astype(np.float64)
+
+    # Few distinct tags and event names, only those are handled in Python
+    event_names, event_idx = np.unique(column("event"), return_inverse=True)
+    event_map = np.array([EVENTS.get(e.decode().strip().lower(), -1) for e in event_names], dtype=np.int8)
+    event = event_map[event_idx]
+    keep = event >= 0
+    tag_names, tag_idx = np.unique(column("tag")[keep], return_inverse=True)
+    names = {}
+    tag_map = np.array([names.setdefault(n.decode().strip(), len(names)) for n in tag_names], dtype=np.int64)
+    cap.add_many(
+        numbers("timestamp", np.nan)[keep],
+        list(names),
+        tag_map[tag_idx],
+        event[keep],
+        interval=numbers("interval_ms", np.nan)[keep],
+        counter=numbers("counter", -1)[keep].astype(np.int32),
+        status=numbers("status", 0)[keep].astype(np.int8),
+    )
+
+
+def restart_losses(lost, restart_s, tolerance_s, check_s):
+    """Marks the sync losses that are a restart interval away from another sync loss"""
+    if len(lost) < 2:
+        return np.zeros(len(lost), dtype=bool)
+    d = lost[None, :] - lost[:, None]
+    # The restart is checked every check_s seconds so it is never early, but can be up to check_s late
+    near = (d >= restart_s - tolerance_s) & (d <= restart_s + check_s + tolerance_s)
+    return near.any(axis=0) | near.any(axis=1)
+
+
+def analyze_tag(t, ev, interval, counter, status, args):
+    end = t[-1]
+    ext_t = t[ev == EXT]
+    sync_t = t[ev == SYNC]
+    lost_t = t[ev == LOST]
+    iq = ev == IQ
+    iq_t = t[iq]
+    per_t = t[ev == PER]
+
+    # Sync episodes, a sync without a loss lasts until the end of the capture
+    lost_after = np.searchsorted(lost_t, sync_t)
+    if len(lost_t):
+        episode_end = np.where(lost_after < len(lost_t), lost_t[np.minimum(lost_after, len(lost_t) - 1)], end)
+    else:
+        episode_end = np.full(len(sync_t), end)
+    synced_s = float(np.sum(episode_end - sync_t))
+
+    is_restart = restart_losses(lost_t, args.restart_interval, args.restart_tolerance, args.restart_check)
+
+    # Time to sync, from the first extended advertisement seen after the previous loss
+    prev_lost = np.searchsorted(lost_t, sync_t) - 1
+    if len(lost_t):
+        search_from = np.where(prev_lost >= 0, lost_t[np.maximum(prev_lost, 0)], -np.inf)
+    else:
+        search_from = np.full(len(sync_t), -np.inf)
+    first_ext = np.searchsorted(ext_t, search_from)
+    valid = first_ext < len(ext_t)
+    tts = np.where(valid, sync_t - ext_t[np.minimum(first_ext, max(len(ext_t) - 1, 0))], np.nan) if len(ext_t) else np.full(len(sync_t), np.nan)
+    tts = np.where(tts >= 0, tts, np.nan)
+    after_restart = np.zeros(len(sync_t), dtype=bool)
+    after_restart[prev_lost >= 0] = is_restart[prev_lost[prev_lost >= 0]]
+    # Time to resync after a restart is counted from the loss itself
+    resync = sync_t[after_restart] - lost_t[prev_lost[after_restart]]
+
+    nominal = interval[ev == SYNC]
+    nominal = nominal[~np.isnan(nominal)]
+    train_t = per_t if len(per_t) else iq_t
+    dt = np.diff(train_t)
+    # Only look at time differences within one sync episode
+    episode = np.searchsorted(sync_t, train_t, side="right")
+    same = (episode[1:] == episode[:-1]) & (episode[1:] > 0)
+    if len(nominal):
+        interval_s = float(np.median(nominal)) / 1000.0
+    elif np.any(same):
+        interval_s = float(np.median(dt[same]))
+    else:
+        interval_s = np.nan
+
+    jitter_ms = np.nan
+    missed = np.array([], dtype=np.int64)
+    if not np.isnan(interval_s) and np.any(same):
+        dt = dt[same]
+        n = np.maximum(np.rint(dt / interval_s), 1)
+        jitter_ms = 1000.0 * float(np.std(dt - n * interval_s))
+        missed = n.astype(np.int64) - 1
+    # The periodic event counter in the IQ reports is exact, use it when available
+    iq_counter = counter[iq]
+    if len(iq_t) > 1 and np.all(iq_counter >= 0):
+        iq_episode = np.searchsorted(sync_t, iq_t, side="right")
+        iq_same = (iq_episode[1:] == iq_episode[:-1]) & (iq_episode[1:] > 0)
+        missed = (np.diff(iq_counter) % 0x10000 - 1)[iq_same]
+
+    collision = (missed >= 1) & (missed <= args.max_collision_gap)
+    long_gap = missed > args.max_collision_gap
+
+    def stat(a, fn):
+        a = a[~np.isnan(a)] if len(a) else a
+        return round(float(fn(a)), 3) if len(a) else None
+
+    return {
+        "ext_reports": int(len(ext_t)),
+        "syncs": int(len(sync_t)),
+        "sync_lost": int(len(lost_t)),
+        "restart_drops": int(np.sum(is_restart)),
+        "tts_median_s": stat(tts, np.median),
+        "tts_max_s": stat(tts, np.max),
+        "resync_after_restart_s": stat(resync, np.median),
+        "synced_s": round(synced_s, 1),
+        "interval_ms": round(1000.0 * interval_s, 2) if not np.isnan(interval_s) else None,
+        "cte_rate_hz": round(len(iq_t) / synced_s, 2) if synced_s > 0 else None,
+        "cte_crc_err": int(np.sum(status[iq] != 0)),
+        "jitter_ms": round(jitter_ms, 3) if not np.isnan(jitter_ms) else None,
+        "collision_gaps": int(np.sum(collision)),
+        "collision_missed": int(np.sum(missed[collision])),
+        "long_gaps": int(np.sum(long_gap)),
+        "max_gap_events": int(missed.max()) if len(missed) else 0,
+    }
+
+
+def analyze(cap, args):
+    t, tag, ev, interval, counter, status = cap.arrays()
+    bounds = np.flatnonzero(np.diff(tag)) + 1
+    starts = np.concatenate(([0], bounds))
+    ends = np.concatenate((bounds, [len(t)]))
+    names = {idx: name for name, idx in cap.tags.items()}
+    results = {}
+    for s, e in zip(starts, ends):
+        name = cap.tag_name(names[int(tag[s])]) if args.instance_id else names[int(tag[s])]
+        results[name] = analyze_tag(t[s:e], ev[s:e], interval[s:e], counter[s:e], status[s:e], args)
+    return results
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Compute time to sync, CTE rate, interval jitter, collision gaps and restart drops per tag from a btsnoop or CSV capture of an anchor."
+    )
+
+    parser.add_argument(
+        "--input",
+        dest="input",
+        required=True,
+        help="btsnoop (also btmon -w) or CSV file",
+    )
+
+    parser.add_argument(
+        "--instance_id",
+        dest="instance_id",
+        action="store_true",
+        help="Name tags by the Eddystone instance ID instead of address/SID (btsnoop only)",
+    )
+
+    parser.add_argument(
+        "--restart_interval",
+        dest="restart_interval",
+        type=float,
+        default=600.0,
+        help="Tag advertising restart interval in seconds, ADV_RESTART_INTERVAL in main.c (default 600)",
+    )
+
+    parser.add_argument(
+        "--restart_check",
+        dest="restart_check",
+        type=float,
+        default=5.0,
+        help="How often the tag checks if it is time to restart in seconds (default 5)",
+    )
+
+    parser.add_argument(
+        "--restart_tolerance",
+        dest="restart_tolerance",
+        type=float,
+        default=10.0,
+        help="Tolerance in seconds when matching sync losses to restarts, should cover the scanner's sync timeout (default 10)",
+    )
+
+    parser.add_argument(
+        "--max_collision_gap",
+        dest="max_collision_gap",
+        type=int,
+        default=3,
+        help="Gaps of at most this many missed periodic events are counted as collisions (default 3)",
+    )
+
+    parser.add_argument(
+        "--json",
+        dest="json",
+        action="store_true",
+        help="Print as JSON",
+    )
+
+    args = parser.parse_args()
+    cap = Capture()
+    with open(args.input, "rb") as f:
+        is_btsnoop = f.read(len(BTSNOOP_MAGIC)) == BTSNOOP_MAGIC
+    if is_btsnoop:
+        read_btsnoop(args.input, cap)
+    else:
+        read_csv(args.input, cap)
+    results = analyze(cap, args)
+
+    if args.json:
+        json.dump(results, sys.stdout, indent=2, sort_keys=True)
+        print()
+        sys.exit(0)
+
+    cols = [
+        "syncs",
+        "sync_lost",
+        "restart_drops",
+        "tts_median_s",
+        "tts_max_s",
+        "resync_after_restart_s",
+        "interval_ms",
+        "cte_rate_hz",
+        "jitter_ms",
+        "collision_gaps",
+        "long_gaps",
+        "max_gap_events",
+    ]
+    print("{0:<24}".format("tag") + "".join(c.rjust(len(c) + 2) for c in cols))
+    for tag in sorted(results):
+        print("{0:<24}".format(tag) + "".join(str(results[tag][c]).rjust(len(c) + 2) for c in cols))
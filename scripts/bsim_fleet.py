@@ -0,0 +1,300 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Fleet benchmark in BabbleSim. Runs many instances of the nrf52_bsim build of the firmware and
+# one scanner (bsim/scanner) on the simulated 2.4 GHz phy, and reports time to first sync, sync
+# losses at the advertising restart and at other times, and the periodic report rate.
+#
+# The scanner prints its events as the CSV of adv_capture.py, the per tag results are computed
+# with adv_capture.analyze(). The simulated radio has no Direction Finding, so the tags send no
+# CTE; each periodic report would carry one, so the report rate stands in for the CTE rate.
+#
+# Everything is seeded, the same seed, build and tag count give the same report.
+
+import argparse, json, os, re, subprocess, sys
+from types import SimpleNamespace
+import numpy as np
+from adv_capture import Capture, EVENTS, PER, analyze
+from tag_fleet import ROOT_DIR, firmware_params
+
+# The scanner output is prefixed by the device number and simulation time by bsim
+EVENT_RE = re.compile(r"(\d+\.\d+),([0-9A-F:]+/\d+),(\w+),([\d.]*),([\d-]*),([\d-]*)\s*$")
+PHY_EXE = "bs_2G4_phy_v1"
+
+
+def device_args(sim_id, dev, seed, boot_spread_us, rng):
+    args = ["-s=" + sim_id, "-d={}".format(dev), "-rs={}".format(seed * 1000 + dev)]
+    if boot_spread_us:
+        args.append("-start_offset={}".format(int(rng.integers(0, boot_spread_us))))
+    return args
+
+
+def run(args, rng):
+    """Runs the simulation, returns the capture of the scanner"""
+    bin_dir = os.path.join(args.bsim_out, "bin")
+    # The scanner is the last device
+    devices = args.tags + 1
+    procs = [
+        subprocess.Popen(
+            [
+                os.path.join(bin_dir, PHY_EXE),
+                "-s=" + args.sim_id,
+                "-D={}".format(devices),
+                "-sim_length={}".format(int(args.duration * 1e6)),
+                "-rs={}".format(args.seed),
+            ],
+            cwd=bin_dir,
+            stdout=subprocess.DEVNULL,
+        )
+    ]
+    for i in range(args.tags):
+        log = open(os.path.join(args.log_dir, "tag_{}.log".format(i)), "w") if args.log_dir else None
+        procs.append(
+            subprocess.Popen(
+                [os.path.abspath(args.tag_exe)]
+                + device_args(args.sim_id, i, args.seed, int(args.boot_spread * 1e6), rng),
+                cwd=bin_dir,
+                stdout=log or subprocess.DEVNULL,
+                stderr=subprocess.STDOUT,
+            )
+        )
+    scanner = subprocess.Popen(
+        [os.path.abspath(args.scanner_exe)] + device_args(args.sim_id, args.tags, args.seed, 0, rng),
+        cwd=bin_dir,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT,
+        text=True,
+    )
+
+    cap = Capture()
+    log = open(os.path.join(args.log_dir, "scanner.csv"), "w") if args.log_dir else None
+    for line in scanner.stdout:
+        match = EVENT_RE.search(line)
+        if not match:
+            continue
+        if log:
+            log.write(",".join(match.groups()) + "\n")
+        t, tag, event, interval, counter, status = match.groups()
+        cap.add(
+            float(t),
+            tag,
+            EVENTS[event],
+            interval=float(interval) if interval else np.nan,
+            counter=int(counter) if counter else -1,
+            status=int(status) if status else 0,
+        )
+    for proc in procs + [scanner]:
+        proc.wait()
+    if procs[0].returncode != 0:
+        sys.exit("The phy exited with {}".format(procs[0].returncode))
+    return cap
+
+
+def summarize(cap, tags, args):
+    _, tag, ev, _, _, _ = cap.arrays()
+    per_count = np.bincount(tag[ev == PER], minlength=len(cap.tags))
+    names = sorted(cap.tags, key=cap.tags.get)
+    for name, count in zip(names, per_count):
+        r = tags[name]
+        r["per_reports"] = int(count)
+        expected = 1000.0 * r["synced_s"] / r["interval_ms"] if r["interval_ms"] else 0
+        r["report_rate_pct"] = round(100.0 * count / expected, 2) if expected else None
+
+    def values(key):
+        a = np.array([r[key] for r in tags.values() if r[key] is not None], dtype=float)
+        return a if len(a) else np.array([np.nan])
+
+    def rnd(v):
+        return None if np.isnan(v) else round(float(v), 3)
+
+    tag_hours = max(args.tags * args.duration / 3600.0, 1e-9)
+    synced = [r for r in tags.values() if r["syncs"] > 0]
+    restart_drops = sum(r["restart_drops"] for r in tags.values())
+    sync_lost = sum(r["sync_lost"] for r in tags.values())
+    expected = sum(1000.0 * r["synced_s"] / r["interval_ms"] for r in synced if r["interval_ms"])
+    return {
+        "tags": args.tags,
+        "tags_seen": len(tags),
+        "tags_synced": len(synced),
+        "tts_median_s": rnd(np.median(values("tts_median_s"))),
+        "tts_p90_s": rnd(np.percentile(values("tts_median_s"), 90)),
+        "tts_max_s": rnd(np.max(values("tts_max_s"))),
+        "resync_after_restart_s": rnd(np.median(values("resync_after_restart_s"))),
+        "restart_drops_per_tag_hour": round(restart_drops / tag_hours, 3),
+        "other_losses_per_tag_hour": round((sync_lost - restart_drops) / tag_hours, 3),
+        "report_rate_pct": round(100.0 * sum(r["per_reports"] for r in synced) / expected, 2) if expected else None,
+        "collision_gaps_per_tag_hour": round(sum(r["collision_gaps"] for r in tags.values()) / tag_hours, 3),
+        "long_gaps": sum(r["long_gaps"] for r in tags.values()),
+    }
+
+
+def git_describe():
+    result = subprocess.run(
+        ["git", "describe", "--always", "--dirty"], cwd=ROOT_DIR, capture_output=True, text=True
+    )
+    return result.stdout.strip()
+
+
+if __name__ == "__main__":
+    params = firmware_params()
+
+    parser = argparse.ArgumentParser(
+        description="Run a fleet of tags and a scanner in BabbleSim and report time to sync, sync losses and periodic report rate."
+    )
+
+    parser.add_argument(
+        "--tag_exe",
+        dest="tag_exe",
+        default="build/bsim/zephyr/zephyr.exe",
+        help="nrf52_bsim build of the firmware (default build/bsim/zephyr/zephyr.exe)",
+    )
+
+    parser.add_argument(
+        "--scanner_exe",
+        dest="scanner_exe",
+        default="build/bsim_scanner/zephyr/zephyr.exe",
+        help="nrf52_bsim build of bsim/scanner (default build/bsim_scanner/zephyr/zephyr.exe)",
+    )
+
+    parser.add_argument(
+        "--bsim_out",
+        dest="bsim_out",
+        default=os.environ.get("BSIM_OUT_PATH"),
+        help="BabbleSim output folder with bin/{} (default $BSIM_OUT_PATH)".format(PHY_EXE),
+    )
+
+    parser.add_argument(
+        "--tags",
+        dest="tags",
+        type=int,
+        default=32,
+        help="Number of tags (default 32). The scanner syncs to at most CONFIG_BT_PER_ADV_SYNC_MAX of them",
+    )
+
+    parser.add_argument(
+        "--duration",
+        dest="duration",
+        type=float,
+        default=1800.0,
+        help="Simulated seconds (default 1800, covers two advertising restarts)",
+    )
+
+    parser.add_argument(
+        "--boot_spread",
+        dest="boot_spread",
+        type=float,
+        default=0.0,
+        help="Tags boot at random times in this many seconds, 0 is all at once (default 0)",
+    )
+
+    parser.add_argument(
+        "--seed",
+        dest="seed",
+        type=int,
+        default=0,
+        help="Random seed of the phy and the devices (default 0)",
+    )
+
+    parser.add_argument(
+        "--sim_id",
+        dest="sim_id",
+        default="c209_fleet",
+        help="BabbleSim simulation ID, must differ between simulations running at the same time (default c209_fleet)",
+    )
+
+    parser.add_argument(
+        "--restart_interval",
+        dest="restart_interval",
+        type=float,
+        default=params["restart_ms"] / 1000.0 if params["restart_ms"] else 0.0,
+        help="Tag advertising restart interval in seconds (default ADV_RESTART_INTERVAL in main.c)",
+    )
+
+    parser.add_argument(
+        "--restart_tolerance",
+        dest="restart_tolerance",
+        type=float,
+        default=10.0,
+        help="Tolerance in seconds when matching sync losses to restarts (default 10)",
+    )
+
+    parser.add_argument(
+        "--max_collision_gap",
+        dest="max_collision_gap",
+        type=int,
+        default=3,
+        help="Gaps of at most this many missed periodic events are counted as collisions (default 3)",
+    )
+
+    parser.add_argument(
+        "--log_dir",
+        dest="log_dir",
+        help="Folder to write the tag logs and the scanner CSV to",
+    )
+
+    parser.add_argument(
+        "--out",
+        dest="out",
+        help="Write the report as JSON to this file",
+    )
+
+    parser.add_argument(
+        "--compare",
+        dest="compare",
+        help="JSON report of an earlier run to compare with",
+    )
+
+    args = parser.parse_args()
+    if not args.bsim_out:
+        parser.error("give --bsim_out or set BSIM_OUT_PATH")
+    if args.log_dir:
+        os.makedirs(args.log_dir, exist_ok=True)
+
+    rng = np.random.default_rng(args.seed)
+    cap = run(args, rng)
+    analyze_args = SimpleNamespace(
+        restart_interval=args.restart_interval,
+        restart_check=params["loop_ms"] / 1000.0,
+        restart_tolerance=args.restart_tolerance,
+        max_collision_gap=args.max_collision_gap,
+        instance_id=False,
+    )
+    tags = analyze(cap, analyze_args) if len(cap.tags) else {}
+    report = {
+        "version": git_describe(),
+        "params": {
+            "tags": args.tags,
+            "duration_s": args.duration,
+            "boot_spread_s": args.boot_spread,
+            "seed": args.seed,
+            "restart_interval_s": args.restart_interval,
+            "per_intervals_ms": params["per_intervals_ms"],
+        },
+        "summary": summarize(cap, tags, args),
+        "tags": tags,
+    }
+
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+
+    baseline = {}
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)["summary"]
+    print("{0:<30}{1:>12}{2:>12}{3:>12}".format("", "now", "baseline" if baseline else "", "delta" if baseline else ""))
+    for key, value in report["summary"].items():
+        old = baseline.get(key)
+        delta = round(value - old, 3) if isinstance(value, (int, float)) and isinstance(old, (int, float)) else ""
+        print("{0:<30}{1:>12}{2:>12}{3:>12}".format(key, str(value), "" if old is None else str(old), str(delta)))
@@ -0,0 +1,163 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Host side version of AT+BUDGET. Builds the charge model and solver of the firmware
+# (src/energy_model.c and src/budget.c) with the host C compiler so both give the same answer.
+
+import argparse, ctypes, sys
+from host_lib import DEFAULT_CC, load_library
+
+SOURCES = ["energy_model.c", "budget.c"]
+
+# Extended advertising AD data of the firmware: flags, UUID16, Eddystone UID and the device name
+DEFAULT_EXT_PAYLOAD_LEN = 3 + 4 + 26 + 2 + len("u-blox C209 DF Tag")
+
+
+class BudgetInput(ctypes.Structure):
+    _fields_ = [
+        ("targetHours", ctypes.c_uint32),
+        ("capacityMah", ctypes.c_uint32),
+        ("consumedUah", ctypes.c_uint32),
+        ("otherCurrentNa", ctypes.c_uint32),
+        ("extPayloadLen", ctypes.c_uint16),
+        ("perPayloadLen", ctypes.c_uint16),
+        ("extIntervalMinMs", ctypes.c_uint16),
+        ("extIntervalMaxMs", ctypes.c_uint16),
+        ("cteCountMax", ctypes.c_uint8),
+    ]
+
+
+class BudgetResult(ctypes.Structure):
+    _fields_ = [
+        ("perIntervalMs", ctypes.c_uint16),
+        ("extIntervalMs", ctypes.c_uint16),
+        ("cteLen", ctypes.c_uint8),
+        ("cteCount", ctypes.c_uint8),
+        ("txPower", ctypes.c_int8),
+        ("avgCurrentNa", ctypes.c_uint32),
+        ("lifeHours", ctypes.c_uint32),
+    ]
+
+
+def load_solver(cc=DEFAULT_CC):
+    lib = load_library("libbudget", SOURCES, cc)
+    lib.budgetSolve.argtypes = [ctypes.POINTER(BudgetInput), ctypes.POINTER(BudgetResult)]
+    lib.budgetSolve.restype = ctypes.c_bool
+    lib.budgetEvaluate.argtypes = [ctypes.POINTER(BudgetInput), ctypes.POINTER(BudgetResult)]
+    lib.budgetEvaluate.restype = None
+    return lib
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Pick the fastest advertising settings that make the tag last the given number of days, same as AT+BUDGET on the tag."
+    )
+
+    parser.add_argument(
+        "--days",
+        dest="days",
+        type=int,
+        required=True,
+        help="Required battery life in days",
+    )
+
+    parser.add_argument(
+        "--capacity",
+        dest="capacity",
+        type=int,
+        default=220,
+        help="Battery capacity in mAh",
+    )
+
+    parser.add_argument(
+        "--other_ua",
+        dest="other_ua",
+        type=int,
+        default=0,
+        help="Average current of sensors, LED and UART in uA, see +ENERGYLIFE of AT+ENERGY? on a running tag",
+    )
+
+    parser.add_argument(
+        "--per_payload",
+        dest="per_payload",
+        type=int,
+        default=0,
+        help="Bytes of periodic advertising data, 26 with sensor data enabled",
+    )
+
+    parser.add_argument(
+        "--ext_payload",
+        dest="ext_payload",
+        type=int,
+        default=DEFAULT_EXT_PAYLOAD_LEN,
+        help="Bytes of extended advertising data",
+    )
+
+    parser.add_argument(
+        "--ext_min",
+        dest="ext_min",
+        type=int,
+        default=200,
+        help="Min extended advertising interval in ms, CONFIG_EXT_ADV_INT_MS_MIN of the tag",
+    )
+
+    parser.add_argument(
+        "--ext_max",
+        dest="ext_max",
+        type=int,
+        default=300,
+        help="Max extended advertising interval in ms, CONFIG_EXT_ADV_INT_MS_MAX of the tag",
+    )
+
+    parser.add_argument(
+        "--max_cte_count",
+        dest="max_cte_count",
+        type=int,
+        default=1,
+        help="CTEs per periodic advertising event to consider, the firmware sends 1",
+    )
+
+    parser.add_argument(
+        "--cc",
+        dest="cc",
+        default=DEFAULT_CC,
+        help="Host C compiler (default $CC or cc)",
+    )
+
+    args = parser.parse_args()
+    lib = load_solver(args.cc)
+
+    budget_in = BudgetInput(
+        targetHours=args.days * 24,
+        capacityMah=args.capacity,
+        consumedUah=0,
+        otherCurrentNa=args.other_ua * 1000,
+        extPayloadLen=args.ext_payload,
+        perPayloadLen=args.per_payload,
+        extIntervalMinMs=args.ext_min,
+        extIntervalMaxMs=args.ext_max,
+        cteCountMax=args.max_cte_count,
+    )
+    result = BudgetResult()
+    if not lib.budgetSolve(ctypes.byref(budget_in), ctypes.byref(result)):
+        print("No settings last {0} days on {1} mAh".format(args.days, args.capacity))
+        sys.exit(1)
+
+    print("Periodic interval:  {0} ms".format(result.perIntervalMs))
+    print("Extended interval:  {0} ms".format(result.extIntervalMs))
+    print("CTE:                {0} x {1} us".format(result.cteCount, result.cteLen * 8))
+    print("TX power:           {0} dBm".format(result.txPower))
+    print("Average current:    {0:.1f} uA".format(result.avgCurrentNa / 1000))
+    print("Projected life:     {0} days".format(result.lifeHours // 24))
+    print("On the tag:         AT+BUDGET={0},{1}".format(args.days, args.capacity))
@@ -0,0 +1,245 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Collision and sync availability of many tags heard by one anchor, for choosing advIntervals[]
+# and the advertising defaults of dense deployments.
+#
+# Model:
+# - Each tag sends a periodic train with its interval from the plan, offset by the random 0-255 ms
+#   start delay of main() after its boot, running (1 + drift) too fast from the RC oscillator.
+# - Each periodic event is on a random one of the 37 data channels (channel selection algorithm
+#   #2) and lasts the PDU plus the CTE. Two events overlapping in time on the same channel are
+#   both lost.
+# - With the restart scheme the train stops every ADV_RESTART_INTERVAL and starts again with a
+#   new random 0-255 ms delay, which makes the anchor lose sync.
+# - The anchor loses sync when nothing is received for the sync timeout. Syncing takes receiving
+#   one extended advertisement while scanning, then one periodic event. The anchor can track at
+#   most max_syncs tags, with more tags it is assumed to share its time evenly between them.
+#
+# Plans are interval tables, tags are assigned their interval round robin from the table.
+
+import argparse, json, sys
+import numpy as np
+from tag_fleet import firmware_params, next_events
+
+DATA_CHANNELS = 37
+START_DELAY_MAX_S = 0.255
+ADV_DELAY_MAX_S = 0.010
+PER_ADV_PDU_OVERHEAD_BYTES = 13
+US_PER_BYTE = 8
+US_PER_CTE_UNIT = 8
+SCHEMES = ["none", "restart", "spread", "restart+spread"]
+
+
+def union_length(starts, ends):
+    """Total length of the union of the intervals [starts, ends)"""
+    if len(starts) == 0:
+        return 0.0
+    order = np.argsort(starts)
+    s, e = starts[order], np.maximum.accumulate(ends[order])
+    # A new block starts where the interval begins after all earlier ones ended
+    new = np.concatenate(([True], s[1:] > e[:-1]))
+    block = np.cumsum(new) - 1
+    block_start = s[new]
+    block_end = np.zeros(len(block_start))
+    np.maximum.at(block_end, block, e)
+    return float(np.sum(block_end - block_start))
+
+
+def sync_delays(count, per_int, coll_prob, params, args, rng):
+    """Time to sync: extended advertisements until one is heard, then the first periodic event"""
+    ext_int = rng.uniform(params["ext_min_ms"], params["ext_max_ms"], count) * 1e-3 + ADV_DELAY_MAX_S / 2
+    p_ext = max(args.scan_duty * (1.0 - args.ext_loss), 1e-6)
+    p_per = max(1.0 - coll_prob, 1e-6)
+    return rng.geometric(p_ext, count) * ext_int + rng.geometric(p_per, count) * per_int
+
+
+def simulate(plan, scheme, params, args, rng):
+    n = args.tags
+    drift = rng.uniform(-args.drift_ppm, args.drift_ppm, n) * 1e-6
+    scale = 1.0 / (1.0 + drift)
+    units = np.round(np.asarray(plan, dtype=np.float64)[np.arange(n) % len(plan)] / 1.25)
+    if "spread" in scheme:
+        units += rng.integers(0, args.spread_units + 1, n)
+    per_int = units * 1.25e-3 * scale
+    boot = rng.uniform(0, args.boot_spread, n)
+    nxt = boot + rng.uniform(0, START_DELAY_MAX_S, n)
+    airtime = ((PER_ADV_PDU_OVERHEAD_BYTES + args.payload) * US_PER_BYTE + args.cte_len * US_PER_CTE_UNIT) * 1e-6
+
+    restart_int = None
+    if "restart" in scheme and params["restart_ms"]:
+        restart_int = params["restart_ms"] * 1e-3 * scale
+        next_restart = boot + restart_int
+    restarts = [[] for _ in range(n)]
+
+    sent = np.zeros(n, dtype=np.int64)
+    collided_per_tag = np.zeros(n, dtype=np.int64)
+    rx_t, rx_tag = [], []
+    t = 0.0
+    while t < args.duration:
+        end = min(t + args.window, args.duration)
+        parts_t, parts_idx = [], []
+        mask = np.ones(n, dtype=bool)
+        until = np.full(n, end)
+        restarting = np.zeros(n, dtype=bool)
+        if restart_int is not None:
+            restarting = next_restart < end
+            until = np.where(restarting, next_restart, end)
+        for _ in range(2):
+            ev_t, ev_idx, k = next_events(nxt, per_int, until, mask)
+            nxt += k * per_int
+            parts_t.append(ev_t)
+            parts_idx.append(ev_idx)
+            if not np.any(restarting):
+                break
+            for i in np.flatnonzero(restarting):
+                restarts[i].append(next_restart[i])
+            nxt[restarting] = next_restart[restarting] + rng.uniform(0, START_DELAY_MAX_S, np.count_nonzero(restarting))
+            next_restart[restarting] += restart_int[restarting]
+            mask = restarting
+            until = np.full(n, end)
+            restarting = np.zeros(n, dtype=bool)
+
+        ev_t = np.concatenate(parts_t)
+        ev_idx = np.concatenate(parts_idx)
+        order = np.argsort(ev_t, kind="stable")
+        ev_t, ev_idx = ev_t[order], ev_idx[order]
+        ch = rng.integers(0, DATA_CHANNELS, len(ev_t))
+        collided = np.zeros(len(ev_t), dtype=bool)
+        # Compare each event with the following ones as long as any of them still overlap
+        lag = 1
+        while lag < len(ev_t):
+            overlap = ev_t[lag:] < ev_t[:-lag] + airtime
+            if not overlap.any():
+                break
+            hit = overlap & (ch[lag:] == ch[:-lag])
+            collided[lag:] |= hit
+            collided[:-lag] |= hit
+            lag += 1
+        sent += np.bincount(ev_idx, minlength=n)
+        collided_per_tag += np.bincount(ev_idx[collided], minlength=n)
+        rx = ~collided & (rng.random(len(ev_t)) >= args.rx_loss)
+        rx_t.append(ev_t[rx])
+        rx_tag.append(ev_idx[rx])
+        t = end
+
+    coll_prob = float(collided_per_tag.sum()) / max(int(sent.sum()), 1)
+    rx_t = np.concatenate(rx_t)
+    rx_tag = np.concatenate(rx_tag)
+    order = np.lexsort((rx_t, rx_tag))
+    rx_t, rx_tag = rx_t[order], rx_tag[order]
+    bounds = np.searchsorted(rx_tag, np.arange(n + 1))
+
+    availability = np.zeros(n)
+    updates = np.zeros(n)
+    for i in range(n):
+        r = rx_t[bounds[i] : bounds[i + 1]]
+        observed = args.duration - boot[i]
+        if observed <= 0:
+            continue
+        # Unsynced from boot until the first sync
+        first = r[0] if len(r) else args.duration
+        starts = [np.array([boot[i]])]
+        ends = [np.array([first]) + sync_delays(1, per_int[i], coll_prob, params, args, rng)]
+        # Lost after the sync timeout without receiving anything
+        gap = np.diff(r) > args.sync_timeout
+        lost_at = r[:-1][gap] + args.sync_timeout
+        starts.append(lost_at)
+        ends.append(lost_at + sync_delays(len(lost_at), per_int[i], coll_prob, params, args, rng))
+        # A restart moves the train away from where the anchor listens
+        rs = np.asarray(restarts[i])
+        if len(rs):
+            last = np.searchsorted(r, rs) - 1
+            last_rx = np.where(last >= 0, r[np.maximum(last, 0)], rs)
+            detect = np.maximum(rs, last_rx + args.sync_timeout)
+            starts.append(rs)
+            ends.append(detect + sync_delays(len(rs), per_int[i], coll_prob, params, args, rng))
+        s = np.concatenate(starts)
+        e = np.minimum(np.concatenate(ends), args.duration)
+        unsynced = union_length(s, np.maximum(e, s))
+        availability[i] = max(0.0, 1.0 - unsynced / observed)
+        # Only events received while synced give a location update
+        block = np.zeros(len(r), dtype=bool)
+        for a, b in zip(s, e):
+            block |= (r >= a) & (r < b)
+        updates[i] = np.count_nonzero(~block) / observed
+
+    # An anchor tracking fewer tags than there are shares its time between them
+    share = min(1.0, args.max_syncs / n) if args.max_syncs > 0 else 1.0
+    availability *= share
+    updates *= share
+    return {
+        "plan": ",".join(str(v) for v in plan),
+        "scheme": scheme,
+        "collision_pct": round(100.0 * coll_prob, 3),
+        "avail_mean_pct": round(100.0 * float(np.mean(availability)), 2),
+        "avail_p5_pct": round(100.0 * float(np.percentile(availability, 5)), 2),
+        "rate_mean_hz": round(float(np.mean(updates)), 3),
+        "rate_p5_hz": round(float(np.percentile(updates, 5)), 3),
+        "per_tag": {
+            "interval_ms": (per_int * 1000.0).round(3).tolist(),
+            "collision_pct": (100.0 * collided_per_tag / np.maximum(sent, 1)).round(3).tolist(),
+            "availability_pct": (100.0 * availability).round(2).tolist(),
+            "rate_hz": updates.round(3).tolist(),
+        },
+    }
+
+
+if __name__ == "__main__":
+    params = firmware_params()
+
+    parser = argparse.ArgumentParser(
+        description="Simulate periodic advertising collisions and anchor sync availability of many tags for interval plans and dithering schemes."
+    )
+
+    parser.add_argument("--tags", dest="tags", type=int, default=500, help="Tags heard by the anchor (default 500)")
+    parser.add_argument(
+        "--plans",
+        dest="plans",
+        nargs="+",
+        default=[str(v) for v in params["per_intervals_ms"]],
+        help="Interval tables in ms to sweep, e.g. 100 50,100,250. Default is each value of advIntervals[] in main.c",
+    )
+    parser.add_argument("--schemes", dest="schemes", nargs="+", choices=SCHEMES, default=SCHEMES, help="Dithering schemes to sweep (default all)")
+    parser.add_argument("--spread_units", dest="spread_units", type=int, default=8, help="Max per tag interval offset in 1.25 ms units for the spread scheme (default 8)")
+    parser.add_argument("--duration", dest="duration", type=float, default=1800.0, help="Simulated seconds (default 1800)")
+    parser.add_argument("--drift_ppm", dest="drift_ppm", type=float, default=250.0, help="Max tag clock drift in ppm, RC oscillator (default 250)")
+    parser.add_argument("--boot_spread", dest="boot_spread", type=float, default=0.0, help="Tags boot at random times in this many seconds, 0 is all at once (default 0)")
+    parser.add_argument("--payload", dest="payload", type=int, default=44, help="Periodic advertising data length (default 44, sensor data and TLM)")
+    parser.add_argument("--cte_len", dest="cte_len", type=int, default=20, help="CTE length in 8 us units (default 20)")
+    parser.add_argument("--sync_timeout", dest="sync_timeout", type=float, default=2.0, help="Anchor sync timeout in seconds (default 2)")
+    parser.add_argument("--scan_duty", dest="scan_duty", type=float, default=1.0, help="Fraction of time the anchor scans for extended advertising (default 1)")
+    parser.add_argument("--ext_loss", dest="ext_loss", type=float, default=0.05, help="Probability an extended advertisement is missed while scanning (default 0.05)")
+    parser.add_argument("--rx_loss", dest="rx_loss", type=float, default=0.0, help="Probability a periodic event is lost for other reasons than collisions (default 0)")
+    parser.add_argument("--max_syncs", dest="max_syncs", type=int, default=0, help="Periodic trains the anchor can track at the same time, 0 for no limit (default 0)")
+    parser.add_argument("--window", dest="window", type=float, default=10.0, help="Seconds simulated per step (default 10)")
+    parser.add_argument("--seed", dest="seed", type=int, default=0, help="Random seed (default 0)")
+    parser.add_argument("--json", dest="json", action="store_true", help="Print as JSON including per tag results")
+
+    args = parser.parse_args()
+    results = []
+    for plan in args.plans:
+        for scheme in args.schemes:
+            rng = np.random.default_rng(args.seed)
+            results.append(simulate([int(v) for v in plan.split(",")], scheme, params, args, rng))
+
+    if args.json:
+        json.dump(results, sys.stdout, indent=2)
+        print()
+        sys.exit(0)
+
+    cols = ["collision_pct", "avail_mean_pct", "avail_p5_pct", "rate_mean_hz", "rate_p5_hz"]
+    print("{0:<20}{1:<16}".format("plan", "scheme") + "".join(c.rjust(len(c) + 2) for c in cols))
+    for r in results:
+        print("{0:<20}{1:<16}".format(r["plan"], r["scheme"]) + "".join(str(r[c]).rjust(len(c) + 2) for c in cols))
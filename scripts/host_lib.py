@@ -0,0 +1,66 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Builds the plain C modules of the firmware into a shared library for the host tools. These
+# modules (tag_payload, energy_model and budget) must not depend on Zephyr so that they build
+# with any host C compiler, $CC or cc by default. Libraries are cached in one directory under the temp directory,
+# named after a hash of the compiler, sources and their headers. A library is only rebuilt when
+# the sources change, and the build of an older version is then removed.
+
+import ctypes, glob, hashlib, os, subprocess, tempfile
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src")
+CFLAGS = ["-std=c99", "-O2", "-shared", "-fPIC"]
+CACHE_DIR = os.path.join(tempfile.gettempdir(), "c209_aoa_tag_host_libs")
+DEFAULT_CC = os.environ.get("CC", "cc")
+
+
+def _digest(cc, paths):
+    digest = hashlib.sha1()
+    for part in [cc] + CFLAGS:
+        digest.update(part.encode() + b"\0")
+    for path in paths:
+        with open(path, "rb") as f:
+            digest.update(f.read())
+    return digest.hexdigest()[:16]
+
+
+def load_library(name, sources, cc=DEFAULT_CC):
+    """Returns the ctypes library of the given files of src/, built with cc if not cached"""
+    paths = [os.path.join(SRC_DIR, f) for f in sources]
+    # The headers of the sources define the structures shared with Python
+    headers = [os.path.splitext(p)[0] + ".h" for p in paths]
+    headers = [h for h in headers if os.path.exists(h)]
+    lib_path = os.path.join(CACHE_DIR, "{}-{}.so".format(name, _digest(cc, paths + headers)))
+
+    if not os.path.exists(lib_path):
+        os.makedirs(CACHE_DIR, exist_ok=True)
+        # Built under a temporary name so that a tool started meanwhile never loads half a file
+        fd, tmp_path = tempfile.mkstemp(prefix=name + "-", suffix=".tmp", dir=CACHE_DIR)
+        os.close(fd)
+        try:
+            subprocess.check_call([cc] + CFLAGS + ["-o", tmp_path] + paths)
+            os.replace(tmp_path, lib_path)
+        finally:
+            if os.path.exists(tmp_path):
+                os.remove(tmp_path)
+        for old in glob.glob(os.path.join(CACHE_DIR, name + "-*.so")):
+            if old != lib_path:
+                try:
+                    os.remove(old)
+                except OSError:
+                    # Still loaded by another tool
+                    pass
+
+    return ctypes.CDLL(lib_path)
@@ -0,0 +1,190 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Decoder of the event journal (src/journal.c). The records are read with AT+JOURNAL?, from the
+# tag over serial or from a saved reply, and printed one event per line, oldest first.
+#
+# AT+JOURNAL? replies
+# +JOURNALSTAT:<records>,<capacity>,<pending>,<boot>,<bytes_written>,<erases>,<dropped>
+# followed by +JOURNAL:<base64> lines of up to 3 records. A record is 16 bytes, little endian:
+# uptime ms (u32), boot (u16), event (u8), reserved (u8), value (i32), value2 (i32).
+
+import argparse, base64, struct, sys, time
+
+FINAL_REPLIES = ("OK\r\n", "ERROR\r\n")
+RECORD = struct.Struct("<IHBBii")
+
+# RESET_* of the Zephyr hwinfo API
+RESET_CAUSES = [
+    "PIN",
+    "SOFTWARE",
+    "BROWNOUT",
+    "POR",
+    "WATCHDOG",
+    "DEBUG",
+    "SECURITY",
+    "LOW_POWER_WAKE",
+    "CPU_LOCKUP",
+    "PARITY",
+    "PLL",
+    "CLOCK",
+    "HARDWARE",
+    "USER",
+    "TEMPERATURE",
+]
+
+# UART_ERROR_* of the Zephyr UART API
+UART_ERRORS = ["OVERRUN", "PARITY", "FRAMING", "BREAK", "COLLISION", "NOISE"]
+
+
+def bit_names(value, names):
+    found = [name for i, name in enumerate(names) if value & (1 << i)]
+    return "|".join(found) if found else "0x{:x}".format(value)
+
+
+def boot_details(value, value2):
+    return "reset {}, {} records kept in RAM".format(bit_names(value, RESET_CAUSES), value2)
+
+
+def radio_details(value, value2):
+    tx_power = struct.unpack("b", bytes([value2 & 0xFF]))[0]
+    return "ext interval {} ms, CTE {}, TX {} dBm".format(value, value2 >> 8, tx_power)
+
+
+# journalEvent_t of src/journal.h
+EVENTS = [
+    ("BOOT", boot_details),
+    ("REBOOT", lambda v, v2: "button" if v == 1 else "AT+CPWROFF"),
+    ("ADV_START", None),
+    ("ADV_STOP", None),
+    ("ADV_RESTART", lambda v, v2: "delay {} ms".format(v)),
+    ("ADV_INTERVAL", lambda v, v2: "{:g}-{:g} ms".format(v * 1.25, v2 * 1.25)),
+    ("RADIO_PARAMS", radio_details),
+    ("HCI_ERROR", lambda v, v2: "err {}, bt_adv.c line {}".format(v, v2)),
+    ("UART_ERROR", lambda v, v2: bit_names(v, UART_ERRORS)),
+    ("LOW_BATTERY", lambda v, v2: "{} h left, {} uAh used since boot".format(v, v2)),
+]
+
+
+def read_tag(port, baudrate, timeout):
+    import serial
+
+    with serial.Serial(port, baudrate, timeout=0.1) as ser:
+        # An empty line wakes the UART of the tag, the characters sent meanwhile are lost
+        ser.write(b"\r")
+        time.sleep(0.05)
+        ser.reset_input_buffer()
+        ser.write(b"AT+JOURNAL?\r")
+        start = time.monotonic()
+        reply = ""
+        while not reply.endswith(FINAL_REPLIES):
+            if time.monotonic() - start > timeout:
+                sys.exit("No reply to AT+JOURNAL? from " + port)
+            reply += ser.read(1024).decode(errors="replace")
+    if reply.endswith("ERROR\r\n"):
+        sys.exit("AT+JOURNAL? failed")
+    return reply
+
+
+def parse_reply(reply):
+    """Returns the records and the +JOURNALSTAT values"""
+    data = bytearray()
+    stat = None
+    for line in reply.splitlines():
+        line = line.strip()
+        if line.startswith("+JOURNAL:"):
+            data += base64.b64decode(line[9:])
+        elif line.startswith("+JOURNALSTAT:"):
+            stat = [int(v) for v in line[13:].split(",")]
+    records = []
+    for pos in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        records.append(RECORD.unpack_from(data, pos))
+    return records, stat
+
+
+def format_record(record):
+    time_ms, boot, event, _, value, value2 = record
+    if event < len(EVENTS):
+        name, details = EVENTS[event]
+        text = details(value, value2) if details else ""
+    else:
+        name, text = "EVENT_{}".format(event), "{} {}".format(value, value2)
+    return "{:5} {:10.3f} {:13} {}".format(boot, time_ms / 1000, name, text).rstrip()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Read the event journal of a tag with AT+JOURNAL? and print it."
+    )
+
+    parser.add_argument(
+        "--port",
+        dest="port",
+        help="Serial port of the tag, e.g. COM12 or /dev/ttyACM0",
+    )
+
+    parser.add_argument(
+        "--baudrate",
+        dest="baudrate",
+        type=int,
+        default=115200,
+        help="Baud rate (default 115200)",
+    )
+
+    parser.add_argument(
+        "--input",
+        dest="input",
+        help="Saved AT+JOURNAL? reply to decode instead of reading the tag",
+    )
+
+    parser.add_argument(
+        "--save",
+        dest="save",
+        help="Also write the reply to this file, to decode it again with --input",
+    )
+
+    parser.add_argument(
+        "--timeout",
+        dest="timeout",
+        type=float,
+        default=10.0,
+        help="Seconds to wait for the reply (default 10)",
+    )
+
+    args = parser.parse_args()
+    if bool(args.port) == bool(args.input):
+        parser.error("give one of --port and --input")
+
+    if args.port:
+        reply = read_tag(args.port, args.baudrate, args.timeout)
+    else:
+        with open(args.input, newline="") as f:
+            reply = f.read()
+    if args.save:
+        with open(args.save, "w", newline="") as f:
+            f.write(reply)
+
+    records, stat = parse_reply(reply)
+    if stat:
+        print(
+            "# {} of {} records, {} pending, boot {}, {} bytes written, {} erases and {} dropped since boot".format(
+                *stat
+            ),
+            file=sys.stderr,
+        )
+    print(" boot     uptime s event         details")
+    for record in records:
+        # Erased slots left by a write cut short by a reset
+        if record[2] != 0xFF:
+            print(format_record(record))
@@ -0,0 +1,148 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Decoder of the log ring of release builds (CONFIG_LOG_RING, src/log_ring.c). The messages are
+# read with AT+LOG?, from the tag over serial or from a saved reply, and decoded with the
+# dictionary log parser of Zephyr and the log_dictionary.json of the same build.
+#
+# AT+LOG? replies +LOGSTAT:<messages>,<bytes_used>,<size>,<overwritten>,<dropped> followed by
+# +LOG:<hex> lines, the messages split over lines of up to 40 bytes.
+
+import argparse, os, sys, time
+
+FINAL_REPLIES = ("OK\r\n", "ERROR\r\n")
+
+
+def read_tag(port, baudrate, timeout):
+    import serial
+
+    with serial.Serial(port, baudrate, timeout=0.1) as ser:
+        # An empty line wakes the UART of the tag, the characters sent meanwhile are lost
+        ser.write(b"\r")
+        time.sleep(0.05)
+        ser.reset_input_buffer()
+        ser.write(b"AT+LOG?\r")
+        start = time.monotonic()
+        reply = ""
+        while not reply.endswith(FINAL_REPLIES):
+            if time.monotonic() - start > timeout:
+                sys.exit("No reply to AT+LOG? from " + port)
+            reply += ser.read(1024).decode(errors="replace")
+    if reply.endswith("ERROR\r\n"):
+        sys.exit("AT+LOG? failed, is the firmware built with CONFIG_LOG_RING?")
+    return reply
+
+
+def parse_reply(reply):
+    """Returns the log data and the +LOGSTAT values"""
+    data = bytearray()
+    stat = None
+    for line in reply.splitlines():
+        line = line.strip()
+        if line.startswith("+LOG:"):
+            data += bytes.fromhex(line[5:])
+        elif line.startswith("+LOGSTAT:"):
+            stat = [int(v) for v in line[9:].split(",")]
+    return bytes(data), stat
+
+
+def decode(data, db_file, zephyr_base):
+    sys.path.insert(0, os.path.join(zephyr_base, "scripts", "logging", "dictionary"))
+    import dictionary_parser
+    from dictionary_parser.log_database import LogDatabase
+
+    database = LogDatabase.read_json_database(db_file)
+    if database is None:
+        sys.exit("Could not read " + db_file)
+    parser = dictionary_parser.get_parser(database)
+    if parser is None:
+        sys.exit("No parser for the log format of " + db_file)
+    parser.parse_log_data(data)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Read the log ring of a tag with AT+LOG? and decode it with the dictionary of the build."
+    )
+
+    parser.add_argument(
+        "--port",
+        dest="port",
+        help="Serial port of the tag, e.g. COM12 or /dev/ttyACM0",
+    )
+
+    parser.add_argument(
+        "--baudrate",
+        dest="baudrate",
+        type=int,
+        default=115200,
+        help="Baud rate (default 115200)",
+    )
+
+    parser.add_argument(
+        "--input",
+        dest="input",
+        help="Saved AT+LOG? reply to decode instead of reading the tag",
+    )
+
+    parser.add_argument(
+        "--db",
+        dest="db",
+        default="build/zephyr/log_dictionary.json",
+        help="Log dictionary of the build running on the tag (default build/zephyr/log_dictionary.json)",
+    )
+
+    parser.add_argument(
+        "--zephyr_base",
+        dest="zephyr_base",
+        default=os.environ.get("ZEPHYR_BASE"),
+        help="Zephyr tree with the dictionary log parser (default $ZEPHYR_BASE)",
+    )
+
+    parser.add_argument(
+        "--save",
+        dest="save",
+        help="Also write the reply to this file, to decode it again with --input",
+    )
+
+    parser.add_argument(
+        "--timeout",
+        dest="timeout",
+        type=float,
+        default=10.0,
+        help="Seconds to wait for the reply (default 10)",
+    )
+
+    args = parser.parse_args()
+    if bool(args.port) == bool(args.input):
+        parser.error("give one of --port and --input")
+    if not args.zephyr_base:
+        parser.error("give --zephyr_base or set ZEPHYR_BASE")
+
+    if args.port:
+        reply = read_tag(args.port, args.baudrate, args.timeout)
+    else:
+        with open(args.input, newline="") as f:
+            reply = f.read()
+    if args.save:
+        with open(args.save, "w", newline="") as f:
+            f.write(reply)
+
+    data, stat = parse_reply(reply)
+    if stat:
+        print(
+            "# {} messages, {} of {} bytes, {} overwritten and {} dropped since boot".format(*stat),
+            file=sys.stderr,
+        )
+    decode(data, args.db, args.zephyr_base)
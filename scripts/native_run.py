@@ -0,0 +1,189 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Runs the native_posix build of the firmware and plays a scenario against it. The AT interface
+# (uart0) and the simulation control port (uart1, see src/sim/sim_control.c) are ptys whose
+# names the executable prints at start.
+#
+# Scenario file, one step per line, # starts a comment:
+#   at <command>        send an AT command and wait for OK or ERROR
+#   sim <command>       send a simulation control command, e.g. "sim button click 300"
+#   sleep <seconds>     let the firmware run, in host time also with --no_rt
+#   expect <text>       fail unless the reply of the previous step contains text
+
+import argparse, os, re, select, subprocess, sys, termios, threading, time, tty
+
+PTY_RE = re.compile(r"(\S+) connected to pseudotty: (\S+)")
+FINAL_REPLIES = ("OK\r\n", "ERROR\r\n")
+
+
+class Port:
+    def __init__(self, path):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+
+    def command(self, cmd, timeout):
+        """Sends one line, returns the reply and the time to the final OK or ERROR"""
+        os.write(self.fd, (cmd + "\r").encode())
+        start = time.perf_counter()
+        reply = ""
+        while not reply.endswith(FINAL_REPLIES):
+            left = timeout - (time.perf_counter() - start)
+            if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+                return reply, None
+            reply += os.read(self.fd, 1024).decode(errors="replace")
+        return reply, time.perf_counter() - start
+
+
+def drain_output(proc, log_path):
+    """Keeps the firmware from blocking on a full stdout pipe, optionally logging it"""
+    log = open(log_path, "w") if log_path else None
+    for line in proc.stdout:
+        if log:
+            log.write(line)
+    if log:
+        log.close()
+
+
+def start_firmware(exe, extra_args, timeout):
+    proc = subprocess.Popen(
+        [exe] + extra_args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True
+    )
+    ptys = {}
+    deadline = time.monotonic() + timeout
+    while len(ptys) < 2 and time.monotonic() < deadline:
+        line = proc.stdout.readline()
+        if not line:
+            break
+        match = PTY_RE.search(line)
+        if match:
+            ptys["sim" if match.group(1).endswith("1") else "at"] = match.group(2)
+    if len(ptys) < 2:
+        proc.kill()
+        sys.exit("Could not find the ptys of {}".format(exe))
+    return proc, ptys
+
+
+def read_steps(path):
+    steps = []
+    with open(path) as f:
+        for line in f:
+            line = line.split("#", 1)[0].strip()
+            if line:
+                kind, _, arg = line.partition(" ")
+                steps.append((kind, arg.strip()))
+    return steps
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Run a scenario against the native_posix build.")
+
+    parser.add_argument(
+        "--exe",
+        dest="exe",
+        default="build/zephyr/zephyr.exe",
+        help="Firmware executable (default build/zephyr/zephyr.exe)",
+    )
+
+    parser.add_argument(
+        "--scenario",
+        dest="scenario",
+        help="Scenario file",
+    )
+
+    parser.add_argument(
+        "--commands",
+        dest="commands",
+        nargs="+",
+        default=[],
+        help="AT commands to send after the scenario",
+    )
+
+    parser.add_argument(
+        "--bt_dev",
+        dest="bt_dev",
+        help="HCI device for the Bluetooth host, e.g. hci0. Without it Bluetooth is not started",
+    )
+
+    parser.add_argument(
+        "--seed",
+        dest="seed",
+        type=int,
+        default=0,
+        help="Seed of the random numbers, sets the Bluetooth address (default 0)",
+    )
+
+    parser.add_argument(
+        "--no_rt",
+        dest="no_rt",
+        action="store_true",
+        help="Run the firmware as fast as possible instead of in real time, for long benchmarks",
+    )
+
+    parser.add_argument(
+        "--log",
+        dest="log",
+        help="File to write the console and log output of the firmware to",
+    )
+
+    parser.add_argument(
+        "--timeout",
+        dest="timeout",
+        type=float,
+        default=5.0,
+        help="Seconds to wait for a reply (default 5)",
+    )
+
+    args = parser.parse_args()
+    steps = read_steps(args.scenario) if args.scenario else []
+    steps += [("at", cmd) for cmd in args.commands]
+    if not steps:
+        parser.error("give --scenario or --commands")
+
+    fw_args = ["--seed={}".format(args.seed)]
+    if args.bt_dev:
+        fw_args.append("--bt-dev={}".format(args.bt_dev))
+    if args.no_rt:
+        fw_args.append("--no-rt")
+    proc, ptys = start_firmware(args.exe, fw_args, args.timeout)
+    threading.Thread(target=drain_output, args=(proc, args.log), daemon=True).start()
+    ports = {name: Port(path) for name, path in ptys.items()}
+    # The application starts the AT UART shortly after boot
+    time.sleep(1.0)
+
+    failed = 0
+    reply = ""
+    try:
+        for kind, arg in steps:
+            if kind in ports:
+                reply, latency = ports[kind].command(arg, args.timeout)
+                result = "{:8.2f} ms".format(1000 * latency) if latency is not None else " timeout"
+                print("{:4} {:40} {}  {}".format(kind, arg, result, " ".join(reply.split())))
+                if latency is None or reply.endswith("ERROR\r\n"):
+                    failed += 1
+            elif kind == "sleep":
+                time.sleep(float(arg))
+            elif kind == "expect":
+                if arg not in reply:
+                    print("expected '{}'".format(arg))
+                    failed += 1
+            else:
+                sys.exit("Unknown step '{}'".format(kind))
+    finally:
+        proc.terminate()
+        proc.wait()
+
+    print("{} steps, {} failed".format(len(steps), failed))
+    sys.exit(1 if failed else 0)
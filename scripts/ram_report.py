@@ -0,0 +1,106 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import argparse, json, re, sys
+
+RAM_START = 0x20000000
+RAM_END = 0x20020000
+
+# Input section line in a GNU ld map file, the name may be on the previous line if it is long
+SECTION_RE = re.compile(r"^\s+(\.\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+)$")
+
+
+def module_name(obj):
+    # "app/libapp.a(main.c.obj)" -> "app/main.c", "zephyr/kernel/libkernel.a(sched.c.obj)" -> "kernel/sched.c"
+    m = re.match(r"(?:.*/)?(lib\w+)\.a\((.+?)(?:\.obj|\.o)\)", obj)
+    if m:
+        lib = m.group(1)[3:]
+        return "{0}/{1}".format(lib, m.group(2))
+    return obj.rsplit("/", 1)[-1]
+
+
+def parse_map(path):
+    modules = {}
+    pending_name = None
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if re.match(r"^\s+\.\S+$", line):
+                pending_name = line.strip()
+                continue
+            m = SECTION_RE.match(line)
+            if not m:
+                pending_name = None
+                continue
+            name = m.group(1) or pending_name or ""
+            pending_name = None
+            addr = int(m.group(2), 16)
+            size = int(m.group(3), 16)
+            if size == 0 or not RAM_START <= addr < RAM_END:
+                continue
+            mod = module_name(m.group(4))
+            entry = modules.setdefault(mod, {"data": 0, "bss": 0, "noinit": 0})
+            if "noinit" in name:
+                entry["noinit"] += size
+            elif ".bss" in name or "COMMON" in name:
+                entry["bss"] += size
+            else:
+                entry["data"] += size
+    return modules
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Print static RAM (data, bss and noinit, which holds thread stacks) per module from the linker map file of a build."
+    )
+
+    parser.add_argument(
+        "--map",
+        dest="map",
+        default="build/zephyr/zephyr.map",
+        help="Path to zephyr.map",
+    )
+
+    parser.add_argument(
+        "--app_only",
+        dest="app_only",
+        action="store_true",
+        help="Only list the application modules",
+    )
+
+    parser.add_argument(
+        "--json",
+        dest="json",
+        action="store_true",
+        help="Print as JSON, e.g. to store and compare against a later build",
+    )
+
+    args = parser.parse_args()
+    modules = parse_map(args.map)
+    if args.app_only:
+        modules = {k: v for k, v in modules.items() if k.startswith("app/")}
+
+    if args.json:
+        json.dump(modules, sys.stdout, indent=2, sort_keys=True)
+        print()
+        sys.exit(0)
+
+    rows = sorted(modules.items(), key=lambda kv: -sum(kv[1].values()))
+    print("{0:<48} {1:>8} {2:>8} {3:>8} {4:>8}".format("module", "data", "bss", "noinit", "total"))
+    total = {"data": 0, "bss": 0, "noinit": 0}
+    for mod, sizes in rows:
+        for k in total:
+            total[k] += sizes[k]
+        print("{0:<48} {1:>8} {2:>8} {3:>8} {4:>8}".format(mod, sizes["data"], sizes["bss"], sizes["noinit"], sum(sizes.values())))
+    print("{0:<48} {1:>8} {2:>8} {3:>8} {4:>8}".format("TOTAL", total["data"], total["bss"], total["noinit"], sum(total.values())))
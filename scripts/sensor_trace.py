@@ -0,0 +1,253 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Sensor traces for the simulated sensors of the native_posix and nrf52_bsim builds, see
+# src/sim/sim_trace.h for the format. A trace is either scripted from a motion and a climate
+# profile, or recorded: the BME280 values of one tag from a CSV of its periodic advertising data
+# (timestamp, tag and payload columns, as read by tlm_loss.py).
+#
+# Motion profiles, acceleration in mg:
+#   still      lying on a shelf, sensor noise only
+#   walk       carried by a walking person, about 1.8 steps per second
+#   vehicle    on a vehicle, broadband vibration and slow tilts
+#   handling   mostly lying still in random orientations, picked up and carried now and then
+# Climate profiles, following the time of day from --start_hour:
+#   office     heated office, lights on from 8 to 18
+#   coldchain  refrigerated storage around 4 degC with door openings
+#   outdoor    daily temperature and light cycle, weather driven pressure changes
+
+import argparse, csv, sys
+import numpy as np
+from tag_decoder import TagCodec
+
+MOTIONS = ["still", "walk", "vehicle", "handling"]
+CLIMATES = ["office", "coldchain", "outdoor"]
+DAY_S = 24 * 3600.0
+STILL_MEAN_S = 600.0
+HANDLING_MEAN_S = 20.0
+
+
+def random_orientation(rng):
+    g = rng.normal(size=3)
+    return 1000.0 * g / np.linalg.norm(g)
+
+
+def walk(t, rng):
+    step = 2 * np.pi * 1.8 * t
+    return np.stack(
+        [
+            150.0 * np.sin(step / 2) + rng.normal(0, 30, len(t)),
+            rng.normal(0, 40, len(t)),
+            1000.0 + 300.0 * np.sin(step) + rng.normal(0, 30, len(t)),
+        ],
+        axis=1,
+    )
+
+
+def motion(profile, t, rng):
+    """Acceleration in mg at the times t"""
+    if profile == "still":
+        return np.array([0.0, 0.0, 1000.0]) + rng.normal(0, 4, (len(t), 3))
+    if profile == "walk":
+        return walk(t, rng)
+    if profile == "vehicle":
+        tilt = 80.0 * np.sin(2 * np.pi * t / 40.0)
+        return np.stack([tilt, 0.5 * tilt, np.full(len(t), 1000.0)], axis=1) + rng.normal(0, 80, (len(t), 3))
+
+    # Handling, alternating still and carried episodes
+    acc = np.empty((len(t), 3))
+    start = 0.0
+    carried = False
+    while start <= t[-1]:
+        end = start + rng.exponential(HANDLING_MEAN_S if carried else STILL_MEAN_S)
+        sel = (t >= start) & (t < end)
+        if carried:
+            acc[sel] = walk(t[sel], rng)
+        else:
+            acc[sel] = random_orientation(rng) + rng.normal(0, 4, (np.count_nonzero(sel), 3))
+        start = end
+        carried = not carried
+    return acc
+
+
+def climate(profile, t, start_hour, rng):
+    """Temperature in mdegC, pressure in Pa, humidity in m%RH and light in mlux at the times t"""
+    hour = (start_hour + t / 3600.0) % 24
+    day = np.sin(2 * np.pi * (hour - 9) / 24)
+    # Weather, a slow random walk of the pressure
+    press = 101325.0 + np.cumsum(rng.normal(0, 8 if profile == "outdoor" else 3, len(t)))
+
+    if profile == "office":
+        temp = 21.5 + 1.5 * day + rng.normal(0, 0.05, len(t))
+        hum = 40.0 - 5.0 * day + rng.normal(0, 0.3, len(t))
+        light = np.where((hour >= 8) & (hour < 18), 400.0, 5.0)
+    elif profile == "coldchain":
+        temp = 4.0 + 0.3 * np.sin(2 * np.pi * t / 1800.0) + rng.normal(0, 0.05, len(t))
+        hum = 85.0 + rng.normal(0, 0.5, len(t))
+        light = np.zeros(len(t))
+        # Door openings, temperature rises while open and recovers afterwards
+        for opening in np.cumsum(rng.exponential(7200.0, int(t[-1] / 3600.0) + 2)):
+            since = t - opening
+            open_s = rng.uniform(30, 300)
+            rise = np.where(since < 0, 0, np.minimum(since, open_s) / 60.0)
+            temp += np.where(since < 0, 0, rise * np.exp(-np.maximum(since - open_s, 0) / 600.0))
+            light = np.where((since >= 0) & (since < open_s), 200.0, light)
+    else:
+        temp = 12.0 + 6.0 * np.sin(2 * np.pi * (hour - 9) / 24) + rng.normal(0, 0.1, len(t))
+        hum = 70.0 - 20.0 * np.sin(2 * np.pi * (hour - 9) / 24) + rng.normal(0, 0.5, len(t))
+        light = 20000.0 * np.clip(np.sin(2 * np.pi * (hour - 6) / 24), 0, None) ** 1.5
+
+    return (
+        np.rint(1000 * temp).astype(int),
+        np.rint(press).astype(int),
+        np.rint(1000 * np.clip(hum, 0, 100)).astype(int),
+        np.rint(1000 * light).astype(int),
+    )
+
+
+def scripted(args, out):
+    rng = np.random.default_rng(args.seed)
+    t = np.arange(0.0, args.duration, 1.0 / args.accel_rate)
+    for ti, (x, y, z) in zip(t, np.rint(motion(args.motion, t, rng)).astype(int)):
+        out.write("{:.3f} accel {} {} {}\n".format(ti, x, y, z))
+
+    t = np.arange(0.0, args.duration + args.climate_step, args.climate_step)
+    temp, press, hum, light = climate(args.climate, t, args.start_hour, rng)
+    for ti, values in zip(t, zip(temp, press, hum)):
+        out.write("{:.3f} bme280 {} {} {}\n".format(ti, *values))
+    prev = None
+    for ti, lux in zip(t, light):
+        # Light changes in steps
+        if prev is not None and lux != prev:
+            out.write("{:.3f} light {}\n".format(ti, prev))
+        out.write("{:.3f} light {}\n".format(ti, lux))
+        prev = lux
+
+
+def recorded(args, out):
+    codec = TagCodec()
+    start = None
+    with open(args.record, newline="") as f:
+        for row in csv.DictReader(f):
+            if args.tag and row["tag"] != args.tag:
+                continue
+            try:
+                decoded = codec.decode(bytes.fromhex(row["payload"].strip()))
+            except ValueError:
+                continue
+            if not decoded or "temperature" not in decoded:
+                continue
+            t = float(row["timestamp"])
+            start = t if start is None else start
+            # The tag sends the pressure in kPa
+            out.write(
+                "{:.3f} bme280 {} {} {}\n".format(
+                    t - start,
+                    int(round(1000 * decoded["temperature"])),
+                    int(round(1000 * decoded["pressure"])),
+                    int(round(1000 * decoded["humidity"])),
+                )
+            )
+    if start is None:
+        sys.exit("No sensor data in " + args.record)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Generate a sensor trace for the simulated sensors from motion and climate profiles or from recorded advertising data."
+    )
+
+    parser.add_argument(
+        "--motion",
+        dest="motion",
+        choices=MOTIONS,
+        default="still",
+        help="Motion profile (default still)",
+    )
+
+    parser.add_argument(
+        "--climate",
+        dest="climate",
+        choices=CLIMATES,
+        default="office",
+        help="Climate profile (default office)",
+    )
+
+    parser.add_argument(
+        "--duration",
+        dest="duration",
+        type=float,
+        default=3600.0,
+        help="Trace length in seconds (default 3600)",
+    )
+
+    parser.add_argument(
+        "--start_hour",
+        dest="start_hour",
+        type=float,
+        default=8.0,
+        help="Time of day at the start of the trace (default 8)",
+    )
+
+    parser.add_argument(
+        "--accel_rate",
+        dest="accel_rate",
+        type=float,
+        default=10.0,
+        help="Acceleration points per second (default 10)",
+    )
+
+    parser.add_argument(
+        "--climate_step",
+        dest="climate_step",
+        type=float,
+        default=60.0,
+        help="Seconds between climate points (default 60)",
+    )
+
+    parser.add_argument(
+        "--seed",
+        dest="seed",
+        type=int,
+        default=0,
+        help="Random seed (default 0)",
+    )
+
+    parser.add_argument(
+        "--record",
+        dest="record",
+        help="CSV with timestamp, tag and payload columns to take the BME280 values from instead of the climate profile",
+    )
+
+    parser.add_argument(
+        "--tag",
+        dest="tag",
+        help="Tag to take from the recording (default all rows)",
+    )
+
+    parser.add_argument(
+        "--out",
+        dest="out",
+        help="Trace file (default stdout)",
+    )
+
+    args = parser.parse_args()
+    out = open(args.out, "w") if args.out else sys.stdout
+    out.write("# {}\n".format(" ".join(sys.argv[1:])))
+    if args.record:
+        recorded(args, out)
+    else:
+        scripted(args, out)
+    if args.out:
+        out.close()
@@ -0,0 +1,252 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Python bindings of the tag payload encoder/decoder (src/tag_payload.c), the same code the
+# firmware uses to build its advertising data. The C code is built with the host C compiler and
+# cached, see host_lib.py.
+#
+# Gateways decoding many reports should collect them in one buffer and call decode_batch(),
+# which decodes everything in one call into a numpy structured array without copying.
+
+import argparse, ctypes, sys, time
+import numpy as np
+from host_lib import DEFAULT_CC, load_library
+
+SOURCES = ["tag_payload.c"]
+
+NAMESPACE_LEN = 10
+INSTANCE_LEN = 6
+SENSOR_NUM = 6
+UID_LEN = 22
+TLM_LEN = 16
+SENSORS_LEN = SENSOR_NUM * 4
+AD_TYPE_SVC_DATA16 = 0x16
+AD_TYPE_MANUFACTURER = 0xFF
+TLM_TEMP_UNKNOWN = -0x8000
+
+FIELD_UID = 1 << 0
+FIELD_TLM = 1 << 1
+FIELD_SENSORS = 1 << 2
+FIELD_MALFORMED = 1 << 7
+
+# Same layout as tagPayload_t
+PAYLOAD_DTYPE = np.dtype(
+    [
+        ("advCnt", np.uint32),
+        ("secCnt", np.uint32),
+        ("sensors", np.int32, (SENSOR_NUM,)),
+        ("vbattMv", np.uint16),
+        ("temp", np.int16),
+        ("fields", np.uint8),
+        ("txPower", np.int8),
+        ("namespaceId", np.uint8, (NAMESPACE_LEN,)),
+        ("instanceId", np.uint8, (INSTANCE_LEN,)),
+    ],
+    align=True,
+)
+
+
+class TagPayload(ctypes.Structure):
+    _fields_ = [
+        ("advCnt", ctypes.c_uint32),
+        ("secCnt", ctypes.c_uint32),
+        ("sensors", ctypes.c_int32 * SENSOR_NUM),
+        ("vbattMv", ctypes.c_uint16),
+        ("temp", ctypes.c_int16),
+        ("fields", ctypes.c_uint8),
+        ("txPower", ctypes.c_int8),
+        ("namespaceId", ctypes.c_uint8 * NAMESPACE_LEN),
+        ("instanceId", ctypes.c_uint8 * INSTANCE_LEN),
+    ]
+
+
+def ad_structure(ad_type, data):
+    return bytes([len(data) + 1, ad_type]) + bytes(data)
+
+
+class TagCodec:
+    def __init__(self, cc=DEFAULT_CC):
+        lib = load_library("libtagpayload", SOURCES, cc)
+        if ctypes.sizeof(TagPayload) != PAYLOAD_DTYPE.itemsize:
+            sys.exit("tagPayload_t layout mismatch")
+
+        u8p = ctypes.POINTER(ctypes.c_uint8)
+        lib.tagPayloadEncodeUid.argtypes = [u8p, ctypes.c_int8, u8p, u8p]
+        lib.tagPayloadEncodeUid.restype = None
+        lib.tagPayloadEncodeTlm.argtypes = [u8p, ctypes.c_uint16, ctypes.c_int16, ctypes.c_uint32, ctypes.c_uint32]
+        lib.tagPayloadEncodeTlm.restype = None
+        lib.tagPayloadEncodeSensors.argtypes = [u8p, ctypes.POINTER(ctypes.c_int32)]
+        lib.tagPayloadEncodeSensors.restype = None
+        lib.tagPayloadDecode.argtypes = [u8p, ctypes.c_size_t, ctypes.POINTER(TagPayload)]
+        lib.tagPayloadDecode.restype = ctypes.c_bool
+        lib.tagPayloadDecodeBatch.argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_void_p,
+            ctypes.c_void_p,
+            ctypes.c_size_t,
+            ctypes.c_void_p,
+        ]
+        lib.tagPayloadDecodeBatch.restype = ctypes.c_size_t
+        self.lib = lib
+
+    def encode_uid(self, tx_power, namespace, instance):
+        """Eddystone-UID service data, as in the tag's extended advertising"""
+        buf = (ctypes.c_uint8 * UID_LEN)()
+        ns = (ctypes.c_uint8 * NAMESPACE_LEN).from_buffer_copy(bytes(namespace))
+        inst = (ctypes.c_uint8 * INSTANCE_LEN).from_buffer_copy(bytes(instance))
+        self.lib.tagPayloadEncodeUid(buf, tx_power, ns, inst)
+        return bytes(buf)
+
+    def encode_tlm(self, temp, adv_cnt, sec_cnt, vbatt_mv=0):
+        """Eddystone-TLM service data, temp in 8.8 fixed point"""
+        buf = (ctypes.c_uint8 * TLM_LEN)()
+        self.lib.tagPayloadEncodeTlm(buf, vbatt_mv, temp, adv_cnt & 0xFFFFFFFF, sec_cnt & 0xFFFFFFFF)
+        return bytes(buf)
+
+    def encode_sensors(self, sensors):
+        """Sensor block, sensor_value val1/val2 of temperature, pressure and humidity"""
+        buf = (ctypes.c_uint8 * SENSORS_LEN)()
+        values = (ctypes.c_int32 * SENSOR_NUM)(*sensors)
+        self.lib.tagPayloadEncodeSensors(buf, values)
+        return bytes(buf)
+
+    def ext_adv_data(self, tx_power, namespace, instance):
+        """AD structures of the extended advertising, without the device name"""
+        return (
+            ad_structure(0x01, b"\x06")
+            + ad_structure(0x03, b"\xaa\xfe")
+            + ad_structure(AD_TYPE_SVC_DATA16, self.encode_uid(tx_power, namespace, instance))
+        )
+
+    def per_adv_data(self, sensors=None, tlm=None):
+        """AD structures of the periodic advertising, in the order the tag sends them"""
+        data = b""
+        if sensors is not None:
+            data += ad_structure(AD_TYPE_MANUFACTURER, self.encode_sensors(sensors))
+        if tlm is not None:
+            data += ad_structure(AD_TYPE_SVC_DATA16, self.encode_tlm(*tlm))
+        return data
+
+    def decode(self, data):
+        """Decodes one report, returns a dict of the fields found or None"""
+        buf = (ctypes.c_uint8 * max(len(data), 1)).from_buffer_copy(bytes(data) or b"\x00")
+        out = TagPayload()
+        if not self.lib.tagPayloadDecode(buf, len(data), ctypes.byref(out)):
+            return None
+        res = {}
+        if out.fields & FIELD_UID:
+            res["tx_power"] = out.txPower
+            res["namespace"] = bytes(out.namespaceId).hex()
+            res["instance"] = bytes(out.instanceId).hex()
+        if out.fields & FIELD_TLM:
+            res["vbatt_mv"] = out.vbattMv
+            res["temp"] = out.temp / 256.0 if out.temp != TLM_TEMP_UNKNOWN else None
+            res["adv_cnt"] = out.advCnt
+            res["sec_cnt"] = out.secCnt
+        if out.fields & FIELD_SENSORS:
+            s = list(out.sensors)
+            res["temperature"] = s[0] + s[1] / 1e6
+            res["pressure"] = s[2] + s[3] / 1e6
+            res["humidity"] = s[4] + s[5] / 1e6
+        return res
+
+    def decode_batch(self, buf, offsets, lens, out=None):
+        """
+        Decodes all reports in buf, report i starts at offsets[i] and is lens[i] bytes.
+        Returns a PAYLOAD_DTYPE array, out can be passed to reuse an existing one.
+        """
+        buf = np.ascontiguousarray(np.frombuffer(buf, dtype=np.uint8) if isinstance(buf, (bytes, bytearray)) else buf, dtype=np.uint8)
+        offsets = np.ascontiguousarray(offsets, dtype=np.uint32)
+        lens = np.ascontiguousarray(lens, dtype=np.uint16)
+        if len(offsets) and int(np.max(offsets.astype(np.uint64) + lens)) > len(buf):
+            raise ValueError("report outside buffer")
+        if out is None or len(out) < len(offsets):
+            out = np.empty(len(offsets), dtype=PAYLOAD_DTYPE)
+        self.lib.tagPayloadDecodeBatch(buf.ctypes.data, offsets.ctypes.data, lens.ctypes.data, len(offsets), out.ctypes.data)
+        return out[: len(offsets)]
+
+
+def synthetic_stream(codec, tags, reports, seed=0):
+    """Report buffer of reports from tags tags, every tenth an extended advertisement"""
+    rng = np.random.default_rng(seed)
+    namespace = b"NINA-B4TAG"
+    ext = [codec.ext_adv_data(0, namespace, i.to_bytes(INSTANCE_LEN, "big")) for i in range(tags)]
+    per = []
+    for i in range(tags):
+        temp = rng.integers(15, 30)
+        sensors = [temp, rng.integers(0, 1000000), 101, rng.integers(0, 1000000), 40, 0]
+        per.append(codec.per_adv_data(sensors, (int(temp) * 256, i * 1000, i * 50)))
+    kinds = rng.integers(0, 10, reports)
+    tag_ids = rng.integers(0, tags, reports)
+    chunks = [ext[t] if k == 0 else per[t] for k, t in zip(kinds, tag_ids)]
+    lens = np.fromiter((len(c) for c in chunks), dtype=np.uint16, count=reports)
+    offsets = np.zeros(reports, dtype=np.uint32)
+    offsets[1:] = np.cumsum(lens[:-1], dtype=np.uint64)
+    return b"".join(chunks), offsets, lens
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Decode tag advertising data or benchmark the batch decoder.")
+
+    parser.add_argument(
+        "--hex",
+        dest="hex",
+        help="AD structures of one report as hex to decode",
+    )
+
+    parser.add_argument(
+        "--bench",
+        dest="bench",
+        type=int,
+        help="Benchmark decode_batch with this many synthetic reports",
+    )
+
+    parser.add_argument(
+        "--tags",
+        dest="tags",
+        type=int,
+        default=1000,
+        help="Number of tags in the synthetic reports (default 1000)",
+    )
+
+    parser.add_argument(
+        "--cc",
+        dest="cc",
+        default=DEFAULT_CC,
+        help="Host C compiler (default $CC or cc)",
+    )
+
+    args = parser.parse_args()
+    if args.hex is None and args.bench is None:
+        parser.error("give --hex or --bench")
+
+    codec = TagCodec(args.cc)
+    if args.hex is not None:
+        print(codec.decode(bytes.fromhex(args.hex)))
+
+    if args.bench is not None:
+        buf, offsets, lens = synthetic_stream(codec, args.tags, args.bench)
+        out = np.empty(len(offsets), dtype=PAYLOAD_DTYPE)
+        codec.decode_batch(buf, offsets, lens, out)
+        runs = 5
+        start = time.perf_counter()
+        for _ in range(runs):
+            codec.decode_batch(buf, offsets, lens, out)
+        elapsed = (time.perf_counter() - start) / runs
+        decoded = int(np.count_nonzero(out["fields"] & (FIELD_UID | FIELD_TLM | FIELD_SENSORS)))
+        print("Reports:          {}".format(len(offsets)))
+        print("Decoded:          {}".format(decoded))
+        print("Time per batch:   {:.2f} ms".format(1000.0 * elapsed))
+        print("Reports/s:        {:.1f} M".format(len(offsets) / elapsed / 1e6))
+        print("Throughput:       {:.0f} MB/s".format(len(buf) / elapsed / 1e6))
@@ -0,0 +1,301 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Synthetic advertising reports of a fleet of tags, for load testing gateways.
+#
+# The advertising parameters are read from the firmware source and prj.conf and the payloads are
+# encoded with src/tag_payload.c (see tag_decoder.py), so the reports look like what real tags
+# send. Modelled per tag: boot time, start offset, periodic interval from advIntervals[],
+# extended interval and advDelay, the restart every ADV_RESTART_INTERVAL with its random delay,
+# clock drift and the payload update every LOOP_SLEEP_INTERVAL. The payload includes the TLM
+# frame, as sent by tags built with -DTLM=1.
+#
+# Output is CSV (timestamp, tag, event, payload as hex, readable by tlm_loss.py) or fixed size
+# binary records of BIN_DTYPE, to a file, stdout or UDP datagrams.
+
+import argparse, os, re, socket, sys, time
+import numpy as np
+from host_lib import DEFAULT_CC
+from tag_decoder import TagCodec, ad_structure, SENSOR_NUM
+
+ROOT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+EXT, PER = 0, 1
+EVENT_NAMES = ["ext", "per"]
+MAX_DATA_LEN = 64
+ADV_DELAY_MAX_S = 0.010
+START_DELAY_MAX_S = 0.255
+UDP_MAX_RECORDS = 800
+
+BIN_DTYPE = np.dtype(
+    [
+        ("timestamp", "<f8"),
+        ("address", "u1", (6,)),
+        ("event", "u1"),
+        ("len", "u1"),
+        ("data", "u1", (MAX_DATA_LEN,)),
+    ]
+)
+
+
+def read_file(*path):
+    with open(os.path.join(ROOT_DIR, *path)) as f:
+        return f.read()
+
+
+def c_expr(expr):
+    """Value of a constant integer expression from the C source, digits, * and + only"""
+    if not re.fullmatch(r"[\d\s\*\+\(\)]+", expr):
+        sys.exit("Unexpected expression in firmware source: " + expr)
+    return eval(expr)
+
+
+def firmware_params():
+    main_c = read_file("src", "main.c")
+    storage_c = read_file("src", "storage.c")
+    prj = read_file("prj.conf")
+
+    def define(src, name):
+        m = re.search(r"#define\s+" + name + r"\s+(.+?)\s*(//.*)?$", src, re.M)
+        if not m:
+            sys.exit(name + " not found in firmware source")
+        return m.group(1).strip()
+
+    def conf(name):
+        m = re.search(r"^" + name + r"=(.*)$", prj, re.M)
+        if not m:
+            sys.exit(name + " not found in prj.conf")
+        return m.group(1).strip().strip('"')
+
+    intervals = re.search(r"advIntervals\[\]\s*=\s*\{([^}]*)\}", main_c).group(1)
+    restart = re.search(r"^#define\s+ADV_RESTART_INTERVAL\s+(.+?)\s*(//.*)?$", main_c, re.M)
+    return {
+        "per_intervals_ms": [int(v) for v in intervals.split(",")],
+        # None when the restart is commented out in the firmware
+        "restart_ms": c_expr(restart.group(1)) if restart else None,
+        "loop_ms": c_expr(define(main_c, "LOOP_SLEEP_INTERVAL")),
+        "ext_min_ms": int(conf("CONFIG_EXT_ADV_INT_MS_MIN")),
+        "ext_max_ms": int(conf("CONFIG_EXT_ADV_INT_MS_MAX")),
+        "namespace": define(storage_c, "DEFAULT_NAMESPACE").strip('"').encode(),
+        "tx_power": int(re.sub(r"\(\(int8_t\)(.+)\)", r"\1", define(storage_c, "DEFAULT_TX_POWER"))),
+        "name": conf("CONFIG_BT_DEVICE_NAME").encode(),
+    }
+
+
+def next_events(nxt, interval, end, mask):
+    """Events of all tags in mask from nxt up to end. Returns times, tag indexes and counts."""
+    k = np.where(mask & (nxt < end), np.ceil((end - nxt) / interval), 0).astype(np.int64)
+    idx = np.repeat(np.arange(len(nxt)), k)
+    j = np.arange(len(idx)) - np.repeat(np.cumsum(k) - k, k)
+    return nxt[idx] + j * interval[idx], idx, k
+
+
+class Fleet:
+    def __init__(self, codec, params, args, rng):
+        n = args.tags
+        self.codec = codec
+        self.params = params
+        self.rng = rng
+        self.loss = args.loss
+        # Random static addresses, the instance ID is the address
+        self.address = rng.integers(0, 256, (n, 6), dtype=np.uint8)
+        self.address[:, 0] |= 0xC0
+        self.names = [":".join("%02X" % b for b in a) for a in self.address]
+
+        # Tag clock drift, the tag's timers run (1 + drift) times too fast
+        self.drift = rng.uniform(-args.drift_ppm, args.drift_ppm, n) * 1e-6
+        scale = 1.0 / (1.0 + self.drift)
+        self.boot = rng.uniform(0, args.boot_spread, n)
+        if args.interval is not None:
+            per_ms = np.full(n, args.interval, dtype=np.float64)
+        else:
+            per_ms = rng.choice(params["per_intervals_ms"], n).astype(np.float64)
+        # The periodic interval is in 1.25 ms units
+        self.per_int = np.round(per_ms / 1.25) * 1.25e-3 * scale
+        # The controller picks an extended interval in the range, advDelay is added per event
+        ext_ms = rng.uniform(params["ext_min_ms"], params["ext_max_ms"], n)
+        self.ext_int = ext_ms * 1e-3 * scale
+        self.next_per = self.boot + rng.uniform(0, START_DELAY_MAX_S, n)
+        self.next_ext = self.next_per.copy()
+        self.restart_int = params["restart_ms"] * 1e-3 * scale if params["restart_ms"] else None
+        self.next_restart = self.boot + self.restart_int if self.restart_int is not None else None
+        self.loop_int = params["loop_ms"] * 1e-3 * scale
+        self.next_update = self.boot.copy()
+        self.adv_cnt = np.zeros(n, dtype=np.int64)
+        self.temp = rng.normal(22.0, 2.0, n)
+        self.press = rng.normal(101.3, 0.5, n)
+        self.humidity = rng.uniform(30, 60, n)
+
+        self.data = np.zeros((2, n, MAX_DATA_LEN), dtype=np.uint8)
+        self.data_len = np.zeros((2, n), dtype=np.uint8)
+        self.hex = [[""] * n, [""] * n]
+        name_ad = ad_structure(0x09, params["name"])
+        for i in range(n):
+            ext = codec.ext_adv_data(params["tx_power"], params["namespace"], bytes(self.address[i])) + name_ad
+            self.set_data(EXT, i, ext)
+
+    def set_data(self, event, i, data):
+        self.data[event, i, : len(data)] = np.frombuffer(data, dtype=np.uint8)
+        self.data_len[event, i] = len(data)
+        self.hex[event][i] = data.hex()
+
+    def update_payloads(self, end):
+        """What the blink work does every LOOP_SLEEP_INTERVAL: new sensor data and TLM frame"""
+        for i in np.flatnonzero(self.next_update < end):
+            t = self.next_update[i]
+            self.temp[i] += self.rng.normal(0, 0.05)
+            self.humidity[i] = min(max(self.humidity[i] + self.rng.normal(0, 0.2), 0), 100)
+            sensors = []
+            for v in (self.temp[i], self.press[i], self.humidity[i]):
+                val1 = int(np.trunc(v))
+                sensors += [val1, int(round((v - val1) * 1e6))]
+            uptime = (t - self.boot[i]) * (1.0 + self.drift[i])
+            tlm = (int(round(self.temp[i] * 256)), int(self.adv_cnt[i]), int(uptime * 10))
+            self.set_data(PER, i, self.codec.per_adv_data(sensors[:SENSOR_NUM], tlm))
+            self.next_update[i] += self.loop_int[i]
+
+    def events(self, start, end):
+        self.update_payloads(end)
+        n = len(self.boot)
+        everyone = np.ones(n, dtype=bool)
+        until = np.full(n, end)
+        restarting = np.zeros(n, dtype=bool)
+        if self.next_restart is not None:
+            restarting = self.next_restart < end
+            until = np.where(restarting, self.next_restart, end)
+
+        parts = []
+        for _ in range(2):
+            per_t, per_idx, per_k = next_events(self.next_per, self.per_int, until, everyone)
+            self.next_per += per_k * self.per_int
+            self.adv_cnt += per_k
+            ext_t, ext_idx, ext_k = next_events(self.next_ext, self.ext_int, until, everyone)
+            self.next_ext += ext_k * self.ext_int
+            ext_t = ext_t + self.rng.uniform(0, ADV_DELAY_MAX_S, len(ext_t))
+            parts.append((per_t, per_idx, np.full(len(per_t), PER, dtype=np.uint8)))
+            parts.append((ext_t, ext_idx, np.full(len(ext_t), EXT, dtype=np.uint8)))
+            if not np.any(restarting):
+                break
+            # Advertising stops and starts again after a random delay, both trains get a new anchor
+            r = restarting
+            delay = self.rng.uniform(0, START_DELAY_MAX_S, np.count_nonzero(r))
+            self.next_per[r] = self.next_restart[r] + delay
+            self.next_ext[r] = self.next_per[r]
+            self.next_restart[r] += self.restart_int[r]
+            everyone = r
+            until = np.full(n, end)
+            restarting = np.zeros(n, dtype=bool)
+
+        t = np.concatenate([p[0] for p in parts])
+        idx = np.concatenate([p[1] for p in parts])
+        ev = np.concatenate([p[2] for p in parts])
+        keep = t >= start
+        if self.loss > 0:
+            keep &= self.rng.random(len(t)) >= self.loss
+        order = np.argsort(t[keep], kind="stable")
+        return t[keep][order], idx[keep][order], ev[keep][order]
+
+    def to_bin(self, t, idx, ev):
+        rec = np.empty(len(t), dtype=BIN_DTYPE)
+        rec["timestamp"] = t
+        rec["address"] = self.address[idx]
+        rec["event"] = ev
+        rec["len"] = self.data_len[ev, idx]
+        rec["data"] = self.data[ev, idx]
+        return rec
+
+    def to_csv(self, t, idx, ev):
+        return "".join(
+            "%.6f,%s,%s,%s\n" % (ti, self.names[i], EVENT_NAMES[e], self.hex[e][i]) for ti, i, e in zip(t.tolist(), idx.tolist(), ev.tolist())
+        )
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Generate timestamped advertising reports of many simulated tags, with the firmware's advertising parameters and payload encoding."
+    )
+
+    parser.add_argument("--tags", dest="tags", type=int, default=1000, help="Number of tags (default 1000)")
+    parser.add_argument("--duration", dest="duration", type=float, default=60.0, help="Simulated seconds (default 60)")
+    parser.add_argument(
+        "--interval",
+        dest="interval",
+        type=int,
+        help="Periodic advertising interval in ms for all tags, default is a random one of advIntervals[] in main.c",
+    )
+    parser.add_argument("--drift_ppm", dest="drift_ppm", type=float, default=50.0, help="Max tag clock drift in ppm (default 50)")
+    parser.add_argument("--boot_spread", dest="boot_spread", type=float, default=0.0, help="Tags boot at random times in this many seconds (default 0)")
+    parser.add_argument("--loss", dest="loss", type=float, default=0.0, help="Probability that a report is dropped (default 0)")
+    parser.add_argument(
+        "--speed",
+        dest="speed",
+        type=float,
+        default=0.0,
+        help="Output rate relative to real time, 1 is real time, 0 is as fast as possible (default 0)",
+    )
+    parser.add_argument("--format", dest="format", choices=["csv", "bin"], default="csv", help="Output format (default csv)")
+    parser.add_argument("--output", dest="output", default="-", help="Output file, - for stdout (default -)")
+    parser.add_argument("--udp", dest="udp", help="Send to host:port as UDP datagrams instead of --output")
+    parser.add_argument("--window", dest="window", type=float, default=0.25, help="Seconds simulated per step (default 0.25)")
+    parser.add_argument("--seed", dest="seed", type=int, default=0, help="Random seed (default 0)")
+    parser.add_argument("--cc", dest="cc", default=DEFAULT_CC, help="Host C compiler (default $CC or cc)")
+
+    args = parser.parse_args()
+    params = firmware_params()
+    fleet = Fleet(TagCodec(args.cc), params, args, np.random.default_rng(args.seed))
+
+    sock = None
+    out = None
+    if args.udp:
+        host, port = args.udp.rsplit(":", 1)
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        dest = (host, int(port))
+    elif args.output == "-":
+        out = sys.stdout.buffer
+    else:
+        out = open(args.output, "wb")
+    if out is not None and args.format == "csv":
+        out.write(b"timestamp,tag,event,payload\n")
+
+    wall_start = time.monotonic()
+    reports = 0
+    t = 0.0
+    while t < args.duration:
+        end = min(t + args.window, args.duration)
+        ts, idx, ev = fleet.events(t, end)
+        reports += len(ts)
+        if args.speed > 0:
+            delay = wall_start + end / args.speed - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        if args.format == "bin":
+            payload = fleet.to_bin(ts, idx, ev)
+            if sock:
+                for i in range(0, len(payload), UDP_MAX_RECORDS):
+                    sock.sendto(payload[i : i + UDP_MAX_RECORDS].tobytes(), dest)
+            else:
+                out.write(payload.tobytes())
+        else:
+            if sock:
+                for i in range(0, len(ts), UDP_MAX_RECORDS // 2):
+                    s = slice(i, i + UDP_MAX_RECORDS // 2)
+                    sock.sendto(fleet.to_csv(ts[s], idx[s], ev[s]).encode(), dest)
+            else:
+                out.write(fleet.to_csv(ts, idx, ev).encode())
+        t = end
+
+    if out is not None and out is not sys.stdout.buffer:
+        out.close()
+    elapsed = time.monotonic() - wall_start
+    print("{} reports from {} tags in {:.1f} s, {:.0f} reports/s".format(reports, args.tags, elapsed, reports / max(elapsed, 1e-9)), file=sys.stderr)
@@ -0,0 +1,222 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Loading and analysis of anchor captures in adv_capture.py.
+
+import struct
+from types import SimpleNamespace
+import numpy as np
+import pytest
+
+import adv_capture as ac
+
+ARGS = SimpleNamespace(
+    instance_id=False, restart_interval=600.0, restart_check=5.0, restart_tolerance=10.0, max_collision_gap=3
+)
+
+ADDR_A = bytes([0x01, 0x02, 0x03, 0x04, 0x05, 0xC6])
+ADDR_B = bytes([0x11, 0x12, 0x13, 0x14, 0x15, 0xD6])
+INSTANCE_A = bytes([0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5])
+
+
+def le_meta(sub, params):
+    return bytes([ac.HCI_EVT_LE_META, len(params) + 1, sub]) + params
+
+
+def ext_report(addr, sid, per_interval, data=b""):
+    report = struct.pack("<HB6sBBBbbH", 0, 1, addr, 1, 1, sid, 0, -50, per_interval)
+    report += bytes([0]) + bytes(6) + bytes([len(data)]) + data
+    return le_meta(ac.LE_EXT_ADV_REPORT, bytes([1]) + report)
+
+
+def eddystone_uid(instance):
+    value = b"\xaa\xfe\x00\x04" + b"NINA-B4TAG" + instance + b"\x00\x00"
+    return bytes([len(value) + 1, 0x16]) + value
+
+
+def sync_established(handle, addr, sid, interval):
+    return le_meta(ac.LE_PER_ADV_SYNC_ESTABLISHED, struct.pack("<BHBB6sBHB", 0, handle, sid, 1, addr, 1, interval, 0))
+
+
+def per_report(handle, data_status=0):
+    return le_meta(ac.LE_PER_ADV_REPORT, struct.pack("<HbbBBB", handle, 4, -60, 0xFF, data_status, 0))
+
+
+def sync_lost(handle):
+    return le_meta(ac.LE_PER_ADV_SYNC_LOST, struct.pack("<H", handle))
+
+
+def iq_report(handle, counter, status=0):
+    return le_meta(ac.LE_CONNECTIONLESS_IQ_REPORT, struct.pack("<HBhBBBBHB", handle, 0, -600, 0, 0, 0, status, counter, 0))
+
+
+def btsnoop(events, datalink=ac.DATALINK_HCI_UART):
+    out = [ac.BTSNOOP_MAGIC + struct.pack(">II", 1, datalink)]
+    for t, evt in events:
+        if datalink == ac.DATALINK_HCI_UART:
+            pkt, flags = bytes([ac.H4_EVENT]) + evt, 3
+        elif datalink == ac.DATALINK_HCI_UNENCAP:
+            pkt, flags = evt, 3
+        else:
+            pkt, flags = evt, ac.MONITOR_EVENT_PKT
+        out.append(struct.pack(">IIIIq", len(pkt), len(pkt), flags, 0, int(t * 1e6)) + pkt)
+    return b"".join(out)
+
+
+def scenario():
+    """Tag A syncs, misses events, loses sync and resyncs. Tag B syncs and never loses sync."""
+    events = [(0.0, ext_report(ADDR_A, 1, 40, eddystone_uid(INSTANCE_A))), (0.05, ext_report(ADDR_B, 2, 40))]
+    events += [(0.5, sync_established(1, ADDR_A, 1, 40)), (0.6, sync_established(2, ADDR_B, 2, 40))]
+    counter = 0
+    for n in range(100):
+        t = 1.0 + n * 0.05
+        # Two events of tag A lost to a collision
+        if n not in (20, 21):
+            events.append((t, per_report(1)))
+            events.append((t + 0.001, iq_report(1, counter, status=1 if n == 30 else 0)))
+        events.append((t + 0.01, per_report(2)))
+        events.append((t + 0.011, iq_report(2, counter)))
+        counter += 1
+    events.append((6.0, per_report(2, data_status=ac.PER_ADV_DATA_INCOMPLETE)))
+    events.append((6.1, sync_lost(1)))
+    # Handle 1 is not synced, not counted
+    events.append((6.2, per_report(1)))
+    events.append((6.5, ext_report(ADDR_A, 1, 40)))
+    events.append((7.0, sync_established(3, ADDR_A, 1, 40)))
+    for n in range(10):
+        events.append((7.1 + n * 0.05, per_report(3)))
+    # Advertiser without periodic advertising, ignored
+    events.append((8.0, ext_report(bytes(6), 0, 0)))
+    events.append((8.5, per_report(2)))
+    return events
+
+
+def load(path):
+    cap = ac.Capture()
+    with open(path, "rb") as f:
+        is_btsnoop = f.read(len(ac.BTSNOOP_MAGIC)) == ac.BTSNOOP_MAGIC
+    (ac.read_btsnoop if is_btsnoop else ac.read_csv)(str(path), cap)
+    return cap
+
+
+def reference(events):
+    """Record by record decoding with parse_le_meta"""
+    cap = ac.Capture()
+    handles = {}
+    for t, evt in events:
+        ac.parse_le_meta(cap, t - events[0][0], evt, handles)
+    return cap
+
+
+def by_name(cap):
+    t, tag, ev, interval, counter, status = cap.arrays()
+    names = {idx: name for name, idx in cap.tags.items()}
+    out = {}
+    for name in cap.tags:
+        sel = tag == cap.tags[name]
+        out[name] = (t[sel], ev[sel], interval[sel], counter[sel], status[sel])
+    return out, names
+
+
+@pytest.mark.parametrize("datalink", [ac.DATALINK_HCI_UART, ac.DATALINK_HCI_UNENCAP, ac.DATALINK_MONITOR])
+def test_btsnoop_bulk_decode_matches_record_by_record(tmp_path, datalink):
+    events = scenario()
+    path = tmp_path / "capture.btsnoop"
+    path.write_bytes(btsnoop(events, datalink))
+
+    bulk, _ = by_name(load(path))
+    ref, _ = by_name(reference(events))
+
+    assert sorted(bulk) == sorted(ref)
+    for name in ref:
+        for got, expected in zip(bulk[name], ref[name]):
+            np.testing.assert_allclose(got, expected, atol=1e-6)
+
+
+def test_btsnoop_analysis(tmp_path):
+    path = tmp_path / "capture.btsnoop"
+    path.write_bytes(btsnoop(scenario()))
+    cap = load(path)
+    results = ac.analyze(cap, ARGS)
+
+    a = results[ac.format_addr(ADDR_A, 1)]
+    assert a["syncs"] == 2
+    assert a["sync_lost"] == 1
+    assert a["collision_gaps"] == 1
+    assert a["collision_missed"] == 2
+    assert a["cte_crc_err"] == 1
+    assert a["interval_ms"] == 50.0
+    assert a["tts_median_s"] == pytest.approx(0.5)
+    assert cap.instance[ac.format_addr(ADDR_A, 1)] == INSTANCE_A.hex().upper()
+
+    b = results[ac.format_addr(ADDR_B, 2)]
+    assert b["syncs"] == 1
+    assert b["sync_lost"] == 0
+    assert b["collision_gaps"] == 0
+    assert b["synced_s"] == pytest.approx(8.5 - 0.6, abs=0.1)
+    assert ac.format_addr(bytes(6), 0) not in results
+
+
+def test_csv_tag_that_never_lost_sync(tmp_path):
+    rows = ["timestamp,tag,event,interval_ms,counter,status", "0.0,tag1,ext,,,", "0.4,tag1,sync,100,,"]
+    rows += ["{:.1f},tag1,iq,,{},0".format(0.5 + n * 0.1, n) for n in range(50)]
+    path = tmp_path / "capture.csv"
+    path.write_text("\n".join(rows) + "\n")
+
+    results = ac.analyze(load(path), ARGS)
+
+    tag = results["tag1"]
+    assert tag["syncs"] == 1
+    assert tag["sync_lost"] == 0
+    assert tag["tts_median_s"] == pytest.approx(0.4)
+    assert tag["synced_s"] == pytest.approx(5.4 - 0.4)
+    assert tag["interval_ms"] == 100.0
+    assert tag["long_gaps"] == 0
+
+
+def test_csv_without_optional_columns(tmp_path):
+    rows = ["timestamp,tag,event", "0.0,t,EXT", "1.0,t,Sync", "1.5,t,per", "2.0,t,per", "2.2,t,unknown"]
+    path = tmp_path / "capture.csv"
+    path.write_text("\n".join(rows) + "\n")
+
+    cap = load(path)
+    t, _, ev, interval, counter, status = cap.arrays()
+
+    assert list(ev) == [ac.EXT, ac.SYNC, ac.PER, ac.PER]
+    assert np.all(np.isnan(interval))
+    assert np.all(counter == -1)
+    assert np.all(status == 0)
+    assert ac.analyze(cap, ARGS)["t"]["syncs"] == 1
+
+
+def test_csv_crlf_and_spaces(tmp_path):
+    rows = ["timestamp, tag, event, counter", "0.0, t ,ext,", "1.0,t, sync ,", "1.5, t,IQ, 7"]
+    path = tmp_path / "capture.csv"
+    path.write_bytes(("\r\n".join(rows) + "\r\n\r\n").encode())
+
+    cap = load(path)
+    t, _, ev, _, counter, _ = cap.arrays()
+
+    assert list(cap.tags) == ["t"]
+    assert list(t) == [0.0, 1.0, 1.5]
+    assert list(ev) == [ac.EXT, ac.SYNC, ac.IQ]
+    assert list(counter) == [-1, -1, 7]
+
+
+def test_csv_rows_must_match_header(tmp_path):
+    path = tmp_path / "capture.csv"
+    path.write_text("timestamp,tag,event\n0.0,t,ext\n1.0,t\n")
+
+    with pytest.raises(SystemExit):
+        load(path)
@@ -0,0 +1,146 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# budgetSolve and budgetEvaluate of src/budget.c through the binding of budget.py.
+
+import ctypes, os
+import pytest
+
+from budget import BudgetInput, BudgetResult, DEFAULT_EXT_PAYLOAD_LEN, load_solver
+
+
+@pytest.fixture(scope="module")
+def lib():
+    return load_solver(os.environ.get("CC", "cc"))
+
+
+def budget_input(days, capacity=220, consumed_uah=0, cte_count_max=1):
+    return BudgetInput(
+        targetHours=days * 24,
+        capacityMah=capacity,
+        consumedUah=consumed_uah,
+        otherCurrentNa=0,
+        extPayloadLen=DEFAULT_EXT_PAYLOAD_LEN,
+        perPayloadLen=0,
+        extIntervalMinMs=32,
+        extIntervalMaxMs=16384,
+        cteCountMax=cte_count_max,
+    )
+
+
+def solve(lib, budget_in):
+    result = BudgetResult()
+    ok = lib.budgetSolve(ctypes.byref(budget_in), ctypes.byref(result))
+    return ok, result
+
+
+def evaluate(lib, budget_in, settings):
+    copy = BudgetResult.from_buffer_copy(settings)
+    lib.budgetEvaluate(ctypes.byref(budget_in), ctypes.byref(copy))
+    return copy
+
+
+def test_feasible_budget_lasts_the_target(lib):
+    budget_in = budget_input(days=365)
+    ok, result = solve(lib, budget_in)
+
+    assert ok
+    assert result.lifeHours >= budget_in.targetHours
+    assert 2 <= result.cteLen <= 20
+    assert result.cteCount == 1
+    # The solver reports the projection of the settings it picked
+    again = evaluate(lib, budget_in, result)
+    assert again.lifeHours == result.lifeHours
+    assert again.avgCurrentNa == result.avgCurrentNa
+
+
+def test_short_budget_picks_the_fastest_settings(lib):
+    ok, result = solve(lib, budget_input(days=1))
+
+    assert ok
+    assert result.perIntervalMs == 8
+    assert result.cteLen == 20
+    assert result.extIntervalMs == 32
+
+
+def test_longer_budget_never_picks_a_faster_interval(lib):
+    intervals = []
+    for days in (1, 30, 90, 180, 365, 400):
+        ok, result = solve(lib, budget_input(days=days))
+        assert ok
+        intervals.append(result.perIntervalMs)
+
+    assert intervals == sorted(intervals)
+
+
+def test_infeasible_budget(lib):
+    ok, _ = solve(lib, budget_input(days=36500, capacity=1))
+
+    assert not ok
+
+
+def test_empty_battery_is_infeasible(lib):
+    ok, _ = solve(lib, budget_input(days=1, capacity=220, consumed_uah=220 * 1000))
+
+    assert not ok
+
+
+def test_no_cte_is_infeasible(lib):
+    ok, _ = solve(lib, budget_input(days=1, cte_count_max=0))
+
+    assert not ok
+
+
+def test_target_equal_to_projected_life_is_feasible(lib):
+    ok, result = solve(lib, budget_input(days=365))
+    assert ok
+
+    exact = budget_input(days=0)
+    exact.targetHours = result.lifeHours
+    ok, same = solve(lib, exact)
+    assert ok
+    assert (same.perIntervalMs, same.extIntervalMs, same.cteLen, same.txPower) == (
+        result.perIntervalMs,
+        result.extIntervalMs,
+        result.cteLen,
+        result.txPower,
+    )
+
+    # One hour more no longer fits these settings
+    exact.targetHours = result.lifeHours + 1
+    ok, slower = solve(lib, exact)
+    assert ok
+    assert slower.lifeHours > result.lifeHours
+    assert (slower.perIntervalMs, slower.extIntervalMs, slower.cteLen, slower.txPower) != (
+        result.perIntervalMs,
+        result.extIntervalMs,
+        result.cteLen,
+        result.txPower,
+    )
+
+
+def test_longest_feasible_budget(lib):
+    # The slowest settings the solver considers
+    slowest = BudgetResult(perIntervalMs=60000, extIntervalMs=16384, cteLen=2, cteCount=1, txPower=-40)
+    budget_in = budget_input(days=0)
+    life = evaluate(lib, budget_in, slowest).lifeHours
+
+    budget_in.targetHours = life
+    ok, result = solve(lib, budget_in)
+    assert ok
+    assert result.perIntervalMs == 60000
+
+    budget_in.targetHours = life + 1
+    ok, _ = solve(lib, budget_in)
+    assert not ok
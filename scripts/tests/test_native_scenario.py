@@ -0,0 +1,108 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Boots the native_posix build of the firmware and checks AT replies and the sensor values of the
+# simulated sensors. Skipped unless the build exists, by default build/native/zephyr/zephyr.exe
+# of the repository (README, "Running without hardware"), or NATIVE_EXE.
+
+import os, subprocess, sys, threading, time
+import pytest
+
+import native_run
+
+SCRIPTS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+EXE = os.environ.get("NATIVE_EXE", os.path.join(SCRIPTS_DIR, "..", "build", "native", "zephyr", "zephyr.exe"))
+SCENARIO = os.path.join(os.path.dirname(os.path.abspath(__file__)), "native_smoke.scenario")
+TIMEOUT = 5.0
+
+# sensorsAccelToRaw scales m/s^2 by 2048
+LIS_RAW_PER_G = 9.80665 * 2048
+
+pytestmark = pytest.mark.skipif(not os.path.exists(EXE), reason="native_posix build not found, set NATIVE_EXE")
+
+
+@pytest.fixture
+def firmware(tmp_path, monkeypatch):
+    # flash.bin is created in the working directory, every test starts with erased storage
+    monkeypatch.chdir(tmp_path)
+    proc, ptys = native_run.start_firmware(os.path.abspath(EXE), ["--seed=0"], TIMEOUT)
+    threading.Thread(target=native_run.drain_output, args=(proc, None), daemon=True).start()
+    ports = {name: native_run.Port(path) for name, path in ptys.items()}
+    # The application starts the AT UART shortly after boot
+    time.sleep(1.0)
+    yield ports
+    proc.terminate()
+    proc.wait()
+
+
+def command(port, cmd):
+    reply, latency = port.command(cmd, TIMEOUT)
+    assert latency is not None, "no reply to " + cmd
+    return reply
+
+
+def self_test(ports):
+    """Runs AT+TEST, returns the values and result per sensor, the total result and the reply"""
+    reply = command(ports["at"], "AT+TEST")
+    steps = {}
+    for line in reply.split():
+        if line.startswith("+TEST:"):
+            fields = line[len("+TEST:") :].split(",")
+            steps[fields[0]] = [int(f) for f in fields[1:]]
+    return steps, reply
+
+
+def test_scenario(tmp_path):
+    res = subprocess.run(
+        [sys.executable, os.path.join(SCRIPTS_DIR, "native_run.py"), "--exe", os.path.abspath(EXE)]
+        + ["--scenario", SCENARIO],
+        cwd=str(tmp_path),
+        stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT,
+        text=True,
+        timeout=120,
+    )
+
+    assert res.returncode == 0, res.stdout
+
+
+def test_self_test_reads_simulated_sensors(firmware):
+    assert command(firmware["sim"], "accel 0 -500 866").endswith("OK\r\n")
+    assert command(firmware["sim"], "bme280 -5250 98000 72500").endswith("OK\r\n")
+
+    steps, reply = self_test(firmware)
+
+    assert reply.endswith("OK\r\n")
+    assert steps["TOTAL"][0] == 0
+    result, _, x, y, z = steps["LIS"]
+    assert result == 0
+    assert x == pytest.approx(0, abs=0.02 * LIS_RAW_PER_G)
+    assert y == pytest.approx(-0.5 * LIS_RAW_PER_G, abs=0.02 * LIS_RAW_PER_G)
+    assert z == pytest.approx(0.866 * LIS_RAW_PER_G, abs=0.02 * LIS_RAW_PER_G)
+    result, _, temp, press, humidity = steps["BME"]
+    assert result == 0
+    assert temp == pytest.approx(-5250, abs=100)
+    assert press == pytest.approx(98000, abs=50)
+    assert humidity == pytest.approx(72500, abs=1000)
+
+
+def test_self_test_rejects_implausible_acceleration(firmware):
+    assert command(firmware["sim"], "accel 0 0 1800").endswith("OK\r\n")
+
+    steps, reply = self_test(firmware)
+
+    assert reply.endswith("ERROR\r\n")
+    assert steps["LIS"][0] == 2
+    assert steps["BME"][0] == 0
+    assert steps["TOTAL"][0] == 1
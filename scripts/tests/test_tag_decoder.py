@@ -0,0 +1,98 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Encoding and batch decoding of the tag payload through the ctypes binding of src/tag_payload.c.
+
+import os
+import numpy as np
+import pytest
+
+import tag_decoder as td
+
+NAMESPACE = b"NINA-B4TAG"
+INSTANCE = bytes([0x01, 0x02, 0x03, 0x04, 0x05, 0x06])
+SENSORS = [23, 500000, 101, 325000, 40, 250000]
+
+
+@pytest.fixture(scope="module")
+def codec():
+    return td.TagCodec(os.environ.get("CC", "cc"))
+
+
+def batch(reports):
+    lens = np.array([len(r) for r in reports], dtype=np.uint16)
+    offsets = np.zeros(len(reports), dtype=np.uint32)
+    offsets[1:] = np.cumsum(lens[:-1])
+    return b"".join(reports), offsets, lens
+
+
+def test_batch_round_trip(codec):
+    ext = codec.ext_adv_data(-4, NAMESPACE, INSTANCE)
+    per = codec.per_adv_data(SENSORS, (21 * 256 + 128, 123456, 789))
+    # Length of the second AD structure runs past the end of the report
+    malformed = bytes([2, 0x01, 0x06, 30, td.AD_TYPE_MANUFACTURER]) + bytes(10)
+    no_tag_data = bytes([2, 0x01, 0x06])
+    out = codec.decode_batch(*batch([ext, per, malformed, no_tag_data, b"", per + b"\x00" + malformed]))
+
+    assert len(out) == 6
+    assert out[0]["fields"] == td.FIELD_UID
+    assert out[0]["txPower"] == -4
+    assert bytes(out[0]["namespaceId"]) == NAMESPACE
+    assert bytes(out[0]["instanceId"]) == INSTANCE
+
+    assert out[1]["fields"] == td.FIELD_SENSORS | td.FIELD_TLM
+    assert list(out[1]["sensors"]) == SENSORS
+    assert out[1]["temp"] == 21 * 256 + 128
+    assert out[1]["advCnt"] == 123456
+    assert out[1]["secCnt"] == 789
+
+    assert out[2]["fields"] & td.FIELD_MALFORMED
+    assert out[3]["fields"] == 0
+    assert out[4]["fields"] == 0
+    # Data after an AD structure of length 0 is ignored
+    assert out[5]["fields"] == td.FIELD_SENSORS | td.FIELD_TLM
+
+
+def test_batch_matches_single_decode(codec):
+    buf, offsets, lens = td.synthetic_stream(codec, 20, 500, seed=1)
+    out = codec.decode_batch(buf, offsets, lens)
+
+    for i in range(0, len(offsets), 7):
+        single = codec.decode(buf[offsets[i] : offsets[i] + lens[i]])
+        if out[i]["fields"] & td.FIELD_UID:
+            assert single["instance"] == bytes(out[i]["instanceId"]).hex()
+        if out[i]["fields"] & td.FIELD_TLM:
+            assert single["adv_cnt"] == out[i]["advCnt"]
+            assert single["temp"] == out[i]["temp"] / 256.0
+        if out[i]["fields"] & td.FIELD_SENSORS:
+            assert single["temperature"] == out[i]["sensors"][0] + out[i]["sensors"][1] / 1e6
+
+
+def test_batch_reuses_out(codec):
+    buf, offsets, lens = batch([codec.per_adv_data(SENSORS)] * 3)
+    out = np.empty(10, dtype=td.PAYLOAD_DTYPE)
+
+    res = codec.decode_batch(buf, offsets, lens, out)
+
+    assert len(res) == 3
+    assert np.shares_memory(res, out)
+    assert np.all(res["fields"] == td.FIELD_SENSORS)
+
+
+def test_batch_rejects_report_outside_buffer(codec):
+    buf, offsets, lens = batch([codec.per_adv_data(SENSORS)])
+    lens[0] += 1
+
+    with pytest.raises(ValueError):
+        codec.decode_batch(buf, offsets, lens)
@@ -0,0 +1,146 @@
+# Copyright 2022 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Packet loss and jitter per tag from the Eddystone-TLM frame the tag puts in its periodic
+# advertising data (CONFIG_SEND_TLM_IN_PER_ADV_DATA).
+#
+# Input is a CSV file with a header and at least the columns
+#   timestamp   receive time in seconds
+#   tag         anything that identifies the tag, e.g. MAC address or instance ID
+#   payload     periodic advertising data as hex, AD structures as sent by the tag
+#
+# The tag updates the TLM frame every few seconds with the number of periodic events it has sent.
+# All reports with the same count belong to one update, and the difference to the next count is
+# the number of events sent meanwhile. So the loss is known without relying on receive times.
+
+import argparse, csv, json, sys
+import numpy as np
+
+EDDYSTONE_UUID = b"\xaa\xfe"
+TLM_FRAME_TYPE = 0x20
+AD_TYPE_SVC_DATA16 = 0x16
+
+
+def parse_tlm(payload_hex):
+    """Returns (adv_cnt, sec_cnt) from the AD structures, None if there is no TLM frame"""
+    try:
+        data = bytes.fromhex(payload_hex.strip())
+    except ValueError:
+        return None
+    i = 0
+    while i + 1 < len(data):
+        length = data[i]
+        if length == 0 or i + 1 + length > len(data):
+            return None
+        ad_type = data[i + 1]
+        value = data[i + 2 : i + 1 + length]
+        if ad_type == AD_TYPE_SVC_DATA16 and len(value) >= 16 and value[0:2] == EDDYSTONE_UUID and value[2] == TLM_FRAME_TYPE:
+            adv_cnt = int.from_bytes(value[8:12], "big")
+            sec_cnt = int.from_bytes(value[12:16], "big")
+            return adv_cnt, sec_cnt
+        i += 1 + length
+    return None
+
+
+def read_reports(path):
+    reports = {}
+    with open(path, newline="") as f:
+        for row in csv.DictReader(f):
+            tlm = parse_tlm(row["payload"])
+            if tlm is None:
+                continue
+            reports.setdefault(row["tag"], []).append((float(row["timestamp"]), tlm[0], tlm[1]))
+    return reports
+
+
+def analyze_tag(rows):
+    arr = np.array(sorted(rows), dtype=np.float64)
+    t, adv_cnt, sec_cnt = arr[:, 0], arr[:, 1], arr[:, 2]
+
+    # The counters restart when the tag reboots
+    reboot = np.flatnonzero(np.diff(sec_cnt) < 0) + 1
+    bounds = np.concatenate(([0], reboot, [len(t)]))
+
+    expected = 0
+    received = 0
+    residuals = []
+    max_gap = 0
+    interval_s = []
+    for start, end in zip(bounds[:-1], bounds[1:]):
+        seg_t, seg_cnt, seg_sec = t[start:end], adv_cnt[start:end], sec_cnt[start:end]
+        counts, first = np.unique(seg_cnt, return_index=True)
+        if len(counts) < 2:
+            continue
+        # Reports per update, the last update is still ongoing and not counted
+        per_update = np.diff(np.append(np.sort(first), end - start))
+        expected += int(counts[-1] - counts[0])
+        received += int(per_update[:-1].sum())
+
+        # Interval from the tag's own clock
+        d_cnt = counts[-1] - counts[0]
+        d_sec = (seg_sec[first[-1]] - seg_sec[first[0]]) / 10.0
+        if d_cnt > 0 and d_sec > 0:
+            interval = d_sec / d_cnt
+            interval_s.append(interval)
+            dt = np.diff(seg_t)
+            n = np.maximum(np.rint(dt / interval), 1)
+            residuals.append(dt - n * interval)
+            if len(n):
+                max_gap = max(max_gap, int(n.max()) - 1)
+
+    res = np.concatenate(residuals) if residuals else np.array([])
+    lost = max(expected - received, 0)
+    return {
+        "reports": int(len(t)),
+        "expected": expected,
+        "lost": lost,
+        "loss_pct": round(100.0 * lost / expected, 2) if expected else None,
+        "interval_ms": round(1000.0 * float(np.mean(interval_s)), 2) if interval_s else None,
+        "jitter_ms": round(1000.0 * float(np.std(res)), 3) if len(res) else None,
+        "max_gap_events": max_gap,
+        "reboots": int(len(reboot)),
+    }
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description="Compute periodic advertising packet loss and jitter per tag from recorded anchor output with the tag's Eddystone-TLM payload."
+    )
+
+    parser.add_argument(
+        "--input",
+        dest="input",
+        required=True,
+        help="CSV file with timestamp, tag and payload columns",
+    )
+
+    parser.add_argument(
+        "--json",
+        dest="json",
+        action="store_true",
+        help="Print as JSON",
+    )
+
+    args = parser.parse_args()
+    results = {tag: analyze_tag(rows) for tag, rows in read_reports(args.input).items()}
+
+    if args.json:
+        json.dump(results, sys.stdout, indent=2, sort_keys=True)
+        print()
+        sys.exit(0)
+
+    cols = ["reports", "expected", "lost", "loss_pct", "interval_ms", "jitter_ms", "max_gap_events", "reboots"]
+    print("{0:<20}".format("tag") + "".join("{0:>16}".format(c) for c in cols))
+    for tag in sorted(results):
+        print("{0:<20}".format(tag) + "".join("{0:>16}".format(str(results[tag][c])) for c in cols))
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "app_work.h"
+
+#include <zephyr.h>
+#include <init.h>
+
+#define APP_WORK_STACKSIZE  2048
+#define APP_WORK_PRIORITY   7
+
+K_THREAD_STACK_DEFINE(appWorkStack, APP_WORK_STACKSIZE);
+struct k_work_q appWorkQ;
+
+static int appWorkInit(const struct device *unused)
+{
+    struct k_work_queue_config cfg = {
+        .name = "app_workq",
+    };
+
+    k_work_queue_start(&appWorkQ, appWorkStack, K_THREAD_STACK_SIZEOF(appWorkStack),
+                       APP_WORK_PRIORITY, &cfg);
+
+    return 0;
+}
+
+SYS_INIT(appWorkInit, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
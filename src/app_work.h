@@ -0,0 +1,32 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __APP_WORK_H
+#define __APP_WORK_H
+
+#include <zephyr.h>
+
+/**
+ * @brief   Application work queue.
+ * @details All application activity (periodic blink and sensor update, button handling, AT
+ *          commands and flash writes) runs as work items on this queue instead of in threads of
+ *          their own. It is started before main() so work can be submitted at any time.
+ *          Work items may block for short periods, e.g. for a sensor conversion, but never
+ *          indefinitely.
+ */
+extern struct k_work_q appWorkQ;
+
+#endif
@@ -24,18 +24,36 @@
 #include <sys/__assert.h>
 #include <assert.h>
 #include <drivers/uart.h>
+#include <drivers/gpio.h>
+#include <drivers/pinctrl.h>
 #include <device.h>
 #include <drivers/sensor.h>
 #include <pm/pm.h>
 #include <pm/device.h>
 #include <sys/reboot.h>
+#include <sys/base64.h>
 #include "bt_util.h"
 #include "storage.h"
 #include "version_config.h"
 #include <logging/log.h>
 #include "bt_adv.h"
 #include "at_host.h"
-#include "sensors.h"
+#include "self_test.h"
+#include "boot_profile.h"
+#include "app_work.h"
+#include "mem_stats.h"
+#ifdef CONFIG_TRACING_USER
+#include "wakeup_trace.h"
+#endif
+#include "energy.h"
+#include "budget.h"
+#include "journal.h"
+#ifdef CONFIG_BENCH
+#include "bench.h"
+#endif
+#ifdef CONFIG_LOG_RING
+#include "log_ring.h"
+#endif
 
 LOG_MODULE_REGISTER(at_host, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
 
@@ -46,19 +64,60 @@ LOG_MODULE_REGISTER(at_host, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
 #define OK_STR          "\r\nOK\r\n"
 #define ERROR_STR       "\r\nERROR\r\n"
 
+#define AT_UART_NODE                DT_NODELABEL(uart0)
+#define UART_DEFAULT_BAUDRATE       115200
+#define UART_START_TIMEOUT_MS       1000
+#define UART_START_RETRY_MS         10
+// Time the host has to send a valid command at the new baud rate before we revert.
+#define UART_CFG_CONFIRM_TIMEOUT_MS 5000
+// Let the OK response leave the TX shift register before switching baud rate.
+#define UART_CFG_SWITCH_DELAY_MS    10
+// RTS/CTS can only be switched on when the board routes the pins, see hw-flow-control in the dts
+#define UART_HAS_RTS_CTS            DT_PROP(AT_UART_NODE, hw_flow_control)
+// Must leave room for the host to confirm a baud rate switch
+#define AT_UART_IDLE_TIMEOUT_MIN_MS UART_CFG_CONFIRM_TIMEOUT_MS
+// RX polling period when the UART driver has no async API (native_posix)
+#define UART_RX_POLL_INTERVAL_MS    10
+#if defined(CONFIG_SOC_FAMILY_NRF) && defined(CONFIG_CPU_CORTEX_M)
+// RX pin of the AT UART as port * 32 + pin, taken from its default pinctrl state
+#define AT_UART_RX_PSEL(node, prop, idx) \
+    (NRF_GET_FUN(DT_PROP_BY_IDX(node, prop, idx)) == NRF_FUN_UART_RX) ? \
+    NRF_GET_PIN(DT_PROP_BY_IDX(node, prop, idx)) :
+#define AT_UART_RX_GROUP(group)     DT_FOREACH_PROP_ELEM(group, psels, AT_UART_RX_PSEL)
+#define AT_UART_RX_PIN \
+    (DT_FOREACH_CHILD(DT_PINCTRL_BY_NAME(AT_UART_NODE, default, 0), AT_UART_RX_GROUP) -1)
+BUILD_ASSERT(AT_UART_RX_PIN >= 0, "No RX pin in the AT UART pinctrl");
+#endif
+// Log bytes per +LOG line, as hex
+#define AT_LOG_LINE_BYTES           40
+// Journal records per +JOURNAL line, 48 bytes as 64 base64 characters
+#define AT_JOURNAL_LINE_RECORDS     3
+
 static void resetUartAtBuffer(void);
 static void sendString(char *str);
 
-static bool testLis2dw(void);
-static bool testBme280(void);
-static bool testApds(void);
+static void outputSelfTestReport(const selfTestReport_t *pReport, atOutput outputRsp);
 
 static void uartCallback(const struct device *dev, struct uart_event *evt, void *user_data);
 static void doCommandWork(struct k_work *work);
 
 static void disableAtUartModeTimerCallback(struct k_timer *unused);
+static void uartCfgFallbackTimerCallback(struct k_timer *unused);
 void disableAtUartMode(struct k_work *item);
 void restartUartRxAfterError(struct k_work *item);
+static void uartCfgFallback(struct k_work *item);
+static void wakeAtUartMode(struct k_work *item);
+static void uartRxPinWakeIsr(const struct device *dev, struct gpio_callback *cb, uint32_t pins);
+static void armUartRxPinWake(void);
+static void uartStartWorkHandler(struct k_work *item);
+static void enableUartRx(void);
+static void applyPendingUartCfg(void);
+static int uartRxStart(void);
+static int uartRxStop(void);
+static void uartRxPollWorkHandler(struct k_work *item);
+static void intervalDoneCb(uint16_t minMs, uint16_t maxMs, int err, void *pUserData);
+static void advIntDoneWorkHandler(struct k_work *item);
+static void budgetDoneWorkHandler(struct k_work *item);
 
 extern const char ubxVersionString[];
 
@@ -70,103 +129,308 @@ static size_t atBufLen;
 static struct k_work handleCommandWork;
 static struct k_work cancelUartAtWork;
 static struct k_work restartRxWork;
+static struct k_work uartCfgFallbackWork;
+static struct k_work uartWakeWork;
 static int uartErr = false;
 
 static const struct device *pUartDev;
 
-static const struct uart_config uart_cfg = {
-    .baudrate = 115200,
+static struct uart_config uart_cfg = {
+    .baudrate = UART_DEFAULT_BAUDRATE,
     .parity = UART_CFG_PARITY_NONE,
     .stop_bits = UART_CFG_STOP_BITS_1,
     .data_bits = UART_CFG_DATA_BITS_8,
     .flow_ctrl = UART_CFG_FLOW_CTRL_NONE
 };
 
+// Last confirmed UART config, restored if the host never talks to us at the new one.
+static struct uart_config uartCfgConfirmed;
+static struct uart_config uartCfgPending;
+static bool uartCfgSwitchPending;
+static bool uartCfgAwaitingConfirm;
+
+static uint32_t uartIdleTimeoutMs;
+static bool uartSuspended;
+static int64_t uartResumedAtMs;
+static int64_t uartOnTimeMs;
+static uint32_t uartWakeCount;
+
+// RX pin is sensed as a GPIO while the UART is suspended
+static const struct device *pUartRxPort;
+static gpio_pin_t uartRxPin;
+static struct gpio_callback uartRxPinCallbackData;
+
+static uint32_t uartStartTime;
+K_WORK_DELAYABLE_DEFINE(uartStartWork, uartStartWorkHandler);
+
+static bool uartRxPolling;
+K_WORK_DELAYABLE_DEFINE(uartRxPollWork, uartRxPollWorkHandler);
+
+// AT+ADVINT and AT+BUDGET return once the interval is posted, the settings are stored by these
+// works when the advertising thread reports that the interval is in use
+struct intervalDone_t {
+    struct k_work *pWork;
+    uint16_t intervalMs;
+    int err;
+};
+K_WORK_DEFINE(advIntDoneWork, advIntDoneWorkHandler);
+K_WORK_DEFINE(budgetDoneWork, budgetDoneWorkHandler);
+static struct intervalDone_t advIntDone = {.pWork = &advIntDoneWork};
+static struct intervalDone_t budgetDone = {.pWork = &budgetDoneWork};
+// Settings of the last AT+BUDGET, only used on the application work queue
+static budgetResult_t budgetApplied;
+
 K_TIMER_DEFINE(disableAtUartModeTimer, disableAtUartModeTimerCallback, NULL);
+K_TIMER_DEFINE(uartCfgFallbackTimer, uartCfgFallbackTimerCallback, NULL);
 
 int atHostStart(void)
 {
-    int err;
-    uint32_t start_time;
+    pUartDev = DEVICE_DT_GET_OR_NULL(AT_UART_NODE);
+    uartIdleTimeoutMs = storageGetConfig()->uartIdleTimeoutMs;
 
-    pUartDev = DEVICE_DT_GET_OR_NULL(DT_NODELABEL(uart0));
+    // RX and the timers can submit these as soon as RX is started
+    k_work_init(&handleCommandWork, doCommandWork);
+    k_work_init(&cancelUartAtWork, disableAtUartMode);
+    k_work_init(&restartRxWork, restartUartRxAfterError);
+    k_work_init(&uartCfgFallbackWork, uartCfgFallback);
+    k_work_init(&uartWakeWork, wakeAtUartMode);
 
     if (!device_is_ready(pUartDev)) {
         LOG_ERR("Cannot get UART device");
         return -EFAULT;
     }
 
+    // Waiting for the line to become valid must not hold up the rest of the boot
+    uartStartTime = k_uptime_get_32();
+    k_work_schedule_for_queue(&appWorkQ, &uartStartWork, K_NO_WAIT);
+
+    return 0;
+}
+
+static void uartStartWorkHandler(struct k_work *item)
+{
+    int err;
+
     /* Wait for the UART line to become valid */
-    start_time = k_uptime_get_32();
-    do {
-        err = uart_err_check(pUartDev);
-        if (err) {
-            if (k_uptime_get_32() - start_time > 1000) {
-                LOG_ERR("UART check failed: %d. "
-                        "UART initialization timed out.", err);
-                return -EIO;
-            }
+    err = uart_err_check(pUartDev);
+    if (err && err != -ENOSYS) {
+        if (k_uptime_get_32() - uartStartTime > UART_START_TIMEOUT_MS) {
+            LOG_ERR("UART check failed: %d. "
+                    "UART initialization timed out.", err);
+        } else {
+            k_work_schedule_for_queue(&appWorkQ, &uartStartWork, K_MSEC(UART_START_RETRY_MS));
         }
-    } while (err);
+        return;
+    }
 
-    err = uart_callback_set(pUartDev, &uartCallback, NULL);
-    if (err) {
-        LOG_ERR("Cannot set callback: %d", err);
-        return -EFAULT;
+    if (IS_ENABLED(CONFIG_UART_ASYNC_API)) {
+        err = uart_callback_set(pUartDev, &uartCallback, NULL);
+        if (err) {
+            LOG_ERR("Cannot set callback: %d", err);
+            return;
+        }
     }
 
     pm_device_action_run(pUartDev, PM_DEVICE_ACTION_RESUME);
 
-    err = uart_rx_enable(pUartDev, uartRxBuf[0], sizeof(uartRxBuf[0]), UART_RX_TIMEOUT);
+    err = uartRxStart();
     if (err) {
         LOG_ERR("Cannot enable rx: %d", err);
-        return -EFAULT;
+        return;
     }
 
     resetUartAtBuffer();
 
     err = uart_configure(pUartDev, &uart_cfg);
 
-    if (err == 0) {
-        k_work_init(&handleCommandWork, doCommandWork);
-        k_work_init(&cancelUartAtWork, disableAtUartMode);
-        k_work_init(&restartRxWork, restartUartRxAfterError);
-        k_timer_start(&disableAtUartModeTimer, K_SECONDS(10), K_NO_WAIT);
+    // The native_posix pty has no line settings
+    if (err == 0 || err == -ENOSYS) {
+        uartCfgConfirmed = uart_cfg;
+        uartResumedAtMs = k_uptime_get();
+        k_timer_start(&disableAtUartModeTimer, K_MSEC(uartIdleTimeoutMs), K_NO_WAIT);
     } else {
         LOG_ERR("uart_configure failed: %d", err);
-        return -EFAULT;
+        return;
     }
 
+#if defined(CONFIG_SOC_FAMILY_NRF) && defined(CONFIG_CPU_CORTEX_M)
+    uartRxPin = AT_UART_RX_PIN % 32;
+#if DT_NODE_HAS_STATUS(DT_NODELABEL(gpio1), okay)
+    pUartRxPort = (AT_UART_RX_PIN / 32) ? DEVICE_DT_GET(DT_NODELABEL(gpio1)) :
+                  DEVICE_DT_GET(DT_NODELABEL(gpio0));
+#else
+    pUartRxPort = DEVICE_DT_GET(DT_NODELABEL(gpio0));
+#endif
+    gpio_init_callback(&uartRxPinCallbackData, uartRxPinWakeIsr, BIT(uartRxPin));
+    gpio_add_callback(pUartRxPort, &uartRxPinCallbackData);
+#endif
 
-    return err;
+    bootProfileMark(BOOT_STAGE_UART);
 }
 
 void disableAtUartMode(struct k_work *item)
 {
     int err;
-    LOG_DBG("Exit AT over UART mode, disabling UART\n");
-    err = uart_rx_disable(pUartDev);
+
+    // Suspending needs the RX pin wake, which only exists on the nRF
+    if (uartSuspended || pUartRxPort == NULL) {
+        return;
+    }
+    LOG_DBG("UART idle, suspending until RX activity\n");
+    err = uartRxStop();
     if (err) {
         LOG_ERR("disableAtUartMode failed to stop rx, err: %d. Trying to disabe anyway.", err);
     }
     k_sleep(K_MSEC(100));
+
+    // An unconfirmed baud rate switch is not kept over a suspend
+    if (uartCfgAwaitingConfirm) {
+        k_timer_stop(&uartCfgFallbackTimer);
+        uartCfgAwaitingConfirm = false;
+        uart_cfg = uartCfgConfirmed;
+        uart_configure(pUartDev, &uart_cfg);
+    }
+
     err = pm_device_action_run(pUartDev, PM_DEVICE_ACTION_SUSPEND);
     if (err) {
         LOG_ERR("Can't power off uart: %d", err);
+        enableUartRx();
+        return;
     }
+    uartSuspended = true;
+    uartOnTimeMs += k_uptime_get() - uartResumedAtMs;
+    armUartRxPinWake();
+}
+
+static void armUartRxPinWake(void)
+{
+    int err;
+
+    // Level sensing uses the GPIO SENSE mechanism which, unlike edge detection, costs no
+    // current while waiting. The idle line is high, the start bit pulls it low.
+    err = gpio_pin_configure(pUartRxPort, uartRxPin, GPIO_INPUT | GPIO_PULL_UP);
+    if (err == 0) {
+        err = gpio_pin_interrupt_configure(pUartRxPort, uartRxPin, GPIO_INT_LEVEL_LOW);
+    }
+    if (err) {
+        LOG_ERR("Can't arm UART wake on RX pin: %d", err);
+    }
+}
+
+static void uartRxPinWakeIsr(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+    // Level interrupt keeps firing while the line is low
+    gpio_pin_interrupt_configure(pUartRxPort, uartRxPin, GPIO_INT_DISABLE);
+    k_work_submit_to_queue(&appWorkQ, &uartWakeWork);
+}
+
+static void wakeAtUartMode(struct k_work *item)
+{
+    int err;
+
+    if (!uartSuspended) {
+        return;
+    }
+    // Resuming reapplies the UART pinctrl state to the RX pin
+    err = pm_device_action_run(pUartDev, PM_DEVICE_ACTION_RESUME);
+    if (err) {
+        LOG_ERR("Can't resume uart: %d", err);
+        armUartRxPinWake();
+        return;
+    }
+    uartSuspended = false;
+    uartWakeCount++;
+    uartResumedAtMs = k_uptime_get();
+    LOG_DBG("UART woken by RX activity");
+
+    resetUartAtBuffer();
+    enableUartRx();
+    k_timer_start(&disableAtUartModeTimer, K_MSEC(uartIdleTimeoutMs), K_NO_WAIT);
+}
+
+uint32_t atHostGetUartOnTimeMs(void)
+{
+    int64_t onTime = uartOnTimeMs;
+
+    if (!uartSuspended) {
+        onTime += k_uptime_get() - uartResumedAtMs;
+    }
+
+    return (uint32_t)onTime;
 }
 
 static void disableAtUartModeTimerCallback(struct k_timer *unused)
 {
     // Cannot disable inside of an ISR
-    k_work_submit(&cancelUartAtWork);
+    k_work_submit_to_queue(&appWorkQ, &cancelUartAtWork);
+}
+
+static void uartCfgFallbackTimerCallback(struct k_timer *unused)
+{
+    // Cannot reconfigure inside of an ISR
+    k_work_submit_to_queue(&appWorkQ, &uartCfgFallbackWork);
+}
+
+static void uartCfgFallback(struct k_work *item)
+{
+    int err;
+
+    if (!uartCfgAwaitingConfirm) {
+        return;
+    }
+    uartCfgAwaitingConfirm = false;
+    LOG_WRN("No valid command at %d baud, reverting to %d", uart_cfg.baudrate,
+            uartCfgConfirmed.baudrate);
+
+    uartRxStop();
+    k_sleep(K_MSEC(UART_CFG_SWITCH_DELAY_MS));
+    uart_cfg = uartCfgConfirmed;
+    err = uart_configure(pUartDev, &uart_cfg);
+    if (err) {
+        LOG_ERR("Reverting UART config failed: %d", err);
+    }
+    resetUartAtBuffer();
+    enableUartRx();
+}
+
+static void applyPendingUartCfg(void)
+{
+    int err;
+
+    if (!uartCfgSwitchPending) {
+        return;
+    }
+    uartCfgSwitchPending = false;
+
+    // RX is already stopped here, wait for the OK to be shifted out at the old rate
+    k_sleep(K_MSEC(UART_CFG_SWITCH_DELAY_MS));
+    err = uart_configure(pUartDev, &uartCfgPending);
+    if (err) {
+        LOG_ERR("uart_configure failed: %d, keeping %d baud", err, uart_cfg.baudrate);
+        uart_configure(pUartDev, &uart_cfg);
+        return;
+    }
+    uart_cfg = uartCfgPending;
+    uartCfgAwaitingConfirm = true;
+    k_timer_start(&uartCfgFallbackTimer, K_MSEC(UART_CFG_CONFIRM_TIMEOUT_MS), K_NO_WAIT);
+    LOG_INF("UART switched to %d baud, flow control %d", uart_cfg.baudrate, uart_cfg.flow_ctrl);
+}
+
+static void confirmUartCfg(void)
+{
+    if (uartCfgAwaitingConfirm) {
+        k_timer_stop(&uartCfgFallbackTimer);
+        uartCfgAwaitingConfirm = false;
+        uartCfgConfirmed = uart_cfg;
+        LOG_INF("UART config %d baud confirmed", uart_cfg.baudrate);
+    }
 }
 
 void restartUartRxAfterError(struct k_work *item)
 {
     LOG_INF("restartUartRxAfterError");
     int err = 1;
-    err = uart_rx_enable(pUartDev, uartRxBuf[0], sizeof(uartRxBuf[0]), UART_RX_TIMEOUT);
+    err = uartRxStart();
     if (err) {
         LOG_ERR("UART RX failed: %d", err);
     }
@@ -175,9 +439,10 @@ void restartUartRxAfterError(struct k_work *item)
 
 static void uartRxHandler(uint8_t character)
 {
+    k_timer_start(&disableAtUartModeTimer, K_MSEC(uartIdleTimeoutMs), K_NO_WAIT);
     if (character == '\r' || atBufLen > AT_MAX_CMD_LEN) {
-        uart_rx_disable(pUartDev);
-        k_work_submit(&handleCommandWork);
+        uartRxStop();
+        k_work_submit_to_queue(&appWorkQ, &handleCommandWork);
     } else {
         atBuf[atBufLen] = character;
         atBufLen += 1;
@@ -185,6 +450,88 @@ static void uartRxHandler(uint8_t character)
     }
 }
 
+// Solve for the settings that last the given time and apply them, they are stored by
+// budgetDoneWorkHandler
+static bool applyBudget(long days, long capacityMah, char *outBuf)
+{
+    energyStats_t energy;
+    energyAdvState_t advState;
+    budgetResult_t result;
+    budgetInput_t in = {
+        .targetHours = days * 24,
+        .capacityMah = capacityMah,
+        .extIntervalMinMs = CONFIG_EXT_ADV_INT_MS_MIN,
+        .extIntervalMaxMs = CONFIG_EXT_ADV_INT_MS_MAX,
+        // The number of CTEs per event is fixed in bt_adv.c
+        .cteCountMax = 1,
+    };
+
+    energyGet(&energy);
+    energyGetAdvState(&advState);
+    in.consumedUah = energy.totalUah;
+    in.otherCurrentNa = energy.otherCurrentUa * 1000;
+    in.extPayloadLen = advState.extPayloadLen;
+    in.perPayloadLen = advState.perPayloadLen;
+
+    if (!budgetSolve(&in, &result)) {
+        return false;
+    }
+    // Both or neither, a failure on the advertising thread is undone by budgetDoneWorkHandler
+    if (!btAdvRadioParamsValid(result.extIntervalMs, result.cteLen) ||
+        !btAdvIntervalValid(result.perIntervalMs, result.perIntervalMs)) {
+        return false;
+    }
+    btAdvSetRadioParams(result.extIntervalMs, result.cteLen, result.txPower);
+    btAdvUpdateAdvInterval(result.perIntervalMs, result.perIntervalMs, intervalDoneCb,
+                           &budgetDone);
+    budgetApplied = result;
+
+    sprintf(outBuf, "\r\n+BUDGET:%u,%u,%u,%u,%d,%u,%u", result.perIntervalMs,
+            result.extIntervalMs, result.cteLen, result.cteCount, result.txPower,
+            result.avgCurrentNa / 1000, result.lifeHours / 24);
+
+    return true;
+}
+
+// Called by the advertising thread
+static void intervalDoneCb(uint16_t minMs, uint16_t maxMs, int err, void *pUserData)
+{
+    struct intervalDone_t *pDone = pUserData;
+
+    pDone->intervalMs = minMs;
+    pDone->err = err;
+    k_work_submit_to_queue(&appWorkQ, pDone->pWork);
+}
+
+static void advIntDoneWorkHandler(struct k_work *item)
+{
+    uint16_t intervalMs = advIntDone.intervalMs;
+
+    if (advIntDone.err) {
+        LOG_ERR("Per adv interval %u not set (err %d)", intervalMs, advIntDone.err);
+        return;
+    }
+    storageWrite(STORAGE_PER_ADV_INTERVAL, &intervalMs, sizeof(intervalMs));
+}
+
+static void budgetDoneWorkHandler(struct k_work *item)
+{
+    const storageConfig_t *pConfig = storageGetConfig();
+
+    if (budgetDone.err) {
+        // Neither is kept, back to the stored radio parameters
+        LOG_ERR("Budget interval %u not set (err %d)", budgetDone.intervalMs, budgetDone.err);
+        btAdvSetRadioParams(pConfig->extAdvIntervalMs, pConfig->cteLen, pConfig->txPower);
+        return;
+    }
+    storageWrite(STORAGE_PER_ADV_INTERVAL, &budgetApplied.perIntervalMs,
+                 sizeof(budgetApplied.perIntervalMs));
+    storageWrite(STORAGE_EXT_ADV_INTERVAL, &budgetApplied.extIntervalMs,
+                 sizeof(budgetApplied.extIntervalMs));
+    storageWrite(STORAGE_CTE_LEN, &budgetApplied.cteLen, sizeof(budgetApplied.cteLen));
+    storageWrite(STORAGE_TX_POWER, &budgetApplied.txPower, sizeof(budgetApplied.txPower));
+}
+
 static int validTxPowers(long txPower)
 {
     int error = -EINVAL;
@@ -213,10 +560,37 @@ static int validTxPowers(long txPower)
     return error;
 }
 
+static int validBaudrates(long baudrate)
+{
+    int error = -EINVAL;
+
+    // Baud rates supported by the nRF52 UARTE
+    switch (baudrate) {
+        case 9600:
+        case 14400:
+        case 19200:
+        case 28800:
+        case 38400:
+        case 57600:
+        case 76800:
+        case 115200:
+        case 230400:
+        case 250000:
+        case 460800:
+        case 921600:
+        case 1000000:
+            error = 0;
+        default:
+            break;
+    }
+
+    return error;
+}
+
 bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOutput outputRsp)
 {
     bool validCommand = true;
-    char outBuf[100];
+    char outBuf[128];
     memset(outBuf, 0, sizeof(outBuf));
 
     if (strncmp("ATI9", inAtBuf, 4) == 0 && commandLen == 4) {
@@ -245,23 +619,15 @@ bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOu
         outputRsp(outBuf);
         outputRsp("OK\r\n");
     } else if (strncmp("AT+TEST", inAtBuf, 7) == 0 && commandLen == 7) {
-        bool ok = true;
-        if (!testLis2dw()) {
-            ok = false;
-            outputRsp("\r\nLIS_ERROR\r\n");
-        }
-        if (!testBme280()) {
-            ok = false;
-            outputRsp("\r\nBME_ERROR\r\n");
-        }
-        if (!testApds()) {
-            ok = false;
-            outputRsp("\r\nAPDS_ERROR\r\n");
-        }
-
-        if (ok) {
-            outputRsp(OK_STR);
+        selfTestReport_t report;
+        selfTestRun(&report);
+        outputSelfTestReport(&report, outputRsp);
+    } else if (strncmp("AT+TEST?", inAtBuf, 8) == 0 && commandLen == 8) {
+        selfTestReport_t report;
+        if (selfTestGetLastReport(&report)) {
+            outputSelfTestReport(&report, outputRsp);
         } else {
+            validCommand = false;
             outputRsp(ERROR_STR);
         }
     } else if (strncmp("AT", inAtBuf, 2) == 0 && commandLen == 2) {
@@ -270,6 +636,9 @@ bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOu
         outputRsp("\r\n\"NINA-B4-TAG\"\r\n");
         outputRsp("OK\r\n");
     } else if (strncmp("AT+CPWROFF", inAtBuf, 10) == 0 && commandLen == 10) {
+        journalRecord(JOURNAL_EVT_REBOOT, 0, 0);
+        journalFlush();
+        storageFlush();
         outputRsp(OK_STR);
         k_sleep(K_MSEC(200));
         sys_reboot(SYS_REBOOT_WARM);
@@ -283,6 +652,92 @@ bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOu
             validCommand = false;
             outputRsp(ERROR_STR);
         }
+    } else if (strncmp("AT+NAMESPACE=", inAtBuf, 13) == 0 &&
+               commandLen == 13 + STORAGE_NAMESPACE_LEN) {
+        storageWrite(STORAGE_NAMESPACE, &inAtBuf[13], STORAGE_NAMESPACE_LEN);
+        outputRsp(OK_STR);
+    } else if (strncmp("AT+NAMESPACE?", inAtBuf, 13) == 0 && commandLen == 13) {
+        sprintf(outBuf, "\r\n+NAMESPACE:%.*s\r\n", STORAGE_NAMESPACE_LEN,
+                storageGetConfig()->groupNamespace);
+        outputRsp(outBuf);
+        outputRsp("OK\r\n");
+    } else if (strncmp("AT+STORSTAT?", inAtBuf, 12) == 0 && commandLen == 12) {
+        storageStats_t stats;
+        storageGetStats(&stats);
+        sprintf(outBuf, "\r\n+STORSTAT:%u,%u,%u,%u,%u,%d\r\n", stats.nvsWrites,
+                stats.bytesWritten, stats.skippedWrites, stats.coalescedWrites, stats.gcCount,
+                stats.freeBytes);
+        outputRsp(outBuf);
+        outputRsp("OK\r\n");
+    } else if (strncmp("AT+BOOT?", inAtBuf, 8) == 0 && commandLen == 8) {
+        // One line per stage: +BOOT:<stage>,<us since kernel start>, 0 if not reached
+        for (int i = 0; i < BOOT_STAGE_END; i++) {
+            sprintf(outBuf, "\r\n+BOOT:%s,%u", bootProfileStageName(i), bootProfileGetUs(i));
+            outputRsp(outBuf);
+        }
+        outputRsp(OK_STR);
+    } else if (strncmp("AT+BTSTAT?", inAtBuf, 10) == 0 && commandLen == 10) {
+        btAdvStats_t stats;
+        btAdvGetStats(&stats);
+        sprintf(outBuf, "\r\n+BTSTAT:%u,%u,%u,%u,%u,%u,%u,%u,%u\r\n", stats.requests,
+                stats.coalesced, stats.batches, stats.maxQueueDepth, stats.hciCalls,
+                stats.hciErrors, stats.hciCalls ? (uint32_t)(stats.hciTotalUs / stats.hciCalls) : 0,
+                stats.hciMaxUs, stats.intervalErrors);
+        outputRsp(outBuf);
+        outputRsp("OK\r\n");
+    } else if (strncmp("AT+MEM?", inAtBuf, 7) == 0 && commandLen == 7) {
+        memThreadStats_t threads[MEM_STATS_MAX_THREADS];
+        memBufPoolStats_t pools[MEM_STATS_MAX_BUF_POOLS];
+        memHeapStats_t heap;
+        int num;
+
+        num = memStatsGetThreads(threads, ARRAY_SIZE(threads));
+        for (int i = 0; i < num; i++) {
+            sprintf(outBuf, "\r\n+MEMSTACK:%s,%u,%u", threads[i].name, threads[i].size,
+                    threads[i].used);
+            outputRsp(outBuf);
+        }
+        num = memStatsGetBufPools(pools, ARRAY_SIZE(pools));
+        for (int i = 0; i < num; i++) {
+            sprintf(outBuf, "\r\n+MEMBUF:%s,%u,%u,%u", pools[i].name ? pools[i].name : "?",
+                    pools[i].size, pools[i].used, pools[i].peak);
+            outputRsp(outBuf);
+        }
+        memStatsGetHeap(&heap);
+        sprintf(outBuf, "\r\n+MEMHEAP:%u,%u,%u", heap.size, heap.used, heap.peak);
+        outputRsp(outBuf);
+        outputRsp(OK_STR);
+#ifdef CONFIG_TRACING_USER
+    } else if (strncmp("AT+WAKE?", inAtBuf, 8) == 0 && commandLen == 8) {
+        wakeupTraceStats_t stats;
+        wakeupTraceGet(&stats);
+        for (int i = 0; i < WAKEUP_SRC_END; i++) {
+            sprintf(outBuf, "\r\n+WAKE:%s,%u", wakeupTraceSourceName(i), stats.wakeups[i]);
+            outputRsp(outBuf);
+        }
+        sprintf(outBuf, "\r\n+WAKEIDLE:%u,%u", stats.periodMs, stats.idlePermille);
+        outputRsp(outBuf);
+        for (int i = 0; i < WAKEUP_TRACE_NUM_BURSTS && stats.bursts[i].durationUs > 0; i++) {
+            sprintf(outBuf, "\r\n+WAKEBURST:%u,%s,%u", stats.bursts[i].durationUs,
+                    wakeupTraceSourceName(stats.bursts[i].source), stats.bursts[i].uptimeMs);
+            outputRsp(outBuf);
+        }
+        outputRsp(OK_STR);
+    } else if (strncmp("AT+WAKE=0", inAtBuf, 9) == 0 && commandLen == 9) {
+        wakeupTraceReset();
+        outputRsp(OK_STR);
+#endif
+    } else if (strncmp("AT+ENERGY?", inAtBuf, 10) == 0 && commandLen == 10) {
+        energyStats_t stats;
+        energyGet(&stats);
+        for (int i = 0; i < ENERGY_END; i++) {
+            sprintf(outBuf, "\r\n+ENERGY:%s,%u", energyConsumerName(i), stats.consumedUah[i]);
+            outputRsp(outBuf);
+        }
+        sprintf(outBuf, "\r\n+ENERGYLIFE:%u,%u,%u,%u", stats.totalUah, stats.avgCurrentUa,
+                CONFIG_BATTERY_CAPACITY_MAH, stats.remainingHours);
+        outputRsp(outBuf);
+        outputRsp(OK_STR);
     } else if (strncmp("AT+TXPWR?", inAtBuf, 9) == 0 && commandLen == 9) {
         int8_t pwr;
         storageGetTxPower(&pwr);
@@ -293,11 +748,14 @@ bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOu
         errno = 0;
         long enable = strtol(&inAtBuf[13], NULL, 10);
         if (errno == 0) {
+            uint8_t advEnable = enable;
             if (enable == 0) {
                 btAdvStop();
+                storageWrite(STORAGE_ADV_ENABLE, &advEnable, sizeof(advEnable));
                 outputRsp(OK_STR);
             } else if (enable == 1) {
                 btAdvStart();
+                storageWrite(STORAGE_ADV_ENABLE, &advEnable, sizeof(advEnable));
                 outputRsp(OK_STR);
             } else {
                 outputRsp(ERROR_STR);
@@ -310,8 +768,9 @@ bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOu
     } else if (strncmp("AT+ADVINT=", inAtBuf, 9) == 0 && commandLen > 9) {
         errno = 0;
         long advInt = strtol(&inAtBuf[10], NULL, 10);
-        if (errno == 0) {
-            if (!btAdvUpdateAdvInterval(advInt, advInt)) {
+        uint16_t perAdvInterval = advInt;
+        if (errno == 0 && advInt == perAdvInterval) {
+            if (!btAdvUpdateAdvInterval(advInt, advInt, intervalDoneCb, &advIntDone)) {
                 validCommand = false;
             }
         } else {
@@ -322,6 +781,195 @@ bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOu
         } else {
             outputRsp(ERROR_STR);
         }
+    } else if (strncmp("AT+BUDGET=", inAtBuf, 10) == 0 && commandLen > 10) {
+        char *pEnd;
+        long capacity = CONFIG_BATTERY_CAPACITY_MAH;
+        errno = 0;
+        long days = strtol(&inAtBuf[10], &pEnd, 10);
+        if (errno == 0 && *pEnd == ',') {
+            capacity = strtol(pEnd + 1, &pEnd, 10);
+        }
+        if (errno == 0 && *pEnd == '\0' && days > 0 && days <= 36500 && capacity > 0 &&
+            capacity <= 100000 && applyBudget(days, capacity, outBuf)) {
+            outputRsp(outBuf);
+            outputRsp(OK_STR);
+        } else {
+            validCommand = false;
+            outputRsp(ERROR_STR);
+        }
+    } else if (strncmp("AT+UMRS=", inAtBuf, 8) == 0 && commandLen > 8) {
+        char *pEnd;
+        long flowControl = 0;
+        errno = 0;
+        long baudrate = strtol(&inAtBuf[8], &pEnd, 10);
+        if (errno == 0 && *pEnd == ',') {
+            flowControl = strtol(pEnd + 1, &pEnd, 10);
+        }
+        if (flowControl == 1 && !UART_HAS_RTS_CTS) {
+            LOG_WRN("No RTS/CTS pins on uart0, flow control not supported");
+            flowControl = -1;
+        }
+        // Only the UART itself can be switched, and the host must answer on it to confirm
+        if (errno == 0 && *pEnd == '\0' && validBaudrates(baudrate) == 0 &&
+            (flowControl == 0 || flowControl == 1) && outputRsp == sendString) {
+            uartCfgPending = uart_cfg;
+            uartCfgPending.baudrate = baudrate;
+            uartCfgPending.flow_ctrl = flowControl ? UART_CFG_FLOW_CTRL_RTS_CTS :
+                                       UART_CFG_FLOW_CTRL_NONE;
+            uartCfgSwitchPending = true;
+            outputRsp(OK_STR);
+        } else {
+            validCommand = false;
+            outputRsp(ERROR_STR);
+        }
+    } else if (strncmp("AT+UMRS?", inAtBuf, 8) == 0 && commandLen == 8) {
+        sprintf(outBuf, "\r\n+UMRS:%d,%d\r\n", uart_cfg.baudrate,
+                uart_cfg.flow_ctrl == UART_CFG_FLOW_CTRL_RTS_CTS ? 1 : 0);
+        outputRsp(outBuf);
+        outputRsp("OK\r\n");
+    } else if (strncmp("AT+UIDLE=", inAtBuf, 9) == 0 && commandLen > 9) {
+        char *pEnd;
+        errno = 0;
+        long timeout = strtol(&inAtBuf[9], &pEnd, 10);
+        uint32_t idleTimeout = timeout;
+        if (errno == 0 && *pEnd == '\0' && timeout >= AT_UART_IDLE_TIMEOUT_MIN_MS &&
+            storageWrite(STORAGE_UART_IDLE_TIMEOUT, &idleTimeout, sizeof(idleTimeout)) == 0) {
+            uartIdleTimeoutMs = idleTimeout;
+            if (!uartSuspended) {
+                k_timer_start(&disableAtUartModeTimer, K_MSEC(uartIdleTimeoutMs), K_NO_WAIT);
+            }
+            outputRsp(OK_STR);
+        } else {
+            validCommand = false;
+            outputRsp(ERROR_STR);
+        }
+    } else if (strncmp("AT+UIDLE?", inAtBuf, 9) == 0 && commandLen == 9) {
+        sprintf(outBuf, "\r\n+UIDLE:%u,%u,%u\r\n", uartIdleTimeoutMs, atHostGetUartOnTimeMs(),
+                uartWakeCount);
+        outputRsp(outBuf);
+        outputRsp("OK\r\n");
+    } else if (strncmp("AT+JOURNAL?", inAtBuf, 11) == 0 && commandLen == 11) {
+        journalRecord_t records[AT_JOURNAL_LINE_RECORDS];
+        journalStats_t stats;
+        size_t olen;
+        int count;
+
+        // The pending records are part of the dump
+        journalFlush();
+        journalGetStats(&stats);
+        sprintf(outBuf, "\r\n+JOURNALSTAT:%u,%u,%u,%u,%u,%u,%u", stats.records, stats.capacity,
+                stats.pending, stats.boot, stats.bytesWritten, stats.erases, stats.dropped);
+        outputRsp(outBuf);
+        for (uint32_t i = 0; (count = journalRead(i, records, ARRAY_SIZE(records))) > 0;
+             i += count) {
+            strcpy(outBuf, "\r\n+JOURNAL:");
+            base64_encode(&outBuf[strlen(outBuf)], sizeof(outBuf) - strlen(outBuf), &olen,
+                          (const uint8_t *)records, count * sizeof(journalRecord_t));
+            outputRsp(outBuf);
+        }
+        if (count == 0) {
+            outputRsp(OK_STR);
+        } else {
+            validCommand = false;
+            outputRsp(ERROR_STR);
+        }
+    } else if (strncmp("AT+JOURNAL=0", inAtBuf, 12) == 0 && commandLen == 12) {
+        if (journalClear() == 0) {
+            outputRsp(OK_STR);
+        } else {
+            validCommand = false;
+            outputRsp(ERROR_STR);
+        }
+#ifdef CONFIG_LOG_RING
+    } else if (strncmp("AT+LOG?", inAtBuf, 7) == 0 && commandLen == 7) {
+        uint8_t record[LOG_RING_RECORD_MAX];
+        logRingStats_t stats;
+        size_t len;
+
+        logRingGetStats(&stats);
+        sprintf(outBuf, "\r\n+LOGSTAT:%u,%u,%u,%u,%u", stats.records, stats.used, stats.size,
+                stats.overwritten, stats.dropped);
+        outputRsp(outBuf);
+        // Reading empties the ring, messages logged meanwhile are left for the next read
+        for (uint32_t i = 0; i < stats.records && (len = logRingGet(record)) > 0; i++) {
+            for (size_t pos = 0; pos < len; pos += AT_LOG_LINE_BYTES) {
+                size_t n = MIN(len - pos, AT_LOG_LINE_BYTES);
+
+                strcpy(outBuf, "\r\n+LOG:");
+                bin2hex(&record[pos], n, &outBuf[strlen(outBuf)], 2 * n + 1);
+                outputRsp(outBuf);
+            }
+        }
+        outputRsp(OK_STR);
+    } else if (strncmp("AT+LOG=0", inAtBuf, 8) == 0 && commandLen == 8) {
+        logRingClear();
+        outputRsp(OK_STR);
+    } else if (strncmp("AT+LOGLVL?", inAtBuf, 10) == 0 && commandLen == 10) {
+        for (uint32_t i = 0; i < logRingModuleCount(); i++) {
+            sprintf(outBuf, "\r\n+LOGLVL:%s,%u", logRingModuleName(i), logRingModuleLevel(i));
+            outputRsp(outBuf);
+        }
+        outputRsp(OK_STR);
+    } else if (strncmp("AT+LOGLVL=", inAtBuf, 10) == 0 && commandLen > 10) {
+        const char *pComma = memchr(&inAtBuf[10], ',', commandLen - 10);
+        char module[32];
+        size_t moduleLen = pComma ? pComma - (const char *)&inAtBuf[10] : 0;
+        char *pEnd = NULL;
+        long level = -1;
+
+        // AT+LOGLVL=<module>,<level>
+        if (pComma != NULL && moduleLen > 0 && moduleLen < sizeof(module)) {
+            memcpy(module, &inAtBuf[10], moduleLen);
+            module[moduleLen] = '\0';
+            errno = 0;
+            level = strtol(pComma + 1, &pEnd, 10);
+        }
+        if (pEnd != NULL && pEnd != pComma + 1 && errno == 0 &&
+            pEnd - (const char *)inAtBuf == commandLen && logRingSetLevel(module, level) == 0) {
+            outputRsp(OK_STR);
+        } else {
+            validCommand = false;
+            outputRsp(ERROR_STR);
+        }
+#endif
+#ifdef CONFIG_BENCH
+    } else if (strncmp("AT+BENCH=", inAtBuf, 9) == 0 && commandLen > 9) {
+        const char *pArgs = &inAtBuf[9];
+        const char *pComma = memchr(pArgs, ',', commandLen - 9);
+        char command[AT_MAX_CMD_LEN];
+        benchResult_t result;
+        benchTarget_t target = BENCH_END;
+        long iterations = 0;
+        char *pEnd = NULL;
+        int err = -EINVAL;
+
+        // AT+BENCH=<target>,<iterations>[,<command>], the command runs to the end of the line
+        if (pComma != NULL) {
+            target = benchTargetFromName(pArgs, pComma - pArgs);
+            errno = 0;
+            iterations = strtol(pComma + 1, &pEnd, 10);
+        }
+        if (target != BENCH_END && errno == 0 && pEnd != pComma + 1) {
+            size_t used = pEnd - (const char *)inAtBuf;
+
+            if (used == commandLen) {
+                err = benchRun(target, iterations, NULL, &result);
+            } else if (*pEnd == ',' && commandLen - used - 1 < sizeof(command)) {
+                memcpy(command, pEnd + 1, commandLen - used - 1);
+                command[commandLen - used - 1] = '\0';
+                err = benchRun(target, iterations, command, &result);
+            }
+        }
+        if (err == 0) {
+            sprintf(outBuf, "\r\n+BENCH:%s,%u,%u,%u,%u,%s", benchTargetName(target),
+                    result.iterations, result.min, result.median, result.max, benchUnit());
+            outputRsp(outBuf);
+            outputRsp(OK_STR);
+        } else {
+            validCommand = false;
+            outputRsp(ERROR_STR);
+        }
+#endif
     } else {
         validCommand = false;
         outputRsp(ERROR_STR);
@@ -332,24 +980,31 @@ bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOu
 
 static void doCommandWork(struct k_work *work)
 {
-    int err;
     int commandLen;
     bool validCommand = true;
 
     atBuf[MIN(atBufLen, AT_MAX_CMD_LEN - 1)] = 0;
     commandLen = strlen(atBuf);
 
-    validCommand = atHostHandleCommand(atBuf, commandLen, sendString);
-
-    if (validCommand) {
-        k_timer_stop(&disableAtUartModeTimer);
+    // Empty lines are used by the host to wake the UART, don't answer them
+    if (commandLen > 0) {
+        validCommand = atHostHandleCommand(atBuf, commandLen, sendString);
+        if (validCommand && !uartCfgSwitchPending) {
+            confirmUartCfg();
+        }
     }
 
     resetUartAtBuffer();
+    applyPendingUartCfg();
+    enableUartRx();
+}
+
+static void enableUartRx(void)
+{
+    int err = 1;
 
-    err = 1;
     while (err) {
-        err = uart_rx_enable(pUartDev, uartRxBuf[0], sizeof(uartRxBuf[0]), UART_RX_TIMEOUT);
+        err = uartRxStart();
         if (err) {
             LOG_ERR("UART RX failed: %d", err);
         }
@@ -357,6 +1012,41 @@ static void doCommandWork(struct k_work *work)
     }
 }
 
+static int uartRxStart(void)
+{
+    if (IS_ENABLED(CONFIG_UART_ASYNC_API)) {
+        return uart_rx_enable(pUartDev, uartRxBuf[0], sizeof(uartRxBuf[0]), UART_RX_TIMEOUT);
+    }
+    uartRxPolling = true;
+    k_work_schedule_for_queue(&appWorkQ, &uartRxPollWork, K_NO_WAIT);
+
+    return 0;
+}
+
+static int uartRxStop(void)
+{
+    if (IS_ENABLED(CONFIG_UART_ASYNC_API)) {
+        return uart_rx_disable(pUartDev);
+    }
+    uartRxPolling = false;
+    k_work_cancel_delayable(&uartRxPollWork);
+
+    return 0;
+}
+
+static void uartRxPollWorkHandler(struct k_work *item)
+{
+    unsigned char character;
+
+    // uartRxHandler stops the polling once a command is complete
+    while (uartRxPolling && uart_poll_in(pUartDev, &character) == 0) {
+        uartRxHandler(character);
+    }
+    if (uartRxPolling) {
+        k_work_schedule_for_queue(&appWorkQ, &uartRxPollWork, K_MSEC(UART_RX_POLL_INTERVAL_MS));
+    }
+}
+
 static void uartCallback(const struct device *dev, struct uart_event *evt, void *user_data)
 {
     int err;
@@ -387,11 +1077,12 @@ static void uartCallback(const struct device *dev, struct uart_event *evt, void
             break;
         case UART_RX_STOPPED:
             uartErr = evt->data.rx_stop.reason;
+            journalRecord(JOURNAL_EVT_UART_ERROR, uartErr, 0);
             break;
         case UART_RX_DISABLED:
             if (uartErr != 0) {
                 uartErr = 0;
-                k_work_submit(&restartRxWork);
+                k_work_submit_to_queue(&appWorkQ, &restartRxWork);
             }
             break;
         default:
@@ -412,22 +1103,24 @@ static void sendString(char *str)
     }
 }
 
-static bool testLis2dw(void)
+static void outputSelfTestReport(const selfTestReport_t *pReport, atOutput outputRsp)
 {
-    int16_t x;
-    int16_t y;
-    int16_t z;
+    char outBuf[80];
 
-    return sensorsGetLis2dw12(&x, &y, &z);
-}
-
-static bool testBme280(void)
-{
-    struct sensor_value temp, press, humidity;
-    return sensorsGetBme280Data(&temp, &press, &humidity);
-}
+    // One line per step: +TEST:<name>,<result>,<duration_us>,<value1>,<value2>,<value3>
+    for (int i = 0; i < SELF_TEST_END; i++) {
+        const selfTestStepReport_t *pStep = &pReport->steps[i];
+        sprintf(outBuf, "\r\n+TEST:%s,%d,%u,%d,%d,%d", selfTestStepName(i), pStep->result,
+                pStep->durationUs, pStep->values[0], pStep->values[1], pStep->values[2]);
+        outputRsp(outBuf);
+    }
+    sprintf(outBuf, "\r\n+TEST:TOTAL,%d,%u\r\n", pReport->passed ? 0 : 1,
+            pReport->totalDurationUs);
+    outputRsp(outBuf);
 
-static bool testApds(void)
-{
-    return sensorsDetectApds();
+    if (pReport->passed) {
+        outputRsp("OK\r\n");
+    } else {
+        outputRsp(ERROR_STR);
+    }
 }
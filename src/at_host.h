@@ -21,9 +21,10 @@ typedef void (*atOutput)(char *str);
 
 /**
  * @brief   Init the test and configuration UART interface.
- * @details Enables the UART and initializes the command parser. Configuration and test AT commands will be responded to.
- *          If no valid command is sent within the first 10 seconds the UART will be disabled and no commands accepted.
- *          Once a valid AT command is sent the module, it will stay in test/configuration mode until reset, no 10 seconds limit.
+ * @details Enables the UART and initializes the command parser in the background on the application work queue.
+ *          Configuration and test AT commands will be responded to.
+ *          After CONFIG_AT_UART_IDLE_TIMEOUT_MS without RX activity the UART is suspended. Activity on the RX pin
+ *          wakes it up again, the characters received while waking up are lost.
  */
 int atHostStart(void);
 
@@ -39,4 +40,9 @@ int atHostStart(void);
  */
 bool atHostHandleCommand(const uint8_t *const inAtBuf, uint32_t commandLen, atOutput output);
 
+/**
+ * @brief   Get the total time the UART has been enabled since boot.
+ */
+uint32_t atHostGetUartOnTimeMs(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench.h"
+
+#include <zephyr.h>
+#include <string.h>
+#include <drivers/sensor.h>
+#include <bluetooth/bluetooth.h>
+#include <logging/log.h>
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+#include <arch/arm/aarch32/cortex_m/cmsis.h>
+#elif defined(CONFIG_ARCH_POSIX)
+#include <time.h>
+#endif
+
+#include "at_host.h"
+#include "bt_adv.h"
+#include "leds.h"
+#include "sensors.h"
+#include "storage.h"
+#include "tag_payload.h"
+
+LOG_MODULE_REGISTER(bench, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+
+typedef int (*benchFunc_t)(uint32_t iteration);
+
+static int benchAt(uint32_t iteration);
+static int benchPayload(uint32_t iteration);
+static int benchBme280(uint32_t iteration);
+static int benchLis2dw12(uint32_t iteration);
+static int benchAccelConv(uint32_t iteration);
+static int benchNvsRead(uint32_t iteration);
+static int benchNvsWrite(uint32_t iteration);
+static int benchLed(uint32_t iteration);
+
+static const char *const targetNames[BENCH_END] = {
+    [BENCH_AT] = "AT",
+    [BENCH_PAYLOAD] = "PAYLOAD",
+    [BENCH_BME280] = "BME280",
+    [BENCH_LIS2DW12] = "LIS2DW12",
+    [BENCH_ACCEL_CONV] = "ACCCONV",
+    [BENCH_NVS_READ] = "NVSREAD",
+    [BENCH_NVS_WRITE] = "NVSWRITE",
+    [BENCH_LED] = "LED",
+};
+
+static const benchFunc_t targetFuncs[BENCH_END] = {
+    [BENCH_AT] = benchAt,
+    [BENCH_PAYLOAD] = benchPayload,
+    [BENCH_BME280] = benchBme280,
+    [BENCH_LIS2DW12] = benchLis2dw12,
+    [BENCH_ACCEL_CONV] = benchAccelConv,
+    [BENCH_NVS_READ] = benchNvsRead,
+    [BENCH_NVS_WRITE] = benchNvsWrite,
+    [BENCH_LED] = benchLed,
+};
+
+// Too large for the stack of the work queue the AT commands run on
+static uint32_t samples[BENCH_ITERATIONS_MAX];
+static const char *pAtCommand;
+static size_t atCommandLen;
+
+static void counterStart(void)
+{
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+    // Left running, the counter is only ever read as differences
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+static inline uint32_t counterGet(void)
+{
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+    return DWT->CYCCNT;
+#elif defined(CONFIG_ARCH_POSIX)
+    // Simulated time only moves when the CPU is idle, the host CPU time is what the code costs
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec);
+#else
+    return k_cycle_get_32();
+#endif
+}
+
+const char *benchUnit(void)
+{
+#if defined(CONFIG_ARCH_POSIX)
+    return "ns";
+#else
+    return "cycles";
+#endif
+}
+
+static void discardOutput(char *str)
+{
+}
+
+static int benchAt(uint32_t iteration)
+{
+    // Invalid commands are timed as well, their reply is the ERROR
+    atHostHandleCommand(pAtCommand, atCommandLen, discardOutput);
+
+    return 0;
+}
+
+static int benchPayload(uint32_t iteration)
+{
+    // The payload of the main loop, with fixed sensor values as the reads are timed on their own
+    struct bt_data adData[BT_ADV_PER_ADV_DATA_MAX_NUM];
+    int numAdData = 0;
+#ifdef CONFIG_SEND_SENSOR_DATA_IN_PER_ADV_DATA
+    static const int32_t sensorData[TAG_PAYLOAD_SENSOR_NUM] = {
+        [TAG_PAYLOAD_TEMP_VAL1] = 21,
+        [TAG_PAYLOAD_TEMP_VAL2] = 500000,
+        [TAG_PAYLOAD_PRESS_VAL1] = 101,
+        [TAG_PAYLOAD_PRESS_VAL2] = 325000,
+        [TAG_PAYLOAD_HUMIDITY_VAL1] = 40,
+        [TAG_PAYLOAD_HUMIDITY_VAL2] = 0,
+    };
+    uint8_t sensorBlock[TAG_PAYLOAD_SENSORS_LEN];
+
+    tagPayloadEncodeSensors(sensorBlock, sensorData);
+    adData[numAdData].type = BT_DATA_MANUFACTURER_DATA;
+    adData[numAdData].data = sensorBlock;
+    adData[numAdData].data_len = sizeof(sensorBlock);
+    numAdData++;
+#endif
+#ifdef CONFIG_SEND_TLM_IN_PER_ADV_DATA
+    uint8_t tlm[TAG_PAYLOAD_TLM_LEN];
+
+    tagPayloadEncodeTlm(tlm, 0, 21 * 256, btAdvGetPerAdvEventCount(),
+                        (uint32_t)(k_uptime_get() / 100));
+    adData[numAdData].type = BT_DATA_SVC_DATA16;
+    adData[numAdData].data = tlm;
+    adData[numAdData].data_len = sizeof(tlm);
+    numAdData++;
+#endif
+    if (numAdData == 0) {
+        // The main loop never sets periodic advertising data in this build
+        return -ENOTSUP;
+    }
+    btAdvSetPerAdvData(adData, numAdData);
+
+    return 0;
+}
+
+static int benchBme280(uint32_t iteration)
+{
+    struct sensor_value temp, press, humidity;
+
+    return sensorsGetBme280Data(&temp, &press, &humidity) ? 0 : -EIO;
+}
+
+static int benchLis2dw12(uint32_t iteration)
+{
+    int16_t x, y, z;
+
+    return sensorsGetLis2dw12(&x, &y, &z) ? 0 : -EIO;
+}
+
+static int benchAccelConv(uint32_t iteration)
+{
+    // 1 g on z, volatile so that the conversions are not done at compile time
+    static volatile struct sensor_value acc[3] = {{0, 0}, {0, 0}, {9, 806650}};
+    struct sensor_value val;
+    volatile int16_t raw;
+
+    for (int i = 0; i < ARRAY_SIZE(acc); i++) {
+        val.val1 = acc[i].val1;
+        val.val2 = acc[i].val2;
+        raw = sensorsAccelToRaw(&val);
+    }
+    (void)raw;
+
+    return 0;
+}
+
+static int benchNvsRead(uint32_t iteration)
+{
+    uint32_t value;
+
+    return storageBenchRead(&value);
+}
+
+static int benchNvsWrite(uint32_t iteration)
+{
+    // NVS skips a write of the value already stored, so each write has a new one
+    return storageBenchWrite(iteration + 1);
+}
+
+static int benchLed(uint32_t iteration)
+{
+    ledsSetState(LED_RED, iteration & 1 ? 0 : 1);
+
+    return 0;
+}
+
+int benchRun(benchTarget_t target, uint32_t iterations, const char *pCommand,
+             benchResult_t *pResult)
+{
+    int err = 0;
+    uint32_t start;
+    uint32_t i;
+
+    if (target >= BENCH_END || iterations == 0 || iterations > BENCH_ITERATIONS_MAX ||
+        (target == BENCH_AT) != (pCommand != NULL)) {
+        return -EINVAL;
+    }
+    if (pCommand != NULL) {
+        atCommandLen = strlen(pCommand);
+        // Only queries, the other commands write flash, erase or change the advertising
+        if (atCommandLen == 0 || pCommand[atCommandLen - 1] != '?' ||
+            strncmp("AT+BENCH", pCommand, 8) == 0) {
+            return -EINVAL;
+        }
+        pAtCommand = pCommand;
+    }
+
+    counterStart();
+    if (target == BENCH_NVS_READ) {
+        // Something to read
+        err = storageBenchWrite(0);
+    }
+    for (i = 0; i < iterations && err == 0; i++) {
+        start = counterGet();
+        err = targetFuncs[target](i);
+        samples[i] = counterGet() - start;
+    }
+    if (target == BENCH_NVS_READ || target == BENCH_NVS_WRITE) {
+        storageBenchDelete();
+    }
+    if (target == BENCH_LED) {
+        ledsSetState(LED_RED, 0);
+    }
+    if (err) {
+        LOG_WRN("%s failed at iteration %u: %d", targetNames[target], i - 1, err);
+        return err;
+    }
+
+    // Insertion sort, there are few samples
+    for (i = 1; i < iterations; i++) {
+        uint32_t sample = samples[i];
+        uint32_t j = i;
+
+        while (j > 0 && samples[j - 1] > sample) {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = sample;
+    }
+    pResult->iterations = iterations;
+    pResult->min = samples[0];
+    pResult->median = samples[iterations / 2];
+    pResult->max = samples[iterations - 1];
+
+    return 0;
+}
+
+benchTarget_t benchTargetFromName(const char *pName, size_t len)
+{
+    for (int i = 0; i < BENCH_END; i++) {
+        if (strlen(targetNames[i]) == len && strncmp(targetNames[i], pName, len) == 0) {
+            return i;
+        }
+    }
+
+    return BENCH_END;
+}
+
+const char *benchTargetName(benchTarget_t target)
+{
+    __ASSERT_NO_MSG(target < BENCH_END);
+
+    return targetNames[target];
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <zephyr.h>
+
+#define BENCH_ITERATIONS_MAX    256
+
+/**
+ * @brief Code paths timed by benchRun
+ */
+typedef enum benchTarget_t {
+    BENCH_AT = 0,           // atHostHandleCommand with the given command
+    BENCH_PAYLOAD,          // Periodic advertising payload encoding and btAdvSetPerAdvData
+    BENCH_BME280,           // sensorsGetBme280Data
+    BENCH_LIS2DW12,         // sensorsGetLis2dw12
+    BENCH_ACCEL_CONV,       // The sensor_value to raw conversions of sensorsGetLis2dw12 alone
+    BENCH_NVS_READ,
+    BENCH_NVS_WRITE,
+    BENCH_LED,              // ledsSetState
+    BENCH_END
+} benchTarget_t;
+
+typedef struct benchResult_t {
+    uint32_t iterations;
+    uint32_t min;
+    uint32_t median;
+    uint32_t max;
+} benchResult_t;
+
+/**
+ * @brief   Time a code path.
+ * @details Each iteration is timed on its own. On the nRF52 the unit is CPU cycles from the DWT
+ *          cycle counter, which stops while the CPU sleeps, so the sleeps in the sensor reads are
+ *          not counted. In the native_posix and nrf52_bsim builds it is nanoseconds of host CPU
+ *          time. Interrupts and threads that run during an iteration are included.
+ *
+ * @param   target      Code path to time.
+ * @param   iterations  Number of iterations, 1 to BENCH_ITERATIONS_MAX.
+ * @param   pCommand    AT command for BENCH_AT, NULL for the others. Only queries, ending in
+ *                      '?', are accepted.
+ * @param   pResult     [out] minimum, median and maximum of the iterations.
+ *
+ * @return  0 on success, -EINVAL on bad arguments, -ENOTSUP if the code path is not in the
+ *          build, or the error of the first failed iteration.
+ */
+int benchRun(benchTarget_t target, uint32_t iterations, const char *pCommand,
+             benchResult_t *pResult);
+
+/**
+ * @brief   Get a target by its name in benchTargetName.
+ *
+ * @return  The target, or BENCH_END if there is none by that name.
+ */
+benchTarget_t benchTargetFromName(const char *pName, size_t len);
+
+/**
+ * @brief   Get the name of a target, used in AT+BENCH.
+ */
+const char *benchTargetName(benchTarget_t target);
+
+/**
+ * @brief   Get the unit of the benchRun results, "cycles" or "ns".
+ */
+const char *benchUnit(void);
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_profile.h"
+
+#include <zephyr.h>
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(boot_profile, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+
+static const char *const stageNames[BOOT_STAGE_END] = {
+    [BOOT_STAGE_MAIN] = "MAIN",
+    [BOOT_STAGE_STORAGE] = "STORAGE",
+    [BOOT_STAGE_BT_ENABLE] = "BT_ENABLE",
+    [BOOT_STAGE_SENSORS] = "SENSORS",
+    [BOOT_STAGE_IO] = "IO",
+    [BOOT_STAGE_BT_READY] = "BT_READY",
+    [BOOT_STAGE_ADV_CONFIGURED] = "ADV_CONFIGURED",
+    [BOOT_STAGE_ADV_STARTED] = "ADV_STARTED",
+    [BOOT_STAGE_UART] = "UART",
+};
+
+static uint32_t stageUs[BOOT_STAGE_END];
+
+void bootProfileMark(bootStage_t stage)
+{
+    __ASSERT_NO_MSG(stage < BOOT_STAGE_END);
+
+    if (stageUs[stage] == 0) {
+        // Ticks run from the RTC, so this is fine grained and cheap to read
+        stageUs[stage] = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+        LOG_DBG("%s: %d us", stageNames[stage], stageUs[stage]);
+    }
+}
+
+uint32_t bootProfileGetUs(bootStage_t stage)
+{
+    __ASSERT_NO_MSG(stage < BOOT_STAGE_END);
+
+    return stageUs[stage];
+}
+
+const char *bootProfileStageName(bootStage_t stage)
+{
+    __ASSERT_NO_MSG(stage < BOOT_STAGE_END);
+
+    return stageNames[stage];
+}
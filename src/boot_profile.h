@@ -0,0 +1,60 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BOOT_PROFILE_H
+#define __BOOT_PROFILE_H
+
+#include <zephyr.h>
+
+/**
+ * @brief Boot stages, in the order they normally complete
+ */
+typedef enum bootStage_t {
+    BOOT_STAGE_MAIN = 0,        // main() entered
+    BOOT_STAGE_STORAGE,         // Configuration loaded
+    BOOT_STAGE_BT_ENABLE,       // bt_enable returned, controller init continues in background
+    BOOT_STAGE_SENSORS,         // Sensors put in low power
+    BOOT_STAGE_IO,              // LEDs and button ready
+    BOOT_STAGE_BT_READY,        // Bluetooth ready callback
+    BOOT_STAGE_ADV_CONFIGURED,  // Advertising sets and CTE configured
+    BOOT_STAGE_ADV_STARTED,     // Periodic advertising with CTE enabled
+    BOOT_STAGE_UART,            // AT UART up
+    BOOT_STAGE_END
+} bootStage_t;
+
+/**
+ * @brief   Record the time a boot stage completed.
+ * @details Only the first call per stage is recorded. Safe to call from any context.
+ *
+ * @param   stage       The completed stage.
+ */
+void bootProfileMark(bootStage_t stage);
+
+/**
+ * @brief   Get the time a boot stage completed.
+ *
+ * @param   stage       The stage.
+ *
+ * @return  Microseconds since kernel start, or 0 if the stage has not completed.
+ */
+uint32_t bootProfileGetUs(bootStage_t stage);
+
+/**
+ * @brief   Get a short name of a boot stage, used in reports.
+ */
+const char *bootProfileStageName(bootStage_t stage);
+
+#endif
@@ -15,6 +15,10 @@
  */
 
 #include "bt_adv.h"
+#include "boot_profile.h"
+#include "energy.h"
+#include "journal.h"
+#include "tag_payload.h"
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 #include <sys/__assert.h>
@@ -23,6 +27,7 @@
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 #include <bluetooth/direction.h>
+#include <bluetooth/hci_vs.h>
 #include <sys/byteorder.h>
 #include <sys/util.h>
 
@@ -30,10 +35,7 @@
 #include <bluetooth/services/nus.h>
 #endif
 
-LOG_MODULE_REGISTER(bt_adv_aoa, LOG_LEVEL_DBG);
-
-/* Length of CTE in unit of 8[us] */
-#define CTE_LEN (0x14U)
+LOG_MODULE_REGISTER(bt_adv_aoa, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
 
 /* Number of CTE send in single periodic advertising train
 * Tradeoff with power consumption for the tag and
@@ -41,10 +43,38 @@ LOG_MODULE_REGISTER(bt_adv_aoa, LOG_LEVEL_DBG);
 */
 #define PER_ADV_EVENT_CTE_COUNT 1
 
-// Offsets of the different data in bt_data ad[] below
-#define ADV_DATA_OFFSET_NAMESPACE   4
-#define ADV_DATA_OFFSET_INSTANCE    14
-#define ADV_DATA_OFFSET_TX_POWER    3
+#define BT_ADV_STACKSIZE            1536
+#define BT_ADV_PRIORITY             7
+
+// Shortest periodic advertising interval allowed by the spec, 7.5 ms
+#define PER_ADV_INTERVAL_MIN_MS     8
+
+// Requests posted to the advertising thread. Each one holds only the latest value posted,
+// so a request posted while an older one of the same kind is pending replaces it.
+#define REQ_INIT                    BIT(0)
+#define REQ_INTERVAL                BIT(1)
+#define REQ_PER_ADV_DATA            BIT(2)
+#define REQ_RESTART                 BIT(3)
+#define REQ_ENABLE                  BIT(4)
+#define REQ_NUS                     BIT(5)
+#define REQ_RADIO                   BIT(6)
+// Posted by restartTimer once the restart delay has passed
+#define REQ_RESUME                  BIT(7)
+#define REQ_NUM                     8
+
+#if defined(CONFIG_BT_CTLR_TX_PWR_PLUS_4)
+// Power the controller uses unless told otherwise, no need to spend an HCI command on it
+#define CONTROLLER_DEFAULT_TX_POWER 4
+#endif
+
+// Measures the time of one HCI call and records it in the statistics, errors are journaled
+// with the line of the call
+#define TIMED_HCI(call) ({                          \
+        uint32_t _start = k_cycle_get_32();         \
+        int _err = (call);                          \
+        recordHciCall(_start, _err, __LINE__);      \
+        _err;                                       \
+    })
 
 static struct bt_le_adv_param param =
 // Below intervals are a tradeoff between power consumption and the time
@@ -55,6 +85,10 @@ static struct bt_le_adv_param param =
                          CONFIG_EXT_ADV_INT_MS_MAX / 0.625,
                          NULL);
 
+// The extended interval can be changed at runtime, the controller may pick any interval
+// from the configured one up to this much longer.
+#define EXT_ADV_INT_MS_SPREAD       (CONFIG_EXT_ADV_INT_MS_MAX - CONFIG_EXT_ADV_INT_MS_MIN)
+
 #if defined(CONFIG_BT_NUS)
 static struct bt_le_adv_param param_nus =
     BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_USE_NAME | BT_LE_ADV_OPT_CONNECTABLE,
@@ -73,159 +107,678 @@ static struct bt_le_ext_adv_start_param ext_adv_start_param = {
     .num_events = 0,
 };
 
-struct bt_df_adv_cte_tx_param cte_params = { .cte_len = CTE_LEN,
+struct bt_df_adv_cte_tx_param cte_params = { .cte_len = BT_ADV_CTE_LEN_MAX,
            .cte_count = PER_ADV_EVENT_CTE_COUNT,
            .cte_type = BT_DF_CTE_TYPE_AOA,
            .num_ant_ids = 0,
            .ant_ids = NULL
 };
 
+// Eddystone-UID service data, filled in by init
+static uint8_t eddystoneUid[TAG_PAYLOAD_UID_LEN];
+
 static struct bt_data ad[] = {
     BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR),
     BT_DATA_BYTES(BT_DATA_UUID16_ALL, 0xaa, 0xfe),
-    BT_DATA_BYTES(BT_DATA_SVC_DATA16,
-                  0xaa, 0xfe, /* Eddystone UUID */
-                  0x00, /* Eddystone-UID frame type */
-                  0x00, /* TX Power */
-                  'N', 'I', 'N', 'A', '-', 'B', '4', 'T', 'A', 'G', /* Namespace placeholder, will be replaced in init */
-                  'i', 'n', 's', 't', 'a', 'e', /* Instance Id placeholder, will be replaced in init */
-                  0x00, /* reserved */
-                  0x00 /* reserved */
-                 )
+    BT_DATA(BT_DATA_SVC_DATA16, eddystoneUid, sizeof(eddystoneUid)),
+};
+
+struct btAdvRequest_t {
+    uint32_t flags;
+    uint16_t minInterval;       // In units of 1.25 ms
+    uint16_t maxInterval;
+    // Interval as requested and whom to report the result to
+    uint16_t intervalMinMs;
+    uint16_t intervalMaxMs;
+    btAdvIntervalCb_t intervalCb;
+    void *pIntervalUserData;
+    bool enable;
+    uint16_t restartDelayMs;
+    uint16_t extIntervalMs;
+    uint8_t cteLen;
+    int8_t txPower;
+    uint8_t numPerAdvData;
+    struct bt_data perAdvData[BT_ADV_PER_ADV_DATA_MAX_NUM];
+    uint8_t perAdvDataBuf[BT_ADV_PER_ADV_DATA_MAX_LEN];
 };
 
+static void btAdvThread(void);
+static void recordHciCall(uint32_t start, int err, int line);
+static uint32_t countEventsSinceStart(void);
+static void postRequest(const struct btAdvRequest_t *pReq);
+static void doInit(const struct btAdvRequest_t *pReq);
+static int doSetInterval(const struct btAdvRequest_t *pReq);
+static void doSetRadio(const struct btAdvRequest_t *pReq);
+static void applyRadioParams(const struct btAdvRequest_t *pReq);
+static void setTxPower(uint8_t handleType, uint16_t handle, int8_t txPwrLvl);
+static void doSetPerAdvData(struct btAdvRequest_t *pReq);
+static void doRestart(const struct btAdvRequest_t *pReq);
+static void restartTimerHandler(struct k_timer *timer);
+static void doStart(void);
+static void doStop(void);
+static void setEnergyInterval(const struct btAdvRequest_t *pReq);
+#if defined(CONFIG_BT_NUS)
+static void doStartNus(void);
+#endif
+
+// Only touched by the advertising thread, except advRunning and advInitialized that are changed
+// under requestLock
 static struct bt_le_ext_adv *adv_set;
-static uint16_t minAdvInterval;
-static uint16_t maxAdvInterval;
 static bool advRunning;
+static bool advInitialized;
+// Stopped by a restart, started again by REQ_RESUME unless an enable request came first
+static bool restartPending;
+// False when the controller of a simulation build (native_posix) has no Direction Finding,
+// periodic advertising then runs without CTE. On the tag hardware this fails the init instead.
+// Builds without DF support in the host (nrf52_bsim) never send CTE commands.
+static bool cteEnabled;
+static struct btAdvRequest_t current;
+static energyAdvState_t energyState;
 
-void btAdvInit(uint16_t min_int, uint16_t max_int, uint8_t *namespace, uint8_t *instance_id,
-               int8_t txPower)
+static struct btAdvRequest_t pending;
+static struct k_spinlock requestLock;
+static btAdvStats_t stats;
+// Periodic advertising events sent, estimated from the time advertising has been running
+static uint32_t perEventCount;
+static int64_t perAdvStartedUs;
+K_SEM_DEFINE(requestSem, 0, 1);
+K_TIMER_DEFINE(restartTimer, restartTimerHandler, NULL);
+
+K_THREAD_DEFINE(btAdvThreadId, BT_ADV_STACKSIZE, btAdvThread, NULL, NULL, NULL, BT_ADV_PRIORITY,
+                0, 0);
+
+void btAdvInit(uint16_t min_int, uint16_t max_int, const uint8_t *namespace,
+               const uint8_t *instance_id, int8_t txPower, uint16_t extIntervalMs, uint8_t cteLen)
 {
-    minAdvInterval = min_int / 1.25;
-    maxAdvInterval = max_int / 1.25;
-    advRunning = false;
+    struct btAdvRequest_t req = {
+        .flags = REQ_INIT,
+        .minInterval = min_int / 1.25,
+        .maxInterval = max_int / 1.25,
+        .extIntervalMs = extIntervalMs,
+        .cteLen = cteLen,
+        .txPower = txPower,
+    };
+
+    // Not used by the advertising thread until it has handled the init request
+    tagPayloadEncodeUid(eddystoneUid, txPower, namespace, instance_id);
+
+    postRequest(&req);
+}
+
+void btAdvStart(void)
+{
+    struct btAdvRequest_t req = {
+        .flags = REQ_ENABLE,
+        .enable = true,
+    };
+
+    postRequest(&req);
+}
+
+#if defined(CONFIG_BT_NUS)
+void btAdvStartNus(void)
+{
+    struct btAdvRequest_t req = {
+        .flags = REQ_NUS,
+    };
+
+    postRequest(&req);
+}
+#endif
+
+void btAdvStop(void)
+{
+    struct btAdvRequest_t req = {
+        .flags = REQ_ENABLE,
+        .enable = false,
+    };
+
+    postRequest(&req);
+}
+
+void btAdvRestart(uint16_t delayMs)
+{
+    struct btAdvRequest_t req = {
+        .flags = REQ_RESTART,
+        .restartDelayMs = delayMs,
+    };
+
+    postRequest(&req);
+}
+
+bool btAdvUpdateAdvInterval(uint16_t min, uint16_t max, btAdvIntervalCb_t cb, void *pUserData)
+{
+    struct btAdvRequest_t req = {
+        .flags = REQ_INTERVAL | REQ_ENABLE,
+        .minInterval = min / 1.25,
+        .maxInterval = max / 1.25,
+        .intervalMinMs = min,
+        .intervalMaxMs = max,
+        .intervalCb = cb,
+        .pIntervalUserData = pUserData,
+        .enable = true,
+    };
+
+    if (!btAdvIntervalValid(min, max)) {
+        return false;
+    }
+    postRequest(&req);
+
+    return true;
+}
+
+bool btAdvIntervalValid(uint16_t min, uint16_t max)
+{
+    return min >= PER_ADV_INTERVAL_MIN_MS && max >= min;
+}
+
+bool btAdvSetRadioParams(uint16_t extIntervalMs, uint8_t cteLen, int8_t txPower)
+{
+    struct btAdvRequest_t req = {
+        .flags = REQ_RADIO,
+        .extIntervalMs = extIntervalMs,
+        .cteLen = cteLen,
+        .txPower = txPower,
+    };
+
+    if (!btAdvRadioParamsValid(extIntervalMs, cteLen)) {
+        return false;
+    }
+    postRequest(&req);
+
+    return true;
+}
+
+bool btAdvRadioParamsValid(uint16_t extIntervalMs, uint8_t cteLen)
+{
+    return extIntervalMs >= BT_ADV_EXT_INTERVAL_MIN_MS &&
+           extIntervalMs <= BT_ADV_EXT_INTERVAL_MAX_MS &&
+           cteLen >= BT_ADV_CTE_LEN_MIN && cteLen <= BT_ADV_CTE_LEN_MAX;
+}
+
+void btAdvSetPerAdvData(struct bt_data *data, int len)
+{
+    struct btAdvRequest_t req = {
+        .flags = REQ_PER_ADV_DATA,
+    };
+    size_t offset = 0;
+
+    __ASSERT_NO_MSG(len <= BT_ADV_PER_ADV_DATA_MAX_NUM);
+
+    // The caller's buffers are not valid once we return, keep a copy
+    for (int i = 0; i < len; i++) {
+        if (offset + data[i].data_len > sizeof(req.perAdvDataBuf)) {
+            LOG_ERR("Per adv data too long");
+            return;
+        }
+        memcpy(&req.perAdvDataBuf[offset], data[i].data, data[i].data_len);
+        req.perAdvData[i].type = data[i].type;
+        req.perAdvData[i].data_len = data[i].data_len;
+        offset += data[i].data_len;
+    }
+    req.numPerAdvData = len;
+
+    postRequest(&req);
+}
+
+uint32_t btAdvGetPerAdvEventCount(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&requestLock);
+    uint32_t count = perEventCount;
+
+    if (advRunning) {
+        count += countEventsSinceStart();
+    }
+    k_spin_unlock(&requestLock, key);
+
+    return count;
+}
+
+void btAdvGetStats(btAdvStats_t *pStats)
+{
+    k_spinlock_key_t key = k_spin_lock(&requestLock);
+    *pStats = stats;
+    k_spin_unlock(&requestLock, key);
+}
+
+static void postRequest(const struct btAdvRequest_t *pReq)
+{
+    k_spinlock_key_t key = k_spin_lock(&requestLock);
+    struct btAdvRequest_t replaced = {0};
+    uint8_t depth;
+
+    stats.requests++;
+    if (pending.flags & pReq->flags) {
+        stats.coalesced++;
+    }
+    pending.flags |= pReq->flags;
+    if ((pReq->flags & REQ_INTERVAL) && (pending.flags & REQ_INTERVAL) &&
+        (pending.intervalCb != pReq->intervalCb ||
+         pending.pIntervalUserData != pReq->pIntervalUserData)) {
+        // Another requester's interval is dropped, it is told so below
+        replaced = pending;
+    }
+    if (pReq->flags & (REQ_INIT | REQ_INTERVAL)) {
+        pending.minInterval = pReq->minInterval;
+        pending.maxInterval = pReq->maxInterval;
+    }
+    if (pReq->flags & REQ_INTERVAL) {
+        pending.intervalMinMs = pReq->intervalMinMs;
+        pending.intervalMaxMs = pReq->intervalMaxMs;
+        pending.intervalCb = pReq->intervalCb;
+        pending.pIntervalUserData = pReq->pIntervalUserData;
+    }
+    if (pReq->flags & REQ_ENABLE) {
+        pending.enable = pReq->enable;
+    }
+    if (pReq->flags & REQ_RESTART) {
+        pending.restartDelayMs = pReq->restartDelayMs;
+    }
+    if (pReq->flags & (REQ_INIT | REQ_RADIO)) {
+        pending.extIntervalMs = pReq->extIntervalMs;
+        pending.cteLen = pReq->cteLen;
+        pending.txPower = pReq->txPower;
+    }
+    if (pReq->flags & REQ_PER_ADV_DATA) {
+        pending.numPerAdvData = pReq->numPerAdvData;
+        memcpy(pending.perAdvData, pReq->perAdvData, sizeof(pending.perAdvData));
+        memcpy(pending.perAdvDataBuf, pReq->perAdvDataBuf, sizeof(pending.perAdvDataBuf));
+    }
+    depth = __builtin_popcount(pending.flags);
+    stats.maxQueueDepth = MAX(stats.maxQueueDepth, depth);
+    k_spin_unlock(&requestLock, key);
+
+    if (replaced.intervalCb != NULL) {
+        replaced.intervalCb(replaced.intervalMinMs, replaced.intervalMaxMs, -ECANCELED,
+                            replaced.pIntervalUserData);
+    }
+    k_sem_give(&requestSem);
+}
 
-    memcpy((uint8_t *)&ad[2].data[ADV_DATA_OFFSET_NAMESPACE], namespace, EDDYSTONE_NAMESPACE_LENGFTH);
-    memcpy((uint8_t *)&ad[2].data[ADV_DATA_OFFSET_INSTANCE], instance_id, EDDYSTONE_INSTANCE_ID_LEN);
-    memcpy((uint8_t *)&ad[2].data[ADV_DATA_OFFSET_TX_POWER], &txPower, sizeof(txPower));
+static void btAdvThread(void)
+{
+    k_spinlock_key_t key;
+    int intervalErr = 0;
+
+    while (true) {
+        k_sem_take(&requestSem, K_FOREVER);
 
-    LOG_INF("Create ext. adv...");
-    int err = bt_le_ext_adv_create(&param, NULL, &adv_set);
+        key = k_spin_lock(&requestLock);
+        // Requests posted before init are kept until the init request arrives
+        if (!advInitialized && !(pending.flags & REQ_INIT)) {
+            k_spin_unlock(&requestLock, key);
+            continue;
+        }
+        current = pending;
+        pending.flags = 0;
+        stats.batches++;
+        k_spin_unlock(&requestLock, key);
+
+        if (current.flags & REQ_INIT) {
+            // An interval posted before init is applied by it
+            doInit(&current);
+            intervalErr = advInitialized ? 0 : -EIO;
+            bootProfileMark(BOOT_STAGE_ADV_CONFIGURED);
+        } else {
+            if (current.flags & REQ_INTERVAL) {
+                intervalErr = doSetInterval(&current);
+            }
+            if (current.flags & REQ_RADIO) {
+                doSetRadio(&current);
+            }
+        }
+        if (current.flags & REQ_PER_ADV_DATA) {
+            doSetPerAdvData(&current);
+        }
+        if (current.flags & REQ_RESTART) {
+            doRestart(&current);
+        }
+        if (current.flags & REQ_ENABLE) {
+            // An explicit start or stop replaces the end of a restart
+            restartPending = false;
+            k_timer_stop(&restartTimer);
+            if (current.enable) {
+                doStart();
+            } else {
+                doStop();
+            }
+            // Failures are journaled as HCI errors
+            if (advRunning == current.enable) {
+                journalRecord(advRunning ? JOURNAL_EVT_ADV_START : JOURNAL_EVT_ADV_STOP, 0, 0);
+            }
+        } else if ((current.flags & REQ_RESUME) && restartPending) {
+            restartPending = false;
+            doStart();
+        }
+#if defined(CONFIG_BT_NUS)
+        if (current.flags & REQ_NUS) {
+            doStartNus();
+        }
+#endif
+        energyState.running = advRunning;
+        energySetAdvState(&energyState);
+
+        if ((current.flags & REQ_INTERVAL) && current.intervalCb != NULL) {
+            if (intervalErr) {
+                key = k_spin_lock(&requestLock);
+                stats.intervalErrors++;
+                k_spin_unlock(&requestLock, key);
+            }
+            current.intervalCb(current.intervalMinMs, current.intervalMaxMs, intervalErr,
+                               current.pIntervalUserData);
+        }
+    }
+}
+
+static void recordHciCall(uint32_t start, int err, int line)
+{
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    k_spinlock_key_t key = k_spin_lock(&requestLock);
+
+    stats.hciCalls++;
+    stats.hciTotalUs += us;
+    stats.hciMaxUs = MAX(stats.hciMaxUs, us);
+    if (err) {
+        stats.hciErrors++;
+    }
+    k_spin_unlock(&requestLock, key);
     if (err) {
-        LOG_ERR("failed (err %d)\n", err);
+        journalRecord(JOURNAL_EVT_HCI_ERROR, err, line);
+    }
+}
+
+static void doInit(const struct btAdvRequest_t *pReq)
+{
+#ifdef CONTROLLER_DEFAULT_TX_POWER
+    if (pReq->txPower != CONTROLLER_DEFAULT_TX_POWER)
+#endif
+    {
+        LOG_INF("Setting TxPower: %d", pReq->txPower);
+        setTxPower(BT_HCI_VS_LL_HANDLE_TYPE_ADV, 0, pReq->txPower);
+    }
+    applyRadioParams(pReq);
+
+    // Only failures are logged, successful HCI calls are counted in the statistics
+    int err = TIMED_HCI(bt_le_ext_adv_create(&param, NULL, &adv_set));
+    if (err) {
+        LOG_ERR("Create ext adv failed (err %d)", err);
         return;
     }
-    LOG_INF("success\n");
 
-    LOG_INF("Set ext adv data...");
-    err = bt_le_ext_adv_set_data(adv_set, ad, ARRAY_SIZE(ad), NULL, 0);
+    err = TIMED_HCI(bt_le_ext_adv_set_data(adv_set, ad, ARRAY_SIZE(ad), NULL, 0));
     if (err) {
-        LOG_ERR("Failed setting ext adv data: %d\n", err);
+        LOG_ERR("Ext adv data failed (err %d)", err);
+    }
+
+    if (IS_ENABLED(CONFIG_BT_DF_CONNECTIONLESS_CTE_TX)) {
+        err = TIMED_HCI(bt_df_set_adv_cte_tx_param(adv_set, &cte_params));
+        cteEnabled = (err == 0);
+        // Simulation builds may run against a controller without Direction Finding, the tag
+        // hardware always supports it
+        if (err && !IS_ENABLED(CONFIG_ARCH_POSIX)) {
+            LOG_ERR("CTE params failed (err %d)", err);
+            return;
+        } else if (err) {
+            LOG_WRN("No CTE support (err %d), advertising without CTE", err);
+        }
     }
-    LOG_INF("success\n");
 
-    LOG_INF("Update CTE params...");
-    err = bt_df_set_adv_cte_tx_param(adv_set, &cte_params);
+    struct bt_le_per_adv_param per_adv_param = {
+        .interval_min = pReq->minInterval,
+        .interval_max = pReq->maxInterval,
+        .options = BT_LE_ADV_OPT_USE_TX_POWER,
+    };
+    err = TIMED_HCI(bt_le_per_adv_set_param(adv_set, &per_adv_param));
     if (err) {
-        LOG_ERR("failed (err %d)\n", err);
+        LOG_ERR("Per adv params failed (err %d)", err);
         return;
     }
-    LOG_INF("success\n");
 
-    LOG_INF("Periodic advertising params set...");
+    if (IS_ENABLED(CONFIG_BT_DF_CONNECTIONLESS_CTE_TX) && cteEnabled) {
+        err = TIMED_HCI(bt_df_adv_cte_tx_enable(adv_set));
+        if (err) {
+            LOG_ERR("CTE enable failed (err %d)", err);
+            return;
+        }
+    }
+    LOG_INF("Adv initialized, CTE %s", cteEnabled ? "on" : "off");
+
+    k_spinlock_key_t key = k_spin_lock(&requestLock);
+    advRunning = false;
+    advInitialized = true;
+    k_spin_unlock(&requestLock, key);
+
+    energyState.extPayloadLen = 2 + strlen(bt_get_name());
+    for (int i = 0; i < ARRAY_SIZE(ad); i++) {
+        energyState.extPayloadLen += 2 + ad[i].data_len;
+    }
+    energyState.cteCount = cteEnabled ? PER_ADV_EVENT_CTE_COUNT : 0;
+    setEnergyInterval(pReq);
+}
+
+static int doSetInterval(const struct btAdvRequest_t *pReq)
+{
+    bool wasRunning = advRunning;
     struct bt_le_per_adv_param per_adv_param = {
-        .interval_min = minAdvInterval,
-        .interval_max = maxAdvInterval,
+        .interval_min = pReq->minInterval,
+        .interval_max = pReq->maxInterval,
         .options = BT_LE_ADV_OPT_USE_TX_POWER,
     };
-    err = bt_le_per_adv_set_param(adv_set, &per_adv_param);
+
+    if (wasRunning) {
+        doStop();
+    }
+    int err = TIMED_HCI(bt_le_per_adv_set_param(adv_set, &per_adv_param));
     if (err) {
-        LOG_ERR("failed (err %d)\n", err);
-        return;
+        LOG_ERR("Per adv params failed (err %d)", err);
+    } else {
+        LOG_INF("Per adv interval %u-%u x 1.25 ms", pReq->minInterval, pReq->maxInterval);
+        journalRecord(JOURNAL_EVT_ADV_INTERVAL, pReq->minInterval, pReq->maxInterval);
     }
-    LOG_INF("success\n");
+    setEnergyInterval(pReq);
+    if (wasRunning) {
+        doStart();
+    }
+
+    return err;
+}
+
+static void doSetRadio(const struct btAdvRequest_t *pReq)
+{
+    bool wasRunning = advRunning;
+    int err;
+
+    if (wasRunning) {
+        doStop();
+    }
+    applyRadioParams(pReq);
 
-    LOG_INF("Enable CTE...");
-    err = bt_df_adv_cte_tx_enable(adv_set);
+    err = TIMED_HCI(bt_le_ext_adv_update_param(adv_set, &param));
     if (err) {
-        LOG_ERR("failed (err %d)\n", err);
-        return;
+        LOG_ERR("Ext adv params failed (err %d)", err);
     }
-    LOG_INF("success\n");
-#if defined(CONFIG_BT_NUS)
-    LOG_INF("Legacy advertising NUS enable...");
-    err = bt_le_adv_start(&param_nus, ad_nus, ARRAY_SIZE(ad_nus), NULL, 0);
+    err = TIMED_HCI(bt_le_ext_adv_set_data(adv_set, ad, ARRAY_SIZE(ad), NULL, 0));
     if (err) {
-        LOG_ERR("Advertising failed to start (err %d)\n", err);
+        LOG_ERR("Ext adv data failed (err %d)", err);
+    }
+    // CTE parameters can only be changed with CTE disabled
+    if (IS_ENABLED(CONFIG_BT_DF_CONNECTIONLESS_CTE_TX) && cteEnabled) {
+        err = TIMED_HCI(bt_df_adv_cte_tx_disable(adv_set));
+        if (!err) {
+            err = TIMED_HCI(bt_df_set_adv_cte_tx_param(adv_set, &cte_params));
+        }
+        if (!err) {
+            err = TIMED_HCI(bt_df_adv_cte_tx_enable(adv_set));
+        }
+        if (err) {
+            LOG_ERR("CTE params failed (err %d)", err);
+        }
+    }
+    setTxPower(BT_HCI_VS_LL_HANDLE_TYPE_ADV, 0, pReq->txPower);
+    LOG_INF("Radio params ext %u ms, CTE %u, TX %d dBm", pReq->extIntervalMs, pReq->cteLen,
+            pReq->txPower);
+    journalRecord(JOURNAL_EVT_RADIO_PARAMS, pReq->extIntervalMs,
+                  pReq->cteLen << 8 | (uint8_t)pReq->txPower);
+
+    if (wasRunning) {
+        doStart();
+    }
+}
+
+// Update the parameter structures used for the next HCI commands
+static void applyRadioParams(const struct btAdvRequest_t *pReq)
+{
+    param.interval_min = pReq->extIntervalMs / 0.625;
+    param.interval_max = (pReq->extIntervalMs + EXT_ADV_INT_MS_SPREAD) / 0.625;
+    cte_params.cte_len = pReq->cteLen;
+    eddystoneUid[TAG_PAYLOAD_UID_OFFSET_TX_POWER] = (uint8_t)pReq->txPower;
+
+    energyState.extIntervalUs = (pReq->extIntervalMs + EXT_ADV_INT_MS_SPREAD / 2) * 1000;
+    energyState.cteLen = pReq->cteLen;
+    energyState.txPower = pReq->txPower;
+}
+
+static void doSetPerAdvData(struct btAdvRequest_t *pReq)
+{
+    size_t offset = 0;
+
+    // Point the copied structures to the copied data
+    for (int i = 0; i < pReq->numPerAdvData; i++) {
+        pReq->perAdvData[i].data = &pReq->perAdvDataBuf[offset];
+        offset += pReq->perAdvData[i].data_len;
+    }
+
+    int err = TIMED_HCI(bt_le_per_adv_set_data(adv_set, pReq->perAdvData, pReq->numPerAdvData));
+    if (err) {
+        LOG_ERR("Per adv data failed (err %d)", err);
         return;
     }
-#endif
-    LOG_INF("success\n");
+    energyState.perPayloadLen = 0;
+    for (int i = 0; i < pReq->numPerAdvData; i++) {
+        energyState.perPayloadLen += 2 + pReq->perAdvData[i].data_len;
+    }
 }
 
-void btAdvStart(void)
+static void doRestart(const struct btAdvRequest_t *pReq)
+{
+    if (!advRunning && !restartPending) {
+        return;
+    }
+    journalRecord(JOURNAL_EVT_ADV_RESTART, pReq->restartDelayMs, 0);
+    if (advRunning) {
+        doStop();
+    }
+    // Requests posted meanwhile are handled while advertising is stopped
+    restartPending = true;
+    k_timer_start(&restartTimer, K_MSEC(pReq->restartDelayMs), K_NO_WAIT);
+}
+
+static void restartTimerHandler(struct k_timer *timer)
+{
+    struct btAdvRequest_t req = {
+        .flags = REQ_RESUME,
+    };
+
+    postRequest(&req);
+}
+
+static void doStart(void)
 {
+    k_spinlock_key_t key;
+
     if (advRunning) {
         LOG_WRN("Periodic adv. already running");
         return;
     }
-    LOG_INF("Periodic advertising enable...");
-    int err = bt_le_per_adv_start(adv_set);
+    int err = TIMED_HCI(bt_le_per_adv_start(adv_set));
     if (err) {
-        LOG_ERR("failed (err %d)\n", err);
+        LOG_ERR("Per adv enable failed (err %d)", err);
         return;
     }
-    LOG_INF("success\n");
 
-    LOG_INF("Extended advertising enable...");
-    err = bt_le_ext_adv_start(adv_set, &ext_adv_start_param);
+    err = TIMED_HCI(bt_le_ext_adv_start(adv_set, &ext_adv_start_param));
     if (err) {
-        LOG_ERR("failed (err %d)\n", err);
+        LOG_ERR("Ext adv enable failed (err %d)", err);
         return;
     }
+    key = k_spin_lock(&requestLock);
+    perAdvStartedUs = k_ticks_to_us_floor64(k_uptime_ticks());
     advRunning = true;
-    LOG_INF("success\n");
+    k_spin_unlock(&requestLock, key);
+    bootProfileMark(BOOT_STAGE_ADV_STARTED);
+    LOG_INF("Adv started");
 }
 
-void btAdvStop(void)
+static void doStop(void)
 {
+    k_spinlock_key_t key;
+
     if (!advRunning) {
         LOG_WRN("Periodic adv. already stopped");
         return;
     }
-    __ASSERT_NO_MSG(0 == bt_le_per_adv_stop(adv_set));
-    __ASSERT_NO_MSG(0 == bt_le_ext_adv_stop(adv_set));
+    __ASSERT_NO_MSG(0 == TIMED_HCI(bt_le_per_adv_stop(adv_set)));
+    __ASSERT_NO_MSG(0 == TIMED_HCI(bt_le_ext_adv_stop(adv_set)));
     LOG_INF("Adv stopped");
+    key = k_spin_lock(&requestLock);
+    perEventCount += countEventsSinceStart();
     advRunning = false;
+    k_spin_unlock(&requestLock, key);
 }
 
-bool btAdvUpdateAdvInterval(uint16_t min, uint16_t max)
+static void setTxPower(uint8_t handleType, uint16_t handle, int8_t txPwrLvl)
 {
-    minAdvInterval = min / 1.25;
-    maxAdvInterval = max / 1.25;
-    btAdvStop();
-    struct bt_le_per_adv_param per_adv_param = {
-        .interval_min = minAdvInterval,
-        .interval_max = maxAdvInterval,
-        .options = BT_LE_ADV_OPT_USE_TX_POWER,
-    };
-    int err = bt_le_per_adv_set_param(adv_set, &per_adv_param);
+    struct bt_hci_cp_vs_write_tx_power_level *cp;
+    struct bt_hci_rp_vs_write_tx_power_level *rp;
+    struct net_buf *buf, *rsp = NULL;
+    int err;
+
+    buf = bt_hci_cmd_create(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, sizeof(*cp));
+    __ASSERT(buf, "Unable to allocate command buffer");
+
+    cp = net_buf_add(buf, sizeof(*cp));
+    cp->handle = sys_cpu_to_le16(handle);
+    cp->handle_type = handleType;
+    cp->tx_power_level = txPwrLvl;
+
+    err = TIMED_HCI(bt_hci_cmd_send_sync(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL,
+                                         buf, &rsp));
     if (err) {
-        LOG_ERR("failed (err %d)\n", err);
+        uint8_t reason = rsp ?
+                         ((struct bt_hci_rp_vs_write_tx_power_level *)
+                          rsp->data)->status : 0;
+        LOG_ERR("Set Tx power err: %d reason 0x%02x", err, reason);
+        return;
     }
-    LOG_INF("success\n");
-    btAdvStart();
 
-    return err == 0;
+    rp = (void *)rsp->data;
+    LOG_INF("Set Tx Power: %d", rp->selected_tx_power);
+
+    net_buf_unref(rsp);
 }
 
-void btAdvSetPerAdvData(struct bt_data *data, int len)
+// The first event is sent right away, requestLock must be held
+static uint32_t countEventsSinceStart(void)
+{
+    int64_t elapsedUs = k_ticks_to_us_floor64(k_uptime_ticks()) - perAdvStartedUs;
+
+    return elapsedUs / energyState.perIntervalUs + 1;
+}
+
+static void setEnergyInterval(const struct btAdvRequest_t *pReq)
+{
+    // The controller picks an interval in the range, assume the middle
+    energyState.perIntervalUs = (pReq->minInterval + pReq->maxInterval) * 1250 / 2;
+}
+
+#if defined(CONFIG_BT_NUS)
+static void doStartNus(void)
 {
-    LOG_INF("Set per adv data...");
-    int err = bt_le_per_adv_set_data(adv_set, data, len);
+    int err = TIMED_HCI(bt_le_adv_start(&param_nus, ad_nus, ARRAY_SIZE(ad_nus), NULL, 0));
     if (err) {
-        LOG_ERR("failed (err %d)\n", err);
+        LOG_ERR("NUS advertising failed to start (err %d)", err);
         return;
     }
+    LOG_INF("NUS advertising started");
 }
+#endif
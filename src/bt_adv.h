@@ -19,9 +19,55 @@
 
 #include <zephyr.h>
 #include <bluetooth/bluetooth.h>
+#include "tag_payload.h"
 
-#define EDDYSTONE_INSTANCE_ID_LEN   6
-#define EDDYSTONE_NAMESPACE_LENGFTH 10
+#define EDDYSTONE_INSTANCE_ID_LEN   TAG_PAYLOAD_INSTANCE_LEN
+#define EDDYSTONE_NAMESPACE_LENGFTH TAG_PAYLOAD_NAMESPACE_LEN
+
+// Limits of the periodic advertising data passed to btAdvSetPerAdvData
+#define BT_ADV_PER_ADV_DATA_MAX_NUM 2
+#define BT_ADV_PER_ADV_DATA_MAX_LEN 64
+
+// Limits of the radio parameters passed to btAdvSetRadioParams
+#define BT_ADV_EXT_INTERVAL_MIN_MS  32
+#define BT_ADV_EXT_INTERVAL_MAX_MS  16384
+#define BT_ADV_CTE_LEN_MIN          2   // In units of 8 us
+#define BT_ADV_CTE_LEN_MAX          20
+
+/**
+ * @brief Advertising thread statistics since boot
+ */
+typedef struct btAdvStats_t {
+    uint32_t requests;          // Requests posted
+    uint32_t coalesced;         // Requests that replaced a pending request of the same kind
+    uint32_t batches;           // Times the advertising thread woke up to handle requests
+    uint8_t maxQueueDepth;      // Most kinds of requests pending at once
+    uint32_t hciCalls;
+    uint32_t hciErrors;
+    uint64_t hciTotalUs;
+    uint32_t hciMaxUs;
+    uint32_t intervalErrors;    // Interval requests the controller did not accept
+} btAdvStats_t;
+
+/**
+ * @brief   Result of btAdvUpdateAdvInterval
+ * @details Called by the advertising thread once the request has been handled, or with
+ *          -ECANCELED from btAdvUpdateAdvInterval when a request with another callback or user
+ *          data replaced it before that. Must not block, hand the result over to a work item.
+ *
+ * @param   minMs           Min adv. interval in milliseconds, as requested
+ * @param   maxMs           Max adv. interval in milliseconds, as requested
+ * @param   err             0 if the interval is in use, negative error code otherwise
+ * @param   pUserData       As passed to btAdvUpdateAdvInterval
+ */
+typedef void (*btAdvIntervalCb_t)(uint16_t minMs, uint16_t maxMs, int err, void *pUserData);
+
+/*
+ * All advertising changes are made by a dedicated thread. The functions below post a request to
+ * it and return without waiting for the HCI commands. A request replaces a pending request of
+ * the same kind, e.g. only the last of two quick payload updates is sent to the controller.
+ * Requests posted before btAdvInit are held until after init.
+ */
 
 /**
  * @brief   Init BT advertising
@@ -31,10 +77,12 @@
  * @param   max_int         Max adv. interval in milliseconds
  * @param   namespace       Pointer to the namespace to be sent in Eddystone beacon.
  * @param   instance_id     Pointer to the instance ID to be sent in Eddystone beacon.
- * @param   txPower         The TX power put in advertising data
+ * @param   txPower         TX power in dBm, also put in the advertising data
+ * @param   extIntervalMs   Min extended adv. interval in milliseconds
+ * @param   cteLen          CTE length in units of 8 us
  */
-void btAdvInit(uint16_t min_int, uint16_t max_int, uint8_t *namespace, uint8_t *instance_id,
-               int8_t txPower);
+void btAdvInit(uint16_t min_int, uint16_t max_int, const uint8_t *namespace,
+               const uint8_t *instance_id, int8_t txPower, uint16_t extIntervalMs, uint8_t cteLen);
 
 /**
  * @brief   Start BT advertising
@@ -42,22 +90,79 @@ void btAdvInit(uint16_t min_int, uint16_t max_int, uint8_t *namespace, uint8_t *
  */
 void btAdvStart(void);
 
+#if defined(CONFIG_BT_NUS)
+/**
+ * @brief   Start connectable legacy advertising for the Nordic UART Service
+ * @details Advertising must be initialized before calling. Runs independently of
+ *          btAdvStart/btAdvStop.
+ */
+void btAdvStartNus(void);
+#endif
+
 /**
  * @brief   Stop BT advertising
  * @details Stop advertising, call btAdvStart to enable advertising again.
  */
 void btAdvStop(void);
 
+/**
+ * @brief   Restart BT advertising
+ * @details Stop advertising and start it again after a delay, if it is running. The advertising
+ *          thread is not blocked meanwhile, a start or stop request during the delay replaces
+ *          the start at the end of it.
+ *
+ * @param   delayMs         Time to stay stopped in milliseconds
+ */
+void btAdvRestart(uint16_t delayMs);
+
 /**
  * @brief   Change the advertsing interval
  * @details Change the advertising interval, advertsing will be stopped and restarted with the new interval.
+ *          Advertising is started if it was stopped. Returns without waiting, the result is
+ *          passed to cb. Before btAdvInit has been handled the interval is applied by the init.
  *
  * @param   min_int         Min adv. interval in milliseconds
  * @param   max_int         Max adv. interval in milliseconds
+ * @param   cb              Called with the result, NULL if not needed
+ * @param   pUserData       Passed to cb
  *
- * @return                  True if success, false otherwise.
+ * @return                  True if the interval was valid and the request posted, false otherwise.
  */
-bool btAdvUpdateAdvInterval(uint16_t min, uint16_t max);
+bool btAdvUpdateAdvInterval(uint16_t min, uint16_t max, btAdvIntervalCb_t cb, void *pUserData);
+
+/**
+ * @brief   Check an advertising interval
+ *
+ * @param   min             Min adv. interval in milliseconds
+ * @param   max             Max adv. interval in milliseconds
+ *
+ * @return                  True if btAdvUpdateAdvInterval would accept the interval.
+ */
+bool btAdvIntervalValid(uint16_t min, uint16_t max);
+
+/**
+ * @brief   Change the radio parameters
+ * @details Advertising is stopped while the parameters are changed and restarted if it was
+ *          running. The controller may use an extended interval up to
+ *          CONFIG_EXT_ADV_INT_MS_MAX - CONFIG_EXT_ADV_INT_MS_MIN longer than extIntervalMs.
+ *
+ * @param   extIntervalMs   Min extended adv. interval in milliseconds
+ * @param   cteLen          CTE length in units of 8 us
+ * @param   txPower         TX power in dBm, must be supported by the radio
+ *
+ * @return                  True if the parameters were valid, false otherwise.
+ */
+bool btAdvSetRadioParams(uint16_t extIntervalMs, uint8_t cteLen, int8_t txPower);
+
+/**
+ * @brief   Check radio parameters
+ *
+ * @param   extIntervalMs   Min extended adv. interval in milliseconds
+ * @param   cteLen          CTE length in units of 8 us
+ *
+ * @return                  True if btAdvSetRadioParams would accept the parameters.
+ */
+bool btAdvRadioParamsValid(uint16_t extIntervalMs, uint8_t cteLen);
 
 /**
  * @brief Set or update the periodic advertising data.
@@ -70,4 +175,18 @@ bool btAdvUpdateAdvInterval(uint16_t min, uint16_t max);
  */
 void btAdvSetPerAdvData(struct bt_data *data, int len);
 
+/**
+ * @brief   Get the number of periodic advertising events sent since boot.
+ * @details Estimated from the time periodic advertising has been enabled and its interval. The
+ *          controller runs on the same low frequency clock, so the estimate does not drift.
+ */
+uint32_t btAdvGetPerAdvEventCount(void);
+
+/**
+ * @brief   Get advertising thread statistics.
+ *
+ * @param   pStats          [out] the statistics.
+ */
+void btAdvGetStats(btAdvStats_t *pStats);
+
 #endif
\ No newline at end of file
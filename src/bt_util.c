@@ -18,11 +18,13 @@
 #include <zephyr.h>
 #include <string.h>
 #include <ctype.h>
+#include <random/rand32.h>
 
 #define EMPTY_REGISTER  0xFFFFFFFF
 
 void utilGetBtAddr(bt_addr_le_t *addr)
 {
+#ifdef CONFIG_SOC_FAMILY_NRF
     if (NRF_UICR->CUSTOMER[0] != EMPTY_REGISTER || NRF_UICR->CUSTOMER[1] != EMPTY_REGISTER) {
         addr->a.val[0] = (uint8_t)(NRF_UICR->CUSTOMER[1] >> 8);
         addr->a.val[1] = (uint8_t)NRF_UICR->CUSTOMER[1];
@@ -41,6 +43,13 @@ void utilGetBtAddr(bt_addr_le_t *addr)
         *((uint8_t *)addr->a.val + 5) = (uint8_t)(NRF_FICR->DEVICEADDR[0]);
         addr->type = BT_ADDR_LE_RANDOM;
     }
+#else
+    // No factory address without the FICR, use a random static one. On native_posix it is
+    // derived from the --seed option so that runs can be repeated.
+    sys_rand_get(addr->a.val, sizeof(addr->a.val));
+    addr->a.val[5] |= 0xC0;
+    addr->type = BT_ADDR_LE_RANDOM;
+#endif
 }
 
 void utilToupper(char *str)
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "budget.h"
+#include "energy_model.h"
+
+#include <stddef.h>
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+// Candidates, fastest first
+static const uint16_t perIntervalsMs[] = {
+    8, 10, 20, 25, 50, 75, 100, 150, 200, 250, 500, 750, 1000, 2000, 5000, 10000, 30000, 60000
+};
+static const uint16_t extIntervalsMs[] = {
+    32, 50, 100, 200, 250, 500, 1000, 1500, 2000, 3000, 5000, 10000, 16384
+};
+static const uint8_t cteLens[] = {BUDGET_CTE_LEN_MAX, 16, 12, 8, 4, BUDGET_CTE_LEN_MIN};
+
+static bool lastsLongEnough(const budgetInput_t *pIn, budgetResult_t *pSettings)
+{
+    budgetEvaluate(pIn, pSettings);
+    return pSettings->lifeHours >= pIn->targetHours;
+}
+
+void budgetEvaluate(const budgetInput_t *pIn, budgetResult_t *pSettings)
+{
+    uint64_t capacityUah = (uint64_t)pIn->capacityMah * 1000;
+    uint32_t extNc = energyModelExtEventNc(pIn->extPayloadLen, pSettings->txPower);
+    uint32_t perNc = energyModelPerEventNc(pIn->perPayloadLen, pSettings->cteLen,
+                                           pSettings->cteCount, pSettings->txPower);
+    uint64_t avgNa = ENERGY_MODEL_SLEEP_CURRENT_NA + pIn->otherCurrentNa +
+                     energyModelAdvCurrentNa(extNc, pSettings->extIntervalMs * 1000UL, perNc,
+                                             pSettings->perIntervalMs * 1000UL);
+    uint64_t lifeHours = 0;
+
+    if (capacityUah > pIn->consumedUah) {
+        // uAh * 1000 / nA = h
+        lifeHours = (capacityUah - pIn->consumedUah) * 1000 / avgNa;
+    }
+    pSettings->avgCurrentNa = avgNa;
+    pSettings->lifeHours = lifeHours > UINT32_MAX ? UINT32_MAX : lifeHours;
+}
+
+bool budgetSolve(const budgetInput_t *pIn, budgetResult_t *pOut)
+{
+    int8_t txMin;
+    int numTx = 0;
+    int8_t tx;
+    uint16_t extSlowest = 0;
+    budgetResult_t candidate;
+
+    energyModelGetTxPower(0, &txMin);
+    while (energyModelGetTxPower(numTx, &tx)) {
+        numTx++;
+    }
+    for (size_t i = 0; i < ARRAY_LEN(extIntervalsMs); i++) {
+        if (extIntervalsMs[i] >= pIn->extIntervalMinMs &&
+            extIntervalsMs[i] <= pIn->extIntervalMaxMs) {
+            extSlowest = extIntervalsMs[i];
+        }
+    }
+    if (extSlowest == 0 || pIn->cteCountMax == 0) {
+        return false;
+    }
+
+    for (size_t p = 0; p < ARRAY_LEN(perIntervalsMs); p++) {
+        candidate.perIntervalMs = perIntervalsMs[p];
+
+        // Skip the interval if not even the cheapest settings with it last long enough
+        candidate.extIntervalMs = extSlowest;
+        candidate.cteLen = BUDGET_CTE_LEN_MIN;
+        candidate.cteCount = 1;
+        candidate.txPower = txMin;
+        if (!lastsLongEnough(pIn, &candidate)) {
+            continue;
+        }
+
+        for (size_t c = 0; c < ARRAY_LEN(cteLens); c++) {
+            candidate.cteLen = cteLens[c];
+            for (int t = numTx - 1; t >= 0; t--) {
+                energyModelGetTxPower(t, &candidate.txPower);
+                for (int n = pIn->cteCountMax; n >= 1; n--) {
+                    candidate.cteCount = n;
+                    for (size_t e = 0; e < ARRAY_LEN(extIntervalsMs); e++) {
+                        if (extIntervalsMs[e] < pIn->extIntervalMinMs ||
+                            extIntervalsMs[e] > pIn->extIntervalMaxMs) {
+                            continue;
+                        }
+                        candidate.extIntervalMs = extIntervalsMs[e];
+                        if (lastsLongEnough(pIn, &candidate)) {
+                            *pOut = candidate;
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
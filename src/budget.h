@@ -0,0 +1,73 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BUDGET_H
+#define __BUDGET_H
+
+/*
+ * Battery life budget solver: the fastest advertising settings that last a given time, see
+ * scripts/budget.py.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BUDGET_CTE_LEN_MIN  2   // 16 us, shortest CTE allowed by the spec
+#define BUDGET_CTE_LEN_MAX  20  // 160 us
+
+typedef struct budgetInput_t {
+    uint32_t targetHours;       // Required battery life from now
+    uint32_t capacityMah;
+    uint32_t consumedUah;       // Already used from the battery
+    uint32_t otherCurrentNa;    // Everything but sleep and advertising, e.g. sensors
+    uint16_t extPayloadLen;     // Bytes of AD data in extended advertising
+    uint16_t perPayloadLen;     // Bytes of AD data in periodic advertising
+    uint16_t extIntervalMinMs;  // Allowed extended advertising interval range
+    uint16_t extIntervalMaxMs;
+    uint8_t cteCountMax;        // CTEs per periodic event the controller supports
+} budgetInput_t;
+
+typedef struct budgetResult_t {
+    uint16_t perIntervalMs;
+    uint16_t extIntervalMs;
+    uint8_t cteLen;             // In units of 8 us
+    uint8_t cteCount;
+    int8_t txPower;             // dBm
+    uint32_t avgCurrentNa;
+    uint32_t lifeHours;
+} budgetResult_t;
+
+/**
+ * @brief   Pick the fastest advertising settings that last the target lifetime.
+ * @details Settings are compared in order of importance: shortest periodic interval, then
+ *          longest CTE, highest TX power, most CTEs per event and last shortest extended
+ *          interval. The first combination in that order that lasts long enough is returned.
+ *
+ * @param   pIn             Target and fixed parameters.
+ * @param   pOut            [out] The selected settings and their projected life.
+ * @return  False if even the slowest settings do not last long enough.
+ */
+bool budgetSolve(const budgetInput_t *pIn, budgetResult_t *pOut);
+
+/**
+ * @brief   Project the battery life of a set of settings.
+ *
+ * @param   pIn             Fixed parameters, targetHours is not used.
+ * @param   pSettings       Settings to evaluate, avgCurrentNa and lifeHours are filled in.
+ */
+void budgetEvaluate(const budgetInput_t *pIn, budgetResult_t *pSettings);
+
+#endif
@@ -19,19 +19,25 @@
 #include <zephyr.h>
 #include <device.h>
 #include <sys/__assert.h>
-#include <assert.h>
 #include <drivers/gpio.h>
 #include <logging/log.h>
 
-LOG_MODULE_REGISTER(buttons, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+#include "app_work.h"
 
-#define STACKSIZE               1024
-#define PRIORITY                7
+LOG_MODULE_REGISTER(buttons, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
 
-#define BTN_LONG_PRESS_LIMIT  1000
+#define BTN_LONG_PRESS_LIMIT    1000
+#define BTN_DEBOUNCE_MS         30
+// Longest time between the presses of a double or triple press
+#define BTN_MULTI_PRESS_GAP_MS  400
+#define BTN_MAX_PRESSES         3
+#define BTN_BOOT_HOLD_MS        3000
+#define BTN_GESTURE_QUEUE_LEN   4
 
-static void buttonPressedIsr(const struct device *dev, struct gpio_callback *cb, uint32_t pins);
-static void handleButtonThread(void);
+static void buttonIsr(const struct device *dev, struct gpio_callback *cb, uint32_t pins);
+static void debounceTimerHandler(struct k_timer *timer);
+static void gestureTimerHandler(struct k_timer *timer);
+static void gestureWorkHandler(struct k_work *item);
 
 static buttonHandlerCallback_t callback;
 static struct gpio_callback buttonCallbackData;
@@ -39,11 +45,22 @@ static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET_OR(DT_ALIAS(sw1), gpi
                                                                   0
                                                               });
 
-static struct k_sem btnSem;
-static int buttonCount = 0;
+static struct k_spinlock lock;
+// Debounced state and the kernel time of the first edge of the bounce being debounced
+static bool buttonDown;
+static bool debouncing;
+static int64_t edgeTicks;
+static int64_t pressTicks;
+// Short presses of the gesture being decoded
+static uint8_t presses;
+// The press started before init, its release is not a gesture
+static bool heldAtBoot;
 
-K_THREAD_DEFINE(buttonThreadId, STACKSIZE, handleButtonThread, NULL, NULL, NULL, PRIORITY, 0,
-                K_TICKS_FOREVER);
+// Edges and gestures are handled in timer context, only the callback runs on the work queue
+K_TIMER_DEFINE(debounceTimer, debounceTimerHandler, NULL);
+K_TIMER_DEFINE(gestureTimer, gestureTimerHandler, NULL);
+K_MSGQ_DEFINE(gestureQueue, sizeof(uint8_t), BTN_GESTURE_QUEUE_LEN, 1);
+K_WORK_DEFINE(gestureWork, gestureWorkHandler);
 
 
 void buttonsInit(buttonHandlerCallback_t handler)
@@ -61,52 +78,125 @@ void buttonsInit(buttonHandlerCallback_t handler)
         return;
     }
 
-    k_sem_init(&btnSem, 0, 1);
-    k_thread_start(buttonThreadId);
-    gpio_init_callback(&buttonCallbackData, buttonPressedIsr, BIT(button.pin));
+    if (gpio_pin_get_dt(&button) > 0) {
+        buttonDown = true;
+        heldAtBoot = true;
+        pressTicks = k_uptime_ticks();
+        k_timer_start(&gestureTimer, K_MSEC(BTN_BOOT_HOLD_MS), K_NO_WAIT);
+    }
+    gpio_init_callback(&buttonCallbackData, buttonIsr, BIT(button.pin));
     gpio_add_callback(button.port, &buttonCallbackData);
-    gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_TO_ACTIVE);
-    LOG_INF("Set up button at %s pin %d", button.port->name, button.pin);
+    gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_BOTH);
+    LOG_INF("Set up button at %s pin %d%s", button.port->name, button.pin,
+            heldAtBoot ? ", held" : "");
 }
 
-static void buttonPressedIsr(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+static void reportGesture(buttonPressType_t type)
 {
-    uint32_t val;
-    gpio_remove_callback(button.port, &buttonCallbackData);
-    val = gpio_pin_get_dt(&button);
-    k_sem_give(&btnSem);
+    uint8_t gesture = type;
+
+    if (k_msgq_put(&gestureQueue, &gesture, K_NO_WAIT) != 0) {
+        LOG_WRN("Gesture %d dropped", type);
+        return;
+    }
+    k_work_submit_to_queue(&appWorkQ, &gestureWork);
 }
 
-static void handleButtonThread(void)
+// Short presses collected so far, if any
+static void reportPresses(void)
 {
-    int ret;
-    uint32_t val;
-    int64_t btn_press_start_ms;
-    int64_t btn_pressed_ms;
-    buttonPressType_t press_type;
-
-    while (true) {
-        ret = k_sem_take(&btnSem, K_FOREVER);
-        assert(ret == 0);
-        btn_press_start_ms = k_uptime_get_32();
-        k_sleep(K_MSEC(100)); // Let debounce stabilize
-        val = gpio_pin_get_dt(&button);
-
-        while (val) {
-            val = gpio_pin_get_dt(&button);
-            k_sleep(K_MSEC(10));
-        }
+    static const buttonPressType_t gestures[BTN_MAX_PRESSES + 1] = {
+        [1] = BUTTONS_SHORT_PRESS,
+        [2] = BUTTONS_DOUBLE_PRESS,
+        [3] = BUTTONS_TRIPLE_PRESS,
+    };
+
+    if (presses > 0) {
+        reportGesture(gestures[presses]);
+        presses = 0;
+    }
+}
 
-        buttonCount++;
+static void buttonIsr(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
 
-        btn_pressed_ms = k_uptime_delta(&btn_press_start_ms);
+    // Bounces restart the timer, the pin is sampled once it has been stable
+    if (!debouncing) {
+        debouncing = true;
+        edgeTicks = k_uptime_ticks();
+    }
+    k_timer_start(&debounceTimer, K_MSEC(BTN_DEBOUNCE_MS), K_NO_WAIT);
+    k_spin_unlock(&lock, key);
+}
+
+static void onPress(int64_t ticks)
+{
+    pressTicks = ticks;
+    // Part of the same gesture, decided at the release
+    k_timer_stop(&gestureTimer);
+}
 
-        if (btn_pressed_ms < BTN_LONG_PRESS_LIMIT) {
-            press_type = BUTTONS_SHORT_PRESS;
+static void onRelease(int64_t ticks)
+{
+    int64_t pressedMs = k_ticks_to_ms_floor64(ticks - pressTicks);
+
+    if (heldAtBoot) {
+        // Released before the boot hold was reached, or after it was reported
+        heldAtBoot = false;
+        k_timer_stop(&gestureTimer);
+        return;
+    }
+    if (pressedMs >= BTN_LONG_PRESS_LIMIT) {
+        reportPresses();
+        reportGesture(BUTTONS_LONG_PRESS);
+        return;
+    }
+    if (++presses == BTN_MAX_PRESSES) {
+        // Nothing longer to wait for
+        reportPresses();
+    } else {
+        k_timer_start(&gestureTimer, K_MSEC(BTN_MULTI_PRESS_GAP_MS), K_NO_WAIT);
+    }
+}
+
+static void debounceTimerHandler(struct k_timer *timer)
+{
+    bool down = gpio_pin_get_dt(&button) > 0;
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int64_t ticks = edgeTicks;
+
+    debouncing = false;
+    if (down != buttonDown) {
+        buttonDown = down;
+        if (down) {
+            onPress(ticks);
         } else {
-            press_type = BUTTONS_LONG_PRESS;
+            onRelease(ticks);
+        }
+    }
+    k_spin_unlock(&lock, key);
+}
+
+static void gestureTimerHandler(struct k_timer *timer)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (heldAtBoot) {
+        if (buttonDown) {
+            reportGesture(BUTTONS_BOOT_HOLD);
         }
-        callback(press_type);
-        gpio_add_callback(button.port, &buttonCallbackData);
+    } else if (!buttonDown) {
+        reportPresses();
     }
-}
\ No newline at end of file
+    k_spin_unlock(&lock, key);
+}
+
+static void gestureWorkHandler(struct k_work *item)
+{
+    uint8_t gesture;
+
+    while (k_msgq_get(&gestureQueue, &gesture, K_NO_WAIT) == 0) {
+        callback(gesture);
+    }
+}
@@ -20,19 +20,28 @@
 #include <zephyr.h>
 
 /**
- * @brief Type of button event
+ * @brief Button gesture
  */
 typedef enum buttonPressType_t {
-    BUTTONS_SHORT_PRESS,
-    BUTTONS_LONG_PRESS
+    BUTTONS_SHORT_PRESS,        // One press shorter than a second
+    BUTTONS_LONG_PRESS,         // A press of a second or more
+    BUTTONS_DOUBLE_PRESS,       // Two short presses less than 400 ms apart
+    BUTTONS_TRIPLE_PRESS,       // Three short presses less than 400 ms apart
+    BUTTONS_BOOT_HOLD,          // Pressed at boot and held for 3 seconds
+    BUTTONS_PRESS_END
 } buttonPressType_t;
 
 typedef void(*buttonHandlerCallback_t)(buttonPressType_t type);
 
 /**
  * @brief   Init Button press handler
+ * @details Both edges are taken by interrupt and debounced by a timer, nothing polls the pin.
+ *          Short presses are reported 400 ms after the release, once no further press can
+ *          make them a double or triple press. A press that started before init is only
+ *          reported if it lasts long enough to be a boot hold.
  *
- * @param   handler          Pointer to callback function for button events.
+ * @param   handler          Pointer to callback function for button events, called on the
+ *                           application work queue.
  */
 void buttonsInit(buttonHandlerCallback_t handler);
 
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "energy.h"
+#include "energy_model.h"
+#include "leds.h"
+#include "storage.h"
+#include "journal.h"
+#include "at_host.h"
+
+#include <zephyr.h>
+#include <string.h>
+#include <sys/__assert.h>
+
+static const char *const consumerNames[ENERGY_END] = {
+    [ENERGY_BASE] = "BASE",
+    [ENERGY_EXT_ADV] = "EXT_ADV",
+    [ENERGY_PER_ADV] = "PER_ADV",
+    [ENERGY_SENSORS] = "SENSORS",
+    [ENERGY_LED] = "LED",
+    [ENERGY_UART] = "UART",
+    [ENERGY_FLASH] = "FLASH",
+};
+
+static const uint32_t eventChargeNc[ENERGY_EVENT_END] = {
+    [ENERGY_EVENT_BME280] = ENERGY_MODEL_BME280_CONVERSION_NC,
+    [ENERGY_EVENT_LIS2DW12] = ENERGY_MODEL_LIS2DW12_CONVERSION_NC,
+};
+
+static struct k_spinlock lock;
+static uint64_t chargeNc[ENERGY_END];
+static energyAdvState_t advState;
+static uint32_t extEventNc;
+static uint32_t perEventNc;
+static int64_t advSettledUs;
+static bool ledOn[LED_END];
+static int64_t ledOnSinceUs[LED_END];
+
+static int64_t nowUs(void)
+{
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+// uA * us = pC
+static uint64_t ledChargeNc(int64_t onUs)
+{
+    return (uint64_t)onUs * ENERGY_MODEL_LED_CURRENT_UA / 1000;
+}
+
+// Account for the advertising events since the last call, lock must be held
+static void settleAdv(int64_t now)
+{
+    uint64_t elapsedUs = now - advSettledUs;
+
+    if (advState.running) {
+        chargeNc[ENERGY_EXT_ADV] += elapsedUs * extEventNc / advState.extIntervalUs;
+        chargeNc[ENERGY_PER_ADV] += elapsedUs * perEventNc / advState.perIntervalUs;
+    }
+    advSettledUs = now;
+}
+
+void energySetAdvState(const energyAdvState_t *pState)
+{
+    k_spinlock_key_t key;
+
+    key = k_spin_lock(&lock);
+    settleAdv(nowUs());
+    advState = *pState;
+    if (advState.extIntervalUs == 0 || advState.perIntervalUs == 0) {
+        // Not configured, nothing can be sent
+        advState.running = false;
+    }
+    extEventNc = energyModelExtEventNc(pState->extPayloadLen, pState->txPower);
+    perEventNc = energyModelPerEventNc(pState->perPayloadLen, pState->cteLen, pState->cteCount,
+                                       pState->txPower);
+    k_spin_unlock(&lock, key);
+}
+
+void energyGetAdvState(energyAdvState_t *pState)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *pState = advState;
+    k_spin_unlock(&lock, key);
+}
+
+void energyCountEvent(energyEvent_t event)
+{
+    k_spinlock_key_t key;
+
+    __ASSERT_NO_MSG(event < ENERGY_EVENT_END);
+    key = k_spin_lock(&lock);
+
+    chargeNc[ENERGY_SENSORS] += eventChargeNc[event];
+    k_spin_unlock(&lock, key);
+}
+
+void energySetLedState(uint8_t led, bool on)
+{
+    k_spinlock_key_t key;
+    int64_t now;
+
+    __ASSERT_NO_MSG(led < LED_END);
+    key = k_spin_lock(&lock);
+    now = nowUs();
+
+    if (on && !ledOn[led]) {
+        ledOnSinceUs[led] = now;
+    } else if (!on && ledOn[led]) {
+        chargeNc[ENERGY_LED] += ledChargeNc(now - ledOnSinceUs[led]);
+    }
+    ledOn[led] = on;
+    k_spin_unlock(&lock, key);
+}
+
+void energyGet(energyStats_t *pStats)
+{
+    uint64_t charge[ENERGY_END];
+    uint64_t totalNc = 0;
+    uint64_t variableNc = 0;
+    uint64_t advCurrentNa = 0;
+    uint64_t otherNa;
+    uint64_t avgNa;
+    uint64_t capacityUah = (uint64_t)CONFIG_BATTERY_CAPACITY_MAH * 1000;
+    storageStats_t storageStats;
+    journalStats_t journalStats;
+    k_spinlock_key_t key;
+    int64_t now;
+
+    storageGetStats(&storageStats);
+    journalGetStats(&journalStats);
+
+    key = k_spin_lock(&lock);
+    now = nowUs();
+    settleAdv(now);
+    memcpy(charge, chargeNc, sizeof(charge));
+    for (int i = 0; i < LED_END; i++) {
+        if (ledOn[i]) {
+            charge[ENERGY_LED] += ledChargeNc(now - ledOnSinceUs[i]);
+        }
+    }
+    if (advState.running) {
+        advCurrentNa = energyModelAdvCurrentNa(extEventNc, advState.extIntervalUs, perEventNc,
+                                               advState.perIntervalUs);
+    }
+    k_spin_unlock(&lock, key);
+
+    charge[ENERGY_BASE] = (uint64_t)now * ENERGY_MODEL_SLEEP_CURRENT_NA / 1000000;
+    charge[ENERGY_UART] = (uint64_t)atHostGetUartOnTimeMs() * ENERGY_MODEL_UART_CURRENT_UA;
+    charge[ENERGY_FLASH] = (storageStats.bytesWritten + ENERGY_MODEL_NVS_ATE_BYTES *
+                            storageStats.nvsWrites + journalStats.bytesWritten) / 4 *
+                           ENERGY_MODEL_FLASH_WRITE_NC_PER_WORD +
+                           (uint64_t)(storageStats.gcCount + journalStats.erases) *
+                           ENERGY_MODEL_FLASH_ERASE_NC;
+
+    for (int i = 0; i < ENERGY_END; i++) {
+        pStats->consumedUah[i] = charge[i] / ENERGY_MODEL_NC_PER_UAH;
+        totalNc += charge[i];
+    }
+    pStats->totalUah = totalNc / ENERGY_MODEL_NC_PER_UAH;
+
+    // Sleep and advertising at the current settings, the rest at their average since boot
+    variableNc = charge[ENERGY_SENSORS] + charge[ENERGY_LED] + charge[ENERGY_UART] +
+                 charge[ENERGY_FLASH];
+    otherNa = now > 0 ? variableNc * 1000000 / now : 0;
+    avgNa = ENERGY_MODEL_SLEEP_CURRENT_NA + advCurrentNa + otherNa;
+    pStats->avgCurrentUa = avgNa / 1000;
+    pStats->otherCurrentUa = otherNa / 1000;
+    if (pStats->totalUah < capacityUah && avgNa > 0) {
+        pStats->remainingHours = (capacityUah - pStats->totalUah) * 1000 / avgNa;
+    } else {
+        pStats->remainingHours = 0;
+    }
+}
+
+const char *energyConsumerName(energyConsumer_t consumer)
+{
+    if (consumer >= ENERGY_END) {
+        return "?";
+    }
+    return consumerNames[consumer];
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ENERGY_H
+#define __ENERGY_H
+
+#include <zephyr.h>
+
+/**
+ * @brief Subsystems that charge is accounted to
+ */
+typedef enum energyConsumer_t {
+    ENERGY_BASE = 0,    // Sleep current of the module and sensors
+    ENERGY_EXT_ADV,     // Extended advertising events
+    ENERGY_PER_ADV,     // Periodic advertising events including the CTE
+    ENERGY_SENSORS,     // Sensor conversions
+    ENERGY_LED,
+    ENERGY_UART,
+    ENERGY_FLASH,       // NVS writes and page erases
+    ENERGY_END
+} energyConsumer_t;
+
+/**
+ * @brief Sensor conversions, each one costs a fixed charge
+ */
+typedef enum energyEvent_t {
+    ENERGY_EVENT_BME280 = 0,
+    ENERGY_EVENT_LIS2DW12,
+    ENERGY_EVENT_END
+} energyEvent_t;
+
+/**
+ * @brief Advertising parameters the charge per event depends on
+ */
+typedef struct energyAdvState_t {
+    bool running;
+    uint32_t extIntervalUs;
+    uint32_t perIntervalUs;
+    uint16_t extPayloadLen;     // Bytes of AD data in the AUX_ADV_IND
+    uint16_t perPayloadLen;     // Bytes of AD data in the AUX_SYNC_IND
+    uint8_t cteLen;             // In units of 8 us
+    uint8_t cteCount;
+    int8_t txPower;             // dBm
+} energyAdvState_t;
+
+typedef struct energyStats_t {
+    uint32_t consumedUah[ENERGY_END];   // Since boot
+    uint32_t totalUah;
+    uint32_t avgCurrentUa;              // Projected average with the current settings
+    uint32_t otherCurrentUa;            // Average of sensors, LED, UART and flash since boot
+    uint32_t remainingHours;            // Projected battery life left, 0 if depleted
+} energyStats_t;
+
+/**
+ * @brief   Update the advertising parameters.
+ * @details Charge for the events since the last update is accounted with the old parameters.
+ */
+void energySetAdvState(const energyAdvState_t *pState);
+
+/**
+ * @brief   Get the advertising parameters last set.
+ */
+void energyGetAdvState(energyAdvState_t *pState);
+
+/**
+ * @brief   Account for one sensor conversion.
+ */
+void energyCountEvent(energyEvent_t event);
+
+/**
+ * @brief   Account for LED on-time. Only changes of state matter, repeated calls are fine.
+ *
+ * @param   led         LED index, see leds_t.
+ * @param   on          New state.
+ */
+void energySetLedState(uint8_t led, bool on);
+
+/**
+ * @brief   Get the consumed charge per subsystem and the projected battery life.
+ * @details The battery capacity is CONFIG_BATTERY_CAPACITY_MAH. Consumed charge is counted since
+ *          boot and is not stored, so after a reset the projection assumes a full battery.
+ */
+void energyGet(energyStats_t *pStats);
+
+/**
+ * @brief   Get the name of a consumer.
+ */
+const char *energyConsumerName(energyConsumer_t consumer);
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ENERGY_MODEL_H
+#define __ENERGY_MODEL_H
+
+/*
+ * Charge model of the tag: the charge of each advertising event and sensor conversion, used by
+ * the energy accounting and the budget solver.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ENERGY_MODEL_SLEEP_CURRENT_NA       22000
+#define ENERGY_MODEL_BME280_CONVERSION_NC   5000
+#define ENERGY_MODEL_LIS2DW12_CONVERSION_NC 1500
+#define ENERGY_MODEL_LED_CURRENT_UA         2000
+#define ENERGY_MODEL_UART_CURRENT_UA        800     // UARTE RX and HFCLK running
+#define ENERGY_MODEL_FLASH_WRITE_NC_PER_WORD 140
+#define ENERGY_MODEL_NVS_ATE_BYTES          8
+#define ENERGY_MODEL_FLASH_ERASE_NC         300000
+
+#define ENERGY_MODEL_NC_PER_UAH             3600000ULL
+
+/**
+ * @brief   Check if the radio supports a TX power.
+ *
+ * @param   txPower         TX power in dBm.
+ * @return  True if supported.
+ */
+bool energyModelValidTxPower(int8_t txPower);
+
+/**
+ * @brief   Get the supported TX powers.
+ *
+ * @param   index           0 for the lowest power.
+ * @param   pTxPower        [out] TX power in dBm.
+ * @return  False if index is past the last power.
+ */
+bool energyModelGetTxPower(int index, int8_t *pTxPower);
+
+/**
+ * @brief   Charge of one extended advertising event, the primary channel PDUs and AUX_ADV_IND.
+ *
+ * @param   payloadLen      Bytes of AD data.
+ * @param   txPower         TX power in dBm.
+ * @return  Charge in nC.
+ */
+uint32_t energyModelExtEventNc(uint16_t payloadLen, int8_t txPower);
+
+/**
+ * @brief   Charge of one periodic advertising event including the CTEs.
+ *
+ * @param   payloadLen      Bytes of AD data.
+ * @param   cteLen          CTE length in units of 8 us.
+ * @param   cteCount        CTEs per event, each after its own PDU.
+ * @param   txPower         TX power in dBm.
+ * @return  Charge in nC.
+ */
+uint32_t energyModelPerEventNc(uint16_t payloadLen, uint8_t cteLen, uint8_t cteCount,
+                               int8_t txPower);
+
+/**
+ * @brief   Average current of advertising with the given event charges and intervals.
+ *
+ * @return  Current in nA.
+ */
+uint32_t energyModelAdvCurrentNa(uint32_t extEventNc, uint32_t extIntervalUs,
+                                 uint32_t perEventNc, uint32_t perIntervalUs);
+
+#endif
@@ -0,0 +1,474 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "journal.h"
+
+#include <zephyr.h>
+#include <device.h>
+#include <string.h>
+#include <drivers/flash.h>
+#include <drivers/hwinfo.h>
+#include <storage/flash_map.h>
+#include <linker/section_tags.h>
+#include <sys/crc.h>
+#include <logging/log.h>
+#include "app_work.h"
+
+LOG_MODULE_REGISTER(journal, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+
+// The journal partition is a ring of flash pages. Each page starts with a header and is
+// filled with records in the order they were made. When the newest page is full the oldest one
+// is erased and becomes the newest. Records are batched in RAM kept over a reset and written
+// in one flash write per page, so a batch costs one wakeup of the flash.
+
+#define JOURNAL_PAGE_MAGIC      0x4C4E524A  // "JRNL"
+#define JOURNAL_BATCH_MAGIC     0x5441424A  // "JBAT"
+#define JOURNAL_BATCH_RECORDS   16
+
+typedef struct __packed journalPageHeader_t {
+    uint32_t magic;
+    uint32_t seq;               // Incremented for each new page
+    uint16_t boot;              // Boot number when the page was started
+    uint8_t reserved[6];
+} journalPageHeader_t;
+
+BUILD_ASSERT(sizeof(journalRecord_t) == 16);
+BUILD_ASSERT(sizeof(journalPageHeader_t) == sizeof(journalRecord_t));
+
+// Not cleared at boot, records made just before a warm reset are written after it
+struct journalBatch_t {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t crc;               // Of the records in the batch
+    journalRecord_t records[JOURNAL_BATCH_RECORDS];
+};
+
+static void flushWorkHandler(struct k_work *item);
+
+static __noinit struct journalBatch_t batch;
+static struct k_spinlock batchLock;
+K_MUTEX_DEFINE(journalMutex);
+K_WORK_DELAYABLE_DEFINE(flushWork, flushWorkHandler);
+
+static uint16_t bootNum;
+static journalStats_t stats;
+
+#if FLASH_AREA_LABEL_EXISTS(journal)
+static const struct device *pFlashDev;
+static bool flashReady;
+static uint32_t pageSize;
+static uint32_t pageCount;
+static uint32_t recordsPerPage;
+// Newest page, -1 if the journal is empty
+static int32_t curPage = -1;
+static uint32_t curSeq;
+// Records in the newest page and number of full pages before it
+static uint32_t curCount;
+static uint32_t olderPages;
+
+static off_t pageOffset(uint32_t page)
+{
+    return FLASH_AREA_OFFSET(journal) + (off_t)page * pageSize;
+}
+
+static off_t recordOffset(uint32_t page, uint32_t slot)
+{
+    return pageOffset(page) + sizeof(journalPageHeader_t) + slot * sizeof(journalRecord_t);
+}
+
+static bool slotErased(uint32_t page, uint32_t slot)
+{
+    uint32_t words[sizeof(journalRecord_t) / sizeof(uint32_t)];
+
+    if (flash_read(pFlashDev, recordOffset(page, slot), words, sizeof(words))) {
+        return false;
+    }
+    for (int i = 0; i < ARRAY_SIZE(words); i++) {
+        if (words[i] != UINT32_MAX) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint16_t readBoot(uint32_t page, uint32_t slot)
+{
+    journalRecord_t record;
+
+    if (flash_read(pFlashDev, recordOffset(page, slot), &record, sizeof(record))) {
+        return 0;
+    }
+
+    return record.boot;
+}
+
+static int readHeader(uint32_t page, journalPageHeader_t *pHeader)
+{
+    int err = flash_read(pFlashDev, pageOffset(page), pHeader, sizeof(*pHeader));
+
+    if (err) {
+        LOG_ERR("Read page %u failed (err %d)", page, err);
+    }
+
+    return err;
+}
+
+// Find the newest page and the end of the records in it, raises *pLastBoot to the last boot
+// number found in flash
+static int findEnd(uint16_t *pLastBoot)
+{
+    journalPageHeader_t header;
+    uint16_t curBoot = 0;
+    uint32_t lo = 0;
+    uint32_t hi = recordsPerPage;
+
+    for (uint32_t i = 0; i < pageCount; i++) {
+        if (readHeader(i, &header)) {
+            return -EIO;
+        }
+        if (header.magic == JOURNAL_PAGE_MAGIC && (curPage < 0 || header.seq > curSeq)) {
+            curPage = i;
+            curSeq = header.seq;
+            curBoot = header.boot;
+        }
+    }
+    if (curPage < 0) {
+        return 0;
+    }
+    // Pages are used in turn, the ones before the newest page are full
+    for (uint32_t i = 1; i < pageCount; i++) {
+        if (readHeader((curPage + pageCount - i) % pageCount, &header)) {
+            return -EIO;
+        }
+        if (header.magic != JOURNAL_PAGE_MAGIC || header.seq != curSeq - i) {
+            break;
+        }
+        olderPages++;
+    }
+
+    // Records are appended, so the written slots come before the erased ones
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (slotErased(curPage, mid)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    curCount = lo;
+
+    *pLastBoot = MAX(*pLastBoot, curBoot);
+    if (curCount > 0) {
+        *pLastBoot = MAX(*pLastBoot, readBoot(curPage, curCount - 1));
+    } else if (olderPages > 0) {
+        *pLastBoot = MAX(*pLastBoot, readBoot((curPage + pageCount - 1) % pageCount,
+                                             recordsPerPage - 1));
+    }
+
+    return 0;
+}
+
+static int openNextPage(void)
+{
+    uint32_t page = curPage < 0 ? 0 : (curPage + 1) % pageCount;
+    journalPageHeader_t header = {
+        .magic = JOURNAL_PAGE_MAGIC,
+        .seq = curPage < 0 ? 0 : curSeq + 1,
+        .boot = bootNum,
+    };
+    int err;
+
+    memset(header.reserved, 0xFF, sizeof(header.reserved));
+    err = flash_erase(pFlashDev, pageOffset(page), pageSize);
+    if (err) {
+        LOG_ERR("Erase page %u failed (err %d)", page, err);
+        return err;
+    }
+    stats.erases++;
+    err = flash_write(pFlashDev, pageOffset(page), &header, sizeof(header));
+    if (err) {
+        LOG_ERR("Page header write failed (err %d)", err);
+        return err;
+    }
+    stats.bytesWritten += sizeof(header);
+
+    // The page erased was the oldest one once all pages are in use
+    if (curPage >= 0) {
+        olderPages = MIN(olderPages + 1, pageCount - 1);
+    }
+    curPage = page;
+    curSeq = header.seq;
+    curCount = 0;
+
+    return 0;
+}
+
+// journalMutex must be held, returns the number of records written
+static uint32_t writeRecords(const journalRecord_t *pRecords, uint32_t count)
+{
+    uint32_t written = 0;
+
+    if (!flashReady) {
+        return 0;
+    }
+    while (written < count) {
+        uint32_t n;
+        int err;
+
+        if (curPage < 0 || curCount == recordsPerPage) {
+            if (openNextPage()) {
+                break;
+            }
+        }
+        n = MIN(count - written, recordsPerPage - curCount);
+        err = flash_write(pFlashDev, recordOffset(curPage, curCount), &pRecords[written],
+                          n * sizeof(journalRecord_t));
+        if (err) {
+            LOG_ERR("Write failed (err %d)", err);
+            break;
+        }
+        curCount += n;
+        written += n;
+        stats.bytesWritten += n * sizeof(journalRecord_t);
+    }
+
+    return written;
+}
+
+static uint32_t recordsInFlash(void)
+{
+    return curPage < 0 ? 0 : olderPages * recordsPerPage + curCount;
+}
+
+static int initFlash(uint16_t *pLastBoot)
+{
+    struct flash_pages_info info;
+    int err;
+
+    pFlashDev = FLASH_AREA_DEVICE(journal);
+    if (!device_is_ready(pFlashDev)) {
+        LOG_ERR("Flash device %s is not ready", pFlashDev->name);
+        return -ENODEV;
+    }
+    err = flash_get_page_info_by_offs(pFlashDev, FLASH_AREA_OFFSET(journal), &info);
+    if (err) {
+        LOG_ERR("Unable to get page info");
+        return err;
+    }
+    pageSize = info.size;
+    pageCount = FLASH_AREA_SIZE(journal) / info.size;
+    recordsPerPage = (pageSize - sizeof(journalPageHeader_t)) / sizeof(journalRecord_t);
+    if (pageCount < 2) {
+        // The oldest page must be erased while the newest one is kept
+        LOG_ERR("Journal partition needs two pages");
+        return -EINVAL;
+    }
+    stats.capacity = pageCount * recordsPerPage;
+
+    err = findEnd(pLastBoot);
+    if (err) {
+        return err;
+    }
+    flashReady = true;
+
+    return 0;
+}
+#else
+// Simulated builds have no journal partition, records are counted as dropped
+static uint32_t writeRecords(const journalRecord_t *pRecords, uint32_t count)
+{
+    return 0;
+}
+
+static uint32_t recordsInFlash(void)
+{
+    return 0;
+}
+
+static int initFlash(uint16_t *pLastBoot)
+{
+    return -ENOENT;
+}
+#endif
+
+int journalInit(void)
+{
+    uint32_t resetCause = 0;
+    uint32_t recovered;
+    uint16_t lastBoot = 0;
+    int err;
+
+    if (batch.magic != JOURNAL_BATCH_MAGIC || batch.count > JOURNAL_BATCH_RECORDS ||
+        batch.crc != crc32_ieee((uint8_t *)batch.records,
+                                batch.count * sizeof(journalRecord_t))) {
+        // Power on, the RAM holds no batch
+        batch.magic = JOURNAL_BATCH_MAGIC;
+        batch.count = 0;
+        batch.crc = 0;
+    }
+    recovered = batch.count;
+    if (recovered > 0) {
+        lastBoot = batch.records[recovered - 1].boot;
+    }
+
+    err = initFlash(&lastBoot);
+    if (recovered > 0 || recordsInFlash() > 0) {
+        bootNum = lastBoot + 1;
+    }
+
+    // The reset reasons add up until cleared
+    hwinfo_get_reset_cause(&resetCause);
+    hwinfo_clear_reset_cause();
+    LOG_INF("Boot %u, reset cause 0x%x, %u records", bootNum, resetCause, recordsInFlash());
+    if (recovered > 0) {
+        journalFlush();
+    }
+    journalRecord(JOURNAL_EVT_BOOT, resetCause, recovered);
+
+    return err;
+}
+
+void journalRecord(journalEvent_t event, int32_t value, int32_t value2)
+{
+    journalRecord_t record = {
+        .timeMs = k_uptime_get_32(),
+        .boot = bootNum,
+        .event = event,
+        .reserved = 0xFF,
+        .value = value,
+        .value2 = value2,
+    };
+    k_spinlock_key_t key = k_spin_lock(&batchLock);
+    uint32_t count = batch.count;
+
+    if (count < JOURNAL_BATCH_RECORDS) {
+        batch.records[count] = record;
+        batch.crc = crc32_ieee_update(batch.crc, (uint8_t *)&record, sizeof(record));
+        batch.count = ++count;
+    } else {
+        stats.dropped++;
+    }
+    k_spin_unlock(&batchLock, key);
+
+    if (count == JOURNAL_BATCH_RECORDS) {
+        k_work_reschedule_for_queue(&appWorkQ, &flushWork, K_NO_WAIT);
+    } else if (count == 1) {
+        k_work_schedule_for_queue(&appWorkQ, &flushWork, K_SECONDS(CONFIG_JOURNAL_FLUSH_DELAY_S));
+    }
+}
+
+static void flushWorkHandler(struct k_work *item)
+{
+    journalFlush();
+}
+
+void journalFlush(void)
+{
+    // Static, too large for the stack of the work queue along with the flash driver
+    static journalRecord_t records[JOURNAL_BATCH_RECORDS];
+    k_spinlock_key_t key;
+    uint32_t count;
+    uint32_t written;
+
+    k_mutex_lock(&journalMutex, K_FOREVER);
+    key = k_spin_lock(&batchLock);
+    count = batch.count;
+    memcpy(records, batch.records, count * sizeof(journalRecord_t));
+    k_spin_unlock(&batchLock, key);
+
+    if (count > 0) {
+        written = writeRecords(records, count);
+        // Records made while writing stay in the batch. The batch is only shortened once the
+        // records are in flash, a reset meanwhile writes them again at the next boot.
+        key = k_spin_lock(&batchLock);
+        stats.dropped += count - written;
+        batch.count -= count;
+        memmove(batch.records, &batch.records[count], batch.count * sizeof(journalRecord_t));
+        batch.crc = crc32_ieee((uint8_t *)batch.records, batch.count * sizeof(journalRecord_t));
+        k_spin_unlock(&batchLock, key);
+    }
+    k_mutex_unlock(&journalMutex);
+}
+
+int journalRead(uint32_t first, journalRecord_t *pRecords, int maxCount)
+{
+    int count = 0;
+
+#if FLASH_AREA_LABEL_EXISTS(journal)
+    uint32_t total;
+    uint32_t oldestPage;
+
+    k_mutex_lock(&journalMutex, K_FOREVER);
+    total = recordsInFlash();
+    oldestPage = (curPage + pageCount - olderPages) % pageCount;
+    while (count < maxCount && first + count < total) {
+        uint32_t index = first + count;
+        uint32_t slot = index % recordsPerPage;
+        uint32_t page = (oldestPage + index / recordsPerPage) % pageCount;
+        uint32_t n = MIN(MIN(maxCount - count, recordsPerPage - slot), total - index);
+        int err = flash_read(pFlashDev, recordOffset(page, slot), &pRecords[count],
+                             n * sizeof(journalRecord_t));
+
+        if (err) {
+            k_mutex_unlock(&journalMutex);
+            return err;
+        }
+        count += n;
+    }
+    k_mutex_unlock(&journalMutex);
+#endif
+
+    return count;
+}
+
+int journalClear(void)
+{
+    int err = 0;
+
+#if FLASH_AREA_LABEL_EXISTS(journal)
+    k_mutex_lock(&journalMutex, K_FOREVER);
+    if (flashReady) {
+        err = flash_erase(pFlashDev, FLASH_AREA_OFFSET(journal), pageCount * pageSize);
+        stats.erases += pageCount;
+        curPage = -1;
+        curSeq = 0;
+        curCount = 0;
+        olderPages = 0;
+    }
+    k_mutex_unlock(&journalMutex);
+    if (err) {
+        LOG_ERR("Erase failed (err %d)", err);
+    }
+#endif
+
+    return err;
+}
+
+void journalGetStats(journalStats_t *pStats)
+{
+    k_spinlock_key_t key;
+
+    k_mutex_lock(&journalMutex, K_FOREVER);
+    key = k_spin_lock(&batchLock);
+    *pStats = stats;
+    pStats->pending = batch.count;
+    k_spin_unlock(&batchLock, key);
+    pStats->records = recordsInFlash();
+    pStats->boot = bootNum;
+    k_mutex_unlock(&journalMutex);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __JOURNAL_H
+#define __JOURNAL_H
+
+#include <zephyr.h>
+
+/**
+ * @brief Events kept in the journal. Numbers are stored in flash, only add new ones at the end.
+ */
+typedef enum journalEvent_t {
+    JOURNAL_EVT_BOOT = 0,       // value: reset cause (RESET_* of hwinfo), value2: records kept in RAM
+    JOURNAL_EVT_REBOOT,         // value: 0 AT+CPWROFF, 1 button
+    JOURNAL_EVT_ADV_START,
+    JOURNAL_EVT_ADV_STOP,
+    JOURNAL_EVT_ADV_RESTART,    // value: delay in ms
+    JOURNAL_EVT_ADV_INTERVAL,   // value: min, value2: max periodic interval in 1.25 ms units
+    JOURNAL_EVT_RADIO_PARAMS,   // value: ext interval in ms, value2: CTE length << 8 | TX power
+    JOURNAL_EVT_HCI_ERROR,      // value: error, value2: line in bt_adv.c
+    JOURNAL_EVT_UART_ERROR,     // value: UART_ERROR_* RX stop reason
+    JOURNAL_EVT_LOW_BATTERY,    // Not recorded until the battery voltage is measured
+    JOURNAL_EVT_END
+} journalEvent_t;
+
+/**
+ * @brief One journal entry as stored in flash, little endian
+ */
+typedef struct __packed journalRecord_t {
+    uint32_t timeMs;            // Uptime
+    uint16_t boot;              // Boot number, counted by the journal
+    uint8_t event;              // journalEvent_t
+    uint8_t reserved;
+    int32_t value;
+    int32_t value2;
+} journalRecord_t;
+
+typedef struct journalStats_t {
+    uint32_t records;           // In flash
+    uint32_t capacity;          // Records the journal holds before the oldest page is erased
+    uint32_t pending;           // In RAM, not yet written
+    uint16_t boot;
+    uint32_t bytesWritten;      // Since boot
+    uint32_t erases;            // Since boot
+    uint32_t dropped;           // Records lost since boot, RAM batch full or no journal partition
+} journalStats_t;
+
+/**
+ * @brief   Init the journal and add the boot record.
+ * @details Finds the end of the journal in the journal partition and writes the records that
+ *          were still in RAM when the tag was reset. Without a journal partition records are
+ *          counted as dropped.
+ *
+ * @return  0, if init was ok, else negative error code.
+ */
+int journalInit(void);
+
+/**
+ * @brief   Add a record.
+ * @details Records are batched in RAM, kept over a reset, and written to flash once the batch is
+ *          full or CONFIG_JOURNAL_FLUSH_DELAY_S after the first record of the batch. May be
+ *          called from an ISR.
+ */
+void journalRecord(journalEvent_t event, int32_t value, int32_t value2);
+
+/**
+ * @brief   Write the records in RAM to flash now.
+ */
+void journalFlush(void);
+
+/**
+ * @brief   Read records, oldest first.
+ *
+ * @param   first       Index of the first record to read, 0 is the oldest one in flash.
+ * @param   pRecords    [out] the records.
+ * @param   maxCount    Size of pRecords.
+ *
+ * @return  Number of records read, 0 after the last one, or negative error code.
+ */
+int journalRead(uint32_t first, journalRecord_t *pRecords, int maxCount);
+
+/**
+ * @brief   Erase the journal. The boot number is kept.
+ *
+ * @return  0, if erased, else negative error code.
+ */
+int journalClear(void);
+
+/**
+ * @brief   Get the fill level and flash statistics of the journal.
+ */
+void journalGetStats(journalStats_t *pStats);
+
+#endif
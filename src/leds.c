@@ -14,16 +14,35 @@
  * limitations under the License.
  */
 
+#include <zephyr.h>
 #include <device.h>
 #include <sys/__assert.h>
 #include <drivers/gpio.h>
 #include <string.h>
 #include "leds.h"
+#include "energy.h"
 
+#define LEDS_BLINK_MS           150
+#define LEDS_HEARTBEAT_ON_MS    10
+#define LEDS_ERROR_ON_MS        400
+#define LEDS_ERROR_OFF_MS       400
+#define LEDS_ERROR_PAUSE_MS     2000
+#define LEDS_ERROR_GROUPS       3
+
+// Pattern playing on a LED, stepped from the expiry function of its timer
+struct ledPlayer_t {
+    struct k_timer timer;
+    ledsPattern_t pattern;
+    ledsPattern_t background;   // Resumed when a finite pattern ends, flashes 0 if none
+    bool playing;
+    uint8_t flash;              // Flashes done in the current group
+    uint8_t group;              // Groups done
+};
 
 struct ledCfg_t {
     const struct gpio_dt_spec gpio;
     uint8_t state;
+    struct ledPlayer_t player;
 };
 
 struct LedsState_s {
@@ -40,6 +59,45 @@ static struct LedsState_s state = {
     }
 };
 
+static struct k_spinlock lock;
+
+static void playerTimerHandler(struct k_timer *timer);
+
+// lock must be held
+static void setPin(leds_t led, uint8_t on)
+{
+    int err;
+
+    state.leds[led].state = on;
+    err = gpio_pin_set_dt(&state.leds[led].gpio, on);
+    __ASSERT_NO_MSG(err == 0);
+    (void)err;
+    energySetLedState(led, on);
+}
+
+// lock must be held
+static void startPattern(leds_t led, const ledsPattern_t *pPattern)
+{
+    struct ledPlayer_t *pPlayer = &state.leds[led].player;
+
+    pPlayer->pattern = *pPattern;
+    pPlayer->playing = true;
+    pPlayer->flash = 0;
+    pPlayer->group = 0;
+    setPin(led, 1);
+    k_timer_start(&pPlayer->timer, K_MSEC(pPattern->onMs), K_NO_WAIT);
+}
+
+// lock must be held
+static void stopPatterns(leds_t led)
+{
+    struct ledPlayer_t *pPlayer = &state.leds[led].player;
+
+    k_timer_stop(&pPlayer->timer);
+    pPlayer->playing = false;
+    pPlayer->background.flashes = 0;
+}
+
 void ledsInit(void)
 {
     __ASSERT_NO_MSG(device_is_ready(state.leds[LED_RED].gpio.port));
@@ -48,31 +106,159 @@ void ledsInit(void)
 
     for (int i = 0; i < LED_END; i++) {
         gpio_pin_configure_dt(&state.leds[i].gpio, GPIO_OUTPUT | GPIO_OUTPUT_HIGH);
+        k_timer_init(&state.leds[i].player.timer, playerTimerHandler, NULL);
     }
     state.initialized = true;
 }
 
 void ledsSetState(leds_t led, uint8_t on)
 {
+    k_spinlock_key_t key;
+
     __ASSERT_NO_MSG(state.initialized);
     __ASSERT_NO_MSG(led < LED_END);
     __ASSERT_NO_MSG(on == 0 || on == 1);
 
-    state.leds[led].state = on;
-
-    __ASSERT_NO_MSG(gpio_pin_set_dt(&state.leds[led].gpio, on) == 0);
+    key = k_spin_lock(&lock);
+    stopPatterns(led);
+    setPin(led, on);
+    k_spin_unlock(&lock, key);
 }
 
 void ledsToggle(leds_t led)
 {
+    k_spinlock_key_t key;
+
+    __ASSERT_NO_MSG(state.initialized);
+    __ASSERT_NO_MSG(led < LED_END);
+
+    key = k_spin_lock(&lock);
+    stopPatterns(led);
+    setPin(led, state.leds[led].state == 0 ? 1 : 0);
+    k_spin_unlock(&lock, key);
+}
+
+void ledsPlay(leds_t led, const ledsPattern_t *pPattern)
+{
+    struct ledPlayer_t *pPlayer;
+    k_spinlock_key_t key;
+
     __ASSERT_NO_MSG(state.initialized);
     __ASSERT_NO_MSG(led < LED_END);
 
-    if (state.leds[led].state == 0) {
-        state.leds[led].state = 1;
+    if (pPattern->flashes == 0) {
+        return;
+    }
+    pPlayer = &state.leds[led].player;
+    key = k_spin_lock(&lock);
+    if (pPattern->groups == 0) {
+        pPlayer->background = *pPattern;
+        // A finite pattern keeps playing, the background one starts after it
+        if (!pPlayer->playing || pPlayer->pattern.groups == 0) {
+            startPattern(led, pPattern);
+        }
     } else {
-        state.leds[led].state = 0;
+        startPattern(led, pPattern);
     }
+    k_spin_unlock(&lock, key);
+}
+
+void ledsStopBackground(leds_t led)
+{
+    struct ledPlayer_t *pPlayer;
+    k_spinlock_key_t key;
+
+    __ASSERT_NO_MSG(state.initialized);
+    __ASSERT_NO_MSG(led < LED_END);
+
+    pPlayer = &state.leds[led].player;
+    key = k_spin_lock(&lock);
+    pPlayer->background.flashes = 0;
+    // A finite pattern plays to its end, the LED then stays off
+    if (pPlayer->playing && pPlayer->pattern.groups == 0) {
+        k_timer_stop(&pPlayer->timer);
+        pPlayer->playing = false;
+        setPin(led, 0);
+    }
+    k_spin_unlock(&lock, key);
+}
+
+void ledsBlink(leds_t led, uint8_t count)
+{
+    const ledsPattern_t pattern = {
+        .onMs = LEDS_BLINK_MS,
+        .offMs = LEDS_BLINK_MS,
+        .flashes = count,
+        .pauseMs = 0,
+        .groups = 1,
+    };
+
+    ledsPlay(led, &pattern);
+}
+
+void ledsHeartbeat(leds_t led, uint16_t periodMs)
+{
+    const ledsPattern_t pattern = {
+        .onMs = LEDS_HEARTBEAT_ON_MS,
+        .offMs = 0,
+        .flashes = 1,
+        .pauseMs = periodMs - LEDS_HEARTBEAT_ON_MS,
+        .groups = 0,
+    };
+
+    __ASSERT_NO_MSG(periodMs > LEDS_HEARTBEAT_ON_MS);
+    ledsPlay(led, &pattern);
+}
+
+void ledsErrorCode(leds_t led, uint8_t code)
+{
+    const ledsPattern_t pattern = {
+        .onMs = LEDS_ERROR_ON_MS,
+        .offMs = LEDS_ERROR_OFF_MS,
+        .flashes = code,
+        .pauseMs = LEDS_ERROR_PAUSE_MS,
+        .groups = LEDS_ERROR_GROUPS,
+    };
+
+    ledsPlay(led, &pattern);
+}
 
-    __ASSERT_NO_MSG(gpio_pin_set_dt(&state.leds[led].gpio, state.leds[led].state) == 0);
-}
\ No newline at end of file
+static void playerTimerHandler(struct k_timer *timer)
+{
+    struct ledPlayer_t *pPlayer = CONTAINER_OF(timer, struct ledPlayer_t, timer);
+    struct ledCfg_t *pLed = CONTAINER_OF(pPlayer, struct ledCfg_t, player);
+    leds_t led = pLed - state.leds;
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    uint32_t nextMs;
+
+    if (!pPlayer->playing) {
+        // Stopped while the timer expired
+        k_spin_unlock(&lock, key);
+        return;
+    }
+    if (pLed->state == 0) {
+        setPin(led, 1);
+        nextMs = pPlayer->pattern.onMs;
+    } else {
+        setPin(led, 0);
+        nextMs = pPlayer->pattern.offMs;
+        if (++pPlayer->flash == pPlayer->pattern.flashes) {
+            pPlayer->flash = 0;
+            nextMs = pPlayer->pattern.pauseMs;
+            if (pPlayer->pattern.groups != 0 && ++pPlayer->group == pPlayer->pattern.groups) {
+                pPlayer->playing = false;
+                if (pPlayer->background.flashes != 0) {
+                    // After a pause, so that it is not mistaken for part of the pattern
+                    pPlayer->pattern = pPlayer->background;
+                    pPlayer->playing = true;
+                    pPlayer->group = 0;
+                    nextMs = MAX(pPlayer->pattern.pauseMs, LEDS_BLINK_MS);
+                }
+            }
+        }
+    }
+    if (pPlayer->playing) {
+        k_timer_start(&pPlayer->timer, K_MSEC(nextMs), K_NO_WAIT);
+    }
+    k_spin_unlock(&lock, key);
+}
@@ -17,6 +17,8 @@
 #ifndef __LEDS_H
 #define __LEDS_H
 
+#include <zephyr.h>
+
 /**
  * @brief LED specifier
  */
@@ -28,6 +30,17 @@ typedef enum leds_t {
 } leds_t;
 
 
+/**
+ * @brief LED pattern: groups of flashes separated by a pause
+ */
+typedef struct ledsPattern_t {
+    uint16_t onMs;          // Time on per flash
+    uint16_t offMs;         // Time off between the flashes of a group
+    uint8_t flashes;        // Flashes per group
+    uint16_t pauseMs;       // Time off after each group
+    uint8_t groups;         // Groups to play, 0 to repeat until replaced
+} ledsPattern_t;
+
 /**
  * @brief   Init RGB LEDs control
  */
@@ -35,7 +48,7 @@ void ledsInit(void);
 
 /**
  * @brief   Set state of a specific LED
- * @details Sets the specified LED either on or off.
+ * @details Sets the specified LED either on or off. Stops the patterns played on it.
  *
  * @param   led           The LED to change state of
  * @param   on            If led shall be set to on or off.
@@ -44,10 +57,48 @@ void ledsSetState(leds_t led, uint8_t on);
 
 /**
  * @brief   Toggle a specific LED
- * @details Sets the specified LED to on of it was off or off if it was on.
+ * @details Sets the specified LED to on of it was off or off if it was on. Stops the patterns
+ *          played on it.
  *
  * @param   led          The LED to toggle
  */
 void ledsToggle(leds_t led);
 
+/**
+ * @brief   Play a pattern on a LED
+ * @details Returns at once, the pattern is played by a kernel timer so the CPU only wakes up
+ *          at each edge. A pattern repeated until replaced (groups 0) is the background
+ *          pattern of the LED: it replaces the previous background pattern and, if a finite
+ *          pattern is playing, starts once that one has ended. A finite pattern replaces the
+ *          one playing and the background pattern resumes after it. May be called from an ISR.
+ *
+ * @param   led          The LED to play the pattern on
+ * @param   pPattern     The pattern, copied
+ */
+void ledsPlay(leds_t led, const ledsPattern_t *pPattern);
+
+/**
+ * @brief   Stop the background pattern of a LED
+ * @details The LED is switched off if the background pattern was playing. A finite pattern
+ *          playing is not stopped, the LED stays off after it. May be called from an ISR.
+ *
+ * @param   led          The LED
+ */
+void ledsStopBackground(leds_t led);
+
+/**
+ * @brief   Flash a LED a number of times, 150 ms on and 150 ms off
+ */
+void ledsBlink(leds_t led, uint8_t count);
+
+/**
+ * @brief   Flash a LED for 10 ms once per period, until replaced
+ */
+void ledsHeartbeat(leds_t led, uint16_t periodMs);
+
+/**
+ * @brief   Show an error code, three groups of code long flashes two seconds apart
+ */
+void ledsErrorCode(leds_t led, uint8_t code);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,223 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "log_ring.h"
+
+#include <zephyr.h>
+#include <init.h>
+#include <string.h>
+#include <logging/log.h>
+#include <logging/log_ctrl.h>
+#include <logging/log_backend.h>
+#include <logging/log_output.h>
+#include <logging/log_output_dict.h>
+
+// Log backend keeping the newest messages in RAM in the dictionary format: the message holds
+// the address of the format string and the raw arguments, nothing is formatted on the tag.
+// Each message is stored with a length byte in front so that whole messages are dropped when
+// the ring is full.
+
+#define LOG_RING_OUTPUT_BUF_LEN 32
+
+static int outputFunc(uint8_t *pData, size_t length, void *ctx);
+
+static void process(const struct log_backend *const backend, union log_msg_generic *msg);
+static void dropped(const struct log_backend *const backend, uint32_t cnt);
+static void panic(const struct log_backend *const backend);
+
+static const struct log_backend_api logRingApi = {
+    .process = process,
+    .dropped = dropped,
+    .panic = panic,
+};
+
+// Enabled at init with the default level of the ring instead of the maximum
+LOG_BACKEND_DEFINE(logRingBackend, logRingApi, false);
+
+static uint8_t outputBuf[LOG_RING_OUTPUT_BUF_LEN];
+LOG_OUTPUT_DEFINE(logRingOutput, outputFunc, outputBuf, sizeof(outputBuf));
+
+static struct k_spinlock lock;
+static uint8_t ring[CONFIG_LOG_RING_SIZE];
+static uint32_t head;
+static logRingStats_t stats = {
+    .size = CONFIG_LOG_RING_SIZE,
+};
+
+// Message being output by the log thread
+static uint8_t record[LOG_RING_RECORD_MAX];
+static size_t recordLen;
+static bool recordTooLong;
+
+static int outputFunc(uint8_t *pData, size_t length, void *ctx)
+{
+    if (recordLen + length > sizeof(record)) {
+        recordTooLong = true;
+    } else {
+        memcpy(&record[recordLen], pData, length);
+        recordLen += length;
+    }
+
+    return length;
+}
+
+static void copyToRing(uint32_t pos, const uint8_t *pData, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        ring[(pos + i) % CONFIG_LOG_RING_SIZE] = pData[i];
+    }
+}
+
+static void copyFromRing(uint32_t pos, uint8_t *pData, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        pData[i] = ring[(pos + i) % CONFIG_LOG_RING_SIZE];
+    }
+}
+
+// lock must be held
+static size_t dropOldest(void)
+{
+    size_t len = ring[head];
+
+    head = (head + 1 + len) % CONFIG_LOG_RING_SIZE;
+    stats.used -= 1 + len;
+    stats.records--;
+
+    return len;
+}
+
+static void putRecord(void)
+{
+    k_spinlock_key_t key;
+    uint8_t len = recordLen;
+
+    if (recordTooLong) {
+        stats.dropped++;
+    }
+    if (recordTooLong || recordLen == 0) {
+        recordLen = 0;
+        recordTooLong = false;
+        return;
+    }
+
+    key = k_spin_lock(&lock);
+    while (CONFIG_LOG_RING_SIZE - stats.used < 1 + len) {
+        dropOldest();
+        stats.overwritten++;
+    }
+    copyToRing(head + stats.used, &len, 1);
+    copyToRing(head + stats.used + 1, record, len);
+    stats.used += 1 + len;
+    stats.records++;
+    k_spin_unlock(&lock, key);
+
+    recordLen = 0;
+}
+
+static void process(const struct log_backend *const backend, union log_msg_generic *msg)
+{
+    log_dict_output_msg_process(&logRingOutput, &msg->log, 0);
+    putRecord();
+}
+
+static void dropped(const struct log_backend *const backend, uint32_t cnt)
+{
+    stats.dropped += cnt;
+    log_dict_output_dropped_process(&logRingOutput, cnt);
+    putRecord();
+}
+
+static void panic(const struct log_backend *const backend)
+{
+    // Nothing buffered outside of the ring
+}
+
+size_t logRingGet(uint8_t *pBuf)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    size_t len = 0;
+
+    if (stats.records > 0) {
+        copyFromRing(head + 1, pBuf, ring[head]);
+        len = dropOldest();
+    }
+    k_spin_unlock(&lock, key);
+
+    return len;
+}
+
+void logRingClear(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    head = 0;
+    stats.used = 0;
+    stats.records = 0;
+    k_spin_unlock(&lock, key);
+}
+
+void logRingGetStats(logRingStats_t *pStats)
+{
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    *pStats = stats;
+    k_spin_unlock(&lock, key);
+}
+
+int logRingSetLevel(const char *pModule, uint32_t level)
+{
+    bool all = strcmp(pModule, "*") == 0;
+    int err = -ENOENT;
+
+    if (level > LOG_LEVEL_DBG) {
+        return -EINVAL;
+    }
+    for (uint32_t i = 0; i < logRingModuleCount(); i++) {
+        if (all || strcmp(pModule, logRingModuleName(i)) == 0) {
+            // NULL sets the level in every backend, RTT included in debug builds
+            log_filter_set(NULL, Z_LOG_LOCAL_DOMAIN_ID, i, level);
+            err = 0;
+        }
+    }
+
+    return err;
+}
+
+uint32_t logRingModuleCount(void)
+{
+    return log_src_cnt_get(Z_LOG_LOCAL_DOMAIN_ID);
+}
+
+const char *logRingModuleName(uint32_t module)
+{
+    return log_source_name_get(Z_LOG_LOCAL_DOMAIN_ID, module);
+}
+
+uint32_t logRingModuleLevel(uint32_t module)
+{
+    return log_filter_get(&logRingBackend, Z_LOG_LOCAL_DOMAIN_ID, module, true);
+}
+
+static int logRingInit(const struct device *unused)
+{
+    // Before the log thread starts, so that the messages of the boot are kept
+    log_backend_enable(&logRingBackend, NULL, CONFIG_LOG_RING_LEVEL);
+
+    return 0;
+}
+
+SYS_INIT(logRingInit, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LOG_RING_H
+#define __LOG_RING_H
+
+#include <zephyr.h>
+
+// Largest log message kept, longer ones are dropped
+#define LOG_RING_RECORD_MAX 128
+
+typedef struct logRingStats_t {
+    uint32_t records;       // Messages in the ring
+    uint32_t used;          // Bytes used, including one length byte per message
+    uint32_t size;
+    uint32_t overwritten;   // Oldest messages dropped to make room since boot
+    uint32_t dropped;       // Messages lost before reaching the ring since boot
+} logRingStats_t;
+
+/**
+ * @brief   Take the oldest log message out of the ring.
+ * @details Messages are in the Zephyr dictionary format, decoded on a PC with the
+ *          log_dictionary.json of the build, see scripts/log_decode.py.
+ *
+ * @param   pBuf    [out] the message, LOG_RING_RECORD_MAX bytes.
+ *
+ * @return  Length of the message, 0 if the ring is empty.
+ */
+size_t logRingGet(uint8_t *pBuf);
+
+/**
+ * @brief   Drop all messages in the ring.
+ */
+void logRingClear(void);
+
+/**
+ * @brief   Get the fill level and loss counters of the ring.
+ */
+void logRingGetStats(logRingStats_t *pStats);
+
+/**
+ * @brief   Set the runtime log level of a module for all log backends.
+ * @details The level can not be raised above the level the module was built with.
+ *
+ * @param   pModule Module name as in LOG_MODULE_REGISTER, "*" for all modules.
+ * @param   level   LOG_LEVEL_NONE to LOG_LEVEL_DBG.
+ *
+ * @return  0 on success, -ENOENT if there is no such module, -EINVAL on a bad level.
+ */
+int logRingSetLevel(const char *pModule, uint32_t level);
+
+/**
+ * @brief   Get the number of log modules, for logRingModuleName and logRingModuleLevel.
+ */
+uint32_t logRingModuleCount(void);
+
+/**
+ * @brief   Get the name of a log module.
+ */
+const char *logRingModuleName(uint32_t module);
+
+/**
+ * @brief   Get the runtime log level of a log module in the ring.
+ */
+uint32_t logRingModuleLevel(uint32_t module);
+
+#endif
@@ -23,17 +23,20 @@
 #include "bt_adv.h"
 #include "buttons.h"
 #include <random/rand32.h>
+#include <sys/reboot.h>
 #include <sys/__assert.h>
 #include <device.h>
 #include <drivers/sensor.h>
 #include "bt_util.h"
-#include <bluetooth/hci.h>
-#include <bluetooth/hci_vs.h>
-#include <sys/byteorder.h>
 #include "at_host.h"
 #include "storage.h"
 #include <logging/log.h>
 #include "sensors.h"
+#include "boot_profile.h"
+#include "app_work.h"
+#include "mem_stats.h"
+#include "tag_payload.h"
+#include "journal.h"
 
 #if defined(CONFIG_BT_NUS)
 #include <bluetooth/services/nus.h>
@@ -41,25 +44,41 @@
 
 LOG_MODULE_REGISTER(app, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
 
-#define BLINK_STACKSIZE         1024
-#define BLINK_PRIORITY          7
-#define LED_BLINK_INTERVAL_MS   150
 #define LOOP_SLEEP_INTERVAL     5000
+#define NUS_AT_MAX_LEN          100
 
 // In order to avoid accidental collisions between tags we restart adv. every now and then.
 // Comment out to disable this.
 #define ADV_RESTART_INTERVAL    (10 * 60 * 1000) // 10 min
 
+/**
+ * @brief Actions of the button gestures, numbered as in the CONFIG_BUTTON_ACTION_* options
+ */
+typedef enum buttonAction_t {
+    BUTTON_ACTION_NONE = 0,
+    BUTTON_ACTION_NEXT_INTERVAL,    // Cycle the periodic interval, enables advertising
+    BUTTON_ACTION_TOGGLE_ADV,
+    BUTTON_ACTION_SHOW_INTERVAL,    // Blink the index of the periodic interval
+    BUTTON_ACTION_REBOOT,
+    BUTTON_ACTION_RESET_ADV,        // First periodic interval, advertising enabled
+    BUTTON_ACTION_END
+} buttonAction_t;
+
 static void btReadyCb(int err);
 static void onButtonPressCb(buttonPressType_t type);
-static void setTxPower(uint8_t handleType, uint16_t handle, int8_t txPwrLvl);
-static void blink(void);
+static void blink(struct k_work *item);
+static void updateHeartbeat(void);
+static void setAdvInterval(uint8_t index);
+static void advIntervalDoneCb(uint16_t minMs, uint16_t maxMs, int err, void *pUserData);
+static void advIntervalDoneWorkHandler(struct k_work *item);
+static void advStartWorkHandler(struct k_work *item);
 
 #if defined(CONFIG_BT_NUS)
 static void connected(struct bt_conn *conn, uint8_t err);
 static void disconnected(struct bt_conn *conn, uint8_t reason);
 static void nus_send_data(char *data);
 static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data, uint16_t len);
+static void nusCommandWorkHandler(struct k_work *item);
 BT_CONN_CB_DEFINE(conn_callbacks) = {
     .connected    = connected,
     .disconnected = disconnected,
@@ -70,35 +89,64 @@ static uint32_t nusMaxSendLen;
 static struct bt_nus_cb nus_cb = {
     .received = bt_receive_cb,
 };
+
+// Commands received over NUS are handled on the application work queue, not in BT RX context.
+// NUL terminated, the AT handlers parse numbers with strtol.
+static uint8_t nusCmdBuf[NUS_AT_MAX_LEN + 1];
+static uint16_t nusCmdLen;
+K_WORK_DEFINE(nusCommandWork, nusCommandWorkHandler);
 #endif
 
 static bool isAdvRunning = true;
 static uint16_t advIntervals[] = {50, 100, 250, 1000};
 static uint8_t advIntervalIndex = 0;
-static char *pDefaultGroupNamespace = "NINA-B4TAG";
 
-struct k_timer blinkTimer;
+static const uint8_t buttonActions[BUTTONS_PRESS_END] = {
+    [BUTTONS_SHORT_PRESS] = CONFIG_BUTTON_ACTION_SHORT,
+    [BUTTONS_LONG_PRESS] = CONFIG_BUTTON_ACTION_LONG,
+    [BUTTONS_DOUBLE_PRESS] = CONFIG_BUTTON_ACTION_DOUBLE,
+    [BUTTONS_TRIPLE_PRESS] = CONFIG_BUTTON_ACTION_TRIPLE,
+    [BUTTONS_BOOT_HOLD] = CONFIG_BUTTON_ACTION_BOOT_HOLD,
+};
+
+BUILD_ASSERT(STORAGE_NAMESPACE_LEN == EDDYSTONE_NAMESPACE_LENGFTH);
+
 static uint8_t bluetoothReady;
 static uint8_t uuid[EDDYSTONE_INSTANCE_ID_LEN];
+static int64_t advStartAtMs;
+#ifdef ADV_RESTART_INTERVAL
+static int64_t lastAdvRestartMs;
+#endif
 
-K_THREAD_DEFINE(blinkThreadId, BLINK_STACKSIZE, blink, NULL, NULL, NULL, BLINK_PRIORITY, 0,
-                K_TICKS_FOREVER);
+K_WORK_DELAYABLE_DEFINE(advStartWork, advStartWorkHandler);
+K_WORK_DELAYABLE_DEFINE(blinkWork, blink);
+
+// Result of the last interval set by the button, stored and shown on the application work queue
+K_WORK_DEFINE(advIntervalDoneWork, advIntervalDoneWorkHandler);
+static struct k_spinlock advIntervalDoneLock;
+static uint16_t advIntervalDoneMs;
+static int advIntervalDoneErr;
 
 void main(void)
 {
     uint8_t randDelayMs;
     bt_addr_le_t addr;
 
+    bootProfileMark(BOOT_STAGE_MAIN);
+
     // If all tags are powered on at once their advertisements may collide.
-    // Use a random delay in order to give them some random offset.
+    // Use a random delay in order to give them some random offset. The delay is applied when
+    // starting advertising so that it overlaps with the rest of the init.
     randDelayMs = (uint8_t)(sys_rand32_get() & 0xFF);
-    k_msleep(randDelayMs);
-    LOG_DBG("Slept %dms", randDelayMs);
+    advStartAtMs = k_uptime_get() + randDelayMs;
+    LOG_DBG("Advertising start offset %dms", randDelayMs);
     utilGetBtAddr(&addr);
     bluetoothReady = 0;
 
+    // First, so that the boot record comes before anything else journaled
+    journalInit();
     storageInit();
-    sensorsInit();
+    bootProfileMark(BOOT_STAGE_STORAGE);
 
     // Only swap public address. It's done like this in u-connect.
     if (addr.type == BT_ADDR_LE_PUBLIC) {
@@ -110,6 +158,27 @@ void main(void)
     }
     LOG_HEXDUMP_INF(uuid, EDDYSTONE_INSTANCE_ID_LEN, "InstanceId (MAC)");
 
+    // Bluetooth goes first as its init takes the longest, the rest is done while it runs.
+    // native_posix started without --bt-dev has no controller, the rest still runs there.
+    int btErr = bt_enable(btReadyCb);
+    if (btErr) {
+        LOG_ERR("Bluetooth init failed (err %d)", btErr);
+    }
+    __ASSERT(btErr == 0 || IS_ENABLED(CONFIG_ARCH_POSIX), "Bluetooth init failed");
+    bootProfileMark(BOOT_STAGE_BT_ENABLE);
+
+#if defined(CONFIG_BT_NUS)
+    int err = bt_nus_init(&nus_cb);
+    if (err) {
+        LOG_ERR("Failed to initialize UART service (err: %d)", err);
+        return;
+    }
+#endif
+
+    sensorsInit();
+    bootProfileMark(BOOT_STAGE_SENSORS);
+
+    // Completes in the background
     atHostStart();
 
     ledsInit();
@@ -118,154 +187,222 @@ void main(void)
     ledsSetState(LED_BLUE, 0);
 
     buttonsInit(&onButtonPressCb);
+    bootProfileMark(BOOT_STAGE_IO);
 
-    __ASSERT(bt_enable(btReadyCb) == 0, "Bluetooth init failed");
-
-#if defined(CONFIG_BT_NUS)
-    int err = bt_nus_init(&nus_cb);
-    if (err) {
-        LOG_ERR("Failed to initialize UART service (err: %d)", err);
-        return;
-    }
+#ifdef ADV_RESTART_INTERVAL
+    lastAdvRestartMs = k_uptime_get();
 #endif
-    k_thread_start(blinkThreadId);
+    k_work_schedule_for_queue(&appWorkQ, &blinkWork, K_NO_WAIT);
 }
 
-static void blink(void)
+static void blink(struct k_work *item)
 {
-    LOG_INF("Started blink thread");
 #ifdef ADV_RESTART_INTERVAL
-    uint64_t lastAdvRestartMs = k_uptime_get();
-    uint64_t currentTime;
+    int64_t currentTime;
     uint8_t randDelayMs;
 #endif
+    struct bt_data adData[BT_ADV_PER_ADV_DATA_MAX_NUM];
+    int numAdData = 0;
 #ifdef CONFIG_SEND_SENSOR_DATA_IN_PER_ADV_DATA
-#define NUM_SENSOR_DATA 6
     struct sensor_value temp, press, humidity;
-    struct bt_data adData;
-    int32_t sensorData[NUM_SENSOR_DATA];
+    int32_t sensorData[TAG_PAYLOAD_SENSOR_NUM];
+    uint8_t sensorBlock[TAG_PAYLOAD_SENSORS_LEN];
 #endif
-
-    while (1) {
-#ifdef CONFIG_PERIODIC_LED_BLINK
-        if (isAdvRunning) {
-            ledsSetState(LED_BLUE, 1);
-            k_sleep(K_MSEC(10));
-            ledsSetState(LED_BLUE, 0);
-        }
+#ifdef CONFIG_SEND_TLM_IN_PER_ADV_DATA
+    uint8_t tlm[TAG_PAYLOAD_TLM_LEN];
+    int16_t tlmTemp = TAG_PAYLOAD_TLM_TEMP_UNKNOWN;
 #endif
+
 #ifdef ADV_RESTART_INTERVAL
-        currentTime = k_uptime_get();
-        if (currentTime - lastAdvRestartMs >= ADV_RESTART_INTERVAL) {
-            if (isAdvRunning) {
-                randDelayMs = (uint8_t)(sys_rand32_get() & 0xFF);
-                LOG_INF("Restarting per. adv. to avoid collisions. Delay: %d", randDelayMs);
-                btAdvStop();
-                k_msleep(randDelayMs);
-                btAdvStart();
-                lastAdvRestartMs = currentTime;
-            }
+    currentTime = k_uptime_get();
+    if (currentTime - lastAdvRestartMs >= ADV_RESTART_INTERVAL) {
+        if (isAdvRunning) {
+            randDelayMs = (uint8_t)(sys_rand32_get() & 0xFF);
+            LOG_INF("Restarting per. adv. to avoid collisions. Delay: %d", randDelayMs);
+            btAdvRestart(randDelayMs);
+            lastAdvRestartMs = currentTime;
         }
+    }
 #endif
 #ifdef CONFIG_SEND_SENSOR_DATA_IN_PER_ADV_DATA
-        if (isAdvRunning) {
-            if (sensorsGetBme280Data(&temp, &press, &humidity)) {
-                sensorData[0] = temp.val1;
-                sensorData[1] = temp.val2;
-                sensorData[2] = press.val1;
-                sensorData[3] = press.val2;
-                sensorData[4] = humidity.val1;
-                sensorData[5] = humidity.val2;
-                adData.type = BT_DATA_MANUFACTURER_DATA;
-                adData.data = (uint8_t *)sensorData;
-                adData.data_len = sizeof(int32_t) * NUM_SENSOR_DATA;
-                btAdvSetPerAdvData(&adData, 1);
-            }
+    if (isAdvRunning) {
+        if (sensorsGetBme280Data(&temp, &press, &humidity)) {
+            sensorData[TAG_PAYLOAD_TEMP_VAL1] = temp.val1;
+            sensorData[TAG_PAYLOAD_TEMP_VAL2] = temp.val2;
+            sensorData[TAG_PAYLOAD_PRESS_VAL1] = press.val1;
+            sensorData[TAG_PAYLOAD_PRESS_VAL2] = press.val2;
+            sensorData[TAG_PAYLOAD_HUMIDITY_VAL1] = humidity.val1;
+            sensorData[TAG_PAYLOAD_HUMIDITY_VAL2] = humidity.val2;
+            tagPayloadEncodeSensors(sensorBlock, sensorData);
+            adData[numAdData].type = BT_DATA_MANUFACTURER_DATA;
+            adData[numAdData].data = sensorBlock;
+            adData[numAdData].data_len = sizeof(sensorBlock);
+            numAdData++;
+#ifdef CONFIG_SEND_TLM_IN_PER_ADV_DATA
+            // Signed 8.8 fixed point
+            tlmTemp = (int16_t)(temp.val1 * 256 + temp.val2 * 256 / 1000000);
+#endif
         }
+    }
 #endif
-        k_msleep(LOOP_SLEEP_INTERVAL);
+#ifdef CONFIG_SEND_TLM_IN_PER_ADV_DATA
+    if (isAdvRunning) {
+        // Battery voltage is not measured
+        tagPayloadEncodeTlm(tlm, 0, tlmTemp, btAdvGetPerAdvEventCount(),
+                            (uint32_t)(k_uptime_get() / 100));
+        adData[numAdData].type = BT_DATA_SVC_DATA16;
+        adData[numAdData].data = tlm;
+        adData[numAdData].data_len = sizeof(tlm);
+        numAdData++;
     }
+#endif
+    // All periodic data in one update, one HCI command
+    if (numAdData > 0) {
+        btAdvSetPerAdvData(adData, numAdData);
+    }
+    memStatsSample();
+    k_work_schedule_for_queue(&appWorkQ, &blinkWork, K_MSEC(LOOP_SLEEP_INTERVAL));
 }
 
+// The heartbeat is played by the LED timer, the loop does not wake up for it
+static void updateHeartbeat(void)
+{
+#ifdef CONFIG_PERIODIC_LED_BLINK
+    // A blink started before this plays to its end in both cases
+    if (isAdvRunning) {
+        ledsHeartbeat(LED_BLUE, LOOP_SLEEP_INTERVAL);
+    } else {
+        ledsStopBackground(LED_BLUE);
+    }
+#endif
+}
 
 static void btReadyCb(int err)
 {
-    int8_t txPower = 0;
+    const storageConfig_t *pConfig = storageGetConfig();
     __ASSERT(err == 0, "Bluetooth init failed (err %d)", err);
     LOG_INF("Bluetooth initialized");
     bluetoothReady = 1;
+    bootProfileMark(BOOT_STAGE_BT_READY);
 
-    storageGetTxPower(&txPower);
-    LOG_INF("Setting TxPower: %d", txPower);
-    setTxPower(BT_HCI_VS_LL_HANDLE_TYPE_ADV, 0, txPower);
+    // Button presses continue cycling from the stored interval, or from the start if it was
+    // set to a value outside of the table over AT.
+    for (uint8_t i = 0; i < ARRAY_SIZE(advIntervals); i++) {
+        if (advIntervals[i] == pConfig->perAdvIntervalMs) {
+            advIntervalIndex = i;
+        }
+    }
+
+    btAdvInit(pConfig->perAdvIntervalMs, pConfig->perAdvIntervalMs, pConfig->groupNamespace,
+              uuid, pConfig->txPower, pConfig->extAdvIntervalMs, pConfig->cteLen);
 
-    btAdvInit(advIntervals[advIntervalIndex], advIntervals[advIntervalIndex], pDefaultGroupNamespace,
-              uuid, txPower);
-    btAdvStart();
+    // Whatever is left of the random start offset
+    k_work_schedule_for_queue(&appWorkQ, &advStartWork,
+                              K_MSEC(MAX(advStartAtMs - k_uptime_get(), 0)));
+}
+
+static void advStartWorkHandler(struct k_work *item)
+{
+    isAdvRunning = storageGetConfig()->advEnable;
+    if (isAdvRunning) {
+        btAdvStart();
+    }
+    updateHeartbeat();
+#if defined(CONFIG_BT_NUS)
+    // Connectable advertising is not time critical, keep it out of the way of the CTE start
+    btAdvStartNus();
+#endif
 }
 
 static void onButtonPressCb(buttonPressType_t type)
 {
-    LOG_INF("Pressed, type: %d", type);
-
-    if (type == BUTTONS_SHORT_PRESS) {
-        // If stopped, then restart if adv. interval was changed
-        isAdvRunning = true;
-        advIntervalIndex = (advIntervalIndex + 1) % ARRAY_SIZE(advIntervals);
-        uint16_t new_adv_interval = advIntervals[advIntervalIndex];
-        LOG_INF("New interval: %d => %d", advIntervalIndex, new_adv_interval);
-        btAdvUpdateAdvInterval(new_adv_interval, new_adv_interval);
-
-        // Blink advertising interval index times
-        ledsSetState(LED_BLUE, 1);
-        for (int i = 0; i < advIntervalIndex + 1; i++) {
-            k_sleep(K_MSEC(LED_BLINK_INTERVAL_MS));
-            ledsSetState(LED_BLUE, 0);
-            k_sleep(K_MSEC(LED_BLINK_INTERVAL_MS));
-            ledsSetState(LED_BLUE, 1);
-        }
-        ledsSetState(LED_BLUE, 0);
-    } else {
-        isAdvRunning = !isAdvRunning;
-        if (isAdvRunning) {
-            LOG_INF("Adv started");
-            btAdvStart();
-        } else {
-            LOG_INF("Adv stopped");
-            btAdvStop();
-        }
+    uint8_t advEnable;
+    LOG_INF("Pressed, type: %d, action: %d", type, buttonActions[type]);
+
+    switch (buttonActions[type]) {
+        case BUTTON_ACTION_NEXT_INTERVAL:
+            setAdvInterval((advIntervalIndex + 1) % ARRAY_SIZE(advIntervals));
+            break;
+        case BUTTON_ACTION_TOGGLE_ADV:
+            isAdvRunning = !isAdvRunning;
+            advEnable = isAdvRunning;
+            storageWrite(STORAGE_ADV_ENABLE, &advEnable, sizeof(advEnable));
+            if (isAdvRunning) {
+                LOG_INF("Adv started");
+                btAdvStart();
+            } else {
+                LOG_INF("Adv stopped");
+                btAdvStop();
+            }
+            updateHeartbeat();
+            break;
+        case BUTTON_ACTION_SHOW_INTERVAL:
+            ledsBlink(LED_BLUE, advIntervalIndex + 1);
+            updateHeartbeat();
+            break;
+        case BUTTON_ACTION_REBOOT:
+            journalRecord(JOURNAL_EVT_REBOOT, 1, 0);
+            journalFlush();
+            storageFlush();
+            sys_reboot(SYS_REBOOT_WARM);
+            break;
+        case BUTTON_ACTION_RESET_ADV:
+            setAdvInterval(0);
+            break;
+        default:
+            break;
     }
 }
 
-static void setTxPower(uint8_t handleType, uint16_t handle, int8_t txPwrLvl)
+static void setAdvInterval(uint8_t index)
 {
-    struct bt_hci_cp_vs_write_tx_power_level *cp;
-    struct bt_hci_rp_vs_write_tx_power_level *rp;
-    struct net_buf *buf, *rsp = NULL;
-    int err;
+    uint16_t new_adv_interval = advIntervals[index];
+
+    // If stopped, then restart if adv. interval was changed
+    isAdvRunning = true;
+    LOG_INF("New interval: %d => %d", index, new_adv_interval);
+    if (!btAdvUpdateAdvInterval(new_adv_interval, new_adv_interval, advIntervalDoneCb, NULL)) {
+        LOG_ERR("Interval %d not valid", new_adv_interval);
+        updateHeartbeat();
+    }
+}
 
-    buf = bt_hci_cmd_create(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, sizeof(*cp));
-    __ASSERT(buf, "Unable to allocate command buffer");
+// Called by the advertising thread
+static void advIntervalDoneCb(uint16_t minMs, uint16_t maxMs, int err, void *pUserData)
+{
+    k_spinlock_key_t key = k_spin_lock(&advIntervalDoneLock);
 
-    cp = net_buf_add(buf, sizeof(*cp));
-    cp->handle = sys_cpu_to_le16(handle);
-    cp->handle_type = handleType;
-    cp->tx_power_level = txPwrLvl;
+    advIntervalDoneMs = minMs;
+    advIntervalDoneErr = err;
+    k_spin_unlock(&advIntervalDoneLock, key);
+    k_work_submit_to_queue(&appWorkQ, &advIntervalDoneWork);
+}
 
-    err = bt_hci_cmd_send_sync(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL,
-                               buf, &rsp);
+static void advIntervalDoneWorkHandler(struct k_work *item)
+{
+    k_spinlock_key_t key = k_spin_lock(&advIntervalDoneLock);
+    uint16_t intervalMs = advIntervalDoneMs;
+    int err = advIntervalDoneErr;
+    uint8_t advEnable = 1;
+
+    k_spin_unlock(&advIntervalDoneLock, key);
     if (err) {
-        uint8_t reason = rsp ?
-                         ((struct bt_hci_rp_vs_write_tx_power_level *)
-                          rsp->data)->status : 0;
-        LOG_ERR("Set Tx power err: %d reason 0x%02x", err, reason);
+        // Not stored, the button continues from the interval in use
+        LOG_ERR("Interval %d not set (err %d)", intervalMs, err);
+        updateHeartbeat();
         return;
     }
+    for (uint8_t i = 0; i < ARRAY_SIZE(advIntervals); i++) {
+        if (advIntervals[i] == intervalMs) {
+            advIntervalIndex = i;
+        }
+    }
+    storageWrite(STORAGE_PER_ADV_INTERVAL, &intervalMs, sizeof(intervalMs));
+    storageWrite(STORAGE_ADV_ENABLE, &advEnable, sizeof(advEnable));
 
-    rp = (void *)rsp->data;
-    LOG_INF("Set Tx Power: %d", rp->selected_tx_power);
-
-    net_buf_unref(rsp);
+    // Blink advertising interval index times, the heartbeat resumes after it
+    ledsBlink(LED_BLUE, advIntervalIndex + 1);
+    updateHeartbeat();
 }
 
 #if defined(CONFIG_BT_NUS)
@@ -313,6 +450,22 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data, uint1
 
     LOG_INF("Received data from: %s", addr);
 
-    atHostHandleCommand(data, len, nus_send_data);
+    // The ACL RX buffer carrying the command is still held here
+    memStatsSample();
+
+    // The buffer is in use until the handler has returned, not only while the work is pending
+    if (k_work_busy_get(&nusCommandWork) != 0 || len >= sizeof(nusCmdBuf)) {
+        LOG_WRN("Dropped AT command over NUS");
+        return;
+    }
+    memcpy(nusCmdBuf, data, len);
+    nusCmdBuf[len] = '\0';
+    nusCmdLen = len;
+    k_work_submit_to_queue(&appWorkQ, &nusCommandWork);
+}
+
+static void nusCommandWorkHandler(struct k_work *item)
+{
+    atHostHandleCommand(nusCmdBuf, nusCmdLen, nus_send_data);
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mem_stats.h"
+
+#include <zephyr.h>
+#include <string.h>
+#include <net/buf.h>
+#include <sys/sys_heap.h>
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(mem_stats, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+
+static uint16_t bufPoolPeak[MEM_STATS_MAX_BUF_POOLS];
+
+#if CONFIG_HEAP_MEM_POOL_SIZE > 0 && defined(CONFIG_SYS_HEAP_RUNTIME_STATS)
+extern struct k_heap _system_heap;
+#endif
+
+#if defined(CONFIG_THREAD_MONITOR) && defined(CONFIG_INIT_STACKS)
+struct threadIter_t {
+    memThreadStats_t *pStats;
+    int maxNum;
+    int num;
+};
+
+static void threadCb(const struct k_thread *thread, void *userData)
+{
+    struct threadIter_t *pIter = userData;
+    memThreadStats_t *pStats;
+    size_t unused = 0;
+
+    if (pIter->num >= pIter->maxNum) {
+        return;
+    }
+    pStats = &pIter->pStats[pIter->num++];
+    pStats->name = k_thread_name_get((k_tid_t)thread);
+    if (pStats->name == NULL) {
+        pStats->name = "?";
+    }
+    pStats->size = thread->stack_info.size;
+    if (k_thread_stack_space_get(thread, &unused) != 0) {
+        unused = pStats->size;
+    }
+    pStats->used = pStats->size - unused;
+}
+#endif
+
+void memStatsSample(void)
+{
+    int i = 0;
+
+    STRUCT_SECTION_FOREACH(net_buf_pool, pool) {
+        if (i >= MEM_STATS_MAX_BUF_POOLS) {
+            break;
+        }
+        uint16_t used = pool->pool_size - atomic_get(&pool->avail_count);
+        if (used > bufPoolPeak[i]) {
+            bufPoolPeak[i] = used;
+        }
+        i++;
+    }
+}
+
+int memStatsGetThreads(memThreadStats_t *pStats, int maxNum)
+{
+#if defined(CONFIG_THREAD_MONITOR) && defined(CONFIG_INIT_STACKS)
+    struct threadIter_t iter = {
+        .pStats = pStats,
+        .maxNum = maxNum,
+        .num = 0,
+    };
+
+    // Scanning stacks for the high-water mark is slow, don't hold the scheduler lock meanwhile
+    k_thread_foreach_unlocked(threadCb, &iter);
+
+    return iter.num;
+#else
+    return 0;
+#endif
+}
+
+int memStatsGetBufPools(memBufPoolStats_t *pStats, int maxNum)
+{
+    int i = 0;
+
+    memStatsSample();
+    STRUCT_SECTION_FOREACH(net_buf_pool, pool) {
+        if (i >= maxNum || i >= MEM_STATS_MAX_BUF_POOLS) {
+            break;
+        }
+        pStats[i].name = pool->name;
+        pStats[i].size = pool->pool_size;
+        pStats[i].used = pool->pool_size - atomic_get(&pool->avail_count);
+        pStats[i].peak = bufPoolPeak[i];
+        i++;
+    }
+
+    return i;
+}
+
+void memStatsGetHeap(memHeapStats_t *pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+#if CONFIG_HEAP_MEM_POOL_SIZE > 0 && defined(CONFIG_SYS_HEAP_RUNTIME_STATS)
+    struct sys_memory_stats heapStats;
+
+    if (sys_heap_runtime_stats_get(&_system_heap.heap, &heapStats) == 0) {
+        pStats->size = CONFIG_HEAP_MEM_POOL_SIZE;
+        pStats->used = heapStats.allocated_bytes;
+        pStats->peak = heapStats.max_allocated_bytes;
+    }
+#endif
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MEM_STATS_H
+#define __MEM_STATS_H
+
+#include <zephyr.h>
+
+#define MEM_STATS_MAX_THREADS   16
+#define MEM_STATS_MAX_BUF_POOLS 12
+
+/**
+ * @brief Stack usage of one thread
+ */
+typedef struct memThreadStats_t {
+    const char *name;
+    uint32_t size;
+    uint32_t used;  // High-water mark since boot
+} memThreadStats_t;
+
+/**
+ * @brief Usage of one net_buf pool, e.g. the Bluetooth ACL and HCI buffers
+ */
+typedef struct memBufPoolStats_t {
+    const char *name;
+    uint16_t size;
+    uint16_t used;
+    uint16_t peak;  // Highest sampled usage since boot
+} memBufPoolStats_t;
+
+/**
+ * @brief System heap usage, all zero if the build has no heap
+ */
+typedef struct memHeapStats_t {
+    uint32_t size;
+    uint32_t used;
+    uint32_t peak;
+} memHeapStats_t;
+
+/**
+ * @brief   Sample buffer pool usage.
+ * @details net_buf pools only count free buffers so the peak usage is tracked by sampling.
+ *          Called periodically and from places where buffers are known to be held.
+ */
+void memStatsSample(void);
+
+/**
+ * @brief   Get stack high-water marks of all threads.
+ * @details Needs the thread list and stack painting of prj_diag.conf, none are returned without.
+ *
+ * @param   pStats          Array to fill.
+ * @param   maxNum          Number of entries in pStats.
+ * @return  Number of entries filled.
+ */
+int memStatsGetThreads(memThreadStats_t *pStats, int maxNum);
+
+/**
+ * @brief   Get current and peak usage of all net_buf pools.
+ *
+ * @param   pStats          Array to fill.
+ * @param   maxNum          Number of entries in pStats.
+ * @return  Number of entries filled.
+ */
+int memStatsGetBufPools(memBufPoolStats_t *pStats, int maxNum);
+
+/**
+ * @brief   Get system heap usage.
+ */
+void memStatsGetHeap(memHeapStats_t *pStats);
+
+#endif
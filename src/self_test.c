@@ -0,0 +1,237 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "self_test.h"
+
+#include <zephyr.h>
+#include <string.h>
+#include <stdlib.h>
+#include <logging/log.h>
+#include "sensors.h"
+
+LOG_MODULE_REGISTER(self_test, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+
+#define SELF_TEST_TIMEOUT_MS    2000
+
+// sensorsAccelToRaw scales m/s^2 by 2048, so 1 g is 9.80665 * 2048. A tag lying still must see
+// gravity only, 0.5 to 1.5 g.
+#define LIS_RAW_PER_G           20084
+#define LIS_MIN_G_SQUARED       ((int64_t)(LIS_RAW_PER_G / 2) * (LIS_RAW_PER_G / 2))
+#define LIS_MAX_G_SQUARED       ((int64_t)(LIS_RAW_PER_G * 3 / 2) * (LIS_RAW_PER_G * 3 / 2))
+
+BUILD_ASSERT((int64_t)LIS_RAW_PER_G * LIS_RAW_PER_G > LIS_MIN_G_SQUARED &&
+             (int64_t)LIS_RAW_PER_G * LIS_RAW_PER_G < LIS_MAX_G_SQUARED,
+             "A 1 g reading must pass the LIS2DW12 check");
+BUILD_ASSERT(LIS_RAW_PER_G * 3 / 2 <= INT16_MAX, "1.5 g must fit the raw LIS2DW12 values");
+
+// BME280 operating range
+#define BME_TEMP_MIN_MILLI      (-40 * 1000)
+#define BME_TEMP_MAX_MILLI      (85 * 1000)
+#define BME_PRESS_MIN_MILLI     (30 * 1000)     // kPa
+#define BME_PRESS_MAX_MILLI     (110 * 1000)
+#define BME_HUM_MIN_MILLI       0
+#define BME_HUM_MAX_MILLI       (100 * 1000)
+
+typedef selfTestResult_t (*selfTestFunc_t)(int32_t *pValues);
+
+static selfTestResult_t testLis2dw(int32_t *pValues);
+static selfTestResult_t testBme280(int32_t *pValues);
+static selfTestResult_t testApds(int32_t *pValues);
+static void runStep(selfTestStep_t step);
+static void runConcurrentStep(struct k_work *item);
+
+struct selfTestStepCfg_t {
+    const char *pName;
+    selfTestFunc_t func;
+    // Steps that spend most of their time waiting for a conversion are run on the system work
+    // queue so that the waiting overlaps with the other steps.
+    bool concurrent;
+};
+
+static const struct selfTestStepCfg_t steps[SELF_TEST_END] = {
+    [SELF_TEST_LIS2DW12] = {.pName = "LIS", .func = testLis2dw, .concurrent = false},
+    [SELF_TEST_BME280] = {.pName = "BME", .func = testBme280, .concurrent = true},
+    [SELF_TEST_APDS9306] = {.pName = "APDS", .func = testApds, .concurrent = false},
+};
+
+static struct k_work concurrentWork[SELF_TEST_END];
+static bool concurrentWorkInitialized;
+K_SEM_DEFINE(concurrentDoneSem, 0, SELF_TEST_END);
+
+static selfTestReport_t current;
+static selfTestReport_t last;
+static bool hasLast;
+K_MUTEX_DEFINE(selfTestMutex);
+
+bool selfTestRun(selfTestReport_t *pReport)
+{
+    int numConcurrent = 0;
+    uint32_t start;
+    struct k_work_sync sync;
+
+    k_mutex_lock(&selfTestMutex, K_FOREVER);
+
+    if (!concurrentWorkInitialized) {
+        for (int i = 0; i < SELF_TEST_END; i++) {
+            k_work_init(&concurrentWork[i], runConcurrentStep);
+        }
+        concurrentWorkInitialized = true;
+    }
+
+    k_sem_reset(&concurrentDoneSem);
+    memset(&current, 0, sizeof(current));
+    for (int i = 0; i < SELF_TEST_END; i++) {
+        current.steps[i].result = SELF_TEST_NOT_RUN;
+    }
+    current.timestampMs = k_uptime_get();
+    start = k_cycle_get_32();
+
+    for (int i = 0; i < SELF_TEST_END; i++) {
+        if (steps[i].concurrent) {
+            k_work_submit(&concurrentWork[i]);
+            numConcurrent++;
+        }
+    }
+    for (int i = 0; i < SELF_TEST_END; i++) {
+        if (!steps[i].concurrent) {
+            runStep(i);
+        }
+    }
+    for (int i = 0; i < numConcurrent; i++) {
+        if (k_sem_take(&concurrentDoneSem, K_MSEC(SELF_TEST_TIMEOUT_MS)) != 0) {
+            break;
+        }
+    }
+    // A step still running would write to current while it is copied, wait for it to finish
+    for (int i = 0; i < SELF_TEST_END; i++) {
+        if (steps[i].concurrent && k_work_cancel_sync(&concurrentWork[i], &sync)) {
+            LOG_ERR("Self test step %s timed out", steps[i].pName);
+            current.steps[i].result = SELF_TEST_FAIL_IO;
+        }
+    }
+
+    current.totalDurationUs = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    current.passed = true;
+    for (int i = 0; i < SELF_TEST_END; i++) {
+        if (current.steps[i].result != SELF_TEST_PASS) {
+            current.passed = false;
+        }
+    }
+
+    last = current;
+    hasLast = true;
+    *pReport = current;
+    k_mutex_unlock(&selfTestMutex);
+
+    LOG_INF("Self test %s in %d us", current.passed ? "passed" : "failed",
+            current.totalDurationUs);
+
+    return pReport->passed;
+}
+
+bool selfTestGetLastReport(selfTestReport_t *pReport)
+{
+    bool ret;
+
+    k_mutex_lock(&selfTestMutex, K_FOREVER);
+    ret = hasLast;
+    if (hasLast) {
+        *pReport = last;
+    }
+    k_mutex_unlock(&selfTestMutex);
+
+    return ret;
+}
+
+const char *selfTestStepName(selfTestStep_t step)
+{
+    __ASSERT_NO_MSG(step < SELF_TEST_END);
+
+    return steps[step].pName;
+}
+
+static void runStep(selfTestStep_t step)
+{
+    selfTestStepReport_t *pStep = &current.steps[step];
+    uint32_t start = k_cycle_get_32();
+
+    pStep->result = steps[step].func(pStep->values);
+    pStep->durationUs = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    LOG_DBG("%s: %d in %d us", steps[step].pName, pStep->result, pStep->durationUs);
+}
+
+static void runConcurrentStep(struct k_work *item)
+{
+    runStep(item - concurrentWork);
+    k_sem_give(&concurrentDoneSem);
+}
+
+static bool inRange(int32_t val, int32_t min, int32_t max)
+{
+    return val >= min && val <= max;
+}
+
+static int32_t toMilli(const struct sensor_value *val)
+{
+    return val->val1 * 1000 + val->val2 / 1000;
+}
+
+static selfTestResult_t testLis2dw(int32_t *pValues)
+{
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    int64_t magnitudeSquared;
+
+    if (!sensorsGetLis2dw12(&x, &y, &z)) {
+        return SELF_TEST_FAIL_IO;
+    }
+    pValues[0] = x;
+    pValues[1] = y;
+    pValues[2] = z;
+
+    magnitudeSquared = (int64_t)x * x + (int64_t)y * y + (int64_t)z * z;
+    if (magnitudeSquared < LIS_MIN_G_SQUARED || magnitudeSquared > LIS_MAX_G_SQUARED) {
+        return SELF_TEST_FAIL_RANGE;
+    }
+
+    return SELF_TEST_PASS;
+}
+
+static selfTestResult_t testBme280(int32_t *pValues)
+{
+    struct sensor_value temp, press, humidity;
+
+    if (!sensorsGetBme280Data(&temp, &press, &humidity)) {
+        return SELF_TEST_FAIL_IO;
+    }
+    pValues[0] = toMilli(&temp);
+    pValues[1] = toMilli(&press);
+    pValues[2] = toMilli(&humidity);
+
+    if (!inRange(pValues[0], BME_TEMP_MIN_MILLI, BME_TEMP_MAX_MILLI) ||
+        !inRange(pValues[1], BME_PRESS_MIN_MILLI, BME_PRESS_MAX_MILLI) ||
+        !inRange(pValues[2], BME_HUM_MIN_MILLI, BME_HUM_MAX_MILLI)) {
+        return SELF_TEST_FAIL_RANGE;
+    }
+
+    return SELF_TEST_PASS;
+}
+
+static selfTestResult_t testApds(int32_t *pValues)
+{
+    return sensorsDetectApds() ? SELF_TEST_PASS : SELF_TEST_FAIL_IO;
+}
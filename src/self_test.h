@@ -0,0 +1,82 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SELF_TEST_H
+#define __SELF_TEST_H
+
+#include <zephyr.h>
+
+/**
+ * @brief Self test steps, one per sensor on the C209
+ */
+typedef enum selfTestStep_t {
+    SELF_TEST_LIS2DW12 = 0,
+    SELF_TEST_BME280,
+    SELF_TEST_APDS9306,
+    SELF_TEST_END
+} selfTestStep_t;
+
+/**
+ * @brief Outcome of a self test step
+ */
+typedef enum selfTestResult_t {
+    SELF_TEST_PASS = 0,
+    SELF_TEST_FAIL_IO,      // Device missing or not responding
+    SELF_TEST_FAIL_RANGE,   // Device responded with implausible values
+    SELF_TEST_NOT_RUN
+} selfTestResult_t;
+
+typedef struct selfTestStepReport_t {
+    selfTestResult_t result;
+    uint32_t durationUs;
+    // Step specific values: LIS2DW12 x, y, z raw; BME280 temp, press, humidity in milli units;
+    // none for APDS9306.
+    int32_t values[3];
+} selfTestStepReport_t;
+
+typedef struct selfTestReport_t {
+    selfTestStepReport_t steps[SELF_TEST_END];
+    uint32_t totalDurationUs;
+    int64_t timestampMs;    // Uptime when the test was run
+    bool passed;
+} selfTestReport_t;
+
+/**
+ * @brief   Run the production self test.
+ * @details Independent sensor checks are run concurrently, each one is timed and the returned
+ *          values checked for plausibility. The result is cached, see selfTestGetLastReport.
+ *
+ * @param   pReport     [out] the test report.
+ *
+ * @return  true if all steps passed, else false.
+ */
+bool selfTestRun(selfTestReport_t *pReport);
+
+/**
+ * @brief   Get the report of the last self test run.
+ *
+ * @param   pReport     [out] the cached report.
+ *
+ * @return  true if a self test has been run since boot, else false.
+ */
+bool selfTestGetLastReport(selfTestReport_t *pReport);
+
+/**
+ * @brief   Get a short name of a self test step, used in reports.
+ */
+const char *selfTestStepName(selfTestStep_t step);
+
+#endif
@@ -22,15 +22,25 @@
 #include <pm/device.h>
 #include <lis2dw12_reg.h>
 
-LOG_MODULE_REGISTER(sensors, LOG_LEVEL_DBG);
+#include "energy.h"
+#include "sensors.h"
 
-#define I2C_DEV DT_NODELABEL(i2c0)
+LOG_MODULE_REGISTER(sensors, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+
+// The APDS shares the bus of the BME280
+#define I2C_DEV DT_BUS(DT_INST(0, bosch_bme280))
 
 #define APDS_9306_065_ADDRESS   0x52
 #define APDS_9306_065_REG_ID    0x06
 #define APDS_9306_065_CHIP_ID   0xB3
 
+// ODR used for one-shot accelerometer readings and the time for the first sample to be ready
+// (one ODR period plus turn-on time).
+#define LIS2DW12_SAMPLE_ODR_HZ      100
+#define LIS2DW12_SAMPLE_WAIT_MS     20
+
 static int configureLis2dw12Default(const struct device *lis2dw12Dev);
+static int setLis2dw12Odr(const struct device *lis2dw12Dev, int32_t odr);
 
 int sensorsInit(void)
 {
@@ -78,6 +88,7 @@ bool sensorsGetBme280Data(struct sensor_value *temp, struct sensor_value *press,
     }
 
     err = sensor_sample_fetch(sensor);
+    energyCountEvent(ENERGY_EVENT_BME280);
     if (!err) {
         sensor_channel_get(sensor, SENSOR_CHAN_AMBIENT_TEMP, temp);
         sensor_channel_get(sensor, SENSOR_CHAN_PRESS, press);
@@ -117,16 +128,25 @@ bool sensorsGetLis2dw12(int16_t *x, int16_t *y, int16_t *z)
         return false;
     }
 
-    int err = sensor_sample_fetch(sensor);
+    // LIS2DW12 is kept in power down between readings
+    int err = setLis2dw12Odr(sensor, LIS2DW12_SAMPLE_ODR_HZ);
+    if (err) {
+        return false;
+    }
+    k_msleep(LIS2DW12_SAMPLE_WAIT_MS);
+
+    err = sensor_sample_fetch(sensor);
+    setLis2dw12Odr(sensor, 0);
+    energyCountEvent(ENERGY_EVENT_LIS2DW12);
     if (err) {
         LOG_ERR("Could not fetch sample from %s", sensor->name);
         return false;
     }
     if (!err) {
         sensor_channel_get(sensor, SENSOR_CHAN_ACCEL_XYZ, acc_val);
-        *x = (int16_t)(sensor_value_to_double(&acc_val[0]) * (32768 / 16));
-        *y = (int16_t)(sensor_value_to_double(&acc_val[1]) * (32768 / 16));
-        *z = (int16_t)(sensor_value_to_double(&acc_val[2]) * (32768 / 16));
+        *x = sensorsAccelToRaw(&acc_val[0]);
+        *y = sensorsAccelToRaw(&acc_val[1]);
+        *z = sensorsAccelToRaw(&acc_val[2]);
         LOG_DBG("x: %d y: %d z: %d", *x, *y, *z);
     } else {
         LOG_ERR("Failed fetching sample from %s", sensor->name);
@@ -136,6 +156,18 @@ bool sensorsGetLis2dw12(int16_t *x, int16_t *y, int16_t *z)
     return true;
 }
 
+int16_t sensorsAccelToRaw(const struct sensor_value *pAcc)
+{
+    double raw = sensor_value_to_double(pAcc) * (32768 / 16);
+
+    if (raw > INT16_MAX) {
+        return INT16_MAX;
+    } else if (raw < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)raw;
+}
+
 bool sensorsDetectApds(void)
 {
     uint8_t id = 0;
@@ -171,7 +203,6 @@ bool sensorsDetectApds(void)
 static int configureLis2dw12Default(const struct device *lis2dw12Dev)
 {
     int err;
-    struct sensor_value val;
     stmdev_ctx_t *ctx = (stmdev_ctx_t *)lis2dw12Dev->config;
 
     /*
@@ -195,11 +226,20 @@ static int configureLis2dw12Default(const struct device *lis2dw12Dev)
         LOG_ERR("Updating INT pin mode");
         return err;
     }
-    val.val1 = 0; // ODR 0 will set LIS2DW12 into power down mode
+
+    return setLis2dw12Odr(lis2dw12Dev, 0);
+}
+
+static int setLis2dw12Odr(const struct device *lis2dw12Dev, int32_t odr)
+{
+    int err;
+    struct sensor_value val;
+
+    val.val1 = odr; // ODR 0 will set LIS2DW12 into power down mode
     val.val2 = 0;
     err = sensor_attr_set(lis2dw12Dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SAMPLING_FREQUENCY, &val);
     if (err < 0) {
-        LOG_ERR("lis2dw12 ODR set zero failed: %d", err);
+        LOG_ERR("lis2dw12 ODR set %d failed: %d", odr, err);
     }
 
     return err;
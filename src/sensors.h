@@ -42,7 +42,7 @@ bool sensorsGetBme280Data(struct sensor_value *temp, struct sensor_value *press,
 
 /**
  * @brief   Get the acceleration on x, y, z axes.
- * @details Turns on BME280, samples and then shuts it off again.
+ * @details Turns on LIS2DW12, samples and then puts it in power down again.
  *
  * @param   x           [out] acceleration on x axis.
  * @param   y           [out] acceleration on y axis.
@@ -52,6 +52,14 @@ bool sensorsGetBme280Data(struct sensor_value *temp, struct sensor_value *press,
  */
 bool sensorsGetLis2dw12(int16_t *x, int16_t *y, int16_t *z);
 
+/**
+ * @brief   Convert an acceleration from the sensor driver to the raw value reported by
+ *          sensorsGetLis2dw12.
+ * @details The raw value is m/s^2 times 2048, so 1 g is about 20084. Accelerations beyond about
+ *          +-1.6 g are clamped to INT16_MIN/INT16_MAX.
+ */
+int16_t sensorsAccelToRaw(const struct sensor_value *pAcc);
+
 /**
  * @brief   Detect if APDS9306 is connected.
  * @details Rading from APDS9306 is not implemented. This function just checks if it's alive.
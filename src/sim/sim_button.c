@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zephyr.h>
+#include <device.h>
+#include <init.h>
+#include <drivers/gpio.h>
+#include <drivers/gpio/gpio_emul.h>
+#include <random/rand32.h>
+
+// Periodic short presses of the emulated button, so that fleet simulations also go through
+// periodic advertising interval changes. The presses go through the normal button handling.
+
+#define SIM_BUTTON_CLICK_MS 200
+
+#if CONFIG_SIM_BUTTON_PRESS_INTERVAL_S > 0
+
+static void simButtonWorkHandler(struct k_work *item);
+
+static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET(DT_ALIAS(sw1), gpios);
+static bool pressed;
+K_WORK_DELAYABLE_DEFINE(simButtonWork, simButtonWorkHandler);
+
+static void simButtonWorkHandler(struct k_work *item)
+{
+    pressed = !pressed;
+    gpio_emul_input_set(button.port, button.pin, pressed ? 1 : 0);
+    if (pressed) {
+        k_work_schedule(&simButtonWork, K_MSEC(SIM_BUTTON_CLICK_MS));
+    } else {
+        k_work_schedule(&simButtonWork,
+                        K_MSEC(CONFIG_SIM_BUTTON_PRESS_INTERVAL_S * 1000 - SIM_BUTTON_CLICK_MS));
+    }
+}
+
+// Tags of a simulated fleet boot together, spread their first press over the interval
+static int simButtonInit(const struct device *unused)
+{
+    uint32_t firstPressMs = sys_rand32_get() % (CONFIG_SIM_BUTTON_PRESS_INTERVAL_S * 1000);
+
+    k_work_schedule(&simButtonWork, K_MSEC(CONFIG_SIM_BUTTON_PRESS_INTERVAL_S * 1000 +
+                                           firstPressMs));
+
+    return 0;
+}
+
+SYS_INIT(simButtonInit, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif
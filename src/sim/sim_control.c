@@ -0,0 +1,180 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sim_sensors.h"
+#include "sim_i2c.h"
+#include "sim_trace.h"
+
+#include <zephyr.h>
+#include <device.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <drivers/uart.h>
+#include <drivers/gpio.h>
+#include <drivers/gpio/gpio_emul.h>
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(sim_control, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+
+// Control port of the simulation on the second pty (uart1). One command per line:
+//   button press|release|click [ms]     drive the button, click defaults to 200 ms
+//   bme280 <mdegC> <Pa> <m%RH>           environment seen by the BME280
+//   accel <x mg> <y mg> <z mg>           acceleration seen by the LIS2DW12
+//   light <mlux>                         illuminance seen by the APDS-9306
+//   trace <path>                         play a sensor trace from now, see sim_trace.h
+//   i2c?                                 bus traffic per device since boot or the last reset,
+//                                        one +I2C:<uptime ms>,<addr>,<transfers>,<bytes> each
+//   i2c reset                            clear the bus traffic counters
+//   led?                                 LED states, answered with +LED:<red>,<green>,<blue>
+// Every command is answered with OK or ERROR.
+
+#define SIM_CONTROL_POLL_MS         10
+#define SIM_CONTROL_LINE_LEN        128
+#define SIM_CONTROL_CLICK_MS        200
+#define SIM_CONTROL_I2C_DEVICES     4
+#define SIM_CONTROL_STACK_SIZE      1024
+#define SIM_CONTROL_PRIORITY        K_PRIO_PREEMPT(10)
+
+static const struct device *pCtrlUart = DEVICE_DT_GET(DT_NODELABEL(uart1));
+static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET(DT_ALIAS(sw1), gpios);
+static const struct gpio_dt_spec leds[] = {
+    GPIO_DT_SPEC_GET(DT_NODELABEL(led0), gpios),
+    GPIO_DT_SPEC_GET(DT_NODELABEL(led1), gpios),
+    GPIO_DT_SPEC_GET(DT_NODELABEL(led2), gpios),
+};
+
+static void sendString(const char *str)
+{
+    for (int i = 0; i < strlen(str); i++) {
+        uart_poll_out(pCtrlUart, str[i]);
+    }
+}
+
+static int setButton(bool pressed)
+{
+    return gpio_emul_input_set(button.port, button.pin, pressed ? 1 : 0);
+}
+
+static bool parseInts(char *pArgs, long *pValues, int count)
+{
+    char *pEnd;
+
+    for (int i = 0; i < count; i++) {
+        pValues[i] = strtol(pArgs, &pEnd, 10);
+        if (pEnd == pArgs) {
+            return false;
+        }
+        pArgs = pEnd;
+    }
+
+    return true;
+}
+
+static bool handleCommand(char *pCmd)
+{
+    long values[3];
+    char outBuf[48];
+
+    if (strcmp(pCmd, "button press") == 0) {
+        return setButton(true) == 0;
+    } else if (strcmp(pCmd, "button release") == 0) {
+        return setButton(false) == 0;
+    } else if (strncmp(pCmd, "button click", strlen("button click")) == 0) {
+        char *pArgs = pCmd + strlen("button click");
+        long durationMs = SIM_CONTROL_CLICK_MS;
+
+        if (*pArgs != '\0' && !parseInts(pArgs, &durationMs, 1)) {
+            return false;
+        }
+        if (setButton(true) != 0) {
+            return false;
+        }
+        k_sleep(K_MSEC(durationMs));
+        return setButton(false) == 0;
+    } else if (strncmp(pCmd, "bme280 ", strlen("bme280 ")) == 0) {
+        if (!parseInts(pCmd + strlen("bme280 "), values, 3) || values[1] < 0 || values[2] < 0) {
+            return false;
+        }
+        simSensorsSetBme280(values[0], values[1], values[2]);
+        return true;
+    } else if (strncmp(pCmd, "accel ", strlen("accel ")) == 0) {
+        if (!parseInts(pCmd + strlen("accel "), values, 3)) {
+            return false;
+        }
+        simSensorsSetLis2dw12(values[0], values[1], values[2]);
+        return true;
+    } else if (strncmp(pCmd, "light ", strlen("light ")) == 0) {
+        if (!parseInts(pCmd + strlen("light "), values, 1) || values[0] < 0) {
+            return false;
+        }
+        simSensorsSetLight(values[0]);
+        return true;
+    } else if (strncmp(pCmd, "trace ", strlen("trace ")) == 0) {
+        return simTraceLoad(pCmd + strlen("trace ")) == 0;
+    } else if (strcmp(pCmd, "i2c?") == 0) {
+        simI2cStats_t stats[SIM_CONTROL_I2C_DEVICES];
+        int count = simI2cGetStats(stats, ARRAY_SIZE(stats));
+
+        for (int i = 0; i < count; i++) {
+            sprintf(outBuf, "+I2C:%u,0x%02x,%u,%u\r\n", (uint32_t)k_uptime_get(), stats[i].addr,
+                    stats[i].transfers, stats[i].bytes);
+            sendString(outBuf);
+        }
+        return true;
+    } else if (strcmp(pCmd, "i2c reset") == 0) {
+        simI2cResetStats();
+        return true;
+    } else if (strcmp(pCmd, "led?") == 0) {
+        sprintf(outBuf, "+LED:%d,%d,%d\r\n", gpio_emul_output_get(leds[0].port, leds[0].pin),
+                gpio_emul_output_get(leds[1].port, leds[1].pin),
+                gpio_emul_output_get(leds[2].port, leds[2].pin));
+        sendString(outBuf);
+        return true;
+    }
+
+    return false;
+}
+
+static void simControlThread(void *p1, void *p2, void *p3)
+{
+    char line[SIM_CONTROL_LINE_LEN];
+    size_t lineLen = 0;
+    unsigned char character;
+
+    if (!device_is_ready(pCtrlUart)) {
+        LOG_ERR("Simulation control port not ready");
+        return;
+    }
+
+    while (true) {
+        while (uart_poll_in(pCtrlUart, &character) == 0) {
+            if (character == '\r' || character == '\n') {
+                if (lineLen > 0) {
+                    line[lineLen] = '\0';
+                    sendString(handleCommand(line) ? "OK\r\n" : "ERROR\r\n");
+                    lineLen = 0;
+                }
+            } else if (lineLen < sizeof(line) - 1) {
+                line[lineLen++] = character;
+            }
+        }
+        k_sleep(K_MSEC(SIM_CONTROL_POLL_MS));
+    }
+}
+
+K_THREAD_DEFINE(simControl, SIM_CONTROL_STACK_SIZE, simControlThread, NULL, NULL, NULL,
+                SIM_CONTROL_PRIORITY, 0, 0);
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define DT_DRV_COMPAT u_blox_sim_i2c
+
+#include "sim_i2c.h"
+
+#include <zephyr.h>
+#include <device.h>
+#include <drivers/i2c.h>
+
+#define SIM_I2C_MAX_TARGETS 4
+
+static const simI2cTarget_t *targets[SIM_I2C_MAX_TARGETS];
+static simI2cStats_t stats[SIM_I2C_MAX_TARGETS];
+
+int simI2cRegisterTarget(const simI2cTarget_t *pTarget)
+{
+    for (int i = 0; i < SIM_I2C_MAX_TARGETS; i++) {
+        if (targets[i] == NULL) {
+            targets[i] = pTarget;
+            stats[i].addr = pTarget->addr;
+            return 0;
+        }
+    }
+
+    return -ENOMEM;
+}
+
+int simI2cGetStats(simI2cStats_t *pStats, int maxCount)
+{
+    int count = 0;
+
+    for (int i = 0; i < SIM_I2C_MAX_TARGETS && count < maxCount; i++) {
+        if (targets[i] != NULL) {
+            pStats[count++] = stats[i];
+        }
+    }
+
+    return count;
+}
+
+void simI2cResetStats(void)
+{
+    for (int i = 0; i < SIM_I2C_MAX_TARGETS; i++) {
+        stats[i].transfers = 0;
+        stats[i].bytes = 0;
+    }
+}
+
+static int findTarget(uint16_t addr)
+{
+    for (int i = 0; i < SIM_I2C_MAX_TARGETS; i++) {
+        if (targets[i] != NULL && targets[i]->addr == addr) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Any speed is accepted, transfers take no time
+static int simI2cConfigure(const struct device *dev, uint32_t devConfig)
+{
+    return 0;
+}
+
+static int simI2cTransfer(const struct device *dev, struct i2c_msg *msgs, uint8_t numMsgs,
+                          uint16_t addr)
+{
+    int index = findTarget(addr);
+    const simI2cTarget_t *pTarget;
+    bool haveReg = false;
+    uint8_t reg = 0;
+
+    if (index < 0) {
+        return -EIO;
+    }
+    pTarget = targets[index];
+    stats[index].transfers++;
+
+    for (uint8_t i = 0; i < numMsgs; i++) {
+        struct i2c_msg *pMsg = &msgs[i];
+
+        // Address byte plus data, every message starts with a (repeated) start
+        stats[index].bytes += 1 + pMsg->len;
+
+        if ((pMsg->flags & I2C_MSG_RW_MASK) == I2C_MSG_READ) {
+            for (uint32_t j = 0; j < pMsg->len; j++) {
+                pMsg->buf[j] = pTarget->readReg(reg++);
+            }
+        } else {
+            for (uint32_t j = 0; j < pMsg->len; j++) {
+                if (!haveReg) {
+                    reg = pMsg->buf[j];
+                    haveReg = true;
+                } else {
+                    pTarget->writeReg(reg++, pMsg->buf[j]);
+                }
+            }
+        }
+        // A new write after a stop selects the register again
+        if (pMsg->flags & I2C_MSG_STOP) {
+            haveReg = false;
+        }
+    }
+
+    return 0;
+}
+
+static int simI2cInit(const struct device *dev)
+{
+    return 0;
+}
+
+static const struct i2c_driver_api simI2cApi = {
+    .configure = simI2cConfigure,
+    .transfer = simI2cTransfer,
+};
+
+DEVICE_DT_INST_DEFINE(0, simI2cInit, NULL, NULL, NULL, POST_KERNEL, CONFIG_I2C_INIT_PRIORITY,
+                      &simI2cApi);
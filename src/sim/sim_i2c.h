@@ -0,0 +1,63 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SIM_I2C_H
+#define __SIM_I2C_H
+
+#include <zephyr.h>
+
+/**
+ * @brief   Register model of a device on the simulated I2C bus.
+ * @details The first byte written in a transfer selects the register, further bytes are
+ *          written to or read from consecutive registers.
+ */
+typedef struct simI2cTarget_t {
+    uint16_t addr;
+    uint8_t (*readReg)(uint8_t reg);
+    void (*writeReg)(uint8_t reg, uint8_t value);
+} simI2cTarget_t;
+
+/**
+ * @brief   Bus traffic to one device since boot or the last simI2cResetStats().
+ */
+typedef struct simI2cStats_t {
+    uint16_t addr;
+    uint32_t transfers;     // Calls to i2c_transfer()
+    uint32_t bytes;         // Bytes on the bus, address bytes included
+} simI2cStats_t;
+
+/**
+ * @brief   Attach a register model to the bus. Must be called before the drivers of the
+ *          devices on the bus are initialized.
+ * @param   pTarget Model, must stay valid. Transfers to addresses without one are NACKed.
+ * @return  0 on success, -ENOMEM if all slots are used.
+ */
+int simI2cRegisterTarget(const simI2cTarget_t *pTarget);
+
+/**
+ * @brief   Get the traffic of each device on the bus.
+ * @param   pStats      [out] One entry per registered device.
+ * @param   maxCount    Size of pStats.
+ * @return  Number of entries written.
+ */
+int simI2cGetStats(simI2cStats_t *pStats, int maxCount);
+
+/**
+ * @brief   Clear the traffic counters, e.g. at the start of a benchmark.
+ */
+void simI2cResetStats(void);
+
+#endif
@@ -0,0 +1,802 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sim_sensors.h"
+#include "sim_i2c.h"
+#include "sim_trace.h"
+
+#include <zephyr.h>
+#include <device.h>
+#include <init.h>
+#include <string.h>
+#include <drivers/gpio.h>
+#include <drivers/gpio/gpio_emul.h>
+#include <sys/byteorder.h>
+
+// Register models of the sensors on the C209. Measurements take the time of the datasheet and
+// are evaluated when a register is accessed, so an idle sensor costs nothing. A measurement
+// takes its values from the sensor trace if one is playing (see sim_trace.h), otherwise from the
+// last simSensorsSet call. Values change only between transfers: on native_posix a thread is
+// never preempted in the middle of one.
+
+#define BME280_ADDR             DT_REG_ADDR(DT_INST(0, bosch_bme280))
+#define BME280_REG_CALIB_TP     0x88
+#define BME280_REG_CALIB_H1     0xA1
+#define BME280_REG_ID           0xD0
+#define BME280_REG_RESET        0xE0
+#define BME280_REG_CALIB_H2     0xE1
+#define BME280_REG_CTRL_HUM     0xF2
+#define BME280_REG_STATUS       0xF3
+#define BME280_REG_CTRL_MEAS    0xF4
+#define BME280_REG_CONFIG       0xF5
+#define BME280_REG_DATA         0xF7
+#define BME280_CHIP_ID          0x60
+#define BME280_CMD_SOFT_RESET   0xB6
+#define BME280_RAW_TP_MAX       0xFFFFF
+#define BME280_RAW_H_MAX        0xFFFF
+#define BME280_RAW_TP_SKIPPED   0x80000
+#define BME280_RAW_H_SKIPPED    0x8000
+#define BME280_STATUS_MEASURING BIT(3)
+#define BME280_MODE_MASK        0x03
+#define BME280_MODE_SLEEP       0x00
+#define BME280_MODE_NORMAL      0x03
+
+#define LIS2DW12_ADDR           DT_REG_ADDR(DT_INST(0, st_lis2dw12))
+#define LIS2DW12_REG_WHO_AM_I   0x0F
+#define LIS2DW12_REG_CTRL1      0x20
+#define LIS2DW12_REG_CTRL2      0x21
+#define LIS2DW12_REG_CTRL3      0x22
+#define LIS2DW12_REG_CTRL4      0x23
+#define LIS2DW12_REG_CTRL6      0x25
+#define LIS2DW12_REG_STATUS     0x27
+#define LIS2DW12_REG_OUT_X_L    0x28
+#define LIS2DW12_REG_OUT_Z_H    0x2D
+#define LIS2DW12_REG_FIFO_CTRL  0x2E
+#define LIS2DW12_REG_FIFO_SAMPLES 0x2F
+#define LIS2DW12_REG_NUM        0x40
+#define LIS2DW12_CHIP_ID        0x44
+#define LIS2DW12_CTRL2_DEFAULT  0x04
+#define LIS2DW12_SOFT_RESET     BIT(6)
+#define LIS2DW12_MODE_SINGLE    0x02
+#define LIS2DW12_SLP_MODE_SEL   BIT(1)
+#define LIS2DW12_SLP_MODE_1     BIT(0)
+#define LIS2DW12_H_LACTIVE      BIT(3)
+#define LIS2DW12_INT1_DRDY      BIT(0)
+#define LIS2DW12_INT1_FTH       BIT(1)
+#define LIS2DW12_INT1_DIFF5     BIT(2)
+#define LIS2DW12_STATUS_DRDY    BIT(0)
+#define LIS2DW12_FIFO_FTH       BIT(7)
+#define LIS2DW12_FIFO_OVR       BIT(6)
+#define LIS2DW12_FIFO_BYPASS    0x00
+#define LIS2DW12_FIFO_MODE      0x01
+#define LIS2DW12_FIFO_SIZE      32
+// INT1 is modelled when the devicetree connects it to an emulated GPIO
+#define LIS2DW12_HAS_IRQ        DT_NODE_HAS_PROP(DT_INST(0, st_lis2dw12), irq_gpios)
+// Conversion time in single data conversion mode
+#define LIS2DW12_SINGLE_US      2500
+
+#define APDS_9306_065_ADDR      0x52
+#define APDS_REG_MAIN_CTRL      0x00
+#define APDS_REG_MEAS_RATE      0x04
+#define APDS_REG_GAIN           0x05
+#define APDS_REG_ID             0x06
+#define APDS_REG_MAIN_STATUS    0x07
+#define APDS_REG_CLEAR_DATA     0x0A
+#define APDS_REG_ALS_DATA       0x0D
+#define APDS_REG_INT_CFG        0x19
+#define APDS_REG_INT_PERSIST    0x1A
+#define APDS_REG_THRES_UP       0x21
+#define APDS_REG_THRES_LOW      0x24
+#define APDS_REG_NUM            0x28
+#define APDS_9306_065_CHIP_ID   0xB3
+#define APDS_ALS_EN             BIT(1)
+#define APDS_SW_RESET           BIT(4)
+#define APDS_STATUS_DATA        BIT(3)
+#define APDS_STATUS_INT         BIT(4)
+#define APDS_STATUS_POWER_ON    BIT(5)
+#define APDS_INT_EN             BIT(2)
+
+// Typical calibration from the BME280 datasheet
+static const uint16_t bmeT1 = 27504;
+static const int16_t bmeT2 = 26435;
+static const int16_t bmeT3 = -1000;
+static const uint16_t bmeP1 = 36477;
+static const int16_t bmeP2 = -10685;
+static const int16_t bmeP3 = 3024;
+static const int16_t bmeP4 = 2855;
+static const int16_t bmeP5 = 140;
+static const int16_t bmeP6 = -7;
+static const int16_t bmeP7 = 15500;
+static const int16_t bmeP8 = -14600;
+static const int16_t bmeP9 = 6000;
+static const uint8_t bmeH1 = 75;
+static const int16_t bmeH2 = 362;
+static const uint8_t bmeH3 = 0;
+static const int16_t bmeH4 = 313;
+static const int16_t bmeH5 = 50;
+static const int8_t bmeH6 = 30;
+
+// Standby time in normal mode by CONFIG t_sb, in us
+static const uint32_t bmeStandbyUs[] = {500, 62500, 125000, 250000, 500000, 1000000, 10000,
+                                        20000
+                                       };
+// LIS2DW12 output data rate by CTRL1 ODR, in mHz. ODR 1 is 12.5 Hz, or 1.6 Hz in low power mode
+static const uint32_t lisOdrMilliHz[] = {0, 12500, 12500, 25000, 50000, 100000, 200000, 400000,
+                                         800000, 1600000
+                                        };
+// APDS-9306 integration time by ALS_MEAS_RATE resolution and measurement rate, in us
+static const uint32_t apdsIntegrationUs[] = {400000, 200000, 100000, 50000, 25000, 3125, 3125,
+                                             3125
+                                            };
+static const uint32_t apdsRateUs[] = {25000, 50000, 100000, 200000, 500000, 1000000, 2000000,
+                                      2000000
+                                     };
+static const uint8_t apdsGain[] = {1, 3, 6, 9, 18, 18, 18, 18};
+
+typedef int64_t (*bme280Comp_t)(int32_t raw, int32_t tFine);
+
+typedef struct {
+    int16_t xyz[3];
+} lisSample_t;
+
+static int32_t bmeEnv[3];
+static int32_t accelMg[3];
+static int32_t lightMilliLux;
+
+static uint8_t bmeRegs[256];
+static int64_t bmeMeasStartUs;
+static int64_t bmeCycles;
+static bool bmeForcedPending;
+
+static uint8_t lisRegs[LIS2DW12_REG_NUM];
+static lisSample_t lisFifo[LIS2DW12_FIFO_SIZE];
+static lisSample_t lisOut;
+static uint8_t lisFifoHead;
+static uint8_t lisFifoCount;
+static bool lisOverrun;
+static bool lisDrdy;
+static int64_t lisNextSampleUs;
+static bool lisSinglePending;
+
+static uint8_t apdsRegs[APDS_REG_NUM];
+static int64_t apdsStartUs;
+static int64_t apdsCycles;
+static uint8_t apdsPersistCount;
+
+#if LIS2DW12_HAS_IRQ
+static const struct gpio_dt_spec lisIrq = GPIO_DT_SPEC_GET(DT_INST(0, st_lis2dw12), irq_gpios);
+static void lisIrqTimerHandler(struct k_timer *timer);
+K_TIMER_DEFINE(lisIrqTimer, lisIrqTimerHandler, NULL);
+#endif
+
+static int64_t nowUs(void)
+{
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+// Values of a measurement at a time, from the trace if it has the channel
+static void sampleValues(simTraceChannel_t channel, int64_t timeUs, const int32_t *pSet,
+                         int32_t *pValues, int count)
+{
+    if (!simTraceGet(channel, timeUs, pValues)) {
+        memcpy(pValues, pSet, count * sizeof(int32_t));
+    }
+}
+
+// Compensation formulas of the datasheet, as used by the driver
+static int32_t bme280TFine(int32_t adcT)
+{
+    int32_t var1 = (((adcT >> 3) - ((int32_t)bmeT1 << 1)) * bmeT2) >> 11;
+    int32_t var2 = (((((adcT >> 4) - bmeT1) * ((adcT >> 4) - bmeT1)) >> 12) * bmeT3) >> 14;
+
+    return var1 + var2;
+}
+
+// Temperature in 0.01 degrees C
+static int64_t bme280CompTemp(int32_t adcT, int32_t tFine)
+{
+    ARG_UNUSED(tFine);
+
+    return (bme280TFine(adcT) * 5 + 128) >> 8;
+}
+
+// Pressure in Q24.8 Pa
+static int64_t bme280CompPress(int32_t adcP, int32_t tFine)
+{
+    int64_t var1 = (int64_t)tFine - 128000;
+    int64_t var2 = var1 * var1 * bmeP6;
+    int64_t p;
+
+    var2 = var2 + ((var1 * bmeP5) << 17);
+    var2 = var2 + ((int64_t)bmeP4 << 35);
+    var1 = ((var1 * var1 * bmeP3) >> 8) + ((var1 * bmeP2) << 12);
+    var1 = ((((int64_t)1) << 47) + var1) * bmeP1 >> 33;
+    if (var1 == 0) {
+        return 0;
+    }
+    p = 1048576 - adcP;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = ((int64_t)bmeP9 * (p >> 13) * (p >> 13)) >> 25;
+    var2 = ((int64_t)bmeP8 * p) >> 19;
+
+    return ((p + var1 + var2) >> 8) + ((int64_t)bmeP7 << 4);
+}
+
+// Relative humidity in Q22.10 percent
+static int64_t bme280CompHumidity(int32_t adcH, int32_t tFine)
+{
+    int32_t v = tFine - 76800;
+    int32_t h;
+
+    h = (((adcH << 14) - ((int32_t)bmeH4 << 20) - (bmeH5 * v)) + 16384) >> 15;
+    h = h * (((((((v * bmeH6) >> 10) * (((v * bmeH3) >> 11) + 32768)) >> 10) + 2097152) *
+              bmeH2 + 8192) >> 14);
+    h = h - (((((h >> 15) * (h >> 15)) >> 7) * bmeH1) >> 4);
+    h = CLAMP(h, 0, 419430400);
+
+    return h >> 12;
+}
+
+// All compensations are monotonic, pressure falls with a rising raw value
+static int32_t bme280FindRaw(bme280Comp_t comp, int32_t tFine, int64_t target, int32_t maxRaw)
+{
+    bool rising = comp(maxRaw, tFine) > comp(0, tFine);
+    int32_t lo = 0;
+    int32_t hi = maxRaw;
+
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        int64_t value = comp(mid, tFine);
+
+        if (rising ? value < target : value > target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static int32_t bme280Oversampling(uint8_t osrs)
+{
+    return osrs == 0 ? 0 : 1 << MIN(osrs - 1, 4);
+}
+
+// Typical measurement time of the datasheet
+static uint32_t bme280MeasUs(void)
+{
+    int32_t osrsT = bme280Oversampling(bmeRegs[BME280_REG_CTRL_MEAS] >> 5);
+    int32_t osrsP = bme280Oversampling((bmeRegs[BME280_REG_CTRL_MEAS] >> 2) & 0x07);
+    int32_t osrsH = bme280Oversampling(bmeRegs[BME280_REG_CTRL_HUM] & 0x07);
+
+    return 1000 + 2000 * osrsT + (osrsP ? 2000 * osrsP + 500 : 0) +
+           (osrsH ? 2000 * osrsH + 500 : 0);
+}
+
+// Converts the environment at the end of a measurement into the data registers
+static void bme280Measure(int64_t timeUs)
+{
+    int32_t env[3];
+    int32_t adcT;
+    int32_t adcP;
+    int32_t adcH;
+    int32_t tFine;
+    uint8_t *pData = &bmeRegs[BME280_REG_DATA];
+
+    sampleValues(SIM_TRACE_BME280, timeUs, bmeEnv, env, ARRAY_SIZE(env));
+    adcT = bme280FindRaw(bme280CompTemp, 0, env[0] / 10, BME280_RAW_TP_MAX);
+    tFine = bme280TFine(adcT);
+    adcP = bme280FindRaw(bme280CompPress, tFine, (int64_t)env[1] * 256, BME280_RAW_TP_MAX);
+    adcH = bme280FindRaw(bme280CompHumidity, tFine, (int64_t)env[2] * 1024 / 1000,
+                         BME280_RAW_H_MAX);
+
+    // Skipped measurements read as 0x80000 and 0x8000
+    if ((bmeRegs[BME280_REG_CTRL_MEAS] >> 5) == 0) {
+        adcT = BME280_RAW_TP_SKIPPED;
+    }
+    if (((bmeRegs[BME280_REG_CTRL_MEAS] >> 2) & 0x07) == 0) {
+        adcP = BME280_RAW_TP_SKIPPED;
+    }
+    if ((bmeRegs[BME280_REG_CTRL_HUM] & 0x07) == 0) {
+        adcH = BME280_RAW_H_SKIPPED;
+    }
+
+    pData[0] = adcP >> 12;
+    pData[1] = adcP >> 4;
+    pData[2] = (adcP & 0x0F) << 4;
+    pData[3] = adcT >> 12;
+    pData[4] = adcT >> 4;
+    pData[5] = (adcT & 0x0F) << 4;
+    sys_put_be16(adcH, &pData[6]);
+}
+
+// Completes the measurements due by now and updates the status register. A forced measurement
+// returns the sensor to sleep mode, normal mode measures every measurement plus standby time.
+static void bme280Update(void)
+{
+    int64_t now = nowUs();
+    uint8_t mode = bmeRegs[BME280_REG_CTRL_MEAS] & BME280_MODE_MASK;
+    uint32_t measUs = bme280MeasUs();
+    bool measuring = false;
+
+    if (mode == BME280_MODE_NORMAL) {
+        uint32_t periodUs = measUs + bmeStandbyUs[bmeRegs[BME280_REG_CONFIG] >> 5];
+        int64_t cycles = now >= bmeMeasStartUs + measUs ?
+                         (now - bmeMeasStartUs - measUs) / periodUs + 1 : 0;
+
+        if (cycles > bmeCycles) {
+            bme280Measure(bmeMeasStartUs + (cycles - 1) * periodUs + measUs);
+            bmeCycles = cycles;
+        }
+        measuring = (now - bmeMeasStartUs) % periodUs < measUs;
+    } else if (bmeForcedPending) {
+        if (now >= bmeMeasStartUs + measUs) {
+            bme280Measure(bmeMeasStartUs + measUs);
+            bmeForcedPending = false;
+            bmeRegs[BME280_REG_CTRL_MEAS] &= ~BME280_MODE_MASK;
+        } else {
+            measuring = true;
+        }
+    }
+
+    WRITE_BIT(bmeRegs[BME280_REG_STATUS], 3, measuring);
+}
+
+void simSensorsSetBme280(int32_t tempMilliC, uint32_t pressPa, uint32_t humidityMilliPct)
+{
+    bmeEnv[0] = tempMilliC;
+    bmeEnv[1] = pressPa;
+    bmeEnv[2] = humidityMilliPct;
+}
+
+void simSensorsSetLis2dw12(int32_t xMg, int32_t yMg, int32_t zMg)
+{
+    accelMg[0] = xMg;
+    accelMg[1] = yMg;
+    accelMg[2] = zMg;
+}
+
+void simSensorsSetLight(uint32_t milliLux)
+{
+    lightMilliLux = milliLux;
+}
+
+static void bme280Reset(void)
+{
+    uint8_t *pCalib = &bmeRegs[BME280_REG_CALIB_TP];
+    uint8_t *pCalibH = &bmeRegs[BME280_REG_CALIB_H2];
+    const uint16_t calibTp[] = {bmeT1, bmeT2, bmeT3, bmeP1, bmeP2, bmeP3, bmeP4, bmeP5, bmeP6,
+                               bmeP7, bmeP8, bmeP9
+                              };
+
+    for (int i = 0; i < ARRAY_SIZE(calibTp); i++) {
+        sys_put_le16(calibTp[i], &pCalib[i * 2]);
+    }
+    bmeRegs[BME280_REG_CALIB_H1] = bmeH1;
+    sys_put_le16(bmeH2, &pCalibH[0]);
+    pCalibH[2] = bmeH3;
+    pCalibH[3] = bmeH4 >> 4;
+    pCalibH[4] = (bmeH4 & 0x0F) | ((bmeH5 & 0x0F) << 4);
+    pCalibH[5] = bmeH5 >> 4;
+    pCalibH[6] = bmeH6;
+
+    bmeRegs[BME280_REG_ID] = BME280_CHIP_ID;
+    bmeRegs[BME280_REG_CTRL_HUM] = 0;
+    bmeRegs[BME280_REG_STATUS] = 0;
+    bmeRegs[BME280_REG_CTRL_MEAS] = 0;
+    bmeRegs[BME280_REG_CONFIG] = 0;
+    sys_put_be24(BME280_RAW_TP_SKIPPED << 4, &bmeRegs[BME280_REG_DATA]);
+    sys_put_be24(BME280_RAW_TP_SKIPPED << 4, &bmeRegs[BME280_REG_DATA + 3]);
+    sys_put_be16(BME280_RAW_H_SKIPPED, &bmeRegs[BME280_REG_DATA + 6]);
+    bmeForcedPending = false;
+}
+
+static uint8_t bme280ReadReg(uint8_t reg)
+{
+    if (reg >= BME280_REG_STATUS) {
+        bme280Update();
+    }
+
+    return bmeRegs[reg];
+}
+
+static void bme280WriteReg(uint8_t reg, uint8_t value)
+{
+    bme280Update();
+
+    switch (reg) {
+        case BME280_REG_RESET:
+            if (value == BME280_CMD_SOFT_RESET) {
+                bme280Reset();
+            }
+            break;
+        case BME280_REG_CTRL_MEAS:
+            bmeRegs[reg] = value;
+            // Any mode but sleep and normal is forced mode, a measurement starts right away
+            if ((value & BME280_MODE_MASK) != BME280_MODE_SLEEP) {
+                bmeMeasStartUs = nowUs();
+                bmeCycles = 0;
+                bmeForcedPending = (value & BME280_MODE_MASK) != BME280_MODE_NORMAL;
+            }
+            bme280Update();
+            break;
+        case BME280_REG_CTRL_HUM:
+        case BME280_REG_CONFIG:
+            bmeRegs[reg] = value;
+            break;
+        default:
+            break;
+    }
+}
+
+// Output is left aligned two's complement, the full scale is selected by CTRL6 FS[1:0]
+static int16_t lis2dw12Raw(int32_t mg)
+{
+    int32_t fullScaleMg = 2000 << ((lisRegs[LIS2DW12_REG_CTRL6] >> 4) & 0x03);
+    int32_t raw = mg * 32768 / fullScaleMg;
+
+    return (int16_t)CLAMP(raw, INT16_MIN, INT16_MAX);
+}
+
+static uint32_t lis2dw12PeriodUs(void)
+{
+    uint8_t odr = lisRegs[LIS2DW12_REG_CTRL1] >> 4;
+    uint8_t mode = (lisRegs[LIS2DW12_REG_CTRL1] >> 2) & 0x03;
+
+    if (odr == 0 || odr >= ARRAY_SIZE(lisOdrMilliHz)) {
+        return 0;
+    }
+    if (odr == 1 && mode == 0) {
+        return 625000;
+    }
+
+    return 1000000000 / lisOdrMilliHz[odr];
+}
+
+static uint8_t lis2dw12FifoMode(void)
+{
+    return lisRegs[LIS2DW12_REG_FIFO_CTRL] >> 5;
+}
+
+static void lis2dw12Push(int64_t timeUs)
+{
+    int32_t mg[3];
+    lisSample_t sample;
+
+    sampleValues(SIM_TRACE_ACCEL, timeUs, accelMg, mg, ARRAY_SIZE(mg));
+    for (int i = 0; i < 3; i++) {
+        sample.xyz[i] = lis2dw12Raw(mg[i]);
+    }
+    lisDrdy = true;
+
+    if (lis2dw12FifoMode() == LIS2DW12_FIFO_BYPASS) {
+        lisOut = sample;
+        return;
+    }
+    if (lisFifoCount == LIS2DW12_FIFO_SIZE) {
+        lisOverrun = true;
+        // FIFO mode stops when full, the other modes overwrite the oldest sample
+        if (lis2dw12FifoMode() == LIS2DW12_FIFO_MODE) {
+            return;
+        }
+        lisFifoHead = (lisFifoHead + 1) % LIS2DW12_FIFO_SIZE;
+        lisFifoCount--;
+    }
+    lisFifo[(lisFifoHead + lisFifoCount) % LIS2DW12_FIFO_SIZE] = sample;
+    lisFifoCount++;
+}
+
+#if LIS2DW12_HAS_IRQ
+static bool lis2dw12Int1(void)
+{
+    uint8_t route = lisRegs[LIS2DW12_REG_CTRL4];
+    uint8_t threshold = lisRegs[LIS2DW12_REG_FIFO_CTRL] & 0x1F;
+
+    return ((route & LIS2DW12_INT1_DRDY) && lisDrdy) ||
+           ((route & LIS2DW12_INT1_FTH) && lisFifoCount >= threshold && threshold > 0) ||
+           ((route & LIS2DW12_INT1_DIFF5) && lisFifoCount == LIS2DW12_FIFO_SIZE);
+}
+#endif
+
+// Generates the samples due by now and drives INT1
+static void lis2dw12Update(void)
+{
+    int64_t now = nowUs();
+    uint32_t periodUs = lis2dw12PeriodUs();
+
+    if (lisSinglePending && now >= lisNextSampleUs) {
+        lis2dw12Push(lisNextSampleUs);
+        lisSinglePending = false;
+        lisRegs[LIS2DW12_REG_CTRL3] &= ~LIS2DW12_SLP_MODE_1;
+    } else if (periodUs > 0 && ((lisRegs[LIS2DW12_REG_CTRL1] >> 2) & 0x03) != LIS2DW12_MODE_SINGLE) {
+        // Older samples than a FIFO full are lost anyway
+        if (now - lisNextSampleUs > (int64_t)LIS2DW12_FIFO_SIZE * periodUs) {
+            lisNextSampleUs += ((now - lisNextSampleUs) / periodUs - LIS2DW12_FIFO_SIZE) * periodUs;
+            lisOverrun = lis2dw12FifoMode() != LIS2DW12_FIFO_BYPASS;
+        }
+        while (lisNextSampleUs <= now) {
+            lis2dw12Push(lisNextSampleUs);
+            lisNextSampleUs += periodUs;
+        }
+    }
+
+#if LIS2DW12_HAS_IRQ
+    bool activeLow = lisRegs[LIS2DW12_REG_CTRL3] & LIS2DW12_H_LACTIVE;
+
+    gpio_emul_input_set(lisIrq.port, lisIrq.pin, lis2dw12Int1() != activeLow);
+    // Wake up for the next sample only while an interrupt is routed to the pin
+    if (periodUs > 0 && lisRegs[LIS2DW12_REG_CTRL4] != 0) {
+        k_timer_start(&lisIrqTimer, K_USEC(lisNextSampleUs - now), K_NO_WAIT);
+    } else {
+        k_timer_stop(&lisIrqTimer);
+    }
+#endif
+}
+
+#if LIS2DW12_HAS_IRQ
+static void lisIrqTimerHandler(struct k_timer *timer)
+{
+    lis2dw12Update();
+}
+#endif
+
+static void lis2dw12Reset(void)
+{
+    memset(lisRegs, 0, sizeof(lisRegs));
+    lisRegs[LIS2DW12_REG_WHO_AM_I] = LIS2DW12_CHIP_ID;
+    lisRegs[LIS2DW12_REG_CTRL2] = LIS2DW12_CTRL2_DEFAULT;
+    memset(&lisOut, 0, sizeof(lisOut));
+    lisFifoHead = 0;
+    lisFifoCount = 0;
+    lisOverrun = false;
+    lisDrdy = false;
+    lisSinglePending = false;
+}
+
+// Sample read by OUT_X_L..OUT_Z_H, the oldest in the FIFO unless bypassed
+static const lisSample_t *lis2dw12OutSample(void)
+{
+    if (lis2dw12FifoMode() != LIS2DW12_FIFO_BYPASS && lisFifoCount > 0) {
+        return &lisFifo[lisFifoHead];
+    }
+
+    return &lisOut;
+}
+
+static uint8_t lis2dw12ReadReg(uint8_t reg)
+{
+    lis2dw12Update();
+
+    if (reg >= LIS2DW12_REG_OUT_X_L && reg <= LIS2DW12_REG_OUT_Z_H) {
+        int16_t raw = lis2dw12OutSample()->xyz[(reg - LIS2DW12_REG_OUT_X_L) / 2];
+
+        lisDrdy = false;
+        // Reading the last output byte moves on to the next sample in the FIFO
+        if (reg == LIS2DW12_REG_OUT_Z_H && lis2dw12FifoMode() != LIS2DW12_FIFO_BYPASS &&
+            lisFifoCount > 0) {
+            lisOut = lisFifo[lisFifoHead];
+            lisFifoHead = (lisFifoHead + 1) % LIS2DW12_FIFO_SIZE;
+            lisFifoCount--;
+            lisOverrun = false;
+        }
+        return (reg & 1) ? (uint8_t)(raw >> 8) : (uint8_t)raw;
+    }
+
+    switch (reg) {
+        case LIS2DW12_REG_STATUS:
+            return lisDrdy ? LIS2DW12_STATUS_DRDY : 0;
+        case LIS2DW12_REG_FIFO_SAMPLES: {
+            uint8_t threshold = lisRegs[LIS2DW12_REG_FIFO_CTRL] & 0x1F;
+
+            return lisFifoCount | (lisOverrun ? LIS2DW12_FIFO_OVR : 0) |
+                   (threshold > 0 && lisFifoCount >= threshold ? LIS2DW12_FIFO_FTH : 0);
+        }
+        default:
+            return reg < LIS2DW12_REG_NUM ? lisRegs[reg] : 0;
+    }
+}
+
+static void lis2dw12WriteReg(uint8_t reg, uint8_t value)
+{
+    uint32_t periodUs = lis2dw12PeriodUs();
+
+    if (reg == LIS2DW12_REG_WHO_AM_I || reg >= LIS2DW12_REG_NUM ||
+        reg == LIS2DW12_REG_FIFO_SAMPLES) {
+        return;
+    }
+    lis2dw12Update();
+
+    // Soft reset completes immediately and clears itself
+    if (reg == LIS2DW12_REG_CTRL2 && (value & LIS2DW12_SOFT_RESET)) {
+        lis2dw12Reset();
+        return;
+    }
+    lisRegs[reg] = value;
+
+    switch (reg) {
+        case LIS2DW12_REG_CTRL1:
+            // The first sample is one period after leaving power down
+            if (periodUs == 0 && lis2dw12PeriodUs() > 0) {
+                lisNextSampleUs = nowUs() + lis2dw12PeriodUs();
+            }
+            break;
+        case LIS2DW12_REG_CTRL3:
+            if ((value & LIS2DW12_SLP_MODE_SEL) && (value & LIS2DW12_SLP_MODE_1) &&
+                ((lisRegs[LIS2DW12_REG_CTRL1] >> 2) & 0x03) == LIS2DW12_MODE_SINGLE) {
+                lisSinglePending = true;
+                lisNextSampleUs = nowUs() + LIS2DW12_SINGLE_US;
+            }
+            break;
+        case LIS2DW12_REG_FIFO_CTRL:
+            // Bypass mode empties the FIFO
+            if (lis2dw12FifoMode() == LIS2DW12_FIFO_BYPASS) {
+                lisFifoCount = 0;
+                lisOverrun = false;
+            }
+            break;
+        default:
+            break;
+    }
+    lis2dw12Update();
+}
+
+static uint32_t apdsPeriodUs(void)
+{
+    uint8_t rate = apdsRegs[APDS_REG_MEAS_RATE];
+
+    return MAX(apdsRateUs[rate & 0x07], apdsIntegrationUs[(rate >> 4) & 0x07]);
+}
+
+// Counts for the light at a time. Roughly lux = counts / gain / (integration time / 100 ms),
+// the datasheet factor for a white LED source is close to one.
+static void apdsMeasure(int64_t timeUs)
+{
+    int32_t milliLux;
+    uint8_t rate = apdsRegs[APDS_REG_MEAS_RATE];
+    uint8_t resolution = (rate >> 4) & 0x07;
+    uint32_t maxCount = BIT(20 - MIN(resolution, 4) - (resolution >= 5 ? 3 : 0)) - 1;
+    uint64_t counts;
+    uint32_t up = sys_get_le24(&apdsRegs[APDS_REG_THRES_UP]);
+    uint32_t low = sys_get_le24(&apdsRegs[APDS_REG_THRES_LOW]);
+
+    sampleValues(SIM_TRACE_LIGHT, timeUs, &lightMilliLux, &milliLux, 1);
+    counts = (uint64_t)MAX(milliLux, 0) * apdsGain[apdsRegs[APDS_REG_GAIN] & 0x07] *
+             apdsIntegrationUs[resolution] / 100000000;
+    counts = MIN(counts, maxCount);
+
+    sys_put_le24((uint32_t)counts, &apdsRegs[APDS_REG_ALS_DATA]);
+    sys_put_le24((uint32_t)counts, &apdsRegs[APDS_REG_CLEAR_DATA]);
+    apdsRegs[APDS_REG_MAIN_STATUS] |= APDS_STATUS_DATA;
+
+    // Threshold interrupt after ALS_PERSIST + 1 consecutive measurements out of range
+    if (counts > up || counts < low) {
+        apdsPersistCount++;
+    } else {
+        apdsPersistCount = 0;
+    }
+    if ((apdsRegs[APDS_REG_INT_CFG] & APDS_INT_EN) &&
+        apdsPersistCount > (apdsRegs[APDS_REG_INT_PERSIST] >> 4)) {
+        apdsRegs[APDS_REG_MAIN_STATUS] |= APDS_STATUS_INT;
+    }
+}
+
+static void apdsUpdate(void)
+{
+    int64_t now = nowUs();
+    uint32_t periodUs = apdsPeriodUs();
+    uint32_t integrationUs = apdsIntegrationUs[(apdsRegs[APDS_REG_MEAS_RATE] >> 4) & 0x07];
+    int64_t cycles;
+
+    if (!(apdsRegs[APDS_REG_MAIN_CTRL] & APDS_ALS_EN) || now < apdsStartUs + integrationUs) {
+        return;
+    }
+    cycles = (now - apdsStartUs - integrationUs) / periodUs + 1;
+    if (cycles > apdsCycles) {
+        apdsMeasure(apdsStartUs + (cycles - 1) * periodUs + integrationUs);
+        apdsCycles = cycles;
+    }
+}
+
+static void apdsReset(void)
+{
+    memset(apdsRegs, 0, sizeof(apdsRegs));
+    apdsRegs[APDS_REG_MEAS_RATE] = 0x22;
+    apdsRegs[APDS_REG_GAIN] = 0x01;
+    apdsRegs[APDS_REG_ID] = APDS_9306_065_CHIP_ID;
+    apdsRegs[APDS_REG_MAIN_STATUS] = APDS_STATUS_POWER_ON;
+    apdsRegs[APDS_REG_INT_CFG] = 0x10;
+    sys_put_le24(0xFFFFF, &apdsRegs[APDS_REG_THRES_UP]);
+    apdsPersistCount = 0;
+}
+
+static uint8_t apdsReadReg(uint8_t reg)
+{
+    uint8_t value;
+
+    if (reg >= APDS_REG_NUM) {
+        return 0;
+    }
+    apdsUpdate();
+    value = apdsRegs[reg];
+    // The status flags clear when read
+    if (reg == APDS_REG_MAIN_STATUS) {
+        apdsRegs[reg] = 0;
+    }
+
+    return value;
+}
+
+static void apdsWriteReg(uint8_t reg, uint8_t value)
+{
+    if (reg >= APDS_REG_NUM || reg == APDS_REG_ID || reg == APDS_REG_MAIN_STATUS ||
+        (reg >= APDS_REG_CLEAR_DATA && reg < APDS_REG_ALS_DATA + 3)) {
+        return;
+    }
+    apdsUpdate();
+
+    if (reg == APDS_REG_MAIN_CTRL && (value & APDS_SW_RESET)) {
+        apdsReset();
+        return;
+    }
+    if (reg == APDS_REG_MAIN_CTRL && (value & APDS_ALS_EN) &&
+        !(apdsRegs[reg] & APDS_ALS_EN)) {
+        apdsStartUs = nowUs();
+        apdsCycles = 0;
+    }
+    apdsRegs[reg] = value;
+}
+
+static const simI2cTarget_t bme280Target = {
+    .addr = BME280_ADDR,
+    .readReg = bme280ReadReg,
+    .writeReg = bme280WriteReg,
+};
+
+static const simI2cTarget_t lis2dw12Target = {
+    .addr = LIS2DW12_ADDR,
+    .readReg = lis2dw12ReadReg,
+    .writeReg = lis2dw12WriteReg,
+};
+
+static const simI2cTarget_t apdsTarget = {
+    .addr = APDS_9306_065_ADDR,
+    .readReg = apdsReadReg,
+    .writeReg = apdsWriteReg,
+};
+
+// Registered before any driver is initialized
+static int simSensorsInit(const struct device *unused)
+{
+    bme280Reset();
+    lis2dw12Reset();
+    apdsReset();
+    simSensorsSetBme280(23000, 101325, 45000);
+    simSensorsSetLis2dw12(0, 0, 1000);
+    simSensorsSetLight(300000);
+
+    simI2cRegisterTarget(&bme280Target);
+    simI2cRegisterTarget(&lis2dw12Target);
+    simI2cRegisterTarget(&apdsTarget);
+
+    if (strlen(CONFIG_SIM_SENSOR_TRACE) > 0) {
+        simTraceLoad(CONFIG_SIM_SENSOR_TRACE);
+    }
+
+    return 0;
+}
+
+SYS_INIT(simSensorsInit, PRE_KERNEL_1, 0);
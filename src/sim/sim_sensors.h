@@ -0,0 +1,47 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SIM_SENSORS_H
+#define __SIM_SENSORS_H
+
+#include <zephyr.h>
+
+/**
+ * @brief   Set the environment seen by the simulated BME280. The raw values are chosen so that
+ *          the compensation of the driver gives these values back. Like the other setters, the
+ *          value is used by measurements ending after the call, unless a sensor trace playing
+ *          has the channel.
+ * @param   tempMilliC          Temperature in milli degrees C.
+ * @param   pressPa             Pressure in Pa.
+ * @param   humidityMilliPct    Relative humidity in milli percent.
+ */
+void simSensorsSetBme280(int32_t tempMilliC, uint32_t pressPa, uint32_t humidityMilliPct);
+
+/**
+ * @brief   Set the acceleration seen by the simulated LIS2DW12, clamped to the full scale.
+ * @param   xMg X axis in mg.
+ * @param   yMg Y axis in mg.
+ * @param   zMg Z axis in mg.
+ */
+void simSensorsSetLis2dw12(int32_t xMg, int32_t yMg, int32_t zMg);
+
+/**
+ * @brief   Set the light seen by the simulated APDS-9306.
+ * @param   milliLux    Illuminance in milli lux.
+ */
+void simSensorsSetLight(uint32_t milliLux);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sim_trace.h"
+
+#include <zephyr.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <logging/log.h>
+
+LOG_MODULE_REGISTER(sim_trace, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
+
+// Traces are read with the host C library, the simulated boards run on it. Points are looked up
+// from the last one used, as the sensor models ask for increasing times.
+
+#define SIM_TRACE_LINE_LEN      128
+#define SIM_TRACE_GROW          256
+
+typedef struct {
+    int64_t timeUs;
+    int32_t values[SIM_TRACE_VALUES_MAX];
+} tracePoint_t;
+
+typedef struct {
+    tracePoint_t *pPoints;
+    size_t count;
+    size_t size;
+    size_t last;
+} traceChannel_t;
+
+static const char *const channelNames[SIM_TRACE_NUM] = {"accel", "bme280", "light"};
+static const uint8_t channelValues[SIM_TRACE_NUM] = {3, 3, 1};
+
+static traceChannel_t channels[SIM_TRACE_NUM];
+static int64_t startUs;
+
+static void freeChannels(traceChannel_t *pChannels)
+{
+    for (int i = 0; i < SIM_TRACE_NUM; i++) {
+        free(pChannels[i].pPoints);
+    }
+    memset(pChannels, 0, sizeof(traceChannel_t) * SIM_TRACE_NUM);
+}
+
+static int addPoint(traceChannel_t *pChannel, const tracePoint_t *pPoint)
+{
+    if (pChannel->count > 0 && pPoint->timeUs < pChannel->pPoints[pChannel->count - 1].timeUs) {
+        return -EINVAL;
+    }
+    if (pChannel->count == pChannel->size) {
+        tracePoint_t *pPoints = realloc(pChannel->pPoints,
+                                        (pChannel->size + SIM_TRACE_GROW) * sizeof(tracePoint_t));
+
+        if (pPoints == NULL) {
+            return -ENOMEM;
+        }
+        pChannel->pPoints = pPoints;
+        pChannel->size += SIM_TRACE_GROW;
+    }
+    pChannel->pPoints[pChannel->count++] = *pPoint;
+
+    return 0;
+}
+
+static int parseLine(char *pLine, traceChannel_t *pChannels)
+{
+    char name[16];
+    double timeS;
+    tracePoint_t point = {0};
+    int fields;
+
+    pLine[strcspn(pLine, "#")] = '\0';
+    fields = sscanf(pLine, "%lf %15s %d %d %d", &timeS, name, &point.values[0],
+                    &point.values[1], &point.values[2]);
+    if (fields <= 0) {
+        // Empty line
+        return 0;
+    }
+    if (fields < 2) {
+        return -EINVAL;
+    }
+    point.timeUs = (int64_t)(timeS * 1000000.0);
+
+    for (int i = 0; i < SIM_TRACE_NUM; i++) {
+        if (strcmp(name, channelNames[i]) == 0) {
+            if (fields != 2 + channelValues[i] || point.timeUs < 0) {
+                return -EINVAL;
+            }
+            return addPoint(&pChannels[i], &point);
+        }
+    }
+
+    return -EINVAL;
+}
+
+int simTraceLoad(const char *pPath)
+{
+    traceChannel_t loaded[SIM_TRACE_NUM] = {0};
+    char line[SIM_TRACE_LINE_LEN];
+    int lineNum = 0;
+    int err = 0;
+    FILE *pFile = fopen(pPath, "r");
+
+    if (pFile == NULL) {
+        LOG_ERR("Could not open trace %s", pPath);
+        return -ENOENT;
+    }
+
+    while (err == 0 && fgets(line, sizeof(line), pFile) != NULL) {
+        lineNum++;
+        err = parseLine(line, loaded);
+    }
+    fclose(pFile);
+    if (err) {
+        LOG_ERR("%s:%d: bad trace point", pPath, lineNum);
+        freeChannels(loaded);
+        return err;
+    }
+
+    freeChannels(channels);
+    memcpy(channels, loaded, sizeof(channels));
+    startUs = k_ticks_to_us_floor64(k_uptime_ticks());
+    LOG_INF("Playing trace %s, %d lines", pPath, lineNum);
+
+    return 0;
+}
+
+bool simTraceGet(simTraceChannel_t channel, int64_t timeUs, int32_t *pValues)
+{
+    traceChannel_t *pChannel = &channels[channel];
+    const tracePoint_t *pFrom;
+    const tracePoint_t *pTo;
+    size_t i;
+
+    if (pChannel->count == 0) {
+        return false;
+    }
+
+    timeUs -= startUs;
+    i = pChannel->last;
+    if (pChannel->pPoints[i].timeUs > timeUs) {
+        i = 0;
+    }
+    while (i + 1 < pChannel->count && pChannel->pPoints[i + 1].timeUs <= timeUs) {
+        i++;
+    }
+    pChannel->last = i;
+
+    pFrom = &pChannel->pPoints[i];
+    if (i + 1 == pChannel->count || timeUs <= pFrom->timeUs) {
+        memcpy(pValues, pFrom->values, sizeof(pFrom->values));
+        return true;
+    }
+    pTo = pFrom + 1;
+    for (int v = 0; v < SIM_TRACE_VALUES_MAX; v++) {
+        pValues[v] = pFrom->values[v] + (int32_t)((int64_t)(pTo->values[v] - pFrom->values[v]) *
+                                                  (timeUs - pFrom->timeUs) /
+                                                  (pTo->timeUs - pFrom->timeUs));
+    }
+
+    return true;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SIM_TRACE_H
+#define __SIM_TRACE_H
+
+#include <zephyr.h>
+
+#define SIM_TRACE_VALUES_MAX    3
+
+/**
+ * @brief   Channels of a sensor trace, the values are those of the simSensorsSet functions.
+ */
+typedef enum {
+    SIM_TRACE_ACCEL = 0,    // x, y, z in mg
+    SIM_TRACE_BME280,       // milli degrees C, Pa, milli percent RH
+    SIM_TRACE_LIGHT,        // milli lux
+    SIM_TRACE_NUM
+} simTraceChannel_t;
+
+/**
+ * @brief   Load a sensor trace and start playing it. Replaces the trace playing, if any.
+ * @details One point per line, "<time s> <channel> <values>", with the channels accel, bme280
+ *          and light. # starts a comment. Times are relative to the load and must not decrease
+ *          within a channel. Values are interpolated linearly between the points of a channel,
+ *          two points with the same time make a step, and the last point holds after the end.
+ * @param   pPath   File on the host.
+ * @return  0 on success, -ENOENT if the file could not be opened, -EINVAL on a bad line,
+ *          -ENOMEM if out of memory.
+ */
+int simTraceLoad(const char *pPath);
+
+/**
+ * @brief   Get the values of a channel at a time.
+ * @param   channel Channel.
+ * @param   timeUs  Uptime in microseconds.
+ * @param   pValues [out] Values of the channel.
+ * @return  false if no trace is playing or it has no points for the channel.
+ */
+bool simTraceGet(simTraceChannel_t channel, int64_t timeUs, int32_t *pValues);
+
+#endif
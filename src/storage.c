@@ -15,24 +15,119 @@
  */
 
 #include "storage.h"
+#include <zephyr.h>
 #include <device.h>
+#include <string.h>
 #include <drivers/flash.h>
 #include <storage/flash_map.h>
 #include <fs/nvs.h>
 #include <logging/log.h>
+#include "app_work.h"
 
 LOG_MODULE_REGISTER(storage, CONFIG_APPLICATION_MODULE_LOG_LEVEL);
 
-#define TX_POWER_NVS_ID     1
+/*
+ * Version of the layout below. Bump it when a field changes ID, size or meaning and add a
+ * migration from the previous version.
+ * Version 1 (firmware <= 2.0.x) only stored the TX power and had no version item.
+ */
+#define STORAGE_VERSION             2
+#define STORAGE_VERSION_NVS_ID      0
+#define STORAGE_VERSION_UNVERSIONED 1
+
+#define TX_POWER_NVS_ID             1
+#define PER_ADV_INTERVAL_NVS_ID     2
+#define ADV_ENABLE_NVS_ID           3
+#define NAMESPACE_NVS_ID            4
+#define UART_IDLE_TIMEOUT_NVS_ID    5
+#define EXT_ADV_INTERVAL_NVS_ID     6
+#define CTE_LEN_NVS_ID              7
+// Scratch item of AT+BENCH, deleted after each run
+#define BENCH_NVS_ID                0x7FFF
+
+#define DEFAULT_TX_POWER            ((int8_t)4)
+#define DEFAULT_PER_ADV_INTERVAL_MS 50
+#define DEFAULT_NAMESPACE           "NINA-B4TAG"
+#define DEFAULT_CTE_LEN             20
+
+// NVS keeps the sector in the upper 16 bits of its write addresses
+#define NVS_ADDR_SECT_SHIFT         16
+
+typedef int (*storageMigration_t)(void);
 
-#define DEFAULT_TX_POWER    ((int8_t)4)
+struct storageFieldCfg_t {
+    uint16_t nvsId;
+    uint16_t offset;
+    uint8_t size;
+    bool isSigned;
+    // Range check, only for integer fields
+    bool hasRange;
+    int32_t min;
+    int32_t max;
+};
+
+#define FIELD(_id, _member, _signed, _hasRange, _min, _max) {       \
+        .nvsId = _id,                                               \
+        .offset = offsetof(storageConfig_t, _member),               \
+        .size = sizeof(((storageConfig_t *)0)->_member),            \
+        .isSigned = _signed,                                        \
+        .hasRange = _hasRange,                                      \
+        .min = _min,                                                \
+        .max = _max                                                 \
+    }
+
+static const struct storageFieldCfg_t fields[STORAGE_FIELD_END] = {
+    [STORAGE_TX_POWER] = FIELD(TX_POWER_NVS_ID, txPower, true, true, -40, 8),
+    [STORAGE_PER_ADV_INTERVAL] = FIELD(PER_ADV_INTERVAL_NVS_ID, perAdvIntervalMs, false, true, 8,
+                                       UINT16_MAX),
+    [STORAGE_ADV_ENABLE] = FIELD(ADV_ENABLE_NVS_ID, advEnable, false, true, 0, 1),
+    [STORAGE_NAMESPACE] = FIELD(NAMESPACE_NVS_ID, groupNamespace, false, false, 0, 0),
+    [STORAGE_UART_IDLE_TIMEOUT] = FIELD(UART_IDLE_TIMEOUT_NVS_ID, uartIdleTimeoutMs, false, true,
+                                        5000, 86400000),
+    [STORAGE_EXT_ADV_INTERVAL] = FIELD(EXT_ADV_INTERVAL_NVS_ID, extAdvIntervalMs, false, true, 32,
+                                       16384),
+    [STORAGE_CTE_LEN] = FIELD(CTE_LEN_NVS_ID, cteLen, false, true, 2, 20),
+};
+
+static const storageConfig_t defaultConfig = {
+    .txPower = DEFAULT_TX_POWER,
+    .perAdvIntervalMs = DEFAULT_PER_ADV_INTERVAL_MS,
+    .advEnable = 1,
+    .groupNamespace = DEFAULT_NAMESPACE,
+    .uartIdleTimeoutMs = CONFIG_AT_UART_IDLE_TIMEOUT_MS,
+    .extAdvIntervalMs = CONFIG_EXT_ADV_INT_MS_MIN,
+    .cteLen = DEFAULT_CTE_LEN,
+};
+
+// Index is the version to migrate from, NULL if the layout is compatible with the next version.
+// Version 1 stored TX power with the same ID and format as version 2.
+static const storageMigration_t migrations[STORAGE_VERSION] = {
+    [STORAGE_VERSION_UNVERSIONED] = NULL,
+};
 
 static struct nvs_fs fs;
+static storageConfig_t config;
+// Values last read from or written to flash, what a write is compared with
+static storageConfig_t flashed;
+static uint32_t dirtyFields;
+static storageStats_t stats;
+K_MUTEX_DEFINE(storageMutex);
+
+static void loadConfig(void);
+static int migrate(void);
+static bool validField(storageField_t field, const void *pValue);
+static ssize_t writeNvs(uint16_t id, const void *pData, size_t len);
+static void flushWorkHandler(struct k_work *item);
+
+K_WORK_DELAYABLE_DEFINE(flushWork, flushWorkHandler);
 
 int storageInit(void)
 {
     struct flash_pages_info info;
     int rc = 0;
+
+    config = defaultConfig;
+
     /* define the nvs file system by settings with:
      *  sector_size equal to the pagesize,
      *  starting at FLASH_AREA_OFFSET(storage)
@@ -63,24 +158,225 @@ int storageInit(void)
             LOG_ERR("Flash erase failed after fail of init nvs");
         }
     }
+
+    if (rc == 0) {
+        rc = migrate();
+        loadConfig();
+    }
+    flashed = config;
     LOG_INF("NVS Init done");
     return rc;
 }
 
+const storageConfig_t *storageGetConfig(void)
+{
+    return &config;
+}
+
+int storageWrite(storageField_t field, const void *pValue, size_t len)
+{
+    const struct storageFieldCfg_t *pField;
+    uint8_t *pCached;
+    uint8_t *pFlashed;
+
+    __ASSERT_NO_MSG(field < STORAGE_FIELD_END);
+    pField = &fields[field];
+
+    if (len != pField->size || !validField(field, pValue)) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&storageMutex, K_FOREVER);
+    pCached = (uint8_t *)&config + pField->offset;
+    pFlashed = (uint8_t *)&flashed + pField->offset;
+    memcpy(pCached, pValue, len);
+    if (memcmp(pFlashed, pValue, len) == 0) {
+        // Already in flash, also drops a pending change back to this value
+        dirtyFields &= ~BIT(field);
+        stats.skippedWrites++;
+    } else {
+        // Also retries a flush that failed
+        if (dirtyFields & BIT(field)) {
+            stats.coalescedWrites++;
+        }
+        dirtyFields |= BIT(field);
+        // Restarted on every change so that a burst of changes ends up in one flush
+        k_work_reschedule_for_queue(&appWorkQ, &flushWork, K_MSEC(CONFIG_STORAGE_WRITE_DELAY_MS));
+    }
+    k_mutex_unlock(&storageMutex);
+
+    return 0;
+}
+
+void storageFlush(void)
+{
+    uint8_t buf[sizeof(storageConfig_t)];
+    ssize_t ret;
+
+    k_work_cancel_delayable(&flushWork);
+
+    k_mutex_lock(&storageMutex, K_FOREVER);
+    for (int i = 0; i < STORAGE_FIELD_END; i++) {
+        const struct storageFieldCfg_t *pField = &fields[i];
+
+        if (!(dirtyFields & BIT(i))) {
+            continue;
+        }
+        memcpy(buf, (uint8_t *)&config + pField->offset, pField->size);
+        ret = writeNvs(pField->nvsId, buf, pField->size);
+        __ASSERT(ret == pField->size ||
+                 ret == 0, "nvs_write failed for ID: %d err: %d", pField->nvsId, ret);
+        if (ret >= 0) {
+            memcpy((uint8_t *)&flashed + pField->offset, buf, pField->size);
+            dirtyFields &= ~BIT(i);
+        }
+    }
+    k_mutex_unlock(&storageMutex);
+}
+
+void storageGetStats(storageStats_t *pStats)
+{
+    k_mutex_lock(&storageMutex, K_FOREVER);
+    *pStats = stats;
+    pStats->freeBytes = nvs_calc_free_space(&fs);
+    k_mutex_unlock(&storageMutex);
+}
+
 void storageWriteTxPower(int8_t power)
 {
-    int ret;
-    ret = nvs_write(&fs, TX_POWER_NVS_ID, &power, sizeof(int8_t));
-    __ASSERT(ret == sizeof(int8_t) ||
-             ret == 0, "nvs_write failed for ID: %d err: %d", TX_POWER_NVS_ID, ret);
+    storageWrite(STORAGE_TX_POWER, &power, sizeof(power));
 }
 
 void storageGetTxPower(int8_t *pPower)
 {
-    uint32_t nBytes;
+    *pPower = config.txPower;
+}
+
+#ifdef CONFIG_BENCH
+int storageBenchWrite(uint32_t value)
+{
+    ssize_t ret = writeNvs(BENCH_NVS_ID, &value, sizeof(value));
 
-    nBytes = nvs_read(&fs, TX_POWER_NVS_ID, pPower, sizeof(int8_t));
-    if (nBytes != sizeof(int8_t)) {
-        *pPower = DEFAULT_TX_POWER;
+    return ret < 0 ? ret : 0;
+}
+
+int storageBenchRead(uint32_t *pValue)
+{
+    ssize_t ret = nvs_read(&fs, BENCH_NVS_ID, pValue, sizeof(*pValue));
+
+    return ret < 0 ? ret : 0;
+}
+
+void storageBenchDelete(void)
+{
+    nvs_delete(&fs, BENCH_NVS_ID);
+}
+#endif
+
+static void loadConfig(void)
+{
+    uint8_t buf[sizeof(storageConfig_t)];
+    ssize_t nBytes;
+
+    for (int i = 0; i < STORAGE_FIELD_END; i++) {
+        const struct storageFieldCfg_t *pField = &fields[i];
+
+        nBytes = nvs_read(&fs, pField->nvsId, buf, pField->size);
+        if (nBytes != pField->size) {
+            // Not written yet, keep default
+            continue;
+        }
+        if (!validField(i, buf)) {
+            LOG_WRN("Invalid value for NVS ID %d, using default", pField->nvsId);
+            continue;
+        }
+        memcpy((uint8_t *)&config + pField->offset, buf, pField->size);
+    }
+}
+
+static int migrate(void)
+{
+    uint8_t version;
+    ssize_t nBytes;
+    int ret;
+
+    nBytes = nvs_read(&fs, STORAGE_VERSION_NVS_ID, &version, sizeof(version));
+    if (nBytes != sizeof(version)) {
+        version = STORAGE_VERSION_UNVERSIONED;
+    }
+
+    if (version == STORAGE_VERSION) {
+        return 0;
+    }
+    if (version > STORAGE_VERSION) {
+        // Written by newer firmware, fields that still validate are used as is
+        LOG_WRN("Storage version %d is newer than %d", version, STORAGE_VERSION);
+        return 0;
     }
+
+    for (; version < STORAGE_VERSION; version++) {
+        if (migrations[version] != NULL) {
+            ret = migrations[version]();
+            if (ret) {
+                LOG_ERR("Migration from storage version %d failed: %d", version, ret);
+                return ret;
+            }
+        }
+        LOG_INF("Migrated storage version %d to %d", version, version + 1);
+    }
+
+    ret = writeNvs(STORAGE_VERSION_NVS_ID, &version, sizeof(version));
+    return ret < 0 ? ret : 0;
+}
+
+static void flushWorkHandler(struct k_work *item)
+{
+    storageFlush();
+}
+
+static ssize_t writeNvs(uint16_t id, const void *pData, size_t len)
+{
+    uint32_t sectorBefore = fs.ate_wra >> NVS_ADDR_SECT_SHIFT;
+    ssize_t ret;
+
+    ret = nvs_write(&fs, id, pData, len);
+    if (ret > 0) {
+        stats.nvsWrites++;
+        stats.bytesWritten += ret;
+    }
+    // Moving on to a new sector garbage collects and erases the sector after it
+    if ((fs.ate_wra >> NVS_ADDR_SECT_SHIFT) != sectorBefore) {
+        stats.gcCount++;
+    }
+
+    return ret;
+}
+
+static bool validField(storageField_t field, const void *pValue)
+{
+    const struct storageFieldCfg_t *pField = &fields[field];
+    int64_t val;
+
+    if (!pField->hasRange) {
+        return true;
+    }
+
+    // Values read from flash are not aligned
+    if (pField->size == sizeof(uint8_t)) {
+        uint8_t raw;
+        memcpy(&raw, pValue, sizeof(raw));
+        val = pField->isSigned ? (int8_t)raw : raw;
+    } else if (pField->size == sizeof(uint16_t)) {
+        uint16_t raw;
+        memcpy(&raw, pValue, sizeof(raw));
+        val = pField->isSigned ? (int16_t)raw : raw;
+    } else if (pField->size == sizeof(uint32_t)) {
+        uint32_t raw;
+        memcpy(&raw, pValue, sizeof(raw));
+        val = pField->isSigned ? (int32_t)raw : raw;
+    } else {
+        return false;
+    }
+
+    return val >= pField->min && val <= pField->max;
 }
@@ -17,15 +17,96 @@
 #ifndef __STORAGE_H
 #define __STORAGE_H
 #include <inttypes.h>
+#include <stddef.h>
+
+#define STORAGE_NAMESPACE_LEN   10
+
+/**
+ * @brief Persistent configuration parameters
+ */
+typedef enum storageField_t {
+    STORAGE_TX_POWER = 0,
+    STORAGE_PER_ADV_INTERVAL,
+    STORAGE_ADV_ENABLE,
+    STORAGE_NAMESPACE,
+    STORAGE_UART_IDLE_TIMEOUT,
+    STORAGE_EXT_ADV_INTERVAL,
+    STORAGE_CTE_LEN,
+    STORAGE_FIELD_END
+} storageField_t;
+
+/**
+ * @brief RAM copy of the persistent configuration, one member per storageField_t
+ */
+typedef struct storageConfig_t {
+    int8_t txPower;
+    uint16_t perAdvIntervalMs;
+    uint8_t advEnable;
+    uint8_t groupNamespace[STORAGE_NAMESPACE_LEN];
+    uint32_t uartIdleTimeoutMs;
+    uint16_t extAdvIntervalMs;
+    uint8_t cteLen;             // In units of 8 us
+} storageConfig_t;
+
+/**
+ * @brief Flash write statistics since boot
+ */
+typedef struct storageStats_t {
+    uint32_t nvsWrites;         // Items written to flash
+    uint32_t bytesWritten;      // Data bytes written to flash, excluding NVS headers
+    uint32_t skippedWrites;     // Writes of the value already in flash
+    uint32_t coalescedWrites;   // Writes that replaced a value not yet flushed
+    uint32_t gcCount;           // NVS sector garbage collections, each one erases a sector
+    int32_t freeBytes;          // Free space left in NVS, or negative error code
+} storageStats_t;
 
 /**
  * @brief   Init the NVS storage backend.
+ * @details Mounts NVS, migrates stored data from older firmware versions and loads all
+ *          configuration fields into RAM. Fields that are missing or fail validation get their
+ *          default value.
  *
  * @return  0, if init was ok.
  * @return  negative error code, if init failed.
  */
 int storageInit(void);
 
+/**
+ * @brief   Get the configuration.
+ * @details Returns the RAM copy, never reads flash.
+ *
+ * @return  Pointer to the current configuration.
+ */
+const storageConfig_t *storageGetConfig(void);
+
+/**
+ * @brief   Write a configuration field
+ * @details The value is validated against the field's range and written to the RAM copy. Changed
+ *          fields are written to nvs storage once no field has been changed for
+ *          CONFIG_STORAGE_WRITE_DELAY_MS, or by storageFlush.
+ *
+ * @param   field            Field to write
+ * @param   pValue           Value to write, of the type of the field in storageConfig_t
+ * @param   len              Size of the value, must match the field.
+ *
+ * @return  0, if written.
+ * @return  -EINVAL, if the value is out of range or has the wrong size.
+ */
+int storageWrite(storageField_t field, const void *pValue, size_t len);
+
+/**
+ * @brief   Write all changed fields to nvs storage now.
+ * @details Must be called before a reboot so that no change is lost.
+ */
+void storageFlush(void);
+
+/**
+ * @brief   Get flash write statistics.
+ *
+ * @param   pStats          [out] the statistics.
+ */
+void storageGetStats(storageStats_t *pStats);
+
 /**
  * @brief   Write TX power to nvs storage
  *
@@ -34,10 +115,32 @@ int storageInit(void);
 void storageWriteTxPower(int8_t power);
 
 /**
- * @brief   Read TX power from nvs storage
+ * @brief   Read TX power from the configuration
  *
  * @param   power            pointer to store value in.
  */
 void storageGetTxPower(int8_t *pPower);
 
-#endif
\ No newline at end of file
+#ifdef CONFIG_BENCH
+/**
+ * @brief   Write the AT+BENCH scratch item directly to nvs storage.
+ * @details Bypasses the RAM copy and the write delay, every call with a new value writes flash.
+ *
+ * @return  0, if written, else negative error code.
+ */
+int storageBenchWrite(uint32_t value);
+
+/**
+ * @brief   Read the AT+BENCH scratch item directly from nvs storage.
+ *
+ * @return  0, if read, else negative error code.
+ */
+int storageBenchRead(uint32_t *pValue);
+
+/**
+ * @brief   Delete the AT+BENCH scratch item from nvs storage.
+ */
+void storageBenchDelete(void);
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "tag_payload.h"
+
+#define EDDYSTONE_UUID_LSB          0xaa
+#define EDDYSTONE_UUID_MSB          0xfe
+#define EDDYSTONE_FRAME_UID         0x00
+#define EDDYSTONE_FRAME_TLM         0x20
+#define EDDYSTONE_TLM_VERSION       0x00
+
+// Offsets in the service data, after the UUID
+#define UID_OFFSET_NAMESPACE        4
+#define UID_OFFSET_INSTANCE         14
+#define UID_MIN_LEN                 (UID_OFFSET_INSTANCE + TAG_PAYLOAD_INSTANCE_LEN)
+#define TLM_OFFSET_VBATT            4
+#define TLM_OFFSET_TEMP             6
+#define TLM_OFFSET_ADV_CNT          8
+#define TLM_OFFSET_SEC_CNT          12
+
+static void putBe16(uint16_t val, uint8_t *pDst)
+{
+    pDst[0] = (uint8_t)(val >> 8);
+    pDst[1] = (uint8_t)val;
+}
+
+static void putBe32(uint32_t val, uint8_t *pDst)
+{
+    putBe16((uint16_t)(val >> 16), &pDst[0]);
+    putBe16((uint16_t)val, &pDst[2]);
+}
+
+static uint16_t getBe16(const uint8_t *pSrc)
+{
+    return (uint16_t)((pSrc[0] << 8) | pSrc[1]);
+}
+
+static uint32_t getBe32(const uint8_t *pSrc)
+{
+    return ((uint32_t)getBe16(&pSrc[0]) << 16) | getBe16(&pSrc[2]);
+}
+
+void tagPayloadEncodeUid(uint8_t *pBuf, int8_t txPower, const uint8_t *pNamespace,
+                         const uint8_t *pInstance)
+{
+    // Eddystone UUID, little endian like all Bluetooth fields
+    pBuf[0] = EDDYSTONE_UUID_LSB;
+    pBuf[1] = EDDYSTONE_UUID_MSB;
+    pBuf[2] = EDDYSTONE_FRAME_UID;
+    pBuf[TAG_PAYLOAD_UID_OFFSET_TX_POWER] = (uint8_t)txPower;
+    memcpy(&pBuf[UID_OFFSET_NAMESPACE], pNamespace, TAG_PAYLOAD_NAMESPACE_LEN);
+    memcpy(&pBuf[UID_OFFSET_INSTANCE], pInstance, TAG_PAYLOAD_INSTANCE_LEN);
+    // Reserved
+    pBuf[20] = 0;
+    pBuf[21] = 0;
+}
+
+void tagPayloadEncodeTlm(uint8_t *pBuf, uint16_t vbattMv, int16_t temp, uint32_t advCnt,
+                         uint32_t secCnt)
+{
+    pBuf[0] = EDDYSTONE_UUID_LSB;
+    pBuf[1] = EDDYSTONE_UUID_MSB;
+    pBuf[2] = EDDYSTONE_FRAME_TLM;
+    pBuf[3] = EDDYSTONE_TLM_VERSION;
+    // The TLM fields are big endian
+    putBe16(vbattMv, &pBuf[TLM_OFFSET_VBATT]);
+    putBe16((uint16_t)temp, &pBuf[TLM_OFFSET_TEMP]);
+    putBe32(advCnt, &pBuf[TLM_OFFSET_ADV_CNT]);
+    putBe32(secCnt, &pBuf[TLM_OFFSET_SEC_CNT]);
+}
+
+void tagPayloadEncodeSensors(uint8_t *pBuf, const int32_t *pSensors)
+{
+    // Little endian, the byte order of the int32_t array the tag has always sent
+    for (int i = 0; i < TAG_PAYLOAD_SENSOR_NUM; i++) {
+        uint32_t val = (uint32_t)pSensors[i];
+        pBuf[i * 4] = (uint8_t)val;
+        pBuf[i * 4 + 1] = (uint8_t)(val >> 8);
+        pBuf[i * 4 + 2] = (uint8_t)(val >> 16);
+        pBuf[i * 4 + 3] = (uint8_t)(val >> 24);
+    }
+}
+
+static void decodeServiceData(const uint8_t *pData, uint8_t len, tagPayload_t *pOut)
+{
+    if (len < 3 || pData[0] != EDDYSTONE_UUID_LSB || pData[1] != EDDYSTONE_UUID_MSB) {
+        return;
+    }
+    if (pData[2] == EDDYSTONE_FRAME_UID && len >= UID_MIN_LEN) {
+        pOut->txPower = (int8_t)pData[TAG_PAYLOAD_UID_OFFSET_TX_POWER];
+        memcpy(pOut->namespaceId, &pData[UID_OFFSET_NAMESPACE], TAG_PAYLOAD_NAMESPACE_LEN);
+        memcpy(pOut->instanceId, &pData[UID_OFFSET_INSTANCE], TAG_PAYLOAD_INSTANCE_LEN);
+        pOut->fields |= TAG_PAYLOAD_FIELD_UID;
+    } else if (pData[2] == EDDYSTONE_FRAME_TLM && len >= TAG_PAYLOAD_TLM_LEN &&
+               pData[3] == EDDYSTONE_TLM_VERSION) {
+        pOut->vbattMv = getBe16(&pData[TLM_OFFSET_VBATT]);
+        pOut->temp = (int16_t)getBe16(&pData[TLM_OFFSET_TEMP]);
+        pOut->advCnt = getBe32(&pData[TLM_OFFSET_ADV_CNT]);
+        pOut->secCnt = getBe32(&pData[TLM_OFFSET_SEC_CNT]);
+        pOut->fields |= TAG_PAYLOAD_FIELD_TLM;
+    }
+}
+
+static void decodeSensors(const uint8_t *pData, tagPayload_t *pOut)
+{
+    for (int i = 0; i < TAG_PAYLOAD_SENSOR_NUM; i++) {
+        const uint8_t *p = &pData[i * 4];
+        pOut->sensors[i] = (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                                     ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+    }
+    pOut->fields |= TAG_PAYLOAD_FIELD_SENSORS;
+}
+
+bool tagPayloadDecode(const uint8_t *pData, size_t len, tagPayload_t *pOut)
+{
+    size_t pos = 0;
+
+    pOut->fields = 0;
+    while (pos < len) {
+        uint8_t adLen = pData[pos];
+        if (adLen == 0) {
+            // Early termination of the AD data is allowed
+            break;
+        }
+        if (pos + 1 + adLen > len) {
+            pOut->fields |= TAG_PAYLOAD_FIELD_MALFORMED;
+            return false;
+        }
+        const uint8_t *pAd = &pData[pos + 2];
+        uint8_t dataLen = adLen - 1;
+        switch (pData[pos + 1]) {
+            case TAG_PAYLOAD_AD_TYPE_SVC_DATA16:
+                decodeServiceData(pAd, dataLen, pOut);
+                break;
+            case TAG_PAYLOAD_AD_TYPE_MANUFACTURER:
+                if (dataLen == TAG_PAYLOAD_SENSORS_LEN) {
+                    decodeSensors(pAd, pOut);
+                }
+                break;
+            default:
+                break;
+        }
+        pos += 1 + adLen;
+    }
+    return pOut->fields != 0;
+}
+
+size_t tagPayloadDecodeBatch(const uint8_t *pBuf, const uint32_t *pOffsets,
+                             const uint16_t *pLens, size_t count, tagPayload_t *pOut)
+{
+    size_t decoded = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (tagPayloadDecode(&pBuf[pOffsets[i]], pLens[i], &pOut[i])) {
+            decoded++;
+        }
+    }
+    return decoded;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TAG_PAYLOAD_H
+#define __TAG_PAYLOAD_H
+
+/*
+ * Over the air format of the data the tag advertises: the Eddystone-UID frame of the extended
+ * advertising and the sensor block and Eddystone-TLM frame of the periodic advertising.
+ * The firmware encodes with this module and gateways decode with it, see scripts/tag_decoder.py.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAG_PAYLOAD_NAMESPACE_LEN   10
+#define TAG_PAYLOAD_INSTANCE_LEN    6
+#define TAG_PAYLOAD_SENSOR_NUM      6
+
+// Lengths of the AD structure data, excluding the length and AD type bytes
+#define TAG_PAYLOAD_UID_LEN         22
+#define TAG_PAYLOAD_TLM_LEN         16
+#define TAG_PAYLOAD_SENSORS_LEN     (TAG_PAYLOAD_SENSOR_NUM * 4)
+
+// The TX power is changed at runtime without encoding the whole Eddystone-UID frame again
+#define TAG_PAYLOAD_UID_OFFSET_TX_POWER 3
+
+#define TAG_PAYLOAD_AD_TYPE_SVC_DATA16  0x16
+#define TAG_PAYLOAD_AD_TYPE_MANUFACTURER 0xff
+
+#define TAG_PAYLOAD_TLM_TEMP_UNKNOWN    ((int16_t)0x8000)
+
+// Bits in tagPayload_t.fields
+#define TAG_PAYLOAD_FIELD_UID       (1 << 0)
+#define TAG_PAYLOAD_FIELD_TLM       (1 << 1)
+#define TAG_PAYLOAD_FIELD_SENSORS   (1 << 2)
+#define TAG_PAYLOAD_FIELD_MALFORMED (1 << 7)
+
+// Index in tagPayload_t.sensors, each value is a Zephyr sensor_value split in val1 and val2
+typedef enum tagPayloadSensor_t {
+    TAG_PAYLOAD_TEMP_VAL1,
+    TAG_PAYLOAD_TEMP_VAL2,
+    TAG_PAYLOAD_PRESS_VAL1,
+    TAG_PAYLOAD_PRESS_VAL2,
+    TAG_PAYLOAD_HUMIDITY_VAL1,
+    TAG_PAYLOAD_HUMIDITY_VAL2,
+} tagPayloadSensor_t;
+
+// Everything decoded from one advertising report. Only the fields flagged in fields are valid.
+typedef struct tagPayload_t {
+    uint32_t advCnt;                                    // TLM, periodic events since boot
+    uint32_t secCnt;                                    // TLM, uptime in 100 ms
+    int32_t sensors[TAG_PAYLOAD_SENSOR_NUM];
+    uint16_t vbattMv;                                   // TLM
+    int16_t temp;                                       // TLM, 8.8 fixed point C
+    uint8_t fields;
+    int8_t txPower;                                     // UID
+    uint8_t namespaceId[TAG_PAYLOAD_NAMESPACE_LEN];     // UID
+    uint8_t instanceId[TAG_PAYLOAD_INSTANCE_LEN];       // UID
+} tagPayload_t;
+
+/**
+ * @brief   Encode the Eddystone-UID service data.
+ *
+ * @param   pBuf            [out] TAG_PAYLOAD_UID_LEN bytes.
+ * @param   txPower         Calibrated TX power in dBm.
+ * @param   pNamespace      TAG_PAYLOAD_NAMESPACE_LEN bytes.
+ * @param   pInstance       TAG_PAYLOAD_INSTANCE_LEN bytes.
+ */
+void tagPayloadEncodeUid(uint8_t *pBuf, int8_t txPower, const uint8_t *pNamespace,
+                         const uint8_t *pInstance);
+
+/**
+ * @brief   Encode the Eddystone-TLM service data.
+ *
+ * @param   pBuf            [out] TAG_PAYLOAD_TLM_LEN bytes.
+ * @param   vbattMv         Battery voltage, 0 if not measured.
+ * @param   temp            Temperature in 8.8 fixed point C, TAG_PAYLOAD_TLM_TEMP_UNKNOWN if none.
+ * @param   advCnt          Periodic advertising events since boot.
+ * @param   secCnt          Uptime in 100 ms.
+ */
+void tagPayloadEncodeTlm(uint8_t *pBuf, uint16_t vbattMv, int16_t temp, uint32_t advCnt,
+                         uint32_t secCnt);
+
+/**
+ * @brief   Encode the sensor block sent as manufacturer specific data.
+ *
+ * @param   pBuf            [out] TAG_PAYLOAD_SENSORS_LEN bytes.
+ * @param   pSensors        TAG_PAYLOAD_SENSOR_NUM values, see tagPayloadSensor_t.
+ */
+void tagPayloadEncodeSensors(uint8_t *pBuf, const int32_t *pSensors);
+
+/**
+ * @brief   Decode the AD structures of one advertising report.
+ *
+ * @param   pData           AD structures as in the report.
+ * @param   len             Length of pData.
+ * @param   pOut            [out] Decoded fields.
+ * @return  True if any tag field was found and the data was well formed.
+ */
+bool tagPayloadDecode(const uint8_t *pData, size_t len, tagPayload_t *pOut);
+
+/**
+ * @brief   Decode many reports stored after each other in one buffer, without allocating.
+ *
+ * @details Report i is pBuf[pOffsets[i]] to pBuf[pOffsets[i] + pLens[i] - 1].
+ *
+ * @param   pBuf            Report data.
+ * @param   pOffsets        Start of each report in pBuf.
+ * @param   pLens           Length of each report.
+ * @param   count           Number of reports.
+ * @param   pOut            [out] count decoded reports.
+ * @return  Number of reports tagPayloadDecode() returned true for.
+ */
+size_t tagPayloadDecodeBatch(const uint8_t *pBuf, const uint32_t *pOffsets,
+                             const uint16_t *pLens, size_t count, tagPayload_t *pOut);
+
+#endif
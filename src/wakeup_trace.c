@@ -0,0 +1,163 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "wakeup_trace.h"
+
+#include <zephyr.h>
+#include <soc.h>
+#include <string.h>
+
+/*
+ * Collected from the kernel tracing hooks: the idle hook marks the CPU idle and the first
+ * interrupt after that is counted as the wakeup source. Everything lives in fixed RAM counters
+ * updated with interrupts locked, the hooks cost a kernel tick read per idle entry and wakeup.
+ */
+
+static const char *const sourceNames[WAKEUP_SRC_END] = {
+    [WAKEUP_SRC_TIMER] = "TIMER",
+    [WAKEUP_SRC_GPIO] = "GPIO",
+    [WAKEUP_SRC_UART] = "UART",
+    [WAKEUP_SRC_RADIO] = "RADIO",
+    [WAKEUP_SRC_I2C] = "I2C",
+    [WAKEUP_SRC_OTHER] = "OTHER",
+};
+
+static uint32_t wakeups[WAKEUP_SRC_END];
+static wakeupBurst_t bursts[WAKEUP_TRACE_NUM_BURSTS];
+// Kernel ticks, 64 bit so that the period does not wrap like the 32 bit cycle counter does
+static int64_t idleTicks;
+static int64_t periodStartTicks;
+static int64_t idleStartTicks;
+static int64_t wakeTicks;
+static wakeupSource_t wakeSource;
+static bool isIdle;
+static bool isAwake;
+
+#if defined(CONFIG_SOC_FAMILY_NRF) && defined(CONFIG_CPU_CORTEX_M)
+static wakeupSource_t irqToSource(int irq)
+{
+    switch (irq) {
+        case RTC1_IRQn:
+            return WAKEUP_SRC_TIMER;
+        case GPIOTE_IRQn:
+            return WAKEUP_SRC_GPIO;
+        case UARTE0_UART0_IRQn:
+            return WAKEUP_SRC_UART;
+        case RADIO_IRQn:
+        case RTC0_IRQn:
+        case TIMER0_IRQn:
+            return WAKEUP_SRC_RADIO;
+        case SPIM0_SPIS0_TWIM0_TWIS0_SPI0_TWI0_IRQn:
+            return WAKEUP_SRC_I2C;
+        default:
+            return WAKEUP_SRC_OTHER;
+    }
+}
+#endif
+
+static void recordBurst(int64_t now)
+{
+    uint32_t durationUs = k_ticks_to_us_floor64(now - wakeTicks);
+    int i = WAKEUP_TRACE_NUM_BURSTS - 1;
+
+    if (durationUs <= bursts[i].durationUs) {
+        return;
+    }
+    // Insertion into the list sorted longest first
+    for (; i > 0 && bursts[i - 1].durationUs < durationUs; i--) {
+        bursts[i] = bursts[i - 1];
+    }
+    bursts[i].durationUs = durationUs;
+    bursts[i].uptimeMs = k_ticks_to_ms_floor64(wakeTicks);
+    bursts[i].source = wakeSource;
+}
+
+void sys_trace_idle_user(void)
+{
+    unsigned int key = irq_lock();
+    int64_t now = k_uptime_ticks();
+
+    if (isAwake) {
+        recordBurst(now);
+        isAwake = false;
+    }
+    if (!isIdle) {
+        idleStartTicks = now;
+        isIdle = true;
+    }
+    irq_unlock(key);
+}
+
+void sys_trace_isr_enter_user(int nested_interrupts)
+{
+    unsigned int key;
+    int64_t now;
+
+    if (!isIdle) {
+        return;
+    }
+
+    key = irq_lock();
+    if (isIdle) {
+        now = k_uptime_ticks();
+#if defined(CONFIG_SOC_FAMILY_NRF) && defined(CONFIG_CPU_CORTEX_M)
+        wakeSource = irqToSource((int)(__get_IPSR() & 0x1FF) - 16);
+#else
+        wakeSource = WAKEUP_SRC_OTHER;
+#endif
+        wakeups[wakeSource]++;
+        idleTicks += now - idleStartTicks;
+        wakeTicks = now;
+        isIdle = false;
+        isAwake = true;
+    }
+    irq_unlock(key);
+}
+
+void wakeupTraceGet(wakeupTraceStats_t *pStats)
+{
+    unsigned int key = irq_lock();
+    int64_t periodTicks = k_uptime_ticks() - periodStartTicks;
+    int64_t idle = idleTicks;
+
+    memcpy(pStats->wakeups, wakeups, sizeof(wakeups));
+    memcpy(pStats->bursts, bursts, sizeof(bursts));
+    irq_unlock(key);
+
+    pStats->periodMs = k_ticks_to_ms_floor64(periodTicks);
+    pStats->idlePermille = periodTicks ? (uint16_t)((idle * 1000) / periodTicks) : 0;
+}
+
+void wakeupTraceReset(void)
+{
+    unsigned int key = irq_lock();
+
+    memset(wakeups, 0, sizeof(wakeups));
+    memset(bursts, 0, sizeof(bursts));
+    idleTicks = 0;
+    periodStartTicks = k_uptime_ticks();
+    // The caller is running, so the current burst started now as far as the new period goes
+    wakeTicks = periodStartTicks;
+    irq_unlock(key);
+}
+
+const char *wakeupTraceSourceName(wakeupSource_t source)
+{
+    if (source >= WAKEUP_SRC_END) {
+        return "?";
+    }
+    return sourceNames[source];
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2022 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __WAKEUP_TRACE_H
+#define __WAKEUP_TRACE_H
+
+#include <zephyr.h>
+
+#define WAKEUP_TRACE_NUM_BURSTS 4
+
+/**
+ * @brief Interrupt sources that wake the CPU from idle
+ */
+typedef enum wakeupSource_t {
+    WAKEUP_SRC_TIMER = 0,   // Kernel timer (RTC1): timeouts, sleeps, delayed work
+    WAKEUP_SRC_GPIO,        // GPIOTE: button, UART RX pin wake
+    WAKEUP_SRC_UART,        // UARTE0
+    WAKEUP_SRC_RADIO,       // BLE controller (RADIO, RTC0, TIMER0)
+    WAKEUP_SRC_I2C,         // TWIM0: sensors
+    WAKEUP_SRC_OTHER,
+    WAKEUP_SRC_END
+} wakeupSource_t;
+
+/**
+ * @brief One active period, from wakeup until the CPU was idle again
+ */
+typedef struct wakeupBurst_t {
+    uint32_t durationUs;
+    uint32_t uptimeMs;      // When the burst started
+    wakeupSource_t source;
+} wakeupBurst_t;
+
+typedef struct wakeupTraceStats_t {
+    uint32_t wakeups[WAKEUP_SRC_END];
+    uint32_t periodMs;      // Time since boot or last reset, wraps after 49 days
+    uint16_t idlePermille;  // Share of periodMs spent idle
+    wakeupBurst_t bursts[WAKEUP_TRACE_NUM_BURSTS];  // Longest first, durationUs 0 if unused
+} wakeupTraceStats_t;
+
+/**
+ * @brief   Get the wakeup counters, idle residency and longest bursts.
+ */
+void wakeupTraceGet(wakeupTraceStats_t *pStats);
+
+/**
+ * @brief   Clear all counters and start a new measurement period.
+ */
+void wakeupTraceReset(void);
+
+/**
+ * @brief   Get the name of a wakeup source.
+ */
+const char *wakeupTraceSourceName(wakeupSource_t source);
+
+#endif